@@ -33,10 +33,10 @@
 #define res(n,x) (x&=~(1<<n))
 
 {
-   /* reg/val are initialised to stop gcc's (incorrect) warning,
-    * and static to save initialising them every time.
+   /* reg/val are initialised to stop gcc's (incorrect) warning.
+    * They're automatic so that machines on other threads can't share them.
     */
-   static unsigned char reg=0,val=0;
+   unsigned char reg=0,val=0;
    unsigned short addr;
    unsigned char op;
    if(ixoriy){
@@ -36,6 +36,8 @@
 #endif
 
 #ifdef SZ81	/* Added by Thunor */
+#include <stdio.h>
+#include <stdlib.h>
 #include "sdl.h"
 extern void sdl_set_redraw_video();
 #endif
@@ -45,18 +47,24 @@ extern void sdl_set_redraw_video();
 #include "z80.h"
 #include "allmain.h"
 
-unsigned char mem[65536],*helpscrn;
-unsigned char keyports[9]={0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff, 0xff};
+MACHINE_LOCAL unsigned char mem[65536];
+unsigned char *helpscrn;
+MACHINE_LOCAL unsigned char keyports[9]={0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff, 0xff};
 
 /* this two work on a per-k basis, so we can support 1k etc. properly */
-unsigned char *memptr[64];
-int memattr[64];
+MACHINE_LOCAL unsigned char *memptr[64];
+MACHINE_LOCAL int memattr[64];
 
-int help=0;
-int sound=0;
-int sound_vsync=0,sound_ay=0,sound_ay_type=AY_TYPE_NONE;
+#ifdef SZ81	/* Added by Thunor */
+/* the 1K pages of mem written to since memattr_watch, a bit each */
+MACHINE_LOCAL unsigned long long memdirty=0;
+#endif
+
+MACHINE_LOCAL int help=0;
+MACHINE_LOCAL int sound=0;
+MACHINE_LOCAL int sound_vsync=0,sound_ay=0,sound_ay_type=AY_TYPE_NONE;
 int load_hook=1,save_hook=1;
-int vsync_visuals=0;
+MACHINE_LOCAL int vsync_visuals=0;
 int invert_screen=0;
 
 #ifdef SZ81	/* Added by Thunor */
@@ -65,14 +73,14 @@ int signal_int_flag=0;
 volatile int signal_int_flag=0;
 #endif
 volatile int exit_program_flag=0;
-int interrupted=0;
-int nmigen=0,hsyncgen=0,vsync=0;
+MACHINE_LOCAL int interrupted=0;
+MACHINE_LOCAL int nmigen=0,hsyncgen=0,vsync=0;
 int scrn_freq=2;
 int unexpanded=0;
-int taguladisp=0;
+MACHINE_LOCAL int taguladisp=0;
 int fakedispx=0,fakedispy=0;	/* set by main.c/xmain.c */
 
-extern int ulacharline;
+extern MACHINE_LOCAL int ulacharline;
 
 /* for the printer */
 #ifdef SZ81	/* Added by Thunor */
@@ -90,16 +98,23 @@ extern int ulacharline;
  * variables from being modified from outside this file, but they're
  * not being accessed from outside this file anyway. I think this code
  * may have been copied from xz80. Also zxpframes and zxpcycles aren't
- * being initialised so I'm setting them to zero too */
-static int zxpframes=0,zxpcycles=0,zxpspeed=0,zxpnewspeed=0;
-static int zxpheight=0,zxppixel=-1,zxpstylus=0;
+ * being initialised so I'm setting them to zero too.
+ * 
+ * They are now accessed from outside this file, by snapshot_capture and
+ * snapshot_restore in snapshot.c, so they're no longer static */
+MACHINE_LOCAL int zxpframes=0,zxpcycles=0,zxpspeed=0,zxpnewspeed=0;
+MACHINE_LOCAL int zxpheight=0,zxppixel=-1,zxpstylus=0;
 #else
-static int zxpframes,zxpcycles,zxpspeed,zxpnewspeed;
-static int zxpheight,zxppixel,zxpstylus;
+static MACHINE_LOCAL int zxpframes,zxpcycles,zxpspeed,zxpnewspeed;
+static MACHINE_LOCAL int zxpheight,zxppixel,zxpstylus;
 #endif
-static FILE *zxpfile=NULL;
+static MACHINE_LOCAL FILE *zxpfile=NULL;
 char *zxpfilename=NULL;
-static unsigned char zxpline[256];
+#ifdef SZ81	/* Added by Thunor */
+MACHINE_LOCAL unsigned char zxpline[256];
+#else
+static MACHINE_LOCAL unsigned char zxpline[256];
+#endif
 
 #ifdef SZ81	/* Added by Thunor */
 /* This is actually redundant as z81's load selector has been entirely
@@ -109,10 +124,10 @@ static unsigned char zxpline[256];
 int load_selector_state = 0;
 #endif
 
-int refresh_screen=1;
+MACHINE_LOCAL int refresh_screen=1;
 
 /* =1 if emulating ZX80 rather than ZX81 */
-int zx80=0;
+MACHINE_LOCAL int zx80=0;
 
 int ignore_esc=0;
 
@@ -120,8 +135,8 @@ int autolist=0;
 int autoload=0;
 char autoload_filename[1024];
 
-int chromamode=0;
-unsigned char bordercolour=0x0f;
+MACHINE_LOCAL int chromamode=0;
+MACHINE_LOCAL unsigned char bordercolour=0x0f;
 
 /* not too many prototypes needed... :-) */
 #ifndef SZ81	/* Added by Thunor */
@@ -427,9 +442,45 @@ if(zx80)
   zx80hacks();
 else
   zx81hacks();
+
+#ifdef SZ81	/* Added by Thunor */
+memdirty=~0ULL;
+#endif
 }
 
 
+#ifdef SZ81	/* Added by Thunor */
+/* This is for those that keep a machine's memory elsewhere between runs
+ * (libsz81) and so want to know which of the 1K pages of mem have been
+ * written to. Every writable page is given a memattr of 2 which store()
+ * treats as 1 but first calls memattr_first_store, which notes the page
+ * within memdirty and sets it back to 1 so that it's only called once.
+ * Anything that writes to mem directly sets all of memdirty instead.
+ */
+void memattr_watch(void)
+{
+int f;
+
+for(f=0;f<64;f++)
+  if(memattr[f])
+    memattr[f]=2;
+memdirty=0;
+}
+
+
+void memattr_first_store(int page,int off)
+{
+int f=(memptr[page]-mem)>>10;
+
+memattr[page]=1;
+memdirty|=1ULL<<f;
+/* store2 carries on into the next 1K of mem */
+if(off==1023)
+  memdirty|=1ULL<<((f+1)&63);
+}
+#endif
+
+
 #ifndef SZ81	/* Added by Thunor */
 void loadhelp(void)
 {
@@ -559,6 +610,11 @@ if(!zxpfile)
 	return;
 #endif
 
+#ifdef SZ81	/* Added by Thunor */
+/* the real frame will print this again */
+if(sdl_emulator.speculating) return;
+#endif
+
 zxpheight++;
 for(i=0;i<32;i++)
   {
@@ -742,6 +798,11 @@ switch(l)
 #endif
       }
 
+#ifdef SZ81	/* Added by Thunor */
+    /* any row selected means the ROM is reading the keyboard */
+    if(h!=0xff) sdl_emulator.kbscans++;
+#endif
+
     switch(h)
       {
       case 0xfe:	return(ts|(keyports[0]^tapezeromask));
@@ -1037,7 +1098,7 @@ for(y=0;y<192;y++)
 
 void do_interrupt()
 {
-static int count=0;
+static MACHINE_LOCAL int count=0;
 
 #ifndef SZ81	/* Added by Thunor */
 if(exit_program_flag)
@@ -1048,6 +1109,27 @@ if(exit_program_flag)
 if(interrupted==1)
   interrupted=0;
 
+#ifdef SZ81	/* Added by Thunor */
+/* whilst warping nothing is shown, but input is still read so that
+ * pressing a key can end it */
+if(sdl_emulator.warping)
+  {
+  check_events();
+  return;
+  }
+
+/* when running ahead only the last frame run ahead is shown, and input
+ * is read between the real frames so it's the same for all of them */
+if(sdl_emulator.runahead)
+  {
+  if(sdl_emulator.speculating==1)
+    update_scrn();
+  else if(!sdl_emulator.speculating)
+    check_events();
+  return;
+  }
+#endif
+
 /* only do screen update every 1/Nth */
 count++;
 #ifdef SZ81	/* Added by Thunor */
@@ -1250,13 +1332,29 @@ static int first=1;
 static sigset_t mask,oldmask;
 #endif
 
+#ifdef SZ81	/* Added by Thunor */
+/* frames being run ahead or run flat out are neither heard nor waited for */
+if(sdl_emulator.speculating || sdl_emulator.turbo || sdl_emulator.warping)
+  {
+#ifdef OSS_SOUND_SUPPORT
+  if(!sdl_emulator.speculating)
+    sound_skip_frame();
+#endif
+  if(interrupted<2)
+    interrupted=1;
+  return;
+  }
+#endif
+
 #ifdef OSS_SOUND_SUPPORT
 if(sound_enabled)
   {
   /* we block on the sound instead. It's a bit unpleasant,
    * but it's the best way.
    */
+  PROFILE_PUSH(PROFILE_SOUND);
   sound_frame();
+  PROFILE_POP();
   
 #ifndef SZ81	/* Added by Thunor. We don't block on sound but continue */
   if(interrupted<2)
@@ -1267,8 +1365,9 @@ if(sound_enabled)
 #endif
 
 #ifdef SZ81	/* Added by Thunor */
-while(!signal_int_flag)
-  SDL_Delay(10);
+PROFILE_PUSH(PROFILE_IDLE);
+sdl_timer_wait();
+PROFILE_POP();
 #else
 /* we leave it blocked most of the time, only unblocking
  * temporarily with sigsuspend().
@@ -58,29 +58,34 @@
 #define ZX_VID_VGA_HEIGHT	(192+4*2)
 
 
+#include "machine.h"
+
 /* AY board types */
 #define AY_TYPE_NONE		0
 #define AY_TYPE_QUICKSILVA	1
 #define AY_TYPE_ZONX		2
 
 
-extern unsigned char mem[];
-extern unsigned char *memptr[64];
-extern int memattr[64];
-extern unsigned char keyports[9];
-extern unsigned long tstates,tsmax;
-extern int help,sound,sound_vsync,sound_ay,sound_ay_type,vsync_visuals;
+extern MACHINE_LOCAL unsigned char mem[];
+extern MACHINE_LOCAL unsigned char *memptr[64];
+extern MACHINE_LOCAL int memattr[64];
+#ifdef SZ81	/* Added by Thunor */
+extern MACHINE_LOCAL unsigned long long memdirty;
+#endif
+extern MACHINE_LOCAL unsigned char keyports[9];
+extern MACHINE_LOCAL unsigned long tstates,tsmax;
+extern MACHINE_LOCAL int help,sound,sound_vsync,sound_ay,sound_ay_type,vsync_visuals;
 extern int invert_screen;
 
-extern int interrupted;
-extern int nmigen,hsyncgen,vsync;
-extern int taguladisp;
+extern MACHINE_LOCAL int interrupted;
+extern MACHINE_LOCAL int nmigen,hsyncgen,vsync;
+extern MACHINE_LOCAL int taguladisp;
 extern int autoload;
 extern int scrn_freq;
 extern int fakedispx,fakedispy;
 
-extern int refresh_screen;
-extern int zx80;
+extern MACHINE_LOCAL int refresh_screen;
+extern MACHINE_LOCAL int zx80;
 extern int ignore_esc;
 
 #ifndef SZ81	/* Added by Thunor */
@@ -105,8 +110,10 @@ extern void do_interrupt();
 extern void frame_pause(void);
 #ifdef SZ81	/* Added by Thunor */
 extern void common_reset(void);
+extern void memattr_watch(void);
+extern void memattr_first_store(int page,int off);
 #endif
 
-extern int chromamode;
-extern unsigned char bordercolour;
+extern MACHINE_LOCAL int chromamode;
+extern MACHINE_LOCAL unsigned char bordercolour;
 
@@ -512,7 +512,13 @@ endinstr;
 
 instr(0xfc,4);
 #ifdef SZ81	/* Added by Thunor */
-  if(!zx80 && hl < 0x8000)
+  if(sdl_emulator.speculating)
+    {
+    /* nothing is loaded whilst running ahead: wait here for the real
+     * frame to arrive */
+    pc-=2;
+    }
+  else if(!zx80 && hl < 0x8000)
     {
     sdl_load_file(hl,LOAD_FILE_METHOD_NAMEDLOAD);
     }
@@ -528,7 +534,13 @@ endinstr;
 
 instr(0xfd,4);
 #ifdef SZ81	/* Added by Thunor */
-  if(zx80)
+  if(sdl_emulator.speculating)
+    {
+    /* nothing is saved whilst running ahead: wait here for the real
+     * frame to arrive */
+    pc-=2;
+    }
+  else if(zx80)
     {
     sdl_save_file(hl,SAVE_FILE_METHOD_UNNAMEDSAVE);
     }
@@ -0,0 +1,859 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include "sdl.h"
+#include "common.h"
+#include "sound.h"
+#include "z80.h"
+#include "allmain.h"
+#include "snapshot.h"
+#include "libsz81.h"
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+/* The public header can't see the emulator's own headers */
+#if SZ81_SNAPSHOT_SIZE != SNAPSHOT_SIZE
+	#error "SZ81_SNAPSHOT_SIZE doesn't match SNAPSHOT_SIZE"
+#endif
+#if SZ81_SCREEN_WIDTH != ZX_VID_FULLWIDTH || SZ81_SCREEN_HEIGHT != ZX_VID_FULLHEIGHT
+	#error "SZ81_SCREEN_WIDTH/HEIGHT don't match ZX_VID_FULLWIDTH/HEIGHT"
+#endif
+
+/* More than this wouldn't fit into the RAM anyway */
+#define PROGRAM_SIZE_MAX (48 * 1024)
+
+#define PAGE_SIZE 1024
+#define PAGES 64
+
+/* scrnbmp, scrnbmp_new, scrnbmpc and scrnbmpc_new */
+#define DISPLAY_SIZE (SZ81_SCREEN_SIZE * 4)
+
+/* Variables */
+/* Machines share what they have in common, such as the ROM and the 1K
+ * pages of memory that a fork hasn't yet written to, as blocks that are
+ * reference counted. A block's contents never change whilst it's shared
+ * and every new version of them is given a new serial number, which is
+ * how the contexts know what they already hold */
+struct block {
+	int refs;
+	unsigned long long serial;
+	unsigned char data[];
+};
+
+struct sz81 {
+	int model;
+	int ramsize;
+	int device;				/* SZ81_SOUND_* */
+	struct block *rom;
+	struct block *program;	/* Loaded on reset and by LOAD */
+	int program_len;
+	unsigned long long keys;
+	int started;			/* TRUE once pages and state hold the machine */
+	struct block *pages[PAGES];	/* The contents of memory */
+	unsigned char state[SNAPSHOT_STATE_SIZE];	/* And the rest of the snapshot */
+	struct block *display;	/* The framebuffer and what the ULA has drawn since,
+							 * then the same of the chroma colours */
+	int chroma;				/* TRUE if the chroma colours are in use */
+	unsigned char *audio;	/* What the last sz81_run_frames produced */
+	int audio_len;
+	int audio_capacity;
+	int frames;				/* Frames left to run */
+	int kbscans;			/* sdl_emulator.kbscans at the last frame */
+	int idle;				/* Frames without a display or a keyboard read */
+};
+
+unsigned long long block_serial = 0;
+
+/* This is the headless front end's and so it's defined here, in place
+ * of sdl_engine.c */
+MACHINE_LOCAL struct sdl_emulator sdl_emulator;
+
+/* The machine that's within the context, for the front end's functions */
+MACHINE_LOCAL sz81 *running;
+
+/* The serial numbers of the pages within the context's mem and what its
+ * page tables were set up for by initmem */
+MACHINE_LOCAL unsigned long long loaded[PAGES];
+MACHINE_LOCAL int loaded_model = -1, loaded_ramsize = 0;
+
+/* The keyboard by half-row as SZ81_KEY has it, with ^ for SHIFT */
+static char *keyboard[] = {"^zxcv", "asdfg", "qwert", "12345", "09876", "poiuy",
+	"\nlkjh", " .mnb"};
+
+/* Function prototypes */
+void machine_swap_in(sz81 *machine);
+int machine_swap_out(sz81 *machine);
+struct block *block_new(int size);
+struct block *block_share(struct block *block);
+void block_release(struct block *block);
+int block_writable(struct block **block, int size, int keep);
+
+
+/***************************************************************************
+ * Create                                                                  *
+ ***************************************************************************/
+/* On entry: int model is SZ81_MODEL_ZX81 or SZ81_MODEL_ZX80
+ *           int ramsize is 1, 2, 3, 4, 16, 32, 48 or 56 (K)
+ *           unsigned char *rom points to the 8K ZX81 or 4K ZX80 ROM
+ *  On exit: returns a new machine which will boot on the first call to
+ *           sz81_run_frames, or NULL on error */
+
+sz81 *sz81_create(int model, int ramsize, unsigned char *rom, int romlen) {
+	sz81 *machine;
+
+	if ((model != SZ81_MODEL_ZX81 || romlen != 8 * 1024) &&
+		(model != SZ81_MODEL_ZX80 || romlen != 4 * 1024)) {
+		fprintf(stderr, "%s: The ROM doesn't match the model\n", __func__);
+		return NULL;
+	}
+	if (ramsize != 1 && ramsize != 2 && ramsize != 3 && ramsize != 4 &&
+		ramsize != 16 && ramsize != 32 && ramsize != 48 && ramsize != 56) {
+		fprintf(stderr, "%s: Invalid RAM size %i\n", __func__, ramsize);
+		return NULL;
+	}
+
+	if ((machine = calloc(1, sizeof(sz81))) == NULL ||
+		(machine->rom = block_new(romlen)) == NULL ||
+		(machine->display = block_new(DISPLAY_SIZE)) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		sz81_destroy(machine);
+		return NULL;
+	}
+	machine->model = model;
+	machine->ramsize = ramsize;
+	machine->device = SZ81_SOUND_NONE;
+	memcpy(machine->rom->data, rom, romlen);
+
+	return machine;
+}
+
+/***************************************************************************
+ * Destroy                                                                 *
+ ***************************************************************************/
+
+void sz81_destroy(sz81 *machine) {
+	int page;
+
+	if (!machine) return;
+	block_release(machine->rom);
+	block_release(machine->program);
+	for (page = 0; page < PAGES; page++) block_release(machine->pages[page]);
+	block_release(machine->display);
+	if (machine->audio) free(machine->audio);
+	free(machine);
+}
+
+/***************************************************************************
+ * Set Sound                                                               *
+ ***************************************************************************/
+/* This takes effect from the next call to sz81_run_frames.
+ *
+ * On entry: int device is one of SZ81_SOUND_*
+ *  On exit: returns TRUE on error
+ *           else FALSE */
+
+int sz81_set_sound(sz81 *machine, int device) {
+	if (device < SZ81_SOUND_NONE || device > SZ81_SOUND_VSYNC) return TRUE;
+	machine->device = device;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Load Program                                                            *
+ ***************************************************************************/
+/* This resets the machine and then auto-loads a .o or .p program from
+ * memory on the next call to sz81_run_frames, as sz81 does when given a
+ * program on the command line. The program is also what's loaded if the
+ * machine itself LOADs later.
+ *
+ * On exit: returns TRUE on error
+ *          else FALSE */
+
+int sz81_load_program(sz81 *machine, unsigned char *data, int len) {
+	struct block *program;
+
+	if (len <= 0 || len > PROGRAM_SIZE_MAX) {
+		fprintf(stderr, "%s: Invalid program size %i\n", __func__, len);
+		return TRUE;
+	}
+	if ((program = block_new(len)) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		return TRUE;
+	}
+	memcpy(program->data, data, len);
+
+	block_release(machine->program);
+	machine->program = program;
+	machine->program_len = len;
+	machine->started = FALSE;
+	machine->idle = 0;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Set Keys                                                                *
+ ***************************************************************************/
+/* On entry: unsigned long long mask has a bit set (see SZ81_KEY) for
+ *           each key that's held down from now on */
+
+void sz81_set_keys(sz81 *machine, unsigned long long mask) {
+	machine->keys = mask;
+}
+
+/***************************************************************************
+ * Run Frames                                                              *
+ ***************************************************************************/
+/* This swaps the machine into the context and runs it flat out through
+ * the emulator's mainloop until it has produced the requested number of
+ * frames. The mainloop only ever starts afresh and so the machine is
+ * carried between calls by a snapshot, which auto_resume_start below
+ * restores as the mainloop starts and which is taken once it returns.
+ * The frames are counted by the emulator's timing and not the ULA's, so
+ * what's been drawn of the ULA's frame is carried along with it.
+ *
+ * The contents of memory are kept apart from the rest of the snapshot as
+ * pages so that only what's changed is copied: the context's mem is left
+ * as it is between calls and a page is only copied in if the context
+ * doesn't already hold it, and the pages are watched (see memattr_watch)
+ * whilst running so that only those written to are copied out.
+ *
+ * On exit: returns TRUE on error (the machine will boot afresh next time)
+ *          else FALSE */
+
+int sz81_run_frames(sz81 *machine, int frames) {
+	int page, failed;
+
+	if (frames <= 0) return TRUE;
+
+	running = machine;
+	machine->frames = frames;
+	machine->audio_len = 0;
+	machine->kbscans = 0;
+
+	machine_swap_in(machine);
+
+	/* Power on, or set up the page tables for a different machine */
+	if (!machine->started || loaded_model != machine->model ||
+		loaded_ramsize != machine->ramsize) {
+		if (zx80) {
+			memcpy(sdl_zx80rom.data, machine->rom->data, 4 * 1024);
+			sdl_zx80rom.state = TRUE;
+		} else {
+			memcpy(sdl_zx81rom.data, machine->rom->data, 8 * 1024);
+			sdl_zx81rom.state = TRUE;
+		}
+		initmem();
+		memset(loaded, 0, sizeof(loaded));
+		loaded_model = machine->model;
+		loaded_ramsize = machine->ramsize;
+	}
+	if (machine->started) {
+		for (page = 0; page < PAGES; page++) {
+			if (loaded[page] != machine->pages[page]->serial) {
+				memcpy(mem + page * PAGE_SIZE, machine->pages[page]->data, PAGE_SIZE);
+				loaded[page] = machine->pages[page]->serial;
+			}
+		}
+	}
+	memattr_watch();
+	if (!machine->started) memdirty = ~0ULL;
+
+	if (sound) sound_init();
+
+	mainloop();
+
+	if (sound_enabled) {
+		sound_end();
+		sound_reset();
+	}
+
+	/* It's between instructions and at the end of a frame */
+	interrupted = 0;
+	failed = machine_swap_out(machine);
+	machine->started = !failed;
+
+	/* Reinitialise variables at the top of z80.c and common.c */
+	z80_reset();
+	common_reset();
+	running = NULL;
+
+	return failed;
+}
+
+/***************************************************************************
+ * Get Framebuffer                                                         *
+ ***************************************************************************/
+/* On exit: returns the last frame of the last call to sz81_run_frames
+ *          (see SZ81_SCREEN_*) */
+
+unsigned char *sz81_get_framebuffer(sz81 *machine) {
+	return machine->display->data;
+}
+
+/***************************************************************************
+ * Get Chroma                                                              *
+ ***************************************************************************/
+/* On exit: returns the chroma colours of the last frame of the last call
+ *          to sz81_run_frames (see SZ81_SCREEN_*) or NULL if the program
+ *          isn't using the chroma interface */
+
+unsigned char *sz81_get_chroma(sz81 *machine) {
+	if (!machine->chroma) return NULL;
+
+	return machine->display->data + SZ81_SCREEN_SIZE * 2;
+}
+
+/***************************************************************************
+ * Get Audio                                                               *
+ ***************************************************************************/
+/* On exit: *samples points to the audio from the last call to
+ *          sz81_run_frames (see SZ81_AUDIO_FREQ)
+ *          returns the number of samples, 0 if the sound is off */
+
+int sz81_get_audio(sz81 *machine, unsigned char **samples) {
+	*samples = machine->audio;
+
+	return machine->audio_len;
+}
+
+/***************************************************************************
+ * Peek                                                                    *
+ ***************************************************************************/
+/* On entry: int addr is an address within the ROM or the RAM as fitted
+ *           (the mirrors of the RAM aren't followed)
+ *  On exit: returns the byte at addr as of the end of the last call to
+ *           sz81_run_frames, or -1 on error (the machine hasn't run yet) */
+
+int sz81_peek(sz81 *machine, int addr) {
+	if (!machine->started || addr < 0 || addr > 0xffff) return -1;
+
+	return machine->pages[addr / PAGE_SIZE]->data[addr % PAGE_SIZE];
+}
+
+/***************************************************************************
+ * Get Idle Frames                                                         *
+ ***************************************************************************/
+/* A running program either has a display or reads the keyboard or both,
+ * and so this is how long the machine has appeared to be doing neither,
+ * which is what a crashed or locked up program looks like (as does a
+ * ZX81 computing in FAST mode for a while).
+ *
+ * On exit: returns the frames since the machine last drew a character
+ *          or read the keyboard */
+
+int sz81_get_idle_frames(sz81 *machine) {
+	return machine->idle;
+}
+
+/***************************************************************************
+ * Snapshot                                                                *
+ ***************************************************************************/
+/* On entry: unsigned char *buf points to SZ81_SNAPSHOT_SIZE bytes
+ *  On exit: returns TRUE on error (the machine hasn't run yet)
+ *           else FALSE */
+
+int sz81_snapshot(sz81 *machine, unsigned char *buf) {
+	int page;
+
+	if (!machine->started) return TRUE;
+	for (page = 0; page < PAGES; page++)
+		memcpy(buf + page * PAGE_SIZE, machine->pages[page]->data, PAGE_SIZE);
+	memcpy(buf + PAGES * PAGE_SIZE, machine->state, SNAPSHOT_STATE_SIZE);
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Restore                                                                 *
+ ***************************************************************************/
+/* The machine continues from the snapshot on the next call to
+ * sz81_run_frames. The snapshot must be of a machine of the same model
+ * and RAM size. It doesn't include the display and so the first frame
+ * that follows will be incomplete. Pages that are the same as what the
+ * machine already has are kept, and so remain shared with any forks.
+ *
+ * On entry: unsigned char *buf points to SZ81_SNAPSHOT_SIZE bytes
+ *  On exit: returns TRUE on error
+ *           else FALSE */
+
+int sz81_restore(sz81 *machine, unsigned char *buf) {
+	unsigned char *ptr = buf + SNAPSHOT_SIZE_2_1_7;
+	unsigned long magic;
+	int version, page;
+
+	memread_unsigned_long_little_endian(&magic, &ptr);
+	memread_int_little_endian(&version, &ptr);
+	if (magic != SNAPSHOT_MAGIC || version > SNAPSHOT_VERSION) {
+		fprintf(stderr, "%s: Snapshot is unsupported\n", __func__);
+		return TRUE;
+	}
+
+	for (page = 0; page < PAGES; page++) {
+		if (machine->pages[page] && memcmp(machine->pages[page]->data,
+			buf + page * PAGE_SIZE, PAGE_SIZE) == 0) continue;
+		if (block_writable(&machine->pages[page], PAGE_SIZE, FALSE)) {
+			machine->started = FALSE;
+			return TRUE;
+		}
+		memcpy(machine->pages[page]->data, buf + page * PAGE_SIZE, PAGE_SIZE);
+	}
+	if (block_writable(&machine->display, DISPLAY_SIZE, TRUE)) {
+		machine->started = FALSE;
+		return TRUE;
+	}
+	memcpy(machine->state, buf + PAGES * PAGE_SIZE, SNAPSHOT_STATE_SIZE);
+	memset(machine->display->data + SZ81_SCREEN_SIZE, 0, SZ81_SCREEN_SIZE);
+	memset(machine->display->data + SZ81_SCREEN_SIZE * 3, 0, SZ81_SCREEN_SIZE);
+	machine->started = TRUE;
+	machine->idle = 0;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Copy                                                                    *
+ ***************************************************************************/
+/* This makes one machine continue from exactly where another is, display
+ * and all, which a snapshot alone doesn't. The keys held down aren't
+ * copied. Both must be of the same model and RAM size.
+ *
+ * Nothing is actually copied but the registers and the like: the rest is
+ * shared until either machine changes it.
+ *
+ * On exit: returns TRUE on error
+ *          else FALSE */
+
+int sz81_copy(sz81 *target, sz81 *source) {
+	int page;
+
+	if (target == source) return FALSE;
+	if (target->model != source->model || target->ramsize != source->ramsize) {
+		fprintf(stderr, "%s: The machines don't match\n", __func__);
+		return TRUE;
+	}
+
+	block_release(target->rom);
+	target->rom = block_share(source->rom);
+	block_release(target->program);
+	target->program = block_share(source->program);
+	target->program_len = source->program_len;
+	for (page = 0; page < PAGES; page++) {
+		block_release(target->pages[page]);
+		target->pages[page] = block_share(source->pages[page]);
+	}
+	memcpy(target->state, source->state, SNAPSHOT_STATE_SIZE);
+	block_release(target->display);
+	target->display = block_share(source->display);
+	target->chroma = source->chroma;
+	target->device = source->device;
+	target->started = source->started;
+	target->idle = source->idle;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Fork                                                                    *
+ ***************************************************************************/
+/* This creates a new machine as sz81_copy would have it, for exploring
+ * many possibilities from the same point cheaply. The memory is shared
+ * between the two a 1K page at a time and a page is only duplicated once
+ * either machine has written to it, so a fork costs about a kilobyte
+ * and then only grows as much as it diverges. The machines are entirely
+ * independent otherwise and either can be run or destroyed first.
+ *
+ * On exit: returns a new machine or NULL on error */
+
+sz81 *sz81_fork(sz81 *machine) {
+	sz81 *fork;
+
+	if ((fork = calloc(1, sizeof(sz81))) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		return NULL;
+	}
+	fork->model = machine->model;
+	fork->ramsize = machine->ramsize;
+	sz81_copy(fork, machine);
+
+	return fork;
+}
+
+/***************************************************************************
+ * Hash                                                                    *
+ ***************************************************************************/
+/* This is for comparing framebuffers and the like cheaply.
+ *
+ * On exit: returns the 64-bit FNV-1a hash of len bytes of buf */
+
+unsigned long long sz81_hash(unsigned char *buf, int len) {
+	unsigned long long hash = 0xcbf29ce484222325ULL;
+	int count;
+
+	for (count = 0; count < len; count++) {
+		hash ^= buf[count];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/***************************************************************************
+ * Key Lookup                                                              *
+ ***************************************************************************/
+/* On entry: char *name is a character on the keyboard or SHIFT, NEWLINE
+ *           or SPACE in any case
+ *  On exit: *key is the key's SZ81_KEY bit
+ *           returns TRUE if there's no such key
+ *           else FALSE */
+
+int sz81_key_lookup(char *name, unsigned long long *key) {
+	int halfrow;
+	char *found;
+	char c;
+
+	if (strcasecmp(name, "SHIFT") == 0) {
+		c = '^';
+	} else if (strcasecmp(name, "NEWLINE") == 0) {
+		c = '\n';
+	} else if (strcasecmp(name, "SPACE") == 0) {
+		c = ' ';
+	} else if (strlen(name) == 1 && *name != '^') {
+		c = tolower(*name);
+	} else {
+		return TRUE;
+	}
+
+	for (halfrow = 0; halfrow < 8; halfrow++) {
+		if ((found = strchr(keyboard[halfrow], c)) != NULL) {
+			*key = SZ81_KEY(halfrow, found - keyboard[halfrow]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/***************************************************************************
+ * Machine Swap In                                                         *
+ ***************************************************************************/
+/* This sets up the context for a machine as sdl_init, the rcfile and the
+ * runtime options would for sz81. Everything that sz81 offers to make
+ * the emulator friendlier to use is left off */
+
+void machine_swap_in(sz81 *machine) {
+	zx80 = machine->model == SZ81_MODEL_ZX80;
+
+	sdl_emulator.state = TRUE;
+	sdl_emulator.paused = FALSE;
+	sdl_emulator.m1not = FALSE;
+	sdl_emulator.speed = 20;
+	sdl_emulator.frameskip = 0;
+	sdl_emulator.model = &zx80;
+	sdl_emulator.ramsize = machine->ramsize;
+	sdl_emulator.invert = 0;
+	sdl_emulator.autoload = !machine->started && machine->program;
+	sdl_emulator.runahead = 0;
+	sdl_emulator.speculating = 0;
+	sdl_emulator.turbo = FALSE;
+	sdl_emulator.fastboot = FALSE;
+	sdl_emulator.kbscans = 0;
+	sdl_emulator.resume = FALSE;
+	sdl_emulator.autowarp = 0;
+	sdl_emulator.warping = 0;
+
+	sdl_sound.volume = 128;
+	sdl_sound.ay_thread = FALSE;
+	sound_stereo = sound_stereo_acb = 0;
+	switch (machine->device) {
+		case SZ81_SOUND_NONE:
+			sound = 0; sound_ay = 0; sound_vsync = 0;
+			sound_ay_type = AY_TYPE_NONE;
+			break;
+		case SZ81_SOUND_QUICKSILVA:
+			sound = 1; sound_ay = 1; sound_vsync = 0;
+			sound_ay_type = AY_TYPE_QUICKSILVA;
+			break;
+		case SZ81_SOUND_ZONX:
+			sound = 1; sound_ay = 1; sound_vsync = 0;
+			sound_ay_type = AY_TYPE_ZONX;
+			break;
+		case SZ81_SOUND_VSYNC:
+			sound = 1; sound_ay = 0; sound_vsync = 1;
+			sound_ay_type = AY_TYPE_NONE;
+			break;
+	}
+}
+
+/***************************************************************************
+ * Machine Swap Out                                                        *
+ ***************************************************************************/
+/* This takes the machine back out of the context once it has run. The
+ * pages written to are the only ones copied, into pages of the machine's
+ * own if they're shared.
+ *
+ * On exit: returns TRUE on error
+ *          else FALSE */
+
+int machine_swap_out(sz81 *machine) {
+	int page;
+
+	for (page = 0; page < PAGES; page++) {
+		if (machine->pages[page] && !(memdirty & (1ULL << page))) continue;
+		if (block_writable(&machine->pages[page], PAGE_SIZE, FALSE)) {
+			/* The context now holds pages that no machine has, so the
+			 * next machine swapped in mustn't take any as its own */
+			memset(loaded, 0, sizeof(loaded));
+			return TRUE;
+		}
+		memcpy(machine->pages[page]->data, mem + page * PAGE_SIZE, PAGE_SIZE);
+		loaded[page] = machine->pages[page]->serial;
+	}
+	snapshot_capture_state(machine->state);
+
+	if (block_writable(&machine->display, DISPLAY_SIZE, FALSE)) return TRUE;
+	memcpy(machine->display->data, scrnbmp, SZ81_SCREEN_SIZE);
+	memcpy(machine->display->data + SZ81_SCREEN_SIZE, scrnbmp_new, SZ81_SCREEN_SIZE);
+	memcpy(machine->display->data + SZ81_SCREEN_SIZE * 2, scrnbmpc, SZ81_SCREEN_SIZE);
+	memcpy(machine->display->data + SZ81_SCREEN_SIZE * 3, scrnbmpc_new,
+		SZ81_SCREEN_SIZE);
+	machine->chroma = chromamode != 0;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Block New                                                               *
+ ***************************************************************************/
+/* On exit: returns a new zeroed block with a reference, or NULL on error */
+
+struct block *block_new(int size) {
+	struct block *block;
+
+	if ((block = calloc(1, sizeof(struct block) + size)) == NULL) return NULL;
+	block->refs = 1;
+	block->serial = __sync_add_and_fetch(&block_serial, 1);
+
+	return block;
+}
+
+/***************************************************************************
+ * Block Share                                                             *
+ ***************************************************************************/
+/* Machines on separate threads can share the same block and so the
+ * reference count is atomic.
+ *
+ * On exit: returns the block with another reference, or NULL if NULL */
+
+struct block *block_share(struct block *block) {
+	if (block) __sync_add_and_fetch(&block->refs, 1);
+
+	return block;
+}
+
+/***************************************************************************
+ * Block Release                                                           *
+ ***************************************************************************/
+
+void block_release(struct block *block) {
+	if (block && __sync_sub_and_fetch(&block->refs, 1) == 0) free(block);
+}
+
+/***************************************************************************
+ * Block Writable                                                          *
+ ***************************************************************************/
+/* This is how a block is written to. If it's shared then it's replaced
+ * with one of the machine's own and either way it's given a new serial
+ * number as it's about to change.
+ *
+ * On entry: struct block **block points to the block or NULL
+ *           int keep is TRUE to keep the contents of a replaced block
+ *  On exit: returns TRUE on error (the block is left as it was)
+ *           else FALSE */
+
+int block_writable(struct block **block, int size, int keep) {
+	struct block *writable;
+
+	if (*block && (*block)->refs == 1) {
+		(*block)->serial = __sync_add_and_fetch(&block_serial, 1);
+		return FALSE;
+	}
+
+	if ((writable = block_new(size)) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		return TRUE;
+	}
+	if (*block) {
+		if (keep) memcpy(writable->data, (*block)->data, size);
+		block_release(*block);
+	}
+	*block = writable;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * The Headless Front End                                                  *
+ ***************************************************************************/
+/* These are what the emulator calls of sz81's SDL front end. Within the
+ * library only the keyboard, the audio, loading and the resuming above
+ * mean anything; the rest are kept as nothing */
+
+void update_scrn(void) {
+}
+
+/* read keyboard and update keyports[], keep count of the idle frames and
+ * stop when the frames are up */
+
+void check_events(void) {
+	int y;
+
+	for (y = 0; y < 8; y++)	/* 8 half-rows */
+		keyports[y] = (((running->keys >> (y * 5)) & 31) ^ 31) | 0xe0;
+
+	if (sdl_emulator.ulachars || sdl_emulator.kbscans != running->kbscans) {
+		running->idle = 0;
+	} else {
+		running->idle++;
+	}
+	running->kbscans = sdl_emulator.kbscans;
+	sdl_emulator.ulachars = 0;
+
+	if (--running->frames <= 0) interrupted = INTERRUPT_EMULATOR_EXIT;
+}
+
+void sdl_set_redraw_video() {
+}
+
+void sdl_timer_wait(void) {
+}
+
+/* The memory is already in place (see sz81_run_frames) */
+
+int auto_resume_start(void) {
+	if (!running->started || snapshot_restore_state(running->state)) return TRUE;
+	memcpy(scrnbmp, running->display->data, SZ81_SCREEN_SIZE);
+	memcpy(scrnbmp_new, running->display->data + SZ81_SCREEN_SIZE,
+		SZ81_SCREEN_SIZE);
+	memcpy(scrnbmpc, running->display->data + SZ81_SCREEN_SIZE * 2,
+		SZ81_SCREEN_SIZE);
+	memcpy(scrnbmpc_new, running->display->data + SZ81_SCREEN_SIZE * 3,
+		SZ81_SCREEN_SIZE);
+
+	return FALSE;
+}
+
+void fast_boot_start(void) {
+}
+
+void rewind_frame(void) {
+}
+
+void input_log_frame(void) {
+}
+
+void quick_slot_frame(void) {
+}
+
+void fast_boot_frame(void) {
+}
+
+void auto_warp_frame(void) {
+}
+
+void runahead_frame(void) {
+}
+
+/* Nothing's traced as sdl_trace.state is never set */
+
+void trace_event(const char *name, const char *cat, int phase) {
+}
+
+void trace_frame(void) {
+}
+
+void trace_scanline(int line) {
+}
+
+/* Every LOAD is of the machine's program, which is auto-loaded on reset */
+
+int sdl_load_file(int parameter, int method) {
+	if (!running->program) return TRUE;
+
+	program_load(running->program->data, running->program_len,
+		method == LOAD_FILE_METHOD_DETECT);
+	chromamode = 0;
+
+	return FALSE;
+}
+
+/* There's nowhere to SAVE to */
+
+int sdl_save_file(int parameter, int method) {
+	return TRUE;
+}
+
+/* The audio is collected rather than played, and so it's always mono and
+ * 8-bit and the state is left on as other threads may be using it */
+
+int sdl_sound_init(int freq, int *stereo, int *sixteenbit) {
+	*stereo = 0;
+	*sixteenbit = 0;
+	sdl_sound.state = TRUE;
+
+	return FALSE;
+}
+
+void sdl_sound_frame(unsigned char *data, int len) {
+	unsigned char *audio;
+
+	if (running->audio_len + len > running->audio_capacity) {
+		if ((audio = realloc(running->audio,
+			(running->audio_len + len) * 2)) == NULL) return;
+		running->audio = audio;
+		running->audio_capacity = (running->audio_len + len) * 2;
+	}
+	memcpy(running->audio + running->audio_len, data, len);
+	running->audio_len += len;
+}
+
+void sdl_sound_end(void) {
+}
+
+void sdl_sound_lock(void) {
+}
+
+void sdl_sound_unlock(void) {
+}
+
+void sdl_sound_capture_start(int freq, int stereo) {
+}
+
+void sdl_sound_capture_frame(unsigned char *data, int len, int stereo) {
+}
+
+void sdl_sound_capture_end(void) {
+}
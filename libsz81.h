@@ -0,0 +1,135 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* libsz81: the emulator without SDL.
+ * 
+ * This is the emulator core (z80.c, common.c, sound.c and snapshot.c)
+ * built as a library with a small headless front end of its own so that
+ * it can be embedded elsewhere, stepped a frame at a time and inspected.
+ * The sz81 binary is one client of the same core, supplying the SDL
+ * front end instead.
+ * 
+ * Each machine is created with its own ROM image and configuration, and
+ * is swapped into the emulator's machine context for the duration of
+ * sz81_run_frames, so that any number of machines can be used one after
+ * another on the same thread. When built with -DMACHINE_THREADS each
+ * thread has a context of its own (see machine.h) and so machines can be
+ * run on separate threads at once, but note that the ROM images are
+ * shared and so machines of the same model should use the same ROM.
+ * 
+ * sz81_fork clones a machine for searching from a common point. The
+ * memory is shared between forks a 1K page at a time until written to,
+ * so a fork costs about a kilobyte.
+ * 
+ * The sz81_vec functions run many machines of the same program in
+ * lockstep for training agents on games. Each step takes an action for
+ * every machine (an index into a table of keys held down), runs them all
+ * for a few frames on a pool of worker threads and writes what came of
+ * it into one contiguous buffer that can be shared with other processes.
+ * Each machine has a slot within the buffer holding its framebuffer
+ * followed by the rewards, bytes read from configurable addresses such
+ * as a game's score. Resetting a machine copies the machine that the
+ * sz81_vec started with, which is in memory. The workers run at once
+ * when built with -DMACHINE_THREADS and otherwise one after another.
+ * 
+ * Functions that can fail return TRUE (1) on error else FALSE (0) as
+ * the rest of sz81 does */
+
+#ifndef LIBSZ81_H
+#define LIBSZ81_H
+
+#ifdef __cplusplus
+	extern "C" {
+#endif
+
+/* Defines */
+/* Machine models */
+#define SZ81_MODEL_ZX81 0
+#define SZ81_MODEL_ZX80 1
+
+/* Sound devices, as sdl_sound.device */
+#define SZ81_SOUND_NONE 0
+#define SZ81_SOUND_QUICKSILVA 1
+#define SZ81_SOUND_ZONX 2
+#define SZ81_SOUND_VSYNC 3
+
+/* The framebuffer is the ULA's full image including the overscan at
+ * 1bpp, 8 pixels to a byte with the leftmost in the top bit. A set bit
+ * is ink (black) and a clear bit is paper (white) */
+#define SZ81_SCREEN_WIDTH 384
+#define SZ81_SCREEN_HEIGHT 302
+#define SZ81_SCREEN_SIZE (SZ81_SCREEN_WIDTH * SZ81_SCREEN_HEIGHT / 8)
+
+/* The chroma colours are a byte for every byte of the framebuffer, with
+ * the ink's colour in the low nibble and the paper's in the high nibble
+ * (GRB and bright, as the Chroma 81 interface has them) */
+
+/* The audio is 8-bit unsigned mono */
+#define SZ81_AUDIO_FREQ 32000
+
+/* A snapshot of a machine (the same as the emulator's SNAPSHOT_SIZE) */
+#define SZ81_SNAPSHOT_SIZE 66029
+
+/* The keyboard is 8 half-rows of 5 keys which is how the ROM reads it.
+ * Each key is a bit within the mask given to sz81_set_keys. The half-rows
+ * in order are shift z x c v, a s d f g, q w e r t, 1 2 3 4 5, 0 9 8 7 6,
+ * p o i u y, newline l k j h and space . m n b */
+#define SZ81_KEY(halfrow, key) (1ULL << ((halfrow) * 5 + (key)))
+
+/* The limits of an sz81_vec */
+#define SZ81_VEC_ACTIONS_MAX 256
+#define SZ81_VEC_REWARDS_MAX 16
+
+/* Variables */
+typedef struct sz81 sz81;
+typedef struct sz81_vec sz81_vec;
+
+/* Function prototypes */
+sz81 *sz81_create(int model, int ramsize, unsigned char *rom, int romlen);
+void sz81_destroy(sz81 *machine);
+int sz81_set_sound(sz81 *machine, int device);
+int sz81_load_program(sz81 *machine, unsigned char *data, int len);
+void sz81_set_keys(sz81 *machine, unsigned long long mask);
+int sz81_run_frames(sz81 *machine, int frames);
+unsigned char *sz81_get_framebuffer(sz81 *machine);
+unsigned char *sz81_get_chroma(sz81 *machine);
+int sz81_get_audio(sz81 *machine, unsigned char **samples);
+int sz81_peek(sz81 *machine, int addr);
+int sz81_get_idle_frames(sz81 *machine);
+int sz81_snapshot(sz81 *machine, unsigned char *buf);
+int sz81_restore(sz81 *machine, unsigned char *buf);
+int sz81_copy(sz81 *target, sz81 *source);
+sz81 *sz81_fork(sz81 *machine);
+unsigned long long sz81_hash(unsigned char *buf, int len);
+int sz81_key_lookup(char *name, unsigned long long *key);
+
+sz81_vec *sz81_vec_create(int count, int model, int ramsize,
+	unsigned char *rom, int romlen, unsigned char *program, int len,
+	int startframes, int threads);
+void sz81_vec_destroy(sz81_vec *vec);
+int sz81_vec_set_actions(sz81_vec *vec, unsigned long long *masks, int count);
+int sz81_vec_set_rewards(sz81_vec *vec, int *addrs, int count);
+int sz81_vec_set_frames(sz81_vec *vec, int frames);
+unsigned char *sz81_vec_get_buffer(sz81_vec *vec, int *stride);
+void sz81_vec_reset(sz81_vec *vec, int index);
+int sz81_vec_step(sz81_vec *vec, int *actions);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -0,0 +1,207 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* A small test of libsz81: it boots a ZX81, types on it, checks that
+ * running is deterministic across snapshots, frame steps and forks, steps
+ * several machines in lockstep and then optionally auto-loads a program.
+ * It exits with 0 if everything passed.
+ * 
+ * Usage: libsz81test [zx81.rom [program.p]] */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libsz81.h"
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+/* Variables */
+unsigned char rom[8 * 1024];
+unsigned char program[48 * 1024];
+unsigned char before[SZ81_SNAPSHOT_SIZE], after[SZ81_SNAPSHOT_SIZE];
+unsigned char screen[SZ81_SCREEN_SIZE];
+int failures = 0;
+
+/* Function prototypes */
+int read_file(char *filename, unsigned char *buf, int size);
+void check(int passed, char *what);
+int ink_count(sz81 *machine);
+int vec_test(void);
+
+
+/***************************************************************************
+ * Main                                                                    *
+ ***************************************************************************/
+
+int main(int argc, char *argv[]) {
+	unsigned char *samples;
+	sz81 *machine, *fork;
+	int ink, len;
+
+	if (read_file(argc > 1 ? argv[1] : "data/zx81.rom", rom, sizeof(rom)) !=
+		sizeof(rom)) return 1;
+
+	machine = sz81_create(SZ81_MODEL_ZX81, 16, rom, sizeof(rom));
+	check(machine != NULL, "create");
+	if (!machine) return 1;
+
+	/* Boot: the ROM clears the screen and shows the K cursor */
+	check(sz81_snapshot(machine, before), "no snapshot before running");
+	check(!sz81_run_frames(machine, 150), "boot");
+	ink = ink_count(machine);
+	check(ink > 0 && ink < 64 * 8, "boot shows the cursor alone");
+
+	/* P is PRINT in K mode */
+	sz81_set_keys(machine, SZ81_KEY(5, 0));
+	sz81_run_frames(machine, 5);
+	sz81_set_keys(machine, 0);
+	sz81_run_frames(machine, 5);
+	check(ink_count(machine) > ink, "typing PRINT");
+
+	/* Stepping one frame at a time and restoring a snapshot make no
+	 * difference to where the machine ends up */
+	check(!sz81_snapshot(machine, before), "snapshot");
+	sz81_run_frames(machine, 50);
+	sz81_snapshot(machine, after);
+	memcpy(screen, sz81_get_framebuffer(machine), SZ81_SCREEN_SIZE);
+	check(!sz81_restore(machine, before), "restore");
+	for (len = 0; len < 50; len++) sz81_run_frames(machine, 1);
+	sz81_snapshot(machine, before);
+	check(memcmp(before, after, SZ81_SNAPSHOT_SIZE) == 0, "deterministic snapshot");
+	check(memcmp(screen, sz81_get_framebuffer(machine), SZ81_SCREEN_SIZE) == 0,
+		"deterministic framebuffer");
+
+	/* A fork types PRINT without the original being any the wiser */
+	fork = sz81_fork(machine);
+	check(fork != NULL, "fork");
+	sz81_snapshot(machine, before);
+	sz81_set_keys(fork, SZ81_KEY(5, 0));
+	sz81_run_frames(fork, 10);
+	sz81_run_frames(machine, 10);
+	sz81_snapshot(machine, after);
+	memcpy(screen, sz81_get_framebuffer(machine), SZ81_SCREEN_SIZE);
+	sz81_restore(machine, before);
+	sz81_run_frames(machine, 10);
+	sz81_snapshot(machine, before);
+	check(memcmp(before, after, SZ81_SNAPSHOT_SIZE) == 0 &&
+		ink_count(fork) > ink_count(machine), "fork is independent");
+	sz81_destroy(fork);
+
+	/* A frame's worth of audio per frame */
+	sz81_set_sound(machine, SZ81_SOUND_VSYNC);
+	sz81_run_frames(machine, 10);
+	check(sz81_get_audio(machine, &samples) == 10 * SZ81_AUDIO_FREQ / 50,
+		"audio");
+
+	check(!vec_test(), "lockstep");
+
+	if (argc > 2) {
+		len = read_file(argv[2], program, sizeof(program));
+		check(len > 0 && !sz81_load_program(machine, program, len), "load");
+		sz81_run_frames(machine, 100);
+		check(ink_count(machine) > 0, "program runs");
+	}
+
+	sz81_destroy(machine);
+
+	printf("%s\n", failures ? "FAILED" : "PASSED");
+
+	return failures != 0;
+}
+
+/***************************************************************************
+ * Vec Test                                                                *
+ ***************************************************************************/
+/* Four machines, of which two type PRINT, must pair up and then all be
+ * the same again once reset.
+ * 
+ * On exit: returns TRUE on error
+ *          else FALSE */
+
+int vec_test(void) {
+	unsigned long long masks[2] = {0, SZ81_KEY(5, 0)};
+	int press[4] = {1, 0, 1, 0}, release[4] = {0, 0, 0, 0};
+	int rewards[1] = {0x4034};	/* FRAMES */
+	unsigned char *buf;
+	int stride, count, failed;
+	sz81_vec *vec;
+
+	if ((vec = sz81_vec_create(4, SZ81_MODEL_ZX81, 16, rom, sizeof(rom),
+		NULL, 0, 150, 2)) == NULL) return TRUE;
+	failed = sz81_vec_set_actions(vec, masks, 2) ||
+		sz81_vec_set_rewards(vec, rewards, 1) || sz81_vec_set_frames(vec, 5) ||
+		sz81_vec_step(vec, press) || sz81_vec_step(vec, release);
+	buf = sz81_vec_get_buffer(vec, &stride);
+	if (memcmp(buf, buf + stride * 2, stride) != 0 ||
+		memcmp(buf + stride, buf + stride * 3, stride) != 0 ||
+		memcmp(buf, buf + stride, SZ81_SCREEN_SIZE) == 0) failed = TRUE;
+
+	sz81_vec_reset(vec, -1);
+	for (count = 1; count < 4; count++)
+		if (memcmp(buf, buf + stride * count, stride) != 0) failed = TRUE;
+
+	sz81_vec_destroy(vec);
+
+	return failed;
+}
+
+/***************************************************************************
+ * Read File                                                               *
+ ***************************************************************************/
+/* On exit: returns the number of bytes read or -1 on error */
+
+int read_file(char *filename, unsigned char *buf, int size) {
+	FILE *fp;
+	int len;
+
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		fprintf(stderr, "%s: Cannot read from %s\n", __func__, filename);
+		return -1;
+	}
+	len = fread(buf, 1, size, fp);
+	fclose(fp);
+
+	return len;
+}
+
+/***************************************************************************
+ * Check                                                                   *
+ ***************************************************************************/
+
+void check(int passed, char *what) {
+	printf("%s: %s\n", passed ? "ok" : "FAIL", what);
+	if (!passed) failures++;
+}
+
+/***************************************************************************
+ * Ink Count                                                               *
+ ***************************************************************************/
+/* On exit: returns the number of ink pixels within the framebuffer */
+
+int ink_count(sz81 *machine) {
+	unsigned char *screen = sz81_get_framebuffer(machine);
+	int count, bit, ink = 0;
+
+	for (count = 0; count < SZ81_SCREEN_SIZE; count++)
+		for (bit = 0; bit < 8; bit++)
+			if (screen[count] & (1 << bit)) ink++;
+
+	return ink;
+}
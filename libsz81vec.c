@@ -0,0 +1,431 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Stepping many machines in lockstep (see libsz81.h).
+ *
+ * The machines are shared out in contiguous runs between worker threads
+ * that live as long as the sz81_vec does, each pinned to a core of its
+ * own where the host allows. sz81_vec_step wakes them all and waits
+ * until every one has finished its machines. Without MACHINE_THREADS
+ * there's only the one machine context and so the caller's thread steps
+ * them all itself */
+
+#ifdef __linux__
+	#define _GNU_SOURCE
+#endif
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef MACHINE_THREADS
+	#include <pthread.h>
+	#ifdef __linux__
+		#include <sched.h>
+	#endif
+#endif
+#include "libsz81.h"
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+/* Each machine's slot within the buffer is padded to this so that no two
+ * workers write to the same cache line */
+#define SLOT_ALIGN 64
+
+/* Variables */
+struct sz81_vec;
+
+struct vec_worker {
+	struct sz81_vec *vec;
+	int first, last;		/* The machines it steps */
+	int cpu;				/* The core it's pinned to */
+	#ifdef MACHINE_THREADS
+		pthread_t thread;
+	#endif
+};
+
+struct sz81_vec {
+	int count;
+	sz81 **machines;
+	sz81 *start;			/* The machine every machine resets to */
+	unsigned char *buffer;	/* The machines' slots */
+	int buffer_size;
+	int stride;
+	int frames;				/* Frames per step */
+	unsigned long long actions[SZ81_VEC_ACTIONS_MAX];
+	int action_count;
+	int rewards[SZ81_VEC_REWARDS_MAX];	/* Addresses */
+	int reward_count;
+	int *step_actions;		/* What sz81_vec_step was given */
+	struct vec_worker *workers;
+	int worker_count;
+	#ifdef MACHINE_THREADS
+		pthread_mutex_t mutex;
+		pthread_cond_t go, done;
+		unsigned int generation;	/* Incremented for every step */
+		int pending;		/* Workers yet to finish the step */
+		int quit;
+	#endif
+};
+
+/* Function prototypes */
+void vec_slot_update(sz81_vec *vec, int index);
+void vec_step_range(sz81_vec *vec, int first, int last);
+#ifdef MACHINE_THREADS
+	void *vec_worker_thread(void *arg);
+#endif
+
+
+/***************************************************************************
+ * Vec Create                                                              *
+ ***************************************************************************/
+/* This boots one machine with the program auto-loaded and runs it for a
+ * number of frames to get past the loading and whatever the program does
+ * to start. That machine is kept in memory and every machine begins as a
+ * copy of it and is copied from it again when it's reset.
+ *
+ * The buffer is allocated with mmap as MAP_SHARED so that it's shared
+ * with any process forked afterwards.
+ *
+ * On entry: int count is the number of machines
+ *           int model, ramsize, rom and romlen are as for sz81_create
+ *           unsigned char *program and int len is a .o or .p program
+ *           int startframes is how long to run it for to begin with
+ *           int threads is how many workers to use, 0 for one per core
+ *  On exit: returns a new sz81_vec or NULL on error */
+
+sz81_vec *sz81_vec_create(int count, int model, int ramsize,
+	unsigned char *rom, int romlen, unsigned char *program, int len,
+	int startframes, int threads) {
+	sz81_vec *vec;
+	int index;
+
+	if (count <= 0 || startframes <= 0) return NULL;
+
+	if ((vec = calloc(1, sizeof(sz81_vec))) == NULL ||
+		(vec->machines = calloc(count, sizeof(sz81 *))) == NULL ||
+		(vec->step_actions = calloc(count, sizeof(int))) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		sz81_vec_destroy(vec);
+		return NULL;
+	}
+	vec->count = count;
+	vec->frames = 1;
+	vec->action_count = 1;	/* Action 0 is no keys */
+
+	/* The starting machine */
+	if ((vec->start = sz81_create(model, ramsize, rom, romlen)) == NULL ||
+		(program && sz81_load_program(vec->start, program, len)) ||
+		sz81_run_frames(vec->start, startframes)) {
+		sz81_vec_destroy(vec);
+		return NULL;
+	}
+
+	for (index = 0; index < count; index++) {
+		if ((vec->machines[index] = sz81_create(model, ramsize, rom, romlen))
+			== NULL) {
+			sz81_vec_destroy(vec);
+			return NULL;
+		}
+	}
+
+	if (sz81_vec_set_rewards(vec, NULL, 0)) {
+		sz81_vec_destroy(vec);
+		return NULL;
+	}
+
+	#ifdef MACHINE_THREADS
+		if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (threads > count) threads = count;
+		if (threads < 1) threads = 1;
+	#else
+		threads = 1;
+	#endif
+	if ((vec->workers = calloc(threads, sizeof(struct vec_worker))) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		sz81_vec_destroy(vec);
+		return NULL;
+	}
+	for (index = 0; index < threads; index++) {
+		vec->workers[index].vec = vec;
+		vec->workers[index].first = count * index / threads;
+		vec->workers[index].last = count * (index + 1) / threads;
+		vec->workers[index].cpu = index;
+	}
+
+	#ifdef MACHINE_THREADS
+		pthread_mutex_init(&vec->mutex, NULL);
+		pthread_cond_init(&vec->go, NULL);
+		pthread_cond_init(&vec->done, NULL);
+		for (index = 0; index < threads; index++) {
+			if (pthread_create(&vec->workers[index].thread, NULL,
+				vec_worker_thread, &vec->workers[index])) {
+				fprintf(stderr, "%s: Cannot create a thread\n", __func__);
+				sz81_vec_destroy(vec);
+				return NULL;
+			}
+			vec->worker_count++;
+		}
+	#else
+		vec->worker_count = 1;
+	#endif
+
+	sz81_vec_reset(vec, -1);
+
+	return vec;
+}
+
+/***************************************************************************
+ * Vec Destroy                                                             *
+ ***************************************************************************/
+
+void sz81_vec_destroy(sz81_vec *vec) {
+	int index;
+
+	if (!vec) return;
+
+	#ifdef MACHINE_THREADS
+		if (vec->worker_count) {
+			pthread_mutex_lock(&vec->mutex);
+			vec->quit = TRUE;
+			vec->generation++;
+			pthread_cond_broadcast(&vec->go);
+			pthread_mutex_unlock(&vec->mutex);
+			for (index = 0; index < vec->worker_count; index++)
+				pthread_join(vec->workers[index].thread, NULL);
+			pthread_mutex_destroy(&vec->mutex);
+			pthread_cond_destroy(&vec->go);
+			pthread_cond_destroy(&vec->done);
+		}
+	#endif
+
+	if (vec->machines) {
+		for (index = 0; index < vec->count; index++)
+			sz81_destroy(vec->machines[index]);
+		free(vec->machines);
+	}
+	if (vec->buffer) munmap(vec->buffer, vec->buffer_size);
+	sz81_destroy(vec->start);
+	if (vec->step_actions) free(vec->step_actions);
+	if (vec->workers) free(vec->workers);
+	free(vec);
+}
+
+/***************************************************************************
+ * Vec Set Actions                                                         *
+ ***************************************************************************/
+/* On entry: unsigned long long *masks is the keys held down (see
+ *           SZ81_KEY) for each action from 0 to count - 1
+ *  On exit: returns TRUE on error
+ *           else FALSE */
+
+int sz81_vec_set_actions(sz81_vec *vec, unsigned long long *masks, int count) {
+	if (count <= 0 || count > SZ81_VEC_ACTIONS_MAX) return TRUE;
+	memcpy(vec->actions, masks, count * sizeof(unsigned long long));
+	vec->action_count = count;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Vec Set Rewards                                                         *
+ ***************************************************************************/
+/* This chooses the bytes of memory that are copied into each machine's
+ * slot after the framebuffer, such as a game's score, and so the layout
+ * of the buffer changes with it and sz81_vec_get_buffer should be called
+ * again afterwards.
+ *
+ * On entry: int *addrs is the addresses (as for sz81_peek)
+ *           int count is how many, up to SZ81_VEC_REWARDS_MAX
+ *  On exit: returns TRUE on error
+ *           else FALSE */
+
+int sz81_vec_set_rewards(sz81_vec *vec, int *addrs, int count) {
+	unsigned char *buffer;
+	int stride, size;
+
+	if (count < 0 || count > SZ81_VEC_REWARDS_MAX) return TRUE;
+
+	stride = (SZ81_SCREEN_SIZE + count + SLOT_ALIGN - 1) / SLOT_ALIGN * SLOT_ALIGN;
+	size = stride * vec->count;
+	if (size != vec->buffer_size) {
+		if ((buffer = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED) {
+			fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+			return TRUE;
+		}
+		if (vec->buffer) munmap(vec->buffer, vec->buffer_size);
+		vec->buffer = buffer;
+		vec->buffer_size = size;
+	}
+	vec->stride = stride;
+	if (count) memcpy(vec->rewards, addrs, count * sizeof(int));
+	vec->reward_count = count;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Vec Set Frames                                                          *
+ ***************************************************************************/
+/* On entry: int frames is how many frames each step runs for with the
+ *           action's keys held down
+ *  On exit: returns TRUE on error
+ *           else FALSE */
+
+int sz81_vec_set_frames(sz81_vec *vec, int frames) {
+	if (frames <= 0) return TRUE;
+	vec->frames = frames;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Vec Get Buffer                                                          *
+ ***************************************************************************/
+/* On exit: *stride is the size of each machine's slot
+ *          returns the buffer, which holds a slot per machine in order */
+
+unsigned char *sz81_vec_get_buffer(sz81_vec *vec, int *stride) {
+	*stride = vec->stride;
+
+	return vec->buffer;
+}
+
+/***************************************************************************
+ * Vec Reset                                                               *
+ ***************************************************************************/
+/* This returns a machine to the start by copying the starting machine,
+ * which is entirely in memory, and refreshes its slot.
+ *
+ * On entry: int index is the machine or -1 for all of them */
+
+void sz81_vec_reset(sz81_vec *vec, int index) {
+	int first = index, last = index + 1;
+
+	if (index < 0) {
+		first = 0;
+		last = vec->count;
+	}
+	for (index = first; index < last && index < vec->count; index++) {
+		sz81_copy(vec->machines[index], vec->start);
+		vec_slot_update(vec, index);
+	}
+}
+
+/***************************************************************************
+ * Vec Step                                                                *
+ ***************************************************************************/
+/* Every machine runs for the frames with its action's keys held down and
+ * then its framebuffer and rewards are copied into its slot. This returns
+ * once they all have.
+ *
+ * On entry: int *actions is an action for each machine
+ *  On exit: returns TRUE on error (an action is out of range)
+ *           else FALSE */
+
+int sz81_vec_step(sz81_vec *vec, int *actions) {
+	int index;
+
+	for (index = 0; index < vec->count; index++)
+		if (actions[index] < 0 || actions[index] >= vec->action_count) return TRUE;
+	memcpy(vec->step_actions, actions, vec->count * sizeof(int));
+
+	#ifdef MACHINE_THREADS
+		pthread_mutex_lock(&vec->mutex);
+		vec->pending = vec->worker_count;
+		vec->generation++;
+		pthread_cond_broadcast(&vec->go);
+		while (vec->pending) pthread_cond_wait(&vec->done, &vec->mutex);
+		pthread_mutex_unlock(&vec->mutex);
+	#else
+		vec_step_range(vec, 0, vec->count);
+	#endif
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Vec Step Range                                                          *
+ ***************************************************************************/
+
+void vec_step_range(sz81_vec *vec, int first, int last) {
+	int index;
+
+	for (index = first; index < last; index++) {
+		sz81_set_keys(vec->machines[index],
+			vec->actions[vec->step_actions[index]]);
+		sz81_run_frames(vec->machines[index], vec->frames);
+		vec_slot_update(vec, index);
+	}
+}
+
+/***************************************************************************
+ * Vec Slot Update                                                         *
+ ***************************************************************************/
+
+void vec_slot_update(sz81_vec *vec, int index) {
+	unsigned char *slot = vec->buffer + index * vec->stride;
+	int count;
+
+	memcpy(slot, sz81_get_framebuffer(vec->machines[index]), SZ81_SCREEN_SIZE);
+	for (count = 0; count < vec->reward_count; count++)
+		slot[SZ81_SCREEN_SIZE + count] =
+			sz81_peek(vec->machines[index], vec->rewards[count]);
+}
+
+#ifdef MACHINE_THREADS
+/***************************************************************************
+ * Vec Worker Thread                                                       *
+ ***************************************************************************/
+/* This waits for each step, steps its machines within its own machine
+ * context and then reports back */
+
+void *vec_worker_thread(void *arg) {
+	struct vec_worker *worker = arg;
+	sz81_vec *vec = worker->vec;
+	unsigned int generation = 0;
+	#ifdef __linux__
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(worker->cpu % sysconf(_SC_NPROCESSORS_ONLN), &cpus);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	#endif
+
+	for (;;) {
+		pthread_mutex_lock(&vec->mutex);
+		while (vec->generation == generation)
+			pthread_cond_wait(&vec->go, &vec->mutex);
+		generation = vec->generation;
+		pthread_mutex_unlock(&vec->mutex);
+		if (vec->quit) break;
+
+		vec_step_range(vec, worker->first, worker->last);
+
+		pthread_mutex_lock(&vec->mutex);
+		if (--vec->pending == 0) pthread_cond_signal(&vec->done);
+		pthread_mutex_unlock(&vec->mutex);
+	}
+
+	return NULL;
+}
+#endif
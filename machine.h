@@ -0,0 +1,54 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* The machine context.
+ *
+ * Everything that makes up one emulated machine (memory and its page
+ * tables, the keyboard ports, the CPU registers, the ULA, the display
+ * buffers, the printer, the sound synthesis and sdl_emulator which the
+ * core reads) is declared MACHINE_LOCAL, both where it's defined and
+ * wherever it's declared extern.
+ *
+ * Normally that's nothing and there's one machine per process as there
+ * always was. Building with -DMACHINE_THREADS makes it thread-local
+ * storage instead so that the context is reached through the thread
+ * pointer, and every thread that calls initmem and mainloop has a
+ * machine of its own. Several can then run at once on separate threads.
+ *
+ * A thread's machine starts with the values given in the source, but
+ * what sdl_init sets at run time only applies to the thread that called
+ * it, so a thread must set up sdl_emulator itself, including pointing
+ * sdl_emulator.model at its own zx80, before calling initmem. The SDL
+ * front end only runs on the one thread and SDL's audio callback isn't
+ * the machine's thread so the AY isn't synthesised within the callback
+ * in such builds.
+ *
+ * Host things that aren't part of the machine such as the ROM images,
+ * the sound output, the rcfile settings and the GUI stay shared.
+ * 
+ * z81 keeps the registers local to mainloop so this is for sz81 only */
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#ifdef MACHINE_THREADS
+	#define MACHINE_LOCAL __thread
+#else
+	#define MACHINE_LOCAL
+#endif
+
+#endif
@@ -23,10 +23,17 @@
  *  common.c   sdl_main.c   sdl_*.c
  *   sound.c
  *     z80.c
- */
+ * snapshot.c
+ * libsz81.c
+ * 
+ * sdl.h doesn't include SDL itself so that the emulator core on the left
+ * can be built without it, as it is with libsz81.c in place of the SDL
+ * front end (see libsz81.h) */
 
 /* Includes */
-#include <SDL/SDL.h>
+#include "machine.h"
+#include "sdl_profile.h"
+#include "sdl_trace.h"
 
 /* Defines */
 #define MAX_KEYCODES 358	/* SDL stops at 322 and then I extend them */
@@ -54,7 +61,9 @@
 #define SAVE_FILE_METHOD_UNNAMEDSAVE 2
 #define SAVE_FILE_METHOD_STATESAVE 3
 
-/* 16KB was fine for everything but the Wiz is currently experiencing
+/* This is the default size of the linear sound buffer and can be
+ * changed via the rcfile's sound.buffer_size.
+ * 16KB was fine for everything but the Wiz is currently experiencing
  * linear buffer overflow and so I'm quadrupling it for the Wiz only */
 #if defined(PLATFORM_GP2X) && defined (TOOLCHAIN_OPENWIZ)
 	#define SOUND_BUFFER_SIZE (1024 * 16 * 4)
@@ -79,14 +88,21 @@ struct {
 	int xres;
 	int yres;
 	char filename[256];
+	char wavfile[256];	/* Capture sound to this file if set */
+	int samples;
+	char recfile[256];	/* Record the input to this file if set */
+	char playfile[256];	/* Play back the input from this file if set */
+	int turbo;		/* TRUE to play back flat out and then exit */
+	char tracefile[256];	/* Trace to this file if set (see sdl_trace.h) */
 } sdl_com_line;
 
-struct {
+/* The emulator core reads this too so it belongs to the machine and is
+ * defined within sdl_engine.c (see machine.h) */
+struct sdl_emulator {
 	int state;		/* FALSE=video output/keyboard input disabled, TRUE=all active */
 	int paused;		/* Via Pause key: TRUE=emulation on-hold, keyboard input disabled */
 	int xoffset;
 	int yoffset;
-	SDL_TimerID timer_id;	
 	int m1not;
 	int speed;		/* 10ms=200%, 20ms=100%, 30ms=66%, 40ms=50% */
 	int frameskip;	/* 0 to MAX_FRAMESKIP */
@@ -97,18 +113,40 @@ struct {
 	int ramsize;	/* 1, 2, 3, 4, 16, 32, 48 or 56K */
 	int invert;		/* This should really be in video but it's easier to put it here */
 	int autoload;	/* Set to TRUE when auto-loading or forced-loading */
-} sdl_emulator;
+	int runahead;	/* Frames to run ahead by to hide input lag, 0 to RUNAHEAD_MAX */
+	int speculating;	/* Frames left to run ahead: these aren't heard, waited for or read input */
+	int turbo;		/* TRUE to run flat out: frames aren't heard or waited for */
+	int fastboot;	/* TRUE to restore a cached post-boot state on reset */
+	int kbscans;	/* Keyboard reads since the machine was reset */
+	int resume;		/* TRUE to save the session on exit and resume it on launch */
+	int autowarp;	/* Frames to run flat out after a LOAD, 0 to AUTO_WARP_MAX */
+	int warping;	/* Frames of auto-warp left: these aren't shown, heard or waited for */
+	int ulachars;	/* Characters the ULA has drawn this frame */
+};
+extern MACHINE_LOCAL struct sdl_emulator sdl_emulator;
 
 struct {
 	int state;
 	int volume;
 	int device;		/* See DEVICE* defines in sdl_sound.h */
 	int stereo;
-	Uint8 buffer[SOUND_BUFFER_SIZE];
+	int ay_thread;	/* TRUE to synthesise the AY within the audio callback */
+	int samples;	/* Audio device buffer size or SOUND_SAMPLES_AUTO */
+	int buffer_size;	/* Requested linear buffer size in bytes */
+	unsigned char *buffer;
+	int buffer_capacity;	/* What was actually allocated */
 	int buffer_start;
 	int buffer_end;
+	unsigned long buffer_read;	/* Total bytes consumed from the buffer */
+	int underruns;	/* Times the callback ran out of data */
 } sdl_sound;
 
+struct {
+	int state;		/* TRUE to keep a history that can be rewound through */
+	int interval;	/* Frames between snapshots */
+	int memory;		/* The size of the history in KB */
+} sdl_rewind;
+
 struct {
 	int state;
 	unsigned char data[4 * 1024];
@@ -136,16 +174,30 @@ void sdl_rcfile_read(void);
 int sdl_zxroms_init(void);
 void sdl_component_executive(void);
 void sdl_timer_init(void);
+void sdl_timer_wait(void);
 void sdl_zxprinter_init(void);
-int keyboard_update(void);
+int keyboard_update(int now);
 void sdl_video_update(void);
 int sdl_sound_init(int freq, int *stereo, int *sixteenbit);
-void sdl_sound_callback(void *userdata, Uint8 *stream, int len);
 void sdl_sound_frame(unsigned char *data, int len);
 void sdl_sound_end(void);
+void sdl_sound_lock(void);
+void sdl_sound_unlock(void);
+void sdl_sound_capture_start(int freq, int stereo);
+void sdl_sound_capture_frame(unsigned char *data, int len, int stereo);
+void sdl_sound_capture_end(void);
 int sdl_filetype_casecmp(char *filename, char *filetype);
 int sdl_load_file(int parameter, int method);
 int sdl_save_file(int parameter, int method);
+void rewind_reset(void);
+void rewind_frame(void);
+void runahead_frame(void);
+void input_log_frame(void);
+void quick_slot_frame(void);
+int auto_resume_start(void);
+void fast_boot_start(void);
+void fast_boot_frame(void);
+void auto_warp_frame(void);
 
 
 
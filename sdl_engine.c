@@ -19,14 +19,19 @@
 #include "sdl_engine.h"
 
 /* Defines */
+#define HOLD_IDLE_TIMEOUT 1000
 
 /* Emulator variables I require access to */
-extern int zx80, ramsize;
+extern MACHINE_LOCAL int zx80;
+extern int ramsize;
 
 /* Variables */
+MACHINE_LOCAL struct sdl_emulator sdl_emulator;
+SDL_TimerID emulator_timer_id;
 
 /* Function prototypes */
 void clean_up_before_exit(void);
+int emulator_idle_wait(Uint32 timeout);
 
 
 /***************************************************************************
@@ -77,7 +82,7 @@ int sdl_init(void) {
 	/* All SDL pointers are initialised to NULL here since we could
 	 * exit prematurely and we don't want to cause seg faults by
 	 * freeing nothing. As long as they are NULL everything is fine */
-	sdl_emulator.timer_id = NULL;
+	emulator_timer_id = NULL;
 	control_bar.scaled = NULL;
 	vkeyb.zx80original = vkeyb.zx81original = vkeyb.scaled = NULL;
 	sz81icons.original = sz81icons.scaled = NULL;
@@ -87,6 +92,7 @@ int sdl_init(void) {
 			zx82font.scaled[count] = NULL;
 	joystick = NULL;
 	wm_icon = NULL;
+	sdl_sound.buffer = NULL;
 
 	/* Initialise everything to a default here that could possibly be
 	 * overridden by a command line option or from an rcfile */
@@ -104,6 +110,16 @@ int sdl_init(void) {
 	#endif
 	sdl_sound.device = DEVICE_NONE;
 	sdl_sound.stereo = FALSE;
+	sdl_sound.ay_thread = FALSE;
+	sdl_sound.samples = SOUND_SAMPLES_DEFAULT;
+	sdl_sound.buffer_size = SOUND_BUFFER_SIZE;
+	sdl_emulator.runahead = 0;
+	sdl_emulator.fastboot = TRUE;	/* On is the default */
+	sdl_emulator.autowarp = AUTO_WARP_DEFAULT;
+	sdl_emulator.resume = TRUE;		/* On is the default */
+	sdl_rewind.state = TRUE;
+	sdl_rewind.interval = REWIND_INTERVAL;
+	sdl_rewind.memory = REWIND_MEMORY;
 	vkeyb.alpha = SDL_ALPHA_OPAQUE;
 	vkeyb.autohide = FALSE;
 	vkeyb.toggle_shift = FALSE;
@@ -128,12 +144,20 @@ int sdl_init(void) {
 	sdl_com_line.xres = UNDEFINED;
 	sdl_com_line.yres = UNDEFINED;
 	sdl_com_line.filename[0] = 0;
+	sdl_com_line.wavfile[0] = 0;
+	sdl_com_line.samples = UNDEFINED;
+	sdl_com_line.recfile[0] = 0;
+	sdl_com_line.playfile[0] = 0;
+	sdl_com_line.turbo = FALSE;
+	sdl_com_line.tracefile[0] = 0;
 
 	/* Initialise other things that need to be done before sdl_video_setmode */
 	sdl_emulator.state = TRUE;
 	sdl_emulator.speed = 20;		/* 1000ms/50Hz=20ms is the default */
 	sdl_emulator.autoload = FALSE;
 	sdl_emulator.paused = FALSE;
+	sdl_emulator.speculating = 0;
+	sdl_emulator.turbo = FALSE;
 	sdl_sound.state = FALSE;
 	video.redraw = TRUE;
 	vkeyb.state = FALSE;
@@ -222,6 +246,32 @@ int sdl_com_line_process(int argc, char *argv[]) {
 				sdl_com_line.fullscreen = TRUE;
 			} else if (!strcmp (argv[count], "-w")) {
 				sdl_com_line.fullscreen = FALSE;
+			#ifdef OSS_SOUND_SUPPORT
+			} else if (!strcmp (argv[count], "-a") && count + 1 < argc) {
+				strncpy(sdl_com_line.wavfile, argv[++count], 255);
+				sdl_com_line.wavfile[255] = 0;
+			} else if (!strcmp (argv[count], "-b") && count + 1 < argc) {
+				count++;
+				if (!strcmp (argv[count], "auto")) {
+					sdl_com_line.samples = SOUND_SAMPLES_AUTO;
+				} else if (sscanf (argv[count], "%i", &sdl_com_line.samples) != 1 ||
+					!sdl_sound_samples_valid(sdl_com_line.samples)) {
+					fprintf (stdout, "Invalid audio buffer size: try auto or a power of 2 from %i to %i.\n",
+						SOUND_SAMPLES_MIN, SOUND_SAMPLES_MAX);
+					return TRUE;
+				}
+			#endif
+			} else if (!strcmp (argv[count], "-r") && count + 1 < argc) {
+				strncpy(sdl_com_line.recfile, argv[++count], 255);
+				sdl_com_line.recfile[255] = 0;
+			} else if (!strcmp (argv[count], "-p") && count + 1 < argc) {
+				strncpy(sdl_com_line.playfile, argv[++count], 255);
+				sdl_com_line.playfile[255] = 0;
+			} else if (!strcmp (argv[count], "-t")) {
+				sdl_com_line.turbo = TRUE;
+			} else if (!strcmp (argv[count], "-j") && count + 1 < argc) {
+				strncpy(sdl_com_line.tracefile, argv[++count], 255);
+				sdl_com_line.tracefile[255] = 0;
 			} else if (sscanf (argv[count], "-%ix%i", 
 				&sdl_com_line.xres, &sdl_com_line.yres) == 2) {
 				if (sdl_com_line.xres < 240 || sdl_com_line.yres < 240) {
@@ -238,9 +288,18 @@ int sdl_com_line_process(int argc, char *argv[]) {
 				fprintf (stdout,
 					"z81 2.1 - copyright (C) 1994-2004 Ian Collier and Russell Marks.\n"
 					"sz81 " VERSION " - copyright (C) 2007-2011 Thunor and Chris Young.\n\n"
-					"usage: sz81 [-fhw] [-XRESxYRES] [filename.{o|p|80|81}]\n\n"
+					"usage: sz81 [-fhtw] [-a file.wav] [-b samples]\n"
+					"            [-j file.json] [-p file | -r file]\n"
+					"            [-XRESxYRES]\n"
+					"            [filename.{o|p|80|81}]\n\n"
+					"  -a  capture the sound to a wav file\n"
+					"  -b  audio buffer size e.g. 512 or auto\n"
 					"  -f  run the program fullscreen\n"
 					"  -h  this usage help\n"
+					"  -j  trace the frames and I/O to a file\n"
+					"  -p  play back the input from a file\n"
+					"  -r  record the input to a file\n"
+					"  -t  play back flat out and then exit\n"
 					"  -w  run the program in a window\n"
 					"  -XRESxYRES e.g. -800x480\n\n");
 				return TRUE;
@@ -269,6 +328,17 @@ int sdl_com_line_process(int argc, char *argv[]) {
 		sdl_emulator.autoload = TRUE;
 	}
 
+	if (*sdl_com_line.recfile && *sdl_com_line.playfile) {
+		fprintf (stdout, "Cannot record and play back the input at the same time.\n");
+		return TRUE;
+	}
+	if (*sdl_com_line.recfile &&
+		input_log_begin(INPUT_LOG_RECORD, sdl_com_line.recfile)) return TRUE;
+	if (*sdl_com_line.playfile &&
+		input_log_begin(INPUT_LOG_PLAY, sdl_com_line.playfile)) return TRUE;
+	if (*sdl_com_line.tracefile && trace_begin(sdl_com_line.tracefile))
+		return TRUE;
+
 	#ifdef SDL_DEBUG_COM_LINE
 		printf("%s:\n", __func__);
 		printf("  argc=%i\n", argc);
@@ -280,6 +350,12 @@ int sdl_com_line_process(int argc, char *argv[]) {
 		printf("  sdl_com_line.xres=%i\n", sdl_com_line.xres);
 		printf("  sdl_com_line.yres=%i\n", sdl_com_line.yres);
 		printf("  sdl_com_line.filename=%s\n", sdl_com_line.filename);
+		printf("  sdl_com_line.wavfile=%s\n", sdl_com_line.wavfile);
+		printf("  sdl_com_line.samples=%i\n", sdl_com_line.samples);
+		printf("  sdl_com_line.recfile=%s\n", sdl_com_line.recfile);
+		printf("  sdl_com_line.playfile=%s\n", sdl_com_line.playfile);
+		printf("  sdl_com_line.turbo=%i\n", sdl_com_line.turbo);
+		printf("  sdl_com_line.tracefile=%s\n", sdl_com_line.tracefile);
 	#endif
 
 	return FALSE;
@@ -308,6 +384,9 @@ void sdl_component_executive(void) {
 	int found = FALSE;
 	int count;
 
+	/* Report any files that have finished being written */
+	io_writer_poll();
+
 	/* Monitor control remapper's state */ 
 	if (ctrl_remapper_state != ctrl_remapper.state) {
 		ctrl_remapper_state = ctrl_remapper.state;
@@ -551,7 +630,18 @@ int runtime_options_which(void) {
 
 void sdl_timer_init(void) {
 	/* Create a 10ms timer */
-	sdl_emulator.timer_id = SDL_AddTimer (10, emulator_timer, NULL);
+	emulator_timer_id = SDL_AddTimer (10, emulator_timer, NULL);
+}
+
+/***************************************************************************
+ * Timer Wait                                                              *
+ ***************************************************************************/
+/* The emulator calls this when it's ready for the next frame */
+
+void sdl_timer_wait(void) {
+	TRACE_BEGIN("wait", "timer");
+	while (!signal_int_flag) SDL_Delay(10);
+	TRACE_END("wait", "timer");
 }
 
 /***************************************************************************
@@ -561,8 +651,10 @@ void sdl_timer_init(void) {
 Uint32 emulator_timer(Uint32 interval, void *param) {
 	static int intervals = 0;
 
+	TRACE_THREAD("timer");
 	intervals++;
 	if (intervals >= sdl_emulator.speed / 10) {
+		TRACE_INSTANT("tick", "timer");
 		signal_int_flag = TRUE;
 		intervals = 0;
 	}
@@ -583,6 +675,9 @@ void emulator_reset(void) {
 	/* If the user paused the emulator then unpause it */
 	if (sdl_emulator.paused) toggle_emulator_paused(TRUE);
 
+	/* Don't carry a warp over into the next machine */
+	sdl_emulator.warping = 0;
+
 	/* Restart mainloop on return */
 	interrupted = INTERRUPT_EMULATOR_RESET;
 }
@@ -593,29 +688,95 @@ void emulator_reset(void) {
 /* This will place the emulator into a holding position until the condition
  * changes or the user has initiated emulator exit.
  * 
+ * Nothing is emulated whilst on hold so rather than polling every frame
+ * this sleeps until there's an event to process and only redraws when the
+ * UI has something new to show. It will wake every frame whilst a control
+ * is held down so that key repeat keeps working, and when a notification
+ * expires so that it can be erased.
+ * 
  * On entry: int *condition points to the variable to monitor
  *  On exit: returns TRUE if emulator exit detected
  *           else FALSE */
 
 int emulator_hold(int *condition) {
 	int origcond = *condition;
+	struct Notification nfn;
 	int retval = FALSE;
+	int redraw, count;
+	Uint32 timeout;
+
+	#ifdef OSS_SOUND_SUPPORT
+		/* There's nothing to play whilst on hold */
+		if (sdl_sound.state) SDL_PauseAudio(1);
+	#endif
+
+	/* Show whatever initiated the hold */
+	sdl_video_update();
 
 	do {
-		/* This waits until it's time to process the next frame
-		 * (signal_int_flag=1) */
-		frame_pause();
-		/* This calls update_scrn if the frame is to be rendered
-		 * i.e. not skipped, calls check_events which then calls
-		 * keyboard_update */
-		do_interrupt();
+		/* Work out how long we can sleep for */
+		timeout = HOLD_IDLE_TIMEOUT;
+		for (count = 0; count < MAX_KEYCODES; count++) {
+			if (keyboard_buffer[count] == SDL_PRESSED) {
+				/* Two frames because key repeat ticks every other one */
+				timeout = sdl_emulator.speed * 2;
+				break;
+			}
+		}
+		notification_show(NOTIFICATION_QUERY, &nfn);
+		if (nfn.timeout > 0 && nfn.timeout < timeout) timeout = nfn.timeout;
+
+		redraw = emulator_idle_wait(timeout);
+
+		/* Process the events and update key repeat now rather than on
+		 * keyboard_update's every other call */
+		keyboard_update(TRUE);
+
 		/* If the user initiates emulator exit then quit loop */
 		if (interrupted == INTERRUPT_EMULATOR_EXIT) retval = TRUE;
+
+		/* Redraw if there were events or a notification is showing,
+		 * the latter requiring a second redraw if it's just expired */
+		if (redraw || nfn.timeout > 0) {
+			sdl_video_update();
+			if (nfn.timeout > 0) {
+				notification_show(NOTIFICATION_QUERY, &nfn);
+				if (nfn.timeout <= 0) sdl_video_update();
+			}
+		}
 	} while (origcond == *condition && !retval);
 
+	#ifdef OSS_SOUND_SUPPORT
+		if (sdl_sound.state) SDL_PauseAudio(0);
+	#endif
+
 	return retval;
 }
 
+/***************************************************************************
+ * Emulator Idle Wait                                                      *
+ ***************************************************************************/
+/* SDL 1.2 has no SDL_WaitEvent with a timeout, so this does what
+ * SDL_WaitEvent does internally but gives up after timeout ms. The event
+ * is left in the queue for keyboard_update to process.
+ * 
+ * On entry: Uint32 timeout is the maximum time to wait in ms
+ *  On exit: returns TRUE if an event is waiting
+ *           else FALSE */
+
+int emulator_idle_wait(Uint32 timeout) {
+	Uint32 start_time = SDL_GetTicks();
+	SDL_Event event;
+
+	while (TRUE) {
+		SDL_PumpEvents();
+		if (SDL_PeepEvents(&event, 1, SDL_PEEKEVENT, SDL_ALLEVENTS) > 0)
+			return TRUE;
+		if (SDL_GetTicks() - start_time >= timeout) return FALSE;
+		SDL_Delay(10);
+	}
+}
+
 /***************************************************************************
  * Emulator Exit                                                           *
  ***************************************************************************/
@@ -642,6 +803,9 @@ void emulator_exit(void) {
 	if (get_active_component() & COMP_RUNOPTS_ALL)
 		runopts_transit(TRANSIT_OUT);
 
+	/* Save the session so that it can be resumed next time */
+	auto_resume_save();
+
 	/* Exit mainloop on return */
 	interrupted = INTERRUPT_EMULATOR_EXIT;
 }
@@ -657,9 +821,21 @@ void clean_up_before_exit(void) {
 
 	#ifdef OSS_SOUND_SUPPORT
 		sdl_sound_end();
+		sdl_sound_capture_end();
 	#endif
 
-	if (sdl_emulator.timer_id) SDL_RemoveTimer (sdl_emulator.timer_id);
+	/* Let anything still being saved finish */
+	quick_slot_end();
+	fast_boot_end();
+	io_writer_end();
+
+	rewind_end();
+	input_log_end();
+
+	PROFILE_END();
+	trace_end();
+
+	if (emulator_timer_id) SDL_RemoveTimer (emulator_timer_id);
 
 	if (rcfile.rewrite) rcfile_write();
 
@@ -23,7 +23,9 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <SDL/SDL.h>
 #include "sdl.h"
+#include "snapshot.h"
 #include "sdl_hotspots.h"
 #include "sdl_input.h"
 #include "sdl_loadsave.h"
@@ -47,6 +49,7 @@
 #define SDL_DEBUG_JOYSTICK
 #define SDL_DEBUG_COM_LINE
 */
+/* The frame stage profiler is built with -DSDL_PROFILE (see sdl_profile.h) */
 
 #define TRUE 1
 #define FALSE 0
@@ -69,35 +72,44 @@
 
 /* Emulator variables I require access to */
 /* Variables from the top of z80.c */
-extern unsigned long tstates, frames;
-extern int liney;
-extern int vsy;
-extern unsigned long linestart;
-extern int vsync_toggle, vsync_lasttoggle;
+extern MACHINE_LOCAL unsigned long tstates, frames;
+extern MACHINE_LOCAL int liney, lineyi;
+extern MACHINE_LOCAL int vsy;
+extern MACHINE_LOCAL unsigned long linestart;
+extern MACHINE_LOCAL int vsync_toggle, vsync_lasttoggle;
+extern MACHINE_LOCAL int ay_reg;
+extern MACHINE_LOCAL int linestate, linex, nrmvideo;
+extern MACHINE_LOCAL unsigned char scrnbmp[];
 /* Variables liberated from the top of mainloop */
-extern unsigned char a, f, b, c, d, e, h, l;
-extern unsigned char r, a1, f1, b1, c1, d1, e1, h1, l1, i, iff1, iff2, im;
-extern unsigned short pc;
-extern unsigned short ix, iy, sp;
-extern unsigned char radjust;
-extern unsigned long nextlinetime, linegap, lastvsyncpend;
-extern unsigned char ixoriy, new_ixoriy;
-extern unsigned char intsample;
-extern unsigned char op;
-extern int ulacharline;
-extern int nmipend, intpend, vsyncpend, vsynclen;
-extern int hsyncskip;
-extern int framewait;
+extern MACHINE_LOCAL unsigned char a, f, b, c, d, e, h, l;
+extern MACHINE_LOCAL unsigned char r, a1, f1, b1, c1, d1, e1, h1, l1, i, iff1, iff2, im;
+extern MACHINE_LOCAL unsigned short pc;
+extern MACHINE_LOCAL unsigned short ix, iy, sp;
+extern MACHINE_LOCAL unsigned char radjust;
+extern MACHINE_LOCAL unsigned long nextlinetime, linegap, lastvsyncpend;
+extern MACHINE_LOCAL unsigned char ixoriy, new_ixoriy;
+extern MACHINE_LOCAL unsigned char intsample;
+extern MACHINE_LOCAL unsigned short videodata;
+extern MACHINE_LOCAL unsigned char op;
+extern MACHINE_LOCAL int ulacharline;
+extern MACHINE_LOCAL int nmipend, intpend, vsyncpend, vsynclen;
+extern MACHINE_LOCAL int hsyncskip;
+extern MACHINE_LOCAL int framewait;
 /* Variables from the top of common.c */
-extern unsigned char mem[];
-extern int sound, sound_vsync;
-extern int sound_ay, sound_ay_type;
+extern MACHINE_LOCAL unsigned char mem[];
+extern MACHINE_LOCAL int sound, sound_vsync;
+extern MACHINE_LOCAL int sound_ay, sound_ay_type;
 extern int signal_int_flag;
-extern int interrupted;
-extern int nmigen, hsyncgen, vsync;
+extern MACHINE_LOCAL int interrupted;
+extern MACHINE_LOCAL int nmigen, hsyncgen, vsync;
 extern char *zxpfilename;
+extern MACHINE_LOCAL int zxpframes, zxpcycles, zxpspeed, zxpnewspeed;
+extern MACHINE_LOCAL int zxpheight, zxppixel, zxpstylus;
+extern MACHINE_LOCAL unsigned char zxpline[];
+extern MACHINE_LOCAL int chromamode;
+extern MACHINE_LOCAL unsigned char bordercolour;
 extern int load_selector_state;
-extern int refresh_screen;
+extern MACHINE_LOCAL int refresh_screen;
 /* Variables from the top of sound.c */
 extern int sound_stereo, sound_stereo_acb;
 
@@ -116,9 +128,11 @@ struct runtimeoptions runtime_options[MAX_RUNTIME_OPTIONS];
 extern void initmem(void);
 extern void frame_pause(void);
 extern void do_interrupt(void);
+extern void check_events(void);
 #ifdef OSS_SOUND_SUPPORT
 	extern void sound_ay_setvol(void);
-	extern void sound_framesiz_init(void);
+	extern int sound_framesiz_init(void);
+	extern void sound_ay_callback(unsigned char *stream, int len, unsigned long pos);
 #endif
 
 /* Function prototypes */
@@ -1002,9 +1002,11 @@ void sdl_keyboard_init(void) {
  * |     Target actions      |
  * +-------------------------+
  * 
- * On exit: returns non-zero if there are keyboard events else 0 */
+ * On entry: int now = TRUE to process events on this call regardless
+ *           of the every other call skip below
+ *  On exit: returns non-zero if there are keyboard events else 0 */
 
-int keyboard_update(void) {
+int keyboard_update(int now) {
 	static int skip_update = TRUE, skip_drag = TRUE, last_hs_pressed[2];
 	static int axisstates[MAX_JOY_AXES * 2], init = TRUE;
 	int eventfound = FALSE, count, found;
@@ -1038,7 +1040,9 @@ int keyboard_update(void) {
 
 	/* Process events every other call otherwise the emulator or the
 	 * emulated machine has trouble keeping up with event creation */
-	if (!(skip_update = !skip_update)) {
+	skip_update = !skip_update;
+	if (now) skip_update = FALSE;
+	if (!skip_update) {
 
 		/* If there's something to repeat then maybe do it now. As this
 		 * is done inside the skip-update the default granularity is
@@ -1046,6 +1050,7 @@ int keyboard_update(void) {
 		 * speed is altered e.g. 1000ms / (80Hz / 2) = 25ms */
 		key_repeat_manager(KRM_FUNC_TICK, NULL, 0);
 
+		TRACE_BEGIN("events", "sdl");
 		while (SDL_PollEvent(&event)) {
 			/* Get something we're interested in */
 			device = id = mod_id = state = UNDEFINED;
@@ -1317,6 +1322,21 @@ int keyboard_update(void) {
 							sdl_video_setmode();
 						}
 						found = TRUE;
+					} else if (id >= SDLK_1 && id < SDLK_1 + QUICK_SLOTS &&
+						(modstate & (KMOD_ALT | KMOD_MODE))) {
+						/* Restore a quick slot or with shift capture one */
+						if (state == SDL_PRESSED && get_active_component() == COMP_EMU) {
+							if (modstate & KMOD_SHIFT) {
+								quick_slot_request(id - SDLK_1, QUICK_SLOT_CAPTURE);
+							} else {
+								quick_slot_request(id - SDLK_1, QUICK_SLOT_RESTORE);
+							}
+						}
+						found = TRUE;
+					} else if (id == SDLK_0 && (modstate & (KMOD_ALT | KMOD_MODE))) {
+						/* Write the quick slots to disk */
+						if (state == SDL_PRESSED) quick_slot_flush();
+						found = TRUE;
 					}
 					if (found) device = UNDEFINED;	/* Ignore id and mod_id */
 				}
@@ -1450,6 +1470,7 @@ int keyboard_update(void) {
 				}
 			}
 		}
+		TRACE_END("events", "sdl");
 	}
 
 	return eventfound;
@@ -2472,6 +2493,8 @@ void manage_all_input(void) {
 				} else if (keystate[DINGOO_Y]) {
 					sdl_emulator.invert = !sdl_emulator.invert;
 					refresh_screen = 1;
+				} else if (keystate[DINGOO_X]) {
+					rewind_step();
 				}
 			}
 		}
@@ -2557,6 +2580,17 @@ void manage_all_input(void) {
 					write_mapping_game();
 				}
 			}
+		} else if (id == SDLK_F7) {
+			/* Step backwards through the rewind history (it repeats) */
+			if (state == SDL_PRESSED) {
+				/* The vkeyb uses F7 to toggle its shift type */
+				if (get_active_component() == COMP_EMU) {
+					key_repeat_manager(KRM_FUNC_REPEAT, &event, COMP_EMU * id);
+					rewind_step();
+				}
+			} else if (state == SDL_RELEASED) {
+				key_repeat_manager(KRM_FUNC_RELEASE, NULL, 0);
+			}
 		} else if (id == SDLK_F8) {
 			/* Toggle invert screen */
 			if (state == SDL_PRESSED) {
@@ -18,21 +18,119 @@
 /* Includes */
 #include "sdl_engine.h"
 #include "common.h"
+#include "sound.h"
 
 /* Defines */
 
+/* The most a delta can exceed SNAPSHOT_SIZE by when encoded */
+#define REWIND_DELTA_SLACK 64
+
+/* Save state RAM is compressed with a simple byte oriented LZ77. A control
+ * byte below 0x80 is followed by that many plus one literals, otherwise
+ * its low 7 bits plus LZ_MATCH_MIN is the length of a match and a 16 bit
+ * offset back to it follows */
+#define LZ_MATCH_MIN 4
+#define LZ_MATCH_MAX (0x7f + LZ_MATCH_MIN)
+#define LZ_HASH_BITS 12
+#define LZ_BOUND(len) ((len) + (len) / 128 + 1)
+
 /* Variables */
+unsigned char snapshot_file[SNAPSHOT_SIZE];
+unsigned char snapshot_runahead[SNAPSHOT_SIZE];
+unsigned char state_file[STATE_FILE_SIZE];
+
+struct {
+	unsigned char *ring;	/* The deltas from oldest to newest */
+	int size;				/* The size of ring in bytes */
+	int head;				/* Where the next delta will be written */
+	int used;				/* The bytes within ring in use */
+	int count;				/* The deltas within ring */
+	unsigned char *latest;	/* The most recent snapshot */
+	int captured;			/* TRUE if latest holds a snapshot */
+	unsigned char *work;	/* Where the next snapshot is captured */
+	unsigned char *delta;	/* Where a delta is encoded/decoded */
+	int frames;				/* Frames emulated since latest was captured */
+	int steps;				/* Steps backwards requested but not yet taken */
+} rewind_history;
+
+struct {
+	int mode;				/* INPUT_LOG_NONE, INPUT_LOG_RECORD or INPUT_LOG_PLAY */
+	int started;			/* TRUE once the starting snapshot is taken/restored */
+	FILE *fp;				/* The recording being written */
+	unsigned char *data;	/* The recording being played back */
+	int length;				/* The size of data in bytes */
+	int pos;				/* The next change within data */
+	unsigned int frame;		/* Frames since the start */
+	unsigned char keyports[8];	/* What keyports[0] to [7] were last set to */
+	Uint32 ticks;			/* When playback started, for the benchmark */
+} input_log;
+
+struct {
+	unsigned char *state[QUICK_SLOTS];	/* Save state files built in memory */
+	int len[QUICK_SLOTS];
+	int dirty[QUICK_SLOTS];		/* TRUE if not yet written to disk */
+	char loaded[QUICK_SLOTS][256];	/* The program that each belongs to */
+	int slot;				/* The slot that a pending request is for */
+	int action;				/* QUICK_SLOT_CAPTURE, QUICK_SLOT_RESTORE or 0 */
+} quick_slots;
+
+struct {
+	unsigned char *state;	/* The post-boot save state file for the machine below */
+	int len;
+	int model, ramsize, m1not;
+	unsigned int crc;		/* Of the ROM */
+	int pending;			/* TRUE whilst waiting to capture a cold boot */
+	int frames;				/* Frames since the ROM first read the keyboard */
+} fast_boot;
+
+struct {
+	int kbscans;			/* sdl_emulator.kbscans at the last frame */
+} auto_warp;
+
+struct io_job {
+	int state;				/* See the IO_JOB_* defines */
+	char fullpath[256];
+	unsigned char *data;	/* The file's contents */
+	int len;
+	SDL_Surface *surface;	/* Or a surface to save as a bitmap */
+	char title[31];			/* The notification's title when done */
+};
+
+struct {
+	struct io_job jobs[IO_JOBS_MAX];	/* A queue from head to tail */
+	int head;				/* The next job to write (the writer's) */
+	int tail;				/* Where the next job goes (the submitter's) */
+	int quit;
+	int failed;				/* TRUE if the thread couldn't be created */
+	SDL_Thread *thread;
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+} io_writer;
 
 /* Function prototypes */
 char *strtoupper(char *original);
 char *strzx81_to_ascii(int memaddr);
 char *strzx80_to_ascii(int memaddr);
-void fwrite_unsigned_short_little_endian(unsigned short *source, FILE *fp);
-void fwrite_int_little_endian(int *source, FILE *fp);
-void fwrite_unsigned_long_little_endian(unsigned long *source, FILE *fp);
-void fread_unsigned_short_little_endian(unsigned short *target, FILE *fp);
-void fread_int_little_endian(int *target, FILE *fp);
-void fread_unsigned_long_little_endian(unsigned long *target, FILE *fp);
+int rewind_alloc(void);
+int rewind_delta_encode(unsigned char *newer, unsigned char *older,
+	unsigned char *delta, int size);
+void rewind_delta_apply(unsigned char *snapshot, unsigned char *delta, int len);
+int rewind_ring_write(int pos, unsigned char *source, int len);
+void rewind_ring_read(int pos, unsigned char *target, int len);
+void input_log_write_change(void);
+int state_file_ram_page(int page);
+int io_writer_thread(void *data);
+void quick_slot_path(int slot, char *program, char *fullpath);
+void fast_boot_path(char *fullpath);
+void auto_resume_path(char *fullpath);
+int io_job_write(struct io_job *job);
+void io_job_finish(struct io_job *job, int notify);
+void state_file_thumbnail_capture(unsigned char *thumb);
+int state_file_thumbnail(char *fullpath, unsigned char *thumb);
+unsigned int crc32_calc(unsigned char *buf, int len);
+int lz_compress(unsigned char *in, int len, unsigned char *out);
+unsigned char *lz_literals(unsigned char *out, unsigned char *in, int len);
+int lz_decompress(unsigned char *in, int len, unsigned char *out, int size);
 
 
 /***************************************************************************
@@ -69,7 +167,7 @@ void load_file_dialog_dirlist_populate(int refresh) {
  ***************************************************************************/
 /* This function will open the currently loaded program's save state folder
  * and create it if it's not found to exist. It will then scan it looking
- * for savsta1.ss{o|p} to savsta9.ss{o|p} */
+ * for savsta1.ss{o|p} to savsta9.ss{o|p}, reading their thumbnails */
 
 int save_state_dialog_slots_populate(void) {
 	struct dirent *direntry;
@@ -81,7 +179,7 @@ int save_state_dialog_slots_populate(void) {
 
 	/* Wipe the slots ready for fresh data */
 	for (count = 0; count < 9; count++)
-		save_state_dialog.slots[count] = 0;
+		save_state_dialog.slots[count] = save_state_dialog.thumbs[count] = 0;
 
 	/* Build a path to the currently loaded program's save state folder */
 	#if defined(PLATFORM_GP2X) || defined(__amigaos4__) || defined(_WIN32) || defined(PLATFORM_DINGUX_A320)
@@ -131,8 +229,14 @@ int save_state_dialog_slots_populate(void) {
 				sdl_filetype_casecmp(direntry->d_name, ".sso") == 0) ||
 				(*sdl_emulator.model == MODEL_ZX81 &&
 				sdl_filetype_casecmp(direntry->d_name, ".ssp") == 0))) {
-				save_state_dialog.slots[direntry->d_name
-					[strlen(direntry->d_name) - 5] - '1'] = TRUE;
+				index = direntry->d_name[strlen(direntry->d_name) - 5] - '1';
+				save_state_dialog.slots[index] = TRUE;
+				/* Files saved before thumbnails existed won't have one */
+				strcpy(parentname, foldername);
+				strcatdelimiter(parentname);
+				strcat(parentname, direntry->d_name);
+				save_state_dialog.thumbs[index] = !state_file_thumbnail(parentname,
+					save_state_dialog.thumbnails[index]);
 			}
 		}
 		closedir(dirstream);
@@ -162,6 +266,7 @@ int save_state_dialog_slots_populate(void) {
 int sdl_save_file(int parameter, int method) {
 	char fullpath[256], filename[256];
 	struct Notification notification;
+	unsigned char *ptr;
 	int retval = FALSE;
 	int index;
 	FILE *fp;
@@ -279,110 +384,44 @@ int sdl_save_file(int parameter, int method) {
 		strcat(fullpath, filename);
 	}
 
-	if (!retval) {
+	if (!retval && method == SAVE_FILE_METHOD_STATESAVE) {
+		/* The state is taken now but written in the background so that
+		 * slow storage doesn't hold up emulation. A copy is passed over
+		 * which io_writer will free */
+		index = state_file_build(state_file);
+		if ((ptr = malloc(index)) != NULL) {
+			memcpy(ptr, state_file, index);
+			/* A synchronous write reports its own failure */
+			if (io_writer_submit(fullpath, ptr, index, NULL, "Save State"))
+				retval = TRUE;
+		} else {
+			retval = TRUE;
+			strcpy(notification.title, "Save State");
+			strcpy(notification.text, "Failed");
+			notification.timeout = NOTIFICATION_TIMEOUT_1250;
+			notification_show(NOTIFICATION_SHOW, &notification);
+		}
+	} else if (!retval) {
 		/* Attempt to open the file */
+		TRACE_BEGIN("save", "io");
 		if ((fp = fopen(fullpath, "wb")) != NULL) {
-			if (method == SAVE_FILE_METHOD_STATESAVE) {
-				/* Printer variables are reinitialised when a new file
-				 * is opened on output so saving them is futile.
-				 * Saving keyports and sound variables is unneccessary.
-				 * signal_int_flag is being updated by the SDL timer
-				 * likely in another thread so no point in saving that.
-				 * refresh_screen I'm forcing to 1 anyway.
-				 * 
-				 * To make these files platform independent I'm saving
-				 * and restoring everything by the byte in little-endian
-				 * format. These are the integer sizes on my development
-				 * computer (GNU/Linux 32bit):
-				 * 
-				 * sizeof(long) = 4 bytes
-				 * sizeof(int) = 4 bytes
-				 * sizeof(short) = 2 bytes
-				 * sizeof(char) = 1 byte */
-
-				/* The entire contents of memory */
-				fwrite(mem, 1, 64 * 1024, fp);	/* unsigned char */
-
-				/* Variables from the top of z80.c */
-				fwrite_unsigned_long_little_endian(&tstates, fp);
-				fwrite_unsigned_long_little_endian(&frames, fp);
-				fwrite_int_little_endian(&liney, fp);
-				fwrite_int_little_endian(&vsy, fp);
-				fwrite_unsigned_long_little_endian(&linestart, fp);
-				fwrite_int_little_endian(&vsync_toggle, fp);
-				fwrite_int_little_endian(&vsync_lasttoggle, fp);
-
-				/* Variables liberated from the top of mainloop */
-				fwrite(&a, 1, 1, fp);	/* unsigned char */
-				fwrite(&f, 1, 1, fp);
-				fwrite(&b, 1, 1, fp); 
-				fwrite(&c, 1, 1, fp);
-				fwrite(&d, 1, 1, fp); 
-				fwrite(&e, 1, 1, fp);
-				fwrite(&h, 1, 1, fp); 
-				fwrite(&l, 1, 1, fp);
-				fwrite(&r, 1, 1, fp);
-				fwrite(&a1, 1, 1, fp); 
-				fwrite(&f1, 1, 1, fp);
-				fwrite(&b1, 1, 1, fp); 
-				fwrite(&c1, 1, 1, fp);
-				fwrite(&d1, 1, 1, fp); 
-				fwrite(&e1, 1, 1, fp);
-				fwrite(&h1, 1, 1, fp); 
-				fwrite(&l1, 1, 1, fp);
-				fwrite(&i, 1, 1, fp); 
-				fwrite(&iff1, 1, 1, fp); 
-				fwrite(&iff2, 1, 1, fp);
-				fwrite(&im, 1, 1, fp); 
-				fwrite_unsigned_short_little_endian(&pc, fp);
-				fwrite_unsigned_short_little_endian(&ix, fp);
-				fwrite_unsigned_short_little_endian(&iy, fp);
-				fwrite_unsigned_short_little_endian(&sp, fp);
-				fwrite(&radjust, 1, 1, fp);	/* unsigned char */
-				fwrite_unsigned_long_little_endian(&nextlinetime, fp);
-				fwrite_unsigned_long_little_endian(&linegap, fp);
-				fwrite_unsigned_long_little_endian(&lastvsyncpend, fp);
-				fwrite(&ixoriy, 1, 1, fp);	/* unsigned char */
-				fwrite(&new_ixoriy, 1, 1, fp);
-				fwrite(&intsample, 1, 1, fp);
-				fwrite(&op, 1, 1, fp);
-				fwrite_int_little_endian(&ulacharline, fp);
-				fwrite_int_little_endian(&nmipend, fp);
-				fwrite_int_little_endian(&intpend, fp);
-				fwrite_int_little_endian(&vsyncpend, fp);
-				fwrite_int_little_endian(&vsynclen, fp);
-				fwrite_int_little_endian(&hsyncskip, fp);
-				fwrite_int_little_endian(&framewait, fp);
-
-				/* Variables from the top of common.c */
-				fwrite_int_little_endian(&interrupted, fp);
-				fwrite_int_little_endian(&nmigen, fp);
-				fwrite_int_little_endian(&hsyncgen, fp);
-				fwrite_int_little_endian(&vsync, fp);
-
-				/* 65654/0x10076 bytes to here for 2.1.7 */
-
-			} else {
-				/* Write up to and including E_LINE */
-				if (*sdl_emulator.model == MODEL_ZX80) {
-					fwrite(mem + 0x4000, 1, (mem[0x400b] << 8 | mem[0x400a]) - 0x4000, fp);
-				} else if (*sdl_emulator.model == MODEL_ZX81) {
-					fwrite(mem + 0x4009, 1, (mem[0x4015] << 8 | mem[0x4014]) - 0x4009, fp);
-				}
-				/* Copy fullpath across to the load file dialog as
-				 * then we have a record of what was last saved */
-				strcpy(load_file_dialog.loaded, fullpath);
+			/* Write up to and including E_LINE */
+			if (*sdl_emulator.model == MODEL_ZX80) {
+				fwrite(mem + 0x4000, 1, (mem[0x400b] << 8 | mem[0x400a]) - 0x4000, fp);
+			} else if (*sdl_emulator.model == MODEL_ZX81) {
+				fwrite(mem + 0x4009, 1, (mem[0x4015] << 8 | mem[0x4014]) - 0x4009, fp);
 			}
+			/* Copy fullpath across to the load file dialog as
+			 * then we have a record of what was last saved */
+			strcpy(load_file_dialog.loaded, fullpath);
 			/* Close the file now as we've finished with it */
 			fclose(fp);
+			TRACE_END("save", "io");
 		} else {
+			TRACE_END("save", "io");
 			retval = TRUE;
 			/* Warn the user via the GUI that the save failed */
-			if (method == SAVE_FILE_METHOD_STATESAVE) {
-				strcpy(notification.title, "Save State");
-			} else {
-				strcpy(notification.title, "Save");
-			}
+			strcpy(notification.title, "Save");
 			strcpy(notification.text, "Failed");
 			notification.timeout = NOTIFICATION_TIMEOUT_1250;
 			notification_show(NOTIFICATION_SHOW, &notification);
@@ -418,7 +457,6 @@ int sdl_load_file(int parameter, int method) {
 	struct Notification notification;
 	int retval = FALSE;
 	int count, index;
-	int ramsize;
 	FILE *fp;
 
 	/* If requested, read and set the preset method instead */
@@ -547,189 +585,45 @@ int sdl_load_file(int parameter, int method) {
 				strcat(fullpath, filename);
 			}
 
+			/* A state may have only just been saved to this slot */
+			if (method == LOAD_FILE_METHOD_STATELOAD) io_writer_flush();
+
 			/* Attempt to open the file */
+			TRACE_BEGIN("load", "io");
 			if ((fp = fopen(fullpath, "rb")) != NULL) {
 				if (method == LOAD_FILE_METHOD_STATELOAD) {
-					/* Printer variables are reinitialised when a new file
-					 * is opened on output so saving them is futile.
-					 * Saving keyports and sound variables is unneccessary.
-					 * signal_int_flag is being updated by the SDL timer
-					 * likely in another thread so no point in saving that.
-					 * refresh_screen I'm forcing to 1 anyway.
-					 * 
-					 * To make these files platform independent I'm saving
-					 * and restoring everything by the byte in little-endian
-					 * format. These are the integer sizes on my development
-					 * computer (GNU/Linux 32bit):
-					 * 
-					 * sizeof(long) = 4 bytes
-					 * sizeof(int) = 4 bytes
-					 * sizeof(short) = 2 bytes
-					 * sizeof(char) = 1 byte */
-
-					/* The entire contents of memory */
-					fread(mem, 1, 64 * 1024, fp);	/* unsigned char */
-
-					/* Variables from the top of z80.c */
-					fread_unsigned_long_little_endian(&tstates, fp);
-					fread_unsigned_long_little_endian(&frames, fp);
-					fread_int_little_endian(&liney, fp);
-					fread_int_little_endian(&vsy, fp);
-					fread_unsigned_long_little_endian(&linestart, fp);
-					fread_int_little_endian(&vsync_toggle, fp);
-					fread_int_little_endian(&vsync_lasttoggle, fp);
-
-					/* Variables liberated from the top of mainloop */
-					fread(&a, 1, 1, fp);	/* unsigned char */
-					fread(&f, 1, 1, fp);
-					fread(&b, 1, 1, fp); 
-					fread(&c, 1, 1, fp);
-					fread(&d, 1, 1, fp); 
-					fread(&e, 1, 1, fp);
-					fread(&h, 1, 1, fp); 
-					fread(&l, 1, 1, fp);
-					fread(&r, 1, 1, fp);
-					fread(&a1, 1, 1, fp); 
-					fread(&f1, 1, 1, fp);
-					fread(&b1, 1, 1, fp); 
-					fread(&c1, 1, 1, fp);
-					fread(&d1, 1, 1, fp); 
-					fread(&e1, 1, 1, fp);
-					fread(&h1, 1, 1, fp); 
-					fread(&l1, 1, 1, fp);
-					fread(&i, 1, 1, fp); 
-					fread(&iff1, 1, 1, fp); 
-					fread(&iff2, 1, 1, fp);
-					fread(&im, 1, 1, fp); 
-					fread_unsigned_short_little_endian(&pc, fp);
-					fread_unsigned_short_little_endian(&ix, fp);
-					fread_unsigned_short_little_endian(&iy, fp);
-					fread_unsigned_short_little_endian(&sp, fp);
-					fread(&radjust, 1, 1, fp);	/* unsigned char */
-					fread_unsigned_long_little_endian(&nextlinetime, fp);
-					fread_unsigned_long_little_endian(&linegap, fp);
-					fread_unsigned_long_little_endian(&lastvsyncpend, fp);
-					fread(&ixoriy, 1, 1, fp);	/* unsigned char */
-					fread(&new_ixoriy, 1, 1, fp);
-					fread(&intsample, 1, 1, fp);
-					fread(&op, 1, 1, fp);
-					fread_int_little_endian(&ulacharline, fp);
-					fread_int_little_endian(&nmipend, fp);
-					fread_int_little_endian(&intpend, fp);
-					fread_int_little_endian(&vsyncpend, fp);
-					fread_int_little_endian(&vsynclen, fp);
-					fread_int_little_endian(&hsyncskip, fp);
-					fread_int_little_endian(&framewait, fp);
-
-					/* Variables from the top of common.c */
-					fread_int_little_endian(&interrupted, fp);
-					fread_int_little_endian(&nmigen, fp);
-					fread_int_little_endian(&hsyncgen, fp);
-					fread_int_little_endian(&vsync, fp);
-
-					/* 65654/0x10076 bytes to here for 2.1.7 */
-
-				} else {
-					if (method == LOAD_FILE_METHOD_AUTOLOAD || 
-						method == LOAD_FILE_METHOD_FORCEDLOAD) {
-						/* To duplicate these values: in mainloop in z80.c around
-						 * line 189, change #if 0 to #if 1 and recompile. Run
-						 * the emulator, load a suitably sized program by typing
-						 * LOAD or LOAD "something" and view the console output.
-						 * 
-						 * It's likely I've been a bit too thorough recording these
-						 * values because I know from looking at the ZX81 ROM that
-						 * DE points to the program name in memory which would get
-						 * overwritten on LOAD and make it redundant, and HL and A
-						 * are modified soon after anyway, but there's no harm done.
-						 * 
-						 * Note that the ZX81's RAMTOP won't be greater than 0x8000
-						 * unless POKEd by the user.
-						 */
-						if (*sdl_emulator.model == MODEL_ZX80) {
-							/* Registers (common values) */
-							a = 0x00; f = 0x44; b = 0x00; c = 0x00;
-							d = 0x07; e = 0xae; h = 0x40; l = 0x2a;
-							pc = 0x0283;
-							ix = 0x0000; iy = 0x4000; i = 0x0e; r = 0xdd;
-							a1 = 0x00; f1 = 0x00; b1 = 0x00; c1 = 0x21;
-							d1 = 0xd8; e1 = 0xf0; h1 = 0xd8; l1 = 0xf0;
-							iff1 = 0x00; iff2 = 0x00; im = 0x02;
-							radjust = 0x6a;
-							/* Machine Stack (common values) */
-							if (sdl_emulator.ramsize >= 16) {
-								sp = 0x8000 - 4;
-							} else {
-								sp = 0x4000 - 4 + sdl_emulator.ramsize * 1024;
-							}
-							mem[sp + 0] = 0x47;
-							mem[sp + 1] = 0x04;
-							mem[sp + 2] = 0xba;
-							mem[sp + 3] = 0x3f;
-							/* Now override if RAM configuration changes things
-							 * (there's a possibility these changes are unimportant) */
-							if (sdl_emulator.ramsize == 16) {
-								mem[sp + 2] = 0x22;
-							}
-						} else if (*sdl_emulator.model == MODEL_ZX81) {
-							/* Registers (common values) */
-							a = 0x0b; f = 0x00; b = 0x00; c = 0x02;
-							d = 0x40; e = 0x9b; h = 0x40; l = 0x99;
-							pc = 0x0207;
-							ix = 0x0281; iy = 0x4000; i = 0x1e; r = 0xdd;
-							a1 = 0xf8; f1 = 0xa9; b1 = 0x00; c1 = 0x00;
-							d1 = 0x00; e1 = 0x2b; h1 = 0x00; l1 = 0x00;
-							iff1 = 0; iff2 = 0; im = 2;
-							radjust = 0xa4;
-							/* GOSUB Stack (common values) */
-							if (sdl_emulator.ramsize >= 16) {
-								sp = 0x8000 - 4;
-							} else {
-								sp = 0x4000 - 4 + sdl_emulator.ramsize * 1024;
-							}
-							mem[sp + 0] = 0x76;
-							mem[sp + 1] = 0x06;
-							mem[sp + 2] = 0x00;
-							mem[sp + 3] = 0x3e;
-							/* Now override if RAM configuration changes things
-							 * (there's a possibility these changes are unimportant) */
-							if (sdl_emulator.ramsize >= 4) {
-								d = 0x43; h = 0x43;
-								a1 = 0xec; b1 = 0x81; c1 = 0x02;
-								radjust = 0xa9;
-							}
-							/* System variables */
-							mem[0x4000] = 0xff;				/* ERR_NR */
-							mem[0x4001] = 0x80;				/* FLAGS */
-							mem[0x4002] = sp & 0xff;		/* ERR_SP lo */
-							mem[0x4003] = sp >> 8;			/* ERR_SP hi */
-							mem[0x4004] = (sp + 4) & 0xff;	/* RAMTOP lo */
-							mem[0x4005] = (sp + 4) >> 8;	/* RAMTOP hi */
-							mem[0x4006] = 0x00;				/* MODE */
-							mem[0x4007] = 0xfe;				/* PPC lo */
-							mem[0x4008] = 0xff;				/* PPC hi */
-						}
-					}
-
-					/* Read in up to 48K of data */
-					if (sdl_emulator.ramsize > 48) {
-						ramsize = 48;
+					index = fread(state_file, 1, STATE_FILE_SIZE, fp);
+					if (index >= 4 && state_file[0] == (STATE_FILE_MAGIC & 0xff) &&
+						state_file[1] == (STATE_FILE_MAGIC >> 8 & 0xff) &&
+						state_file[2] == (STATE_FILE_MAGIC >> 16 & 0xff) &&
+						state_file[3] == (STATE_FILE_MAGIC >> 24 & 0xff)) {
+						if (state_file_parse(state_file, index)) retval = TRUE;
 					} else {
-						ramsize = sdl_emulator.ramsize;
-					}
-					if (*sdl_emulator.model == MODEL_ZX80) {
-						fread(mem + 0x4000, 1, ramsize * 1024, fp);
-					} else if (*sdl_emulator.model == MODEL_ZX81) {
-						fread(mem + 0x4009, 1, ramsize * 1024 - 9, fp);
+						/* Older files are a bare snapshot. Those saved by 2.1.7
+						 * end before the snapshot's version and will be zero
+						 * padded which snapshot_restore expects */
+						memset(snapshot_file, 0, SNAPSHOT_SIZE);
+						if (index > SNAPSHOT_SIZE) index = SNAPSHOT_SIZE;
+						memcpy(snapshot_file, state_file, index);
+						if (index < SNAPSHOT_SIZE_2_1_7 ||
+							snapshot_restore(snapshot_file)) retval = TRUE;
 					}
+				} else {
+					index = fread(state_file, 1, STATE_FILE_SIZE, fp);
+					program_load(state_file, index,
+						method == LOAD_FILE_METHOD_AUTOLOAD ||
+						method == LOAD_FILE_METHOD_FORCEDLOAD);
 					/* Copy fullpath across to the load file dialog as
 					 * then we have a record of what was last loaded */
 					strcpy(load_file_dialog.loaded, fullpath);
+					auto_warp_start();
 				}
 				/* Close the file now as we've finished with it */
 				fclose(fp);
+				TRACE_END("load", "io");
 				break;
 			} else {
+				TRACE_END("load", "io");
 				if (!(method == LOAD_FILE_METHOD_NAMEDLOAD && count == 0)) {
 					retval = TRUE;
 					break;
@@ -773,222 +667,1746 @@ int sdl_load_file(int parameter, int method) {
 }
 
 /***************************************************************************
- * Append Directory Delimiter to String                                    *
+ * State File Build                                                        *
  ***************************************************************************/
-/* This will append a directory delimiter to a string if one doesn't already
- * exist.
- * The point of this function is to make it easier to change the delimiter
- * character for other platforms. See also #define DIR_DELIMITER_CHAR.
+/* This builds a save state file in memory from a snapshot of the machine.
  * 
- * On entry: char *toappendto = the string to append to
- *  On exit: toappendto will have had a delimiter appended if required  */
-
-void strcatdelimiter(char *toappendto) {
-	static char delimiter[2] = {DIR_DELIMITER_CHAR, 0};
-
-	#if defined(__amigaos4__)
-		if (toappendto[strlen(toappendto) - 1] != DIR_DELIMITER_CHAR &&
-			toappendto[strlen(toappendto) - 1] != ':')
-			strcat(toappendto, delimiter);
-	#else
-		if (toappendto[strlen(toappendto) - 1] != DIR_DELIMITER_CHAR)
-			strcat(toappendto, delimiter);
-	#endif
+ * Only the RAM that the configured machine actually has is stored, and
+ * that is compressed. The ROM is left out and recorded as a CRC instead
+ * so that a state isn't restored onto a different ROM. The rest of the
+ * snapshot is stored as is since it's small and already versioned.
+ * 
+ * On entry: unsigned char *buf points to at least STATE_FILE_SIZE bytes
+ *  On exit: returns the number of bytes used */
+
+int state_file_build(unsigned char *buf) {
+	static unsigned char ram[64 * 1024];
+	unsigned char *ptr = buf, *lenptr;
+	unsigned int crc, pagemask[2] = {0, 0}, unpacked = 0;
+	int id, len, page, value;
+
+	snapshot_capture(snapshot_file);
+
+	value = STATE_FILE_MAGIC;
+	memwrite_int_little_endian(&value, &ptr);
+	value = STATE_FILE_VERSION;
+	memwrite_int_little_endian(&value, &ptr);
+
+	/* The thumbnail */
+	id = STATE_CHUNK_THUMBNAIL; len = 4 + 4 + SSTATE_THUMB_SIZE;
+	memwrite_int_little_endian(&id, &ptr);
+	memwrite_int_little_endian(&len, &ptr);
+	value = SSTATE_THUMB_W;
+	memwrite_int_little_endian(&value, &ptr);
+	value = SSTATE_THUMB_H;
+	memwrite_int_little_endian(&value, &ptr);
+	state_file_thumbnail_capture(ptr); ptr += SSTATE_THUMB_SIZE;
+
+	/* The configuration that the state depends upon */
+	id = STATE_CHUNK_CONFIG; len = 4 * 4;
+	crc = crc32_calc(mem, *sdl_emulator.model == MODEL_ZX80 ? 4096 : 8192);
+	memwrite_int_little_endian(&id, &ptr);
+	memwrite_int_little_endian(&len, &ptr);
+	memwrite_int_little_endian(sdl_emulator.model, &ptr);
+	memwrite_int_little_endian(&sdl_emulator.ramsize, &ptr);
+	memwrite_int_little_endian(&sdl_emulator.m1not, &ptr);
+	memwrite_unsigned_int_little_endian(&crc, &ptr);
+
+	/* The populated 1K pages of RAM, compressed */
+	for (page = 0; page < 64; page++) {
+		if (state_file_ram_page(page)) {
+			pagemask[page / 32] |= 1U << (page % 32);
+			memcpy(ram + unpacked, snapshot_file + page * 1024, 1024);
+			unpacked += 1024;
+		}
+	}
+	id = STATE_CHUNK_RAM;
+	memwrite_int_little_endian(&id, &ptr);
+	lenptr = ptr; ptr += 4;
+	memwrite_unsigned_int_little_endian(&pagemask[0], &ptr);
+	memwrite_unsigned_int_little_endian(&pagemask[1], &ptr);
+	memwrite_unsigned_int_little_endian(&unpacked, &ptr);
+	len = lz_compress(ram, unpacked, ptr);
+	ptr += len;
+	len += 3 * 4;
+	memwrite_int_little_endian(&len, &lenptr);
+
+	/* Everything else */
+	id = STATE_CHUNK_MACHINE; len = SNAPSHOT_SIZE - 64 * 1024;
+	memwrite_int_little_endian(&id, &ptr);
+	memwrite_int_little_endian(&len, &ptr);
+	memcpy(ptr, snapshot_file + 64 * 1024, len); ptr += len;
+
+	/* The program that was last loaded/saved */
+	id = STATE_CHUNK_PROGRAM; len = strlen(load_file_dialog.loaded) + 1;
+	memwrite_int_little_endian(&id, &ptr);
+	memwrite_int_little_endian(&len, &ptr);
+	memcpy(ptr, load_file_dialog.loaded, len); ptr += len;
+
+	id = STATE_CHUNK_END; len = 0;
+	memwrite_int_little_endian(&id, &ptr);
+	memwrite_int_little_endian(&len, &ptr);
+
+	return ptr - buf;
 }
 
 /***************************************************************************
- * File Dialog Basename                                                    *
+ * State File Parse                                                        *
  ***************************************************************************/
-/* This will return the basename of a path e.g. "/moo/bah" returns "bah".
- * The paths being passed are coming from getcwd or something other than
- * user written so it is not expecting a trailing directory delimiter.
- * getcwd for example will not add a trailing delimiter unless the path
- * is at the root, therefore that's how it will be interpreted here.
+/* This restores the machine from a save state file built by
+ * state_file_build. Nothing is restored unless every chunk is present,
+ * intact and compatible with the configured machine.
  * 
- * On entry: char *dir = the path to extract the basename from
- *  On exit: returns a pointer to a string containing the extracted basename */
-
-char *file_dialog_basename(char *dir) {
-	static char basename[256];
-	int index;
+ * On entry: unsigned char *buf points to the file's contents
+ *           int len is the length of the file
+ *  On exit: returns TRUE on error
+ *           else FALSE */
 
-	strcpy(basename, dir);	/* We'll work with a copy */
+int state_file_parse(unsigned char *buf, int len) {
+	static unsigned char ram[64 * 1024];
+	unsigned char *ptr = buf, *end = buf + len, *chunk, *program = NULL;
+	unsigned int crc, pagemask[2], unpacked;
+	int id, size, model, ramsize, m1not = 0, page, value;
+	int found = 0;
+
+	if (len < 8) return TRUE;
+	memread_int_little_endian(&value, &ptr);
+	if (value != STATE_FILE_MAGIC) return TRUE;
+	memread_int_little_endian(&value, &ptr);
+	if (value > STATE_FILE_VERSION) {
+		fprintf(stderr, "%s: Save state version %i is unsupported\n", __func__,
+			value);
+		return TRUE;
+	}
 
-	if ((index = strlen(dir))) {
-		/* Move leftwards up to a delimiter, root or nothing */
-		while (index >= 1 && 
-			basename[index - 1] != DIR_DELIMITER_CHAR
-		#if defined(__amigaos4__)
-			&& basename[index - 1] != ':'
-		#endif
-			) index--;
+	/* The ROM and anything that isn't populated RAM aren't stored */
+	memcpy(snapshot_file, mem, 64 * 1024);
+	memset(snapshot_file + 64 * 1024, 0, SNAPSHOT_SIZE - 64 * 1024);
+
+	while (end - ptr >= 8) {
+		memread_int_little_endian(&id, &ptr);
+		memread_int_little_endian(&size, &ptr);
+		if (size < 0 || size > end - ptr) break;
+		chunk = ptr;
+		ptr += size;
+		if (id == STATE_CHUNK_CONFIG && size >= 4 * 4) {
+			memread_int_little_endian(&model, &chunk);
+			memread_int_little_endian(&ramsize, &chunk);
+			memread_int_little_endian(&m1not, &chunk);
+			memread_unsigned_int_little_endian(&crc, &chunk);
+			if (model != *sdl_emulator.model || ramsize != sdl_emulator.ramsize) {
+				fprintf(stderr, "%s: The state is for a %s with %iK RAM\n",
+					__func__, model == MODEL_ZX80 ? "ZX80" : "ZX81", ramsize);
+				return TRUE;
+			}
+			if (crc != crc32_calc(mem, model == MODEL_ZX80 ? 4096 : 8192)) {
+				fprintf(stderr, "%s: The state is for a different ROM\n", __func__);
+				return TRUE;
+			}
+			found |= 1;
+		} else if (id == STATE_CHUNK_RAM && size >= 3 * 4) {
+			memread_unsigned_int_little_endian(&pagemask[0], &chunk);
+			memread_unsigned_int_little_endian(&pagemask[1], &chunk);
+			memread_unsigned_int_little_endian(&unpacked, &chunk);
+			if (unpacked > sizeof(ram) || lz_decompress(chunk, size - 3 * 4,
+				ram, sizeof(ram)) != (int)unpacked) break;
+			for (page = 0, value = 0; page < 64; page++) {
+				if (pagemask[page / 32] & (1U << (page % 32))) {
+					if (value + 1024 > (int)unpacked) break;
+					memcpy(snapshot_file + page * 1024, ram + value, 1024);
+					value += 1024;
+				}
+			}
+			if (page < 64) break;
+			found |= 2;
+		} else if (id == STATE_CHUNK_MACHINE) {
+			if (size < SNAPSHOT_SIZE_2_1_7 - 64 * 1024 ||
+				size > SNAPSHOT_SIZE - 64 * 1024) break;
+			memcpy(snapshot_file + 64 * 1024, chunk, size);
+			found |= 4;
+		} else if (id == STATE_CHUNK_PROGRAM) {
+			if (size < 1 || size > 256 || chunk[size - 1]) break;
+			program = chunk;
+		} else if (id == STATE_CHUNK_END) {
+			break;
+		}
+	}
 
-		/* Do we need to return root? */
-		if (index >= 1 && basename[index] == 0 &&
-		#if defined(__amigaos4__)
-			basename[index - 1] == ':'
-		#else
-			basename[index - 1] == DIR_DELIMITER_CHAR
-		#endif
-			) index--;
+	if (found != (1 | 2 | 4)) {
+		fprintf(stderr, "%s: The state is incomplete or corrupt\n", __func__);
+		return TRUE;
 	}
+	if (snapshot_restore(snapshot_file)) return TRUE;
+	sdl_emulator.m1not = m1not;
+	/* Older states don't record it so leave it alone */
+	if (program) strcpy(load_file_dialog.loaded, (char *)program);
 
-	return basename + index;
+	return FALSE;
 }
 
 /***************************************************************************
- * File Dialog Change Directory                                            *
+ * State File RAM Page                                                     *
  ***************************************************************************/
-/* This function will update a target directory string with another source
- * string which could be a relative subdirectory or parent directory "..".
- * The source directory can be wrapped within brackets which will be removed
- * if found e.g. "(sz81)", "sz81", "(..)", "..".
+/* A page is populated if it's writable and not a mirror of another page.
  * 
- * This function is not expecting dir to have a trailing directory delimiter
- * unless it represents *nix root. C functions don't add these and neither
- * do sz81 functions so I'm choosing not to handle them.
+ * On entry: int page = a 1K page from 0 to 63
+ *  On exit: returns TRUE if the page is populated RAM
+ *           else FALSE */
+
+int state_file_ram_page(int page) {
+
+	return memattr[page] && memptr[page] == mem + page * 1024;
+}
+
+/***************************************************************************
+ * State File Thumbnail Capture                                            *
+ ***************************************************************************/
+/* This reduces the 256x192 display to SSTATE_THUMB_W x SSTATE_THUMB_H by
+ * setting a pixel wherever an 8x8 cell is reasonably well inked, which is
+ * enough to recognise the layout of a screen at a glance */
+
+void state_file_thumbnail_capture(unsigned char *thumb) {
+	unsigned char *ptr, bits;
+	int x, y, row, inked;
+
+	memset(thumb, 0, SSTATE_THUMB_SIZE);
+	for (y = 0; y < SSTATE_THUMB_H; y++) {
+		for (x = 0; x < SSTATE_THUMB_W; x++) {
+			ptr = scrnbmp + (ZX_VID_MARGIN + y * 8) * ZX_VID_FULLWIDTH / 8 +
+				(ZX_VID_HMARGIN - FUDGE_FACTOR) / 8 + x;
+			for (row = inked = 0; row < 8; row++) {
+				for (bits = *ptr; bits; bits &= bits - 1) inked++;
+				ptr += ZX_VID_FULLWIDTH / 8;
+			}
+			if (inked >= 12) thumb[y * SSTATE_THUMB_W / 8 + x / 8] |= 0x80 >> (x % 8);
+		}
+	}
+}
+
+/***************************************************************************
+ * State File Thumbnail                                                    *
+ ***************************************************************************/
+/* This reads just the thumbnail from the start of a save state file.
  * 
- * On entry: char *dir = the directory string to update
- *           char *direntry = the relative directory to change to
- *  On exit: char *dir will be updated */
+ * On entry: char *fullpath = the save state file
+ *           unsigned char *thumb points to SSTATE_THUMB_SIZE bytes
+ *  On exit: returns TRUE on error (e.g. a file saved by 2.1.7)
+ *           else FALSE */
 
-void file_dialog_cd(char *dir, char *direntry) {
-	char foldername[256];
-	int index;
+int state_file_thumbnail(char *fullpath, unsigned char *thumb) {
+	unsigned char header[4 * 6], *ptr = header;
+	int magic, version, id, len, width, height;
+	FILE *fp;
 
-	/* Copy the direntry and strip the surrounding brackets if found */
-	if (*direntry == '(') {
-		strcpy(foldername, direntry + 1);
-		foldername[strlen(foldername) - 1] = 0;
-	} else {
-		strcpy(foldername, direntry);
+	if ((fp = fopen(fullpath, "rb")) == NULL) return TRUE;
+	if (fread(header, 1, sizeof(header), fp) < sizeof(header)) {
+		fclose(fp);
+		return TRUE;
+	}
+	memread_int_little_endian(&magic, &ptr);
+	memread_int_little_endian(&version, &ptr);
+	memread_int_little_endian(&id, &ptr);
+	memread_int_little_endian(&len, &ptr);
+	memread_int_little_endian(&width, &ptr);
+	memread_int_little_endian(&height, &ptr);
+	if (magic != STATE_FILE_MAGIC || version > STATE_FILE_VERSION ||
+		id != STATE_CHUNK_THUMBNAIL || width != SSTATE_THUMB_W ||
+		height != SSTATE_THUMB_H ||
+		fread(thumb, 1, SSTATE_THUMB_SIZE, fp) < SSTATE_THUMB_SIZE) {
+		fclose(fp);
+		return TRUE;
 	}
+	fclose(fp);
 
-	/* Is this the parent directory? */
-	if (strcmp(foldername, "..") == 0) {
-		/* Go back to the parent directory */
-		if ((index = strlen(dir))) {
-			/* Truncate leftwards up to a delimiter, root or nothing */
-			while (index >= 1 && 
-				dir[index - 1] != DIR_DELIMITER_CHAR
-			#if defined(__amigaos4__) || defined(_WIN32)
-				&& dir[index - 1] != ':'
-			#endif
-				) dir[--index] = 0;
+	return FALSE;
+}
 
-			/* Do we need to cut the directory delimiter? */
-			if (index >= 2 && 
-				dir[index - 1] == DIR_DELIMITER_CHAR
-			#if defined(_WIN32)
-				&& dir[index - 2] != ':'
-			#endif
-				) dir[--index] = 0;
+/***************************************************************************
+ * CRC32 Calculate                                                         *
+ ***************************************************************************/
+/* The usual reflected CRC-32 (as used by zip and png) */
+
+unsigned int crc32_calc(unsigned char *buf, int len) {
+	static unsigned int table[256];
+	static int initialised = FALSE;
+	unsigned int crc;
+	int count, bit;
+
+	if (!initialised) {
+		for (count = 0; count < 256; count++) {
+			crc = count;
+			for (bit = 0; bit < 8; bit++)
+				crc = (crc & 1) ? 0xedb88320 ^ (crc >> 1) : crc >> 1;
+			table[count] = crc;
 		}
-	} else {
-		/* It's a subdirectory */
-		/* Add a directory delimiter if required */
-		strcatdelimiter(dir);
-		strcat(dir, foldername);
+		initialised = TRUE;
 	}
+
+	crc = 0xffffffff;
+	for (count = 0; count < len; count++)
+		crc = table[(crc ^ buf[count]) & 0xff] ^ (crc >> 8);
+
+	return crc ^ 0xffffffff;
 }
 
 /***************************************************************************
- * Directory List Populate                                                 *
+ * LZ Compress                                                             *
  ***************************************************************************/
-/* This function will record the current directory, change to the requested
- * directory, create a sorted list of its contents and then change back to
- * the original directory.
- * 
- * Directory names are wrapped within brackets and a parent directory
- * "(..)" is forced to always be present (dirlist will never return NULL).
- * 
- * dirlist will return a pointer to the dynamically allocated memory
- * containing the list and should be freed before program exit.
- * When calling this function, any existing list created from a previous
- * call will be freed automatically so the caller need not do this.
+/* This finds matches by hashing the next three bytes at each position into
+ * a table of where they were last seen. It's single pass and greedy which
+ * is plenty for ZX RAM, most of which is repetitive or zero.
  * 
- * On entry: char *dir = a string containing the directory to list
- *           int filetypes = an OR'd combination of file types to list
- *  On exit: char **dirlist will point to the dynamically allocated
- *               directory list
- *           int *dirlist_sizeof will contain the size of each item
- *           int *dirlist_count will contain the number of items found */
+ * On entry: unsigned char *out points to at least LZ_BOUND(len) bytes
+ *  On exit: returns the number of bytes written to out */
+
+int lz_compress(unsigned char *in, int len, unsigned char *out) {
+	static int table[1 << LZ_HASH_BITS];
+	unsigned char *ptr = out;
+	int pos = 0, anchor = 0, ref, match, hash;
+
+	for (hash = 0; hash < 1 << LZ_HASH_BITS; hash++) table[hash] = -1;
+
+	while (pos + LZ_MATCH_MIN <= len) {
+		hash = ((unsigned int)(in[pos] << 16 | in[pos + 1] << 8 | in[pos + 2]) *
+			2654435761U & 0xffffffff) >> (32 - LZ_HASH_BITS);
+		ref = table[hash];
+		table[hash] = pos;
+		if (ref >= 0 && pos - ref <= 0xffff &&
+			memcmp(in + ref, in + pos, LZ_MATCH_MIN) == 0) {
+			match = LZ_MATCH_MIN;
+			while (match < LZ_MATCH_MAX && pos + match < len &&
+				in[ref + match] == in[pos + match]) match++;
+			ptr = lz_literals(ptr, in + anchor, pos - anchor);
+			*ptr++ = 0x80 | (match - LZ_MATCH_MIN);
+			*ptr++ = (pos - ref) & 0xff;
+			*ptr++ = (pos - ref) >> 8;
+			pos += match;
+			anchor = pos;
+		} else {
+			pos++;
+		}
+	}
+	ptr = lz_literals(ptr, in + anchor, len - anchor);
 
-void dirlist_populate(char *dir, char **dirlist, int *dirlist_sizeof,
-	int *dirlist_count, int filetypes) {
-	char cwd[256], swap[256], *realloclist;
-	int parentfound = FALSE, offset = 0;
-	int count, found, swapped;
-	struct dirent *direntry;
-	struct stat filestatus;
-	DIR *dirstream;
+	return ptr - out;
+}
 
-	/* [Re]initialise the list */
-	if (*dirlist) {
-		free(*dirlist); *dirlist = NULL;
+/***************************************************************************
+ * LZ Literals                                                             *
+ ***************************************************************************/
+
+unsigned char *lz_literals(unsigned char *out, unsigned char *in, int len) {
+	int run;
+
+	while (len > 0) {
+		run = len > 0x80 ? 0x80 : len;
+		*out++ = run - 1;
+		memcpy(out, in, run);
+		out += run; in += run; len -= run;
 	}
-	*dirlist_sizeof = 0; *dirlist_count = 0;
 
-	/* Record the current working directory before changing it to dir
-	 * (I've found that stat doesn't work unless the dir is changed) */
-	strcpy(cwd, ""); getcwd(cwd, 256); cwd[255] = 0; chdir(dir);
+	return out;
+}
 
-	/* NOTE TO PORTERS: eventually you'll hit root ('/' on *nix, ':' on
-	 * __amigaos4__, '\' on _WIN32 and as I'm developing this on Linux I
-	 * can't populate the list with drive specifiers etc., so possibly
-	 * you could have a virtual area above root that you fill yourself,
-	 * or you could populate the root list with "(c:)", "(d:)" etc. and
-	 * when the user selects one, you could change to that drive and set
-	 * dir equal to root. Other functions you should take a look at are
-	 * file_dialog_cd, the code within sdl_input.c:2555 that extracts the
-	 * directory from the list to change to and file_dialog_basename. And
-	 * DIR_DELIMITER_CHAR and strcatdelimiter are useful. That's it :) */
+/***************************************************************************
+ * LZ Decompress                                                           *
+ ***************************************************************************/
+/* On entry: int size = the size of out
+ *  On exit: returns the number of bytes written to out
+ *           or -1 if in is corrupt */
+
+int lz_decompress(unsigned char *in, int len, unsigned char *out, int size) {
+	unsigned char *end = in + len;
+	int pos = 0, run, offset;
+
+	while (in < end) {
+		if (*in < 0x80) {
+			run = *in++ + 1;
+			if (run > end - in || pos + run > size) return -1;
+			memcpy(out + pos, in, run);
+			in += run; pos += run;
+		} else {
+			run = (*in++ & 0x7f) + LZ_MATCH_MIN;
+			if (end - in < 2) return -1;
+			offset = in[0] | in[1] << 8;
+			in += 2;
+			if (offset == 0 || offset > pos || pos + run > size) return -1;
+			/* Byte by byte as a match can overlap itself */
+			for (; run > 0; run--, pos++) out[pos] = out[pos - offset];
+		}
+	}
 
-	if ((dirstream = opendir(dir))) {
+	return pos;
+}
 
-		while ((direntry = readdir(dirstream))) {
+/***************************************************************************
+ * Rewind Reset                                                            *
+ ***************************************************************************/
+/* This discards the rewind history and is called whenever the machine is
+ * reinitialised. If the user has changed the size of the history then the
+ * memory is freed here and reallocated when next required */
 
-			/* Store the size of the list element once */
-			if (*dirlist_sizeof == 0)
-				*dirlist_sizeof = sizeof(direntry->d_name) + 2;
+void rewind_reset(void) {
 
-			/* Get directory entry status information */
-			if (stat(direntry->d_name, &filestatus)) {
-				fprintf(stderr, "%s: Cannot stat %s\n", __func__, direntry->d_name);
-			} else {
+	if (rewind_history.ring && rewind_history.size != sdl_rewind.memory * 1024)
+		rewind_end();
 
-				found = FALSE;
+	rewind_history.head = rewind_history.used = rewind_history.count = 0;
+	rewind_history.captured = FALSE;
+	rewind_history.frames = rewind_history.steps = 0;
+}
 
-				if (strcmp(direntry->d_name, "..") == 0) {
-					found = TRUE;
-				} else if (strcmp(direntry->d_name, ".") == 0) {
-					/* Discard */
-				} else if (!(filetypes & DIRLIST_FILETYPE_HIDDEN) &&
-					direntry->d_name[0] == '.') {
-					/* Discard */
-				} else if (S_ISDIR(filestatus.st_mode)) {
-					found = TRUE;
-				} else if (filetypes & DIRLIST_FILETYPE_ZX80 &&
-					sdl_filetype_casecmp(direntry->d_name, ".o") == 0) {
-					found = TRUE;
-				} else if (filetypes & DIRLIST_FILETYPE_ZX80 &&
-					sdl_filetype_casecmp(direntry->d_name, ".80") == 0) {
-					found = TRUE;
-				} else if (filetypes & DIRLIST_FILETYPE_ZX81 &&
-					sdl_filetype_casecmp(direntry->d_name, ".p") == 0) {
-					found = TRUE;
-				} else if (filetypes & DIRLIST_FILETYPE_ZX81 &&
-					sdl_filetype_casecmp(direntry->d_name, ".81") == 0) {
-					found = TRUE;
-				} else if (filetypes & DIRLIST_FILETYPE_TXT &&
-					sdl_filetype_casecmp(direntry->d_name, ".txt") == 0) {
-					found = TRUE;
+/***************************************************************************
+ * Rewind Frame                                                            *
+ ***************************************************************************/
+/* This is called once per frame from mainloop between instructions. It
+ * takes any steps backwards that the user has requested and otherwise
+ * captures a snapshot every sdl_rewind.interval frames.
+ * 
+ * Only the most recent snapshot is kept whole. Each time a new one is
+ * captured, what it would take to turn it back into the previous one is
+ * stored in a ring as an XOR delta that is run-length encoded (frame to
+ * frame most of memory is unchanged so most of it is zero). When the ring
+ * is full the oldest deltas are forgotten, so memory use never exceeds
+ * sdl_rewind.memory KB */
+
+void rewind_frame(void) {
+	struct Notification notification;
+	unsigned char lenbytes[4], *ptr;
+	int len, start, restore = FALSE;
+
+	/* Frames being run ahead are never part of the history */
+	if (!sdl_rewind.state || sdl_emulator.speculating) return;
+
+	/* Take any steps backwards requested via rewind_step */
+	if (rewind_history.steps) {
+		while (rewind_history.steps > 0 && rewind_history.captured) {
+			rewind_history.steps--;
+			/* If we've moved on since the latest snapshot then the first
+			 * step is back to it, otherwise it's to the one before */
+			if (rewind_history.frames == 0) {
+				if (rewind_history.count == 0) {
+					strcpy(notification.title, "Rewind");
+					strcpy(notification.text, "No history");
+					notification.timeout = NOTIFICATION_TIMEOUT_750;
+					notification_show(NOTIFICATION_SHOW, &notification);
+					break;
 				}
+				/* Pop the newest delta */
+				rewind_ring_read((rewind_history.head - 4 + rewind_history.size) %
+					rewind_history.size, lenbytes, 4);
+				ptr = lenbytes;
+				memread_int_little_endian(&len, &ptr);
+				start = (rewind_history.head - len - 8 + rewind_history.size) %
+					rewind_history.size;
+				rewind_ring_read((start + 4) % rewind_history.size,
+					rewind_history.delta, len);
+				rewind_delta_apply(rewind_history.latest, rewind_history.delta, len);
+				rewind_history.head = start;
+				rewind_history.used -= len + 8;
+				rewind_history.count--;
+			}
+			rewind_history.frames = 0;
+			restore = TRUE;
+		}
+		rewind_history.steps = 0;
+		if (restore) snapshot_restore(rewind_history.latest);
+		return;
+	}
 
-				if (found) {
+	if (++rewind_history.frames < sdl_rewind.interval &&
+		rewind_history.captured) return;
+	rewind_history.frames = 0;
 
-					/* Record that the parent directory was found because it's
-					 * not always the case that it is (the Zaurus for example) */
+	if (!rewind_history.ring && rewind_alloc()) {
+		sdl_rewind.state = FALSE;
+		return;
+	}
+
+	snapshot_capture(rewind_history.work);
+
+	if (rewind_history.captured) {
+		len = rewind_delta_encode(rewind_history.work, rewind_history.latest,
+			rewind_history.delta, SNAPSHOT_SIZE);
+
+		/* Forget the oldest deltas until there's room for this one */
+		while (rewind_history.used + len + 8 > rewind_history.size) {
+			rewind_ring_read((rewind_history.head - rewind_history.used +
+				rewind_history.size) % rewind_history.size, lenbytes, 4);
+			ptr = lenbytes;
+			memread_int_little_endian(&start, &ptr);
+			rewind_history.used -= start + 8;
+			rewind_history.count--;
+		}
+
+		/* The length goes either side of the delta so that the ring
+		 * can be walked from either end */
+		ptr = lenbytes;
+		memwrite_int_little_endian(&len, &ptr);
+		rewind_history.head = rewind_ring_write(rewind_history.head, lenbytes, 4);
+		rewind_history.head = rewind_ring_write(rewind_history.head,
+			rewind_history.delta, len);
+		rewind_history.head = rewind_ring_write(rewind_history.head, lenbytes, 4);
+		rewind_history.used += len + 8;
+		rewind_history.count++;
+	}
+
+	/* The new snapshot becomes the latest */
+	ptr = rewind_history.latest;
+	rewind_history.latest = rewind_history.work;
+	rewind_history.work = ptr;
+	rewind_history.captured = TRUE;
+}
+
+/***************************************************************************
+ * Rewind Step                                                             *
+ ***************************************************************************/
+/* This requests a step backwards through the rewind history. It's taken at
+ * the end of the current frame by rewind_frame */
+
+void rewind_step(void) {
+
+	/* Going backwards would desynchronise an input recording */
+	if (sdl_rewind.state && input_log.mode == INPUT_LOG_NONE)
+		rewind_history.steps++;
+}
+
+/***************************************************************************
+ * Rewind End                                                              *
+ ***************************************************************************/
+
+void rewind_end(void) {
+
+	if (rewind_history.ring) free(rewind_history.ring);
+	if (rewind_history.latest) free(rewind_history.latest);
+	if (rewind_history.work) free(rewind_history.work);
+	if (rewind_history.delta) free(rewind_history.delta);
+	rewind_history.ring = rewind_history.latest = NULL;
+	rewind_history.work = rewind_history.delta = NULL;
+	rewind_history.size = 0;
+	rewind_history.captured = FALSE;
+}
+
+/***************************************************************************
+ * Rewind Allocate                                                         *
+ ***************************************************************************/
+/* On exit: returns TRUE on error
+ *          else FALSE */
+
+int rewind_alloc(void) {
+
+	rewind_history.size = sdl_rewind.memory * 1024;
+	rewind_history.ring = malloc(rewind_history.size);
+	rewind_history.latest = malloc(SNAPSHOT_SIZE);
+	rewind_history.work = malloc(SNAPSHOT_SIZE);
+	rewind_history.delta = malloc(SNAPSHOT_SIZE + REWIND_DELTA_SLACK);
+	if (!rewind_history.ring || !rewind_history.latest ||
+		!rewind_history.work || !rewind_history.delta) {
+		fprintf(stderr, "%s: Cannot allocate %iKB for the rewind history\n",
+			__func__, sdl_rewind.memory);
+		rewind_end();
+		return TRUE;
+	}
+	rewind_reset();
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Rewind Delta Encode                                                     *
+ ***************************************************************************/
+/* This encodes newer XOR older as pairs of 16 bit little-endian counts:
+ * the bytes that are unchanged (zero) and then the bytes that follow that
+ * have changed, which are stored. A run of changes only ends at 4 or more
+ * unchanged bytes so the counts never cost more than they save, and the
+ * result is at most REWIND_DELTA_SLACK bytes bigger than size.
+ * 
+ * On entry: delta points to at least size + REWIND_DELTA_SLACK bytes
+ *  On exit: returns the length of the encoded delta */
+
+int rewind_delta_encode(unsigned char *newer, unsigned char *older,
+	unsigned char *delta, int size) {
+	int index = 0, len = 0;
+	int unchanged, changed;
+
+	while (index < size) {
+		/* Count the unchanged bytes (a block at a time where possible) */
+		unchanged = 0;
+		while (index < size && unchanged < 0xffff && 
+			newer[index] == older[index]) {
+			if (index + 32 <= size && unchanged <= 0xffff - 32 &&
+				memcmp(newer + index, older + index, 32) == 0) {
+				index += 32; unchanged += 32;
+			} else {
+				index++; unchanged++;
+			}
+		}
+		/* Store the changed bytes */
+		changed = 0;
+		while (index < size && changed < 0xffff) {
+			if (newer[index] == older[index] && (index + 4 > size ||
+				(newer[index + 1] == older[index + 1] &&
+				newer[index + 2] == older[index + 2] &&
+				newer[index + 3] == older[index + 3]))) break;
+			delta[len + 4 + changed++] = newer[index] ^ older[index];
+			index++;
+		}
+		delta[len++] = unchanged & 0xff;
+		delta[len++] = unchanged >> 8;
+		delta[len++] = changed & 0xff;
+		delta[len++] = changed >> 8;
+		len += changed;
+	}
+
+	return len;
+}
+
+/***************************************************************************
+ * Rewind Delta Apply                                                      *
+ ***************************************************************************/
+/* This XORs a delta encoded by rewind_delta_encode into a snapshot which
+ * turns newer into older */
+
+void rewind_delta_apply(unsigned char *snapshot, unsigned char *delta, int len) {
+	unsigned char *end = delta + len;
+	int changed;
+
+	while (delta < end) {
+		snapshot += delta[0] | delta[1] << 8;
+		changed = delta[2] | delta[3] << 8;
+		delta += 4;
+		while (changed--) *snapshot++ ^= *delta++;
+	}
+}
+
+/***************************************************************************
+ * Rewind Ring Write                                                       *
+ ***************************************************************************/
+/* On exit: returns the position following what was written */
+
+int rewind_ring_write(int pos, unsigned char *source, int len) {
+	int part = rewind_history.size - pos;
+
+	if (len <= part) {
+		memcpy(rewind_history.ring + pos, source, len);
+	} else {
+		memcpy(rewind_history.ring + pos, source, part);
+		memcpy(rewind_history.ring, source + part, len - part);
+	}
+
+	return (pos + len) % rewind_history.size;
+}
+
+/***************************************************************************
+ * Rewind Ring Read                                                        *
+ ***************************************************************************/
+
+void rewind_ring_read(int pos, unsigned char *target, int len) {
+	int part = rewind_history.size - pos;
+
+	if (len <= part) {
+		memcpy(target, rewind_history.ring + pos, len);
+	} else {
+		memcpy(target, rewind_history.ring + pos, part);
+		memcpy(target + part, rewind_history.ring, len - part);
+	}
+}
+
+/***************************************************************************
+ * Run Ahead Frame                                                         *
+ ***************************************************************************/
+/* This is called once per frame from mainloop between instructions, after
+ * rewind_frame, and hides the lag between a key being pressed and the ZX81
+ * responding to it on screen.
+ * 
+ * After each real frame (by which time input has been read) a snapshot is
+ * taken and then sdl_emulator.runahead frames are emulated with that same
+ * input as quickly as possible. Only the last of these is shown and none
+ * are heard. The snapshot is then restored and the next real frame, which
+ * is heard but not shown, is emulated as normal.
+ * 
+ * sdl_emulator.speculating counts down the frames being run ahead, and
+ * frame_pause, do_interrupt, the sound and the LOAD/SAVE/printer side
+ * effects all check it */
+
+void runahead_frame(void) {
+
+	if (sdl_emulator.speculating) {
+		/* Restore before counting down as sound_ay_setstate checks it */
+		if (sdl_emulator.speculating == 1)
+			snapshot_restore(snapshot_runahead);
+		sdl_emulator.speculating--;
+	} else if (sdl_emulator.runahead && !sdl_emulator.warping && !interrupted) {
+		snapshot_capture(snapshot_runahead);
+		sdl_emulator.speculating = sdl_emulator.runahead;
+	}
+}
+
+/***************************************************************************
+ * Quick Slot Request                                                      *
+ ***************************************************************************/
+/* Quick slots hold save states in memory so that they can be taken and
+ * restored instantly and as often as required. They're only written to
+ * disk by quick_slot_flush which happens on request and on exit. This
+ * requests that a slot be captured or restored at the end of the current
+ * frame by quick_slot_frame.
+ * 
+ * On entry: int slot = 0 to QUICK_SLOTS - 1
+ *           int action = QUICK_SLOT_CAPTURE or QUICK_SLOT_RESTORE */
+
+void quick_slot_request(int slot, int action) {
+
+	/* Jumping about would desynchronise an input recording */
+	if (input_log.mode != INPUT_LOG_NONE) return;
+
+	quick_slots.slot = slot;
+	quick_slots.action = action;
+}
+
+/***************************************************************************
+ * Quick Slot Frame                                                        *
+ ***************************************************************************/
+/* This is called once per frame from mainloop between instructions.
+ * 
+ * The slots hold complete save state files rather than bare snapshots as
+ * they're only a few KB and take well under a millisecond to build, and
+ * then restoring one checks that it's for this machine and flushing one
+ * is just a write. If a slot is empty when restored then it's read from
+ * disk if it was flushed in an earlier session */
+
+void quick_slot_frame(void) {
+	struct Notification notification;
+	int slot = quick_slots.slot;
+	char fullpath[256];
+	FILE *fp;
+
+	if (!quick_slots.action || sdl_emulator.speculating || interrupted) return;
+
+	sprintf(notification.title, "Quick Slot %i", slot + 1);
+	if (quick_slots.action == QUICK_SLOT_CAPTURE) {
+		if (!quick_slots.state[slot] &&
+			(quick_slots.state[slot] = malloc(STATE_FILE_SIZE)) == NULL) {
+			strcpy(notification.text, "Failed");
+		} else {
+			quick_slots.len[slot] = state_file_build(quick_slots.state[slot]);
+			quick_slots.dirty[slot] = TRUE;
+			strcpy(quick_slots.loaded[slot], load_file_dialog.loaded);
+			strcpy(notification.text, "Saved");
+		}
+	} else {
+		if (!quick_slots.state[slot] && *load_file_dialog.loaded) {
+			quick_slot_path(slot, load_file_dialog.loaded, fullpath);
+			io_writer_flush();
+			TRACE_BEGIN("quick slot", "io");
+			if ((fp = fopen(fullpath, "rb")) != NULL) {
+				if ((quick_slots.state[slot] = malloc(STATE_FILE_SIZE)) != NULL) {
+					quick_slots.len[slot] = fread(quick_slots.state[slot], 1,
+						STATE_FILE_SIZE, fp);
+					quick_slots.dirty[slot] = FALSE;
+					strcpy(quick_slots.loaded[slot], load_file_dialog.loaded);
+				}
+				fclose(fp);
+			}
+			TRACE_END("quick slot", "io");
+		}
+		if (!quick_slots.state[slot]) {
+			strcpy(notification.text, "Empty");
+		} else if (state_file_parse(quick_slots.state[slot], quick_slots.len[slot])) {
+			strcpy(notification.text, "Failed");
+		} else {
+			strcpy(notification.text, "Restored");
+		}
+	}
+	quick_slots.action = 0;
+
+	notification.timeout = NOTIFICATION_TIMEOUT_750;
+	notification_show(NOTIFICATION_SHOW, &notification);
+}
+
+/***************************************************************************
+ * Quick Slot Flush                                                        *
+ ***************************************************************************/
+/* This queues the slots that have changed to be written to disk alongside
+ * the on-disk save states of the program that they were taken from */
+
+void quick_slot_flush(void) {
+	unsigned char *data;
+	char fullpath[256], title[31];
+	int slot;
+
+	for (slot = 0; slot < QUICK_SLOTS; slot++) {
+		/* Without a program name there's nowhere to put it */
+		if (!quick_slots.dirty[slot] || !*quick_slots.loaded[slot]) continue;
+		if ((data = malloc(quick_slots.len[slot])) == NULL) continue;
+		memcpy(data, quick_slots.state[slot], quick_slots.len[slot]);
+		quick_slot_path(slot, quick_slots.loaded[slot], fullpath);
+		sprintf(title, "Quick Slot %i", slot + 1);
+		io_writer_submit(fullpath, data, quick_slots.len[slot], NULL, title);
+		quick_slots.dirty[slot] = FALSE;
+	}
+}
+
+/***************************************************************************
+ * Quick Slot End                                                          *
+ ***************************************************************************/
+
+void quick_slot_end(void) {
+	int slot;
+
+	quick_slot_flush();
+
+	for (slot = 0; slot < QUICK_SLOTS; slot++) {
+		if (quick_slots.state[slot]) free(quick_slots.state[slot]);
+		quick_slots.state[slot] = NULL;
+	}
+}
+
+/***************************************************************************
+ * Quick Slot Path                                                         *
+ ***************************************************************************/
+/* This builds the path to a quick slot's file within a program's save
+ * state folder, creating the folder if necessary. The extension differs
+ * from the dialog's slots so that the dialog doesn't list them.
+ * 
+ * On entry: char *program = the fullpath of the program
+ *           char *fullpath points to 256 bytes for the result */
+
+void quick_slot_path(int slot, char *program, char *fullpath) {
+	int index;
+
+	#if defined(PLATFORM_GP2X) || defined(__amigaos4__) || defined(_WIN32) || defined(PLATFORM_DINGUX_A320)
+		strcpy(fullpath, LOCAL_DATA_DIR);
+	#else
+		strcpy(fullpath, getenv ("HOME"));
+		strcatdelimiter(fullpath);
+		strcat(fullpath, LOCAL_DATA_DIR);
+	#endif
+	strcatdelimiter(fullpath);
+	strcat(fullpath, LOCAL_SAVSTA_DIR);
+	strcatdelimiter(fullpath);
+	fullpath[index = strlen(fullpath)] = tolower(file_dialog_basename(program)[0]);
+	fullpath[++index] = 0;
+	mkdir(fullpath, 0755);
+	strcatdelimiter(fullpath);
+	strcat(fullpath, file_dialog_basename(program));
+	mkdir(fullpath, 0755);
+	strcatdelimiter(fullpath);
+	sprintf(fullpath + strlen(fullpath), "quick%i.qs%c", slot + 1,
+		*sdl_emulator.model == MODEL_ZX80 ? 'o' : 'p');
+}
+
+/***************************************************************************
+ * Fast Boot Start                                                         *
+ ***************************************************************************/
+/* The ROM spends around a second after power-on testing and clearing RAM
+ * which is always the same for a given machine. This is called when the
+ * mainloop starts from a reset, and if the machine has been seen booting
+ * before then the state that it finished in is restored, else the boot is
+ * watched by fast_boot_frame so that it can be cached. The cache is kept
+ * in memory for resets and on disk for later sessions, and is keyed by the
+ * model, RAM size, ROM CRC and m1not so that a change to any of them forces
+ * a cold boot. Autoloads don't come here as z80.c presets the registers */
+
+void fast_boot_start(void) {
+	unsigned int crc;
+	char fullpath[256];
+	FILE *fp;
+
+	sdl_emulator.kbscans = 0;
+	fast_boot.pending = FALSE;
+
+	if (!sdl_emulator.fastboot) return;
+
+	crc = crc32_calc(mem, *sdl_emulator.model == MODEL_ZX80 ? 4096 : 8192);
+	if (fast_boot.model != *sdl_emulator.model ||
+		fast_boot.ramsize != sdl_emulator.ramsize ||
+		fast_boot.m1not != sdl_emulator.m1not || fast_boot.crc != crc) {
+		/* It's a different machine so look for it on disk */
+		if (fast_boot.state) free(fast_boot.state);
+		fast_boot.state = NULL;
+		fast_boot.model = *sdl_emulator.model;
+		fast_boot.ramsize = sdl_emulator.ramsize;
+		fast_boot.m1not = sdl_emulator.m1not;
+		fast_boot.crc = crc;
+		fast_boot_path(fullpath);
+		if ((fp = fopen(fullpath, "rb")) != NULL) {
+			if ((fast_boot.state = malloc(STATE_FILE_SIZE)) != NULL)
+				fast_boot.len = fread(fast_boot.state, 1, STATE_FILE_SIZE, fp);
+			fclose(fp);
+		}
+	}
+
+	if (fast_boot.state) {
+		if (!state_file_parse(fast_boot.state, fast_boot.len)) return;
+		/* It's stale or damaged so boot cold and replace it */
+		free(fast_boot.state);
+		fast_boot.state = NULL;
+	}
+
+	fast_boot.pending = TRUE;
+	fast_boot.frames = 0;
+}
+
+/***************************************************************************
+ * Fast Boot Frame                                                         *
+ ***************************************************************************/
+/* This is called once per frame from mainloop between instructions.
+ * 
+ * The boot is considered done when the ROM starts reading the keyboard,
+ * plus a few frames for it to draw the cursor. If a key is pressed before
+ * then the machine isn't in its pristine state so nothing is cached */
+
+void fast_boot_frame(void) {
+	unsigned char *data;
+	char fullpath[256];
+	int count;
+
+	if (!fast_boot.pending || sdl_emulator.speculating || interrupted) return;
+
+	for (count = 0; count < 8; count++) {
+		if (keyports[count] != 0xff) {
+			fast_boot.pending = FALSE;
+			return;
+		}
+	}
+
+	if (!sdl_emulator.kbscans || ++fast_boot.frames < FAST_BOOT_SETTLE) return;
+
+	fast_boot.pending = FALSE;
+	if ((fast_boot.state = malloc(STATE_FILE_SIZE)) == NULL) return;
+	fast_boot.len = state_file_build(fast_boot.state);
+
+	/* The writer frees what it's given so it gets a copy */
+	if ((data = malloc(fast_boot.len)) != NULL) {
+		memcpy(data, fast_boot.state, fast_boot.len);
+		fast_boot_path(fullpath);
+		io_writer_submit(fullpath, data, fast_boot.len, NULL, "Fast Boot");
+	}
+}
+
+/***************************************************************************
+ * Fast Boot End                                                           *
+ ***************************************************************************/
+
+void fast_boot_end(void) {
+	if (fast_boot.state) free(fast_boot.state);
+	fast_boot.state = NULL;
+}
+
+/***************************************************************************
+ * Auto Warp Start                                                         *
+ ***************************************************************************/
+/* LOAD itself is instant but many programs then spend seconds initialising
+ * in FAST mode with nothing to see. This is called when a program has been
+ * loaded and runs the emulator flat out without showing or sounding
+ * anything until the program looks ready, which auto_warp_frame decides */
+
+void auto_warp_start(void) {
+	sdl_emulator.warping = sdl_emulator.autowarp;
+	sdl_emulator.ulachars = 0;
+	auto_warp.kbscans = sdl_emulator.kbscans;
+}
+
+/***************************************************************************
+ * Auto Warp Frame                                                         *
+ ***************************************************************************/
+/* This is called once per frame from mainloop between instructions, before
+ * runahead_frame which doesn't run ahead whilst warping.
+ * 
+ * The program is considered ready on the first frame that both reads the
+ * keyboard and has a display, which covers the ZX81 in SLOW mode and both
+ * machines waiting for input. Otherwise the warp ends when the budget runs
+ * out or when the user presses a key */
+
+void auto_warp_frame(void) {
+	int scanned, count;
+
+	if (!sdl_emulator.warping || sdl_emulator.speculating || interrupted) return;
+
+	scanned = sdl_emulator.kbscans != auto_warp.kbscans;
+	auto_warp.kbscans = sdl_emulator.kbscans;
+
+	if (scanned && sdl_emulator.ulachars) {
+		sdl_emulator.warping = 0;
+	} else {
+		sdl_emulator.warping--;
+		for (count = 0; count < 8; count++)
+			if (keyports[count] != 0xff) sdl_emulator.warping = 0;
+	}
+	sdl_emulator.ulachars = 0;
+}
+
+/***************************************************************************
+ * Auto Resume Start                                                       *
+ ***************************************************************************/
+/* The session is saved on exit by auto_resume_save and this carries on
+ * from it when the mainloop first starts, before the first frame, unless
+ * a program was given on the command line or the machine's configuration
+ * has since changed. Later resets don't resume.
+ * 
+ * On exit: returns TRUE if nothing was resumed and the mainloop
+ *          should start the machine itself
+ *          else FALSE */
+
+int auto_resume_start(void) {
+	static int done = FALSE;
+	char fullpath[256];
+	int len;
+	FILE *fp;
+
+	if (done) return TRUE;
+	done = TRUE;
+
+	if (!sdl_emulator.resume || sdl_emulator.autoload ||
+		input_log.mode == INPUT_LOG_PLAY) return TRUE;
+
+	auto_resume_path(fullpath);
+	if ((fp = fopen(fullpath, "rb")) == NULL) return TRUE;
+	len = fread(state_file, 1, STATE_FILE_SIZE, fp);
+	fclose(fp);
+	if (state_file_parse(state_file, len)) return TRUE;
+
+	sdl_emulator.kbscans = 0;
+	#if defined(PLATFORM_MIYOO)
+	if (*load_file_dialog.loaded) mapping_game_read();
+	#endif
+
+	/* Wait for a real frame, to avoid an annoying frame `jump' */
+	framewait = 1;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Auto Resume Save                                                        *
+ ***************************************************************************/
+/* This is called from emulator_exit and queues the session to be written
+ * to the local data directory. The writer finishes it before exiting */
+
+void auto_resume_save(void) {
+	unsigned char *data;
+	char fullpath[256];
+	int len;
+
+	if (!sdl_emulator.resume) return;
+
+	if ((data = malloc(STATE_FILE_SIZE)) == NULL) return;
+	len = state_file_build(data);
+	auto_resume_path(fullpath);
+	io_writer_submit(fullpath, data, len, NULL, "Resume");
+}
+
+/***************************************************************************
+ * Auto Resume Path                                                        *
+ ***************************************************************************/
+/* On entry: char *fullpath points to 256 bytes for the result */
+
+void auto_resume_path(char *fullpath) {
+
+	#if defined(PLATFORM_GP2X) || defined(__amigaos4__) || defined(_WIN32) || defined(PLATFORM_DINGUX_A320)
+		strcpy(fullpath, LOCAL_DATA_DIR);
+	#else
+		strcpy(fullpath, getenv ("HOME"));
+		strcatdelimiter(fullpath);
+		strcat(fullpath, LOCAL_DATA_DIR);
+	#endif
+	strcatdelimiter(fullpath);
+	strcat(fullpath, "resume.ss");
+}
+
+/***************************************************************************
+ * Fast Boot Path                                                          *
+ ***************************************************************************/
+/* This builds the path to the cached boot of the machine within the local
+ * data directory.
+ * 
+ * On entry: char *fullpath points to 256 bytes for the result */
+
+void fast_boot_path(char *fullpath) {
+
+	#if defined(PLATFORM_GP2X) || defined(__amigaos4__) || defined(_WIN32) || defined(PLATFORM_DINGUX_A320)
+		strcpy(fullpath, LOCAL_DATA_DIR);
+	#else
+		strcpy(fullpath, getenv ("HOME"));
+		strcatdelimiter(fullpath);
+		strcat(fullpath, LOCAL_DATA_DIR);
+	#endif
+	strcatdelimiter(fullpath);
+	sprintf(fullpath + strlen(fullpath), "boot-%s-%ik-%08x-%i.ss%c",
+		fast_boot.model == MODEL_ZX80 ? "zx80" : "zx81", fast_boot.ramsize,
+		fast_boot.crc, fast_boot.m1not, fast_boot.model == MODEL_ZX80 ? 'o' : 'p');
+}
+
+/***************************************************************************
+ * IO Writer Submit                                                        *
+ ***************************************************************************/
+/* This queues a file to be written by a background thread so that slow
+ * storage such as an SD card doesn't stall emulation (and the sound). The
+ * caller captures what's to be written beforehand and io_writer takes
+ * ownership of it, freeing it once written. The outcome is reported via
+ * a notification from io_writer_poll.
+ * 
+ * If the thread can't be started or the queue is full then the file is
+ * written here instead, which is what always used to happen. The queue
+ * is flushed first so that an older job to the same file can't be
+ * written over it afterwards. The thread is only tried for once.
+ * 
+ * On entry: char *fullpath = the file to write
+ *           unsigned char *data = malloced contents of length len
+ *           or SDL_Surface *surface = a surface to save as a bitmap
+ *           char *title = the notification's title
+ *  On exit: returns TRUE if the file was written synchronously and failed
+ *           else FALSE */
+
+int io_writer_submit(char *fullpath, unsigned char *data, int len,
+	SDL_Surface *surface, char *title) {
+	struct io_job *job, now;
+	int retval;
+
+	if (!io_writer.thread && !io_writer.failed) {
+		io_writer.head = io_writer.tail = 0;
+		io_writer.quit = FALSE;
+		if ((io_writer.mutex = SDL_CreateMutex()) == NULL ||
+			(io_writer.cond = SDL_CreateCond()) == NULL ||
+			(io_writer.thread = SDL_CreateThread(io_writer_thread, NULL)) == NULL) {
+			fprintf(stderr, "%s: Cannot create thread: %s\n", __func__,
+				SDL_GetError());
+			if (io_writer.cond) SDL_DestroyCond(io_writer.cond);
+			if (io_writer.mutex) SDL_DestroyMutex(io_writer.mutex);
+			io_writer.cond = NULL;
+			io_writer.mutex = NULL;
+			io_writer.failed = TRUE;
+		}
+	}
+
+	if (io_writer.thread) SDL_mutexP(io_writer.mutex);
+	job = &io_writer.jobs[io_writer.tail];
+	if (io_writer.thread && job->state == IO_JOB_FREE) {
+		strcpy(job->fullpath, fullpath);
+		job->data = data;
+		job->len = len;
+		job->surface = surface;
+		strcpy(job->title, title);
+		job->state = IO_JOB_QUEUED;
+		io_writer.tail = (io_writer.tail + 1) % IO_JOBS_MAX;
+		SDL_CondSignal(io_writer.cond);
+		SDL_mutexV(io_writer.mutex);
+		return FALSE;
+	}
+	if (io_writer.thread) {
+		SDL_mutexV(io_writer.mutex);
+		io_writer_flush();
+	}
+
+	/* Write it now using a job that isn't part of the queue */
+	strcpy(now.fullpath, fullpath);
+	now.data = data;
+	now.len = len;
+	now.surface = surface;
+	strcpy(now.title, title);
+	retval = io_job_write(&now);
+	now.state = retval ? IO_JOB_FAILED : IO_JOB_DONE;
+	io_job_finish(&now, TRUE);
+
+	return retval;
+}
+
+/***************************************************************************
+ * IO Writer Poll                                                          *
+ ***************************************************************************/
+/* This is called regularly from the component executive to report and
+ * tidy up after the jobs that the writer has finished */
+
+void io_writer_poll(void) {
+	int count, finished = FALSE;
+
+	if (!io_writer.thread) return;
+
+	SDL_mutexP(io_writer.mutex);
+	for (count = 0; count < IO_JOBS_MAX; count++) {
+		if (io_writer.jobs[count].state == IO_JOB_DONE ||
+			io_writer.jobs[count].state == IO_JOB_FAILED) {
+			io_job_finish(&io_writer.jobs[count], TRUE);
+			finished = TRUE;
+		}
+	}
+	SDL_mutexV(io_writer.mutex);
+
+	/* A slot may have been saved to whilst the dialog was open */
+	if (finished && save_state_dialog.state) save_state_dialog_slots_populate();
+}
+
+/***************************************************************************
+ * IO Writer Flush                                                         *
+ ***************************************************************************/
+/* This waits for the writer to empty its queue, which is necessary before
+ * reading back a file that might still be being written */
+
+void io_writer_flush(void) {
+	int count, busy;
+
+	if (!io_writer.thread) return;
+
+	do {
+		SDL_mutexP(io_writer.mutex);
+		for (count = busy = 0; count < IO_JOBS_MAX; count++)
+			if (io_writer.jobs[count].state == IO_JOB_QUEUED ||
+				io_writer.jobs[count].state == IO_JOB_WRITING) busy = TRUE;
+		SDL_mutexV(io_writer.mutex);
+		if (busy) SDL_Delay(1);
+	} while (busy);
+}
+
+/***************************************************************************
+ * IO Writer End                                                           *
+ ***************************************************************************/
+/* This waits for everything queued to be written and stops the thread */
+
+void io_writer_end(void) {
+	int count;
+
+	if (!io_writer.thread) return;
+
+	SDL_mutexP(io_writer.mutex);
+	io_writer.quit = TRUE;
+	SDL_CondSignal(io_writer.cond);
+	SDL_mutexV(io_writer.mutex);
+	SDL_WaitThread(io_writer.thread, NULL);
+	io_writer.thread = NULL;
+
+	for (count = 0; count < IO_JOBS_MAX; count++)
+		if (io_writer.jobs[count].state != IO_JOB_FREE)
+			io_job_finish(&io_writer.jobs[count], FALSE);
+
+	SDL_DestroyCond(io_writer.cond);
+	SDL_DestroyMutex(io_writer.mutex);
+	io_writer.cond = NULL;
+	io_writer.mutex = NULL;
+}
+
+/***************************************************************************
+ * IO Writer Thread                                                        *
+ ***************************************************************************/
+/* This writes the queued jobs in order, sleeping whilst there are none.
+ * When asked to quit it finishes what's queued first */
+
+int io_writer_thread(void *data) {
+	struct io_job *job;
+	int retval;
+
+	TRACE_THREAD("io writer");
+	SDL_mutexP(io_writer.mutex);
+	for (;;) {
+		job = &io_writer.jobs[io_writer.head];
+		if (job->state != IO_JOB_QUEUED) {
+			if (io_writer.quit) break;
+			SDL_CondWait(io_writer.cond, io_writer.mutex);
+			continue;
+		}
+		job->state = IO_JOB_WRITING;
+		SDL_mutexV(io_writer.mutex);
+		TRACE_BEGIN("write", "io");
+		retval = io_job_write(job);
+		TRACE_END("write", "io");
+		SDL_mutexP(io_writer.mutex);
+		job->state = retval ? IO_JOB_FAILED : IO_JOB_DONE;
+		io_writer.head = (io_writer.head + 1) % IO_JOBS_MAX;
+	}
+	SDL_mutexV(io_writer.mutex);
+
+	return 0;
+}
+
+/***************************************************************************
+ * IO Job Write                                                            *
+ ***************************************************************************/
+/* On exit: returns TRUE on error
+ *          else FALSE */
+
+int io_job_write(struct io_job *job) {
+	int retval = FALSE;
+	FILE *fp;
+
+	if (job->surface) {
+		if (SDL_SaveBMP(job->surface, job->fullpath) < 0) {
+			fprintf(stderr, "%s: Cannot save %s: %s\n", __func__,
+				job->fullpath, SDL_GetError());
+			retval = TRUE;
+		}
+	} else if ((fp = fopen(job->fullpath, "wb")) != NULL) {
+		if (fwrite(job->data, 1, job->len, fp) < (size_t)job->len) retval = TRUE;
+		if (fclose(fp)) retval = TRUE;
+	} else {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__, job->fullpath);
+		retval = TRUE;
+	}
+
+	return retval;
+}
+
+/***************************************************************************
+ * IO Job Finish                                                           *
+ ***************************************************************************/
+/* This reports a job's outcome if requested and frees what it was given */
+
+void io_job_finish(struct io_job *job, int notify) {
+	struct Notification notification;
+
+	if (notify) {
+		strcpy(notification.title, job->title);
+		if (job->state == IO_JOB_DONE) {
+			strcpy(notification.text, "Saved");
+		} else {
+			strcpy(notification.text, "Failed");
+		}
+		notification.timeout = NOTIFICATION_TIMEOUT_1250;
+		notification_show(NOTIFICATION_SHOW, &notification);
+	}
+
+	if (job->data) free(job->data);
+	if (job->surface) SDL_FreeSurface(job->surface);
+	job->data = NULL;
+	job->surface = NULL;
+	job->state = IO_JOB_FREE;
+}
+
+/***************************************************************************
+ * Input Log Begin                                                         *
+ ***************************************************************************/
+/* This prepares to record the input to a file or play it back from one.
+ * Nothing else happens until the next frame when input_log_frame takes or
+ * restores the starting snapshot.
+ * 
+ * A recording is read whole and checked here so that a bad file can be
+ * reported from the command line.
+ * 
+ * On entry: int mode = INPUT_LOG_RECORD or INPUT_LOG_PLAY
+ *           char *filename = the recording
+ *  On exit: returns TRUE on error
+ *           else FALSE */
+
+int input_log_begin(int mode, char *filename) {
+	int magic, version, snapshot_length;
+	unsigned char *ptr;
+	FILE *fp;
+
+	input_log_end();
+
+	if (mode == INPUT_LOG_RECORD) {
+		if ((input_log.fp = fopen(filename, "wb")) == NULL) {
+			fprintf(stderr, "%s: Cannot write to %s\n", __func__, filename);
+			return TRUE;
+		}
+	} else {
+		if ((fp = fopen(filename, "rb")) == NULL) {
+			fprintf(stderr, "%s: Cannot read from %s\n", __func__, filename);
+			return TRUE;
+		}
+		fseek(fp, 0, SEEK_END);
+		input_log.length = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+		if (input_log.length >= INPUT_LOG_HEADER_SIZE &&
+			(input_log.data = malloc(input_log.length)) != NULL) {
+			input_log.length = fread(input_log.data, 1, input_log.length, fp);
+		}
+		fclose(fp);
+		if (!input_log.data) {
+			fprintf(stderr, "%s: Cannot read from %s\n", __func__, filename);
+			return TRUE;
+		}
+		ptr = input_log.data;
+		memread_int_little_endian(&magic, &ptr);
+		memread_int_little_endian(&version, &ptr);
+		ptr = input_log.data + INPUT_LOG_HEADER_SIZE - 4;
+		memread_int_little_endian(&snapshot_length, &ptr);
+		if (input_log.length < INPUT_LOG_HEADER_SIZE ||
+			magic != INPUT_LOG_MAGIC || version > INPUT_LOG_VERSION ||
+			snapshot_length < SNAPSHOT_SIZE_2_1_7 || snapshot_length > SNAPSHOT_SIZE ||
+			input_log.length < INPUT_LOG_HEADER_SIZE + snapshot_length) {
+			fprintf(stderr, "%s: %s is not a valid recording\n", __func__, filename);
+			input_log_end();
+			return TRUE;
+		}
+		input_log.pos = INPUT_LOG_HEADER_SIZE + snapshot_length;
+	}
+
+	input_log.mode = mode;
+	input_log.started = FALSE;
+	input_log.frame = 0;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Input Log Frame                                                         *
+ ***************************************************************************/
+/* This is called once per frame from mainloop between instructions, after
+ * check_events has updated keyports from the keyboard.
+ * 
+ * When recording, the machine and its configuration are written out first
+ * and then keyports is compared with the previous frame and any change is
+ * appended along with the frame number. keyports is all that the emulated
+ * machine reads from the host, so the same changes on the same frames
+ * from the same snapshot will always give the same result.
+ * 
+ * When playing back, the configuration is applied (the component
+ * executive will reset the machine if the model or RAM size changes), the
+ * snapshot is restored and from then on keyports is overwritten with what
+ * was recorded each frame. With -t the frames aren't waited for and the
+ * program exits afterwards reporting how long it took */
+
+void input_log_frame(void) {
+	struct Notification notification;
+	int model, ramsize, m1not, ay_type, snapshot_length;
+	unsigned char header[INPUT_LOG_HEADER_SIZE], *ptr;
+	unsigned int frame;
+	Uint32 ticks;
+
+	/* Frames being run ahead read no input and so aren't counted */
+	if (input_log.mode == INPUT_LOG_NONE || sdl_emulator.speculating ||
+		interrupted) return;
+
+	if (input_log.mode == INPUT_LOG_RECORD) {
+		if (!input_log.started) {
+			snapshot_length = snapshot_capture(snapshot_file);
+			ptr = header;
+			model = INPUT_LOG_MAGIC;
+			memwrite_int_little_endian(&model, &ptr);
+			model = INPUT_LOG_VERSION;
+			memwrite_int_little_endian(&model, &ptr);
+			memwrite_int_little_endian(sdl_emulator.model, &ptr);
+			memwrite_int_little_endian(&sdl_emulator.ramsize, &ptr);
+			memwrite_int_little_endian(&sdl_emulator.m1not, &ptr);
+			memwrite_int_little_endian(&sound_ay_type, &ptr);
+			memwrite_int_little_endian(&snapshot_length, &ptr);
+			fwrite(header, 1, INPUT_LOG_HEADER_SIZE, input_log.fp);
+			fwrite(snapshot_file, 1, snapshot_length, input_log.fp);
+			/* keyports always has the top bits set so this differs */
+			memset(input_log.keyports, 0, 8);
+			input_log.started = TRUE;
+		} else {
+			input_log.frame++;
+		}
+		if (memcmp(input_log.keyports, keyports, 8) != 0) {
+			memcpy(input_log.keyports, keyports, 8);
+			input_log_write_change();
+		}
+		return;
+	}
+
+	if (!input_log.started) {
+		ptr = input_log.data + 8;
+		memread_int_little_endian(&model, &ptr);
+		memread_int_little_endian(&ramsize, &ptr);
+		memread_int_little_endian(&m1not, &ptr);
+		memread_int_little_endian(&ay_type, &ptr);
+		if (*sdl_emulator.model != model || sdl_emulator.ramsize != ramsize ||
+			sdl_emulator.m1not != m1not || sound_ay_type != ay_type) {
+			/* Give the component executive a second to reset the machine */
+			if (input_log.frame++ == 0) {
+				*sdl_emulator.model = model;
+				sdl_emulator.ramsize = ramsize;
+				sdl_emulator.m1not = m1not;
+				#ifdef OSS_SOUND_SUPPORT
+					if (sound_ay_type != ay_type) sdl_sound.device = ay_type;
+				#endif
+			} else if (input_log.frame > 50) {
+				fprintf(stderr, "%s: Cannot configure the machine as recorded\n",
+					__func__);
+				input_log_end();
+			}
+			return;
+		}
+		if (snapshot_restore(input_log.data + INPUT_LOG_HEADER_SIZE)) {
+			fprintf(stderr, "%s: Cannot restore the recorded snapshot\n", __func__);
+			input_log_end();
+			return;
+		}
+		/* The history belongs to what was running before */
+		rewind_reset();
+		sdl_emulator.turbo = sdl_com_line.turbo;
+		input_log.ticks = SDL_GetTicks();
+		input_log.frame = 0;
+		input_log.started = TRUE;
+	} else {
+		input_log.frame++;
+	}
+
+	while (input_log.pos + INPUT_LOG_RECORD_SIZE <= input_log.length) {
+		ptr = input_log.data + input_log.pos;
+		memread_unsigned_int_little_endian(&frame, &ptr);
+		if (frame != input_log.frame) break;
+		memcpy(input_log.keyports, ptr, 8);
+		input_log.pos += INPUT_LOG_RECORD_SIZE;
+	}
+	memcpy(keyports, input_log.keyports, 8);
+
+	/* The last change is written when recording stops */
+	if (input_log.pos + INPUT_LOG_RECORD_SIZE > input_log.length) {
+		ticks = SDL_GetTicks() - input_log.ticks;
+		fprintf(stdout, "Played back %u frames in %ums", input_log.frame + 1, ticks);
+		if (ticks) fprintf(stdout, " (%u fps)", (input_log.frame + 1) * 1000 / ticks);
+		fprintf(stdout, "\n");
+		if (sdl_emulator.turbo) {
+			interrupted = INTERRUPT_EMULATOR_EXIT;
+		} else {
+			strcpy(notification.title, "Playback");
+			strcpy(notification.text, "Finished");
+			notification.timeout = NOTIFICATION_TIMEOUT_1250;
+			notification_show(NOTIFICATION_SHOW, &notification);
+		}
+		input_log_end();
+	}
+}
+
+/***************************************************************************
+ * Input Log End                                                           *
+ ***************************************************************************/
+/* This stops recording or playing back. A recording is finished by writing
+ * keyports again for the final frame so that playback stops there too */
+
+void input_log_end(void) {
+
+	if (input_log.fp) {
+		if (input_log.started) input_log_write_change();
+		fclose(input_log.fp);
+	}
+	if (input_log.data) free(input_log.data);
+	input_log.fp = NULL;
+	input_log.data = NULL;
+	input_log.mode = INPUT_LOG_NONE;
+	sdl_emulator.turbo = FALSE;
+}
+
+/***************************************************************************
+ * Input Log Write Change                                                  *
+ ***************************************************************************/
+
+void input_log_write_change(void) {
+	unsigned char record[INPUT_LOG_RECORD_SIZE], *ptr = record;
+
+	memwrite_unsigned_int_little_endian(&input_log.frame, &ptr);
+	memcpy(ptr, input_log.keyports, 8);
+	fwrite(record, 1, INPUT_LOG_RECORD_SIZE, input_log.fp);
+}
+
+/***************************************************************************
+ * Append Directory Delimiter to String                                    *
+ ***************************************************************************/
+/* This will append a directory delimiter to a string if one doesn't already
+ * exist.
+ * The point of this function is to make it easier to change the delimiter
+ * character for other platforms. See also #define DIR_DELIMITER_CHAR.
+ * 
+ * On entry: char *toappendto = the string to append to
+ *  On exit: toappendto will have had a delimiter appended if required  */
+
+void strcatdelimiter(char *toappendto) {
+	static char delimiter[2] = {DIR_DELIMITER_CHAR, 0};
+
+	#if defined(__amigaos4__)
+		if (toappendto[strlen(toappendto) - 1] != DIR_DELIMITER_CHAR &&
+			toappendto[strlen(toappendto) - 1] != ':')
+			strcat(toappendto, delimiter);
+	#else
+		if (toappendto[strlen(toappendto) - 1] != DIR_DELIMITER_CHAR)
+			strcat(toappendto, delimiter);
+	#endif
+}
+
+/***************************************************************************
+ * File Dialog Basename                                                    *
+ ***************************************************************************/
+/* This will return the basename of a path e.g. "/moo/bah" returns "bah".
+ * The paths being passed are coming from getcwd or something other than
+ * user written so it is not expecting a trailing directory delimiter.
+ * getcwd for example will not add a trailing delimiter unless the path
+ * is at the root, therefore that's how it will be interpreted here.
+ * 
+ * On entry: char *dir = the path to extract the basename from
+ *  On exit: returns a pointer to a string containing the extracted basename */
+
+char *file_dialog_basename(char *dir) {
+	static char basename[256];
+	int index;
+
+	strcpy(basename, dir);	/* We'll work with a copy */
+
+	if ((index = strlen(dir))) {
+		/* Move leftwards up to a delimiter, root or nothing */
+		while (index >= 1 && 
+			basename[index - 1] != DIR_DELIMITER_CHAR
+		#if defined(__amigaos4__)
+			&& basename[index - 1] != ':'
+		#endif
+			) index--;
+
+		/* Do we need to return root? */
+		if (index >= 1 && basename[index] == 0 &&
+		#if defined(__amigaos4__)
+			basename[index - 1] == ':'
+		#else
+			basename[index - 1] == DIR_DELIMITER_CHAR
+		#endif
+			) index--;
+	}
+
+	return basename + index;
+}
+
+/***************************************************************************
+ * File Dialog Change Directory                                            *
+ ***************************************************************************/
+/* This function will update a target directory string with another source
+ * string which could be a relative subdirectory or parent directory "..".
+ * The source directory can be wrapped within brackets which will be removed
+ * if found e.g. "(sz81)", "sz81", "(..)", "..".
+ * 
+ * This function is not expecting dir to have a trailing directory delimiter
+ * unless it represents *nix root. C functions don't add these and neither
+ * do sz81 functions so I'm choosing not to handle them.
+ * 
+ * On entry: char *dir = the directory string to update
+ *           char *direntry = the relative directory to change to
+ *  On exit: char *dir will be updated */
+
+void file_dialog_cd(char *dir, char *direntry) {
+	char foldername[256];
+	int index;
+
+	/* Copy the direntry and strip the surrounding brackets if found */
+	if (*direntry == '(') {
+		strcpy(foldername, direntry + 1);
+		foldername[strlen(foldername) - 1] = 0;
+	} else {
+		strcpy(foldername, direntry);
+	}
+
+	/* Is this the parent directory? */
+	if (strcmp(foldername, "..") == 0) {
+		/* Go back to the parent directory */
+		if ((index = strlen(dir))) {
+			/* Truncate leftwards up to a delimiter, root or nothing */
+			while (index >= 1 && 
+				dir[index - 1] != DIR_DELIMITER_CHAR
+			#if defined(__amigaos4__) || defined(_WIN32)
+				&& dir[index - 1] != ':'
+			#endif
+				) dir[--index] = 0;
+
+			/* Do we need to cut the directory delimiter? */
+			if (index >= 2 && 
+				dir[index - 1] == DIR_DELIMITER_CHAR
+			#if defined(_WIN32)
+				&& dir[index - 2] != ':'
+			#endif
+				) dir[--index] = 0;
+		}
+	} else {
+		/* It's a subdirectory */
+		/* Add a directory delimiter if required */
+		strcatdelimiter(dir);
+		strcat(dir, foldername);
+	}
+}
+
+/***************************************************************************
+ * Directory List Populate                                                 *
+ ***************************************************************************/
+/* This function will record the current directory, change to the requested
+ * directory, create a sorted list of its contents and then change back to
+ * the original directory.
+ * 
+ * Directory names are wrapped within brackets and a parent directory
+ * "(..)" is forced to always be present (dirlist will never return NULL).
+ * 
+ * dirlist will return a pointer to the dynamically allocated memory
+ * containing the list and should be freed before program exit.
+ * When calling this function, any existing list created from a previous
+ * call will be freed automatically so the caller need not do this.
+ * 
+ * On entry: char *dir = a string containing the directory to list
+ *           int filetypes = an OR'd combination of file types to list
+ *  On exit: char **dirlist will point to the dynamically allocated
+ *               directory list
+ *           int *dirlist_sizeof will contain the size of each item
+ *           int *dirlist_count will contain the number of items found */
+
+void dirlist_populate(char *dir, char **dirlist, int *dirlist_sizeof,
+	int *dirlist_count, int filetypes) {
+	char cwd[256], swap[256], *realloclist;
+	int parentfound = FALSE, offset = 0;
+	int count, found, swapped;
+	struct dirent *direntry;
+	struct stat filestatus;
+	DIR *dirstream;
+
+	/* [Re]initialise the list */
+	if (*dirlist) {
+		free(*dirlist); *dirlist = NULL;
+	}
+	*dirlist_sizeof = 0; *dirlist_count = 0;
+
+	/* Record the current working directory before changing it to dir
+	 * (I've found that stat doesn't work unless the dir is changed) */
+	strcpy(cwd, ""); getcwd(cwd, 256); cwd[255] = 0; chdir(dir);
+
+	/* NOTE TO PORTERS: eventually you'll hit root ('/' on *nix, ':' on
+	 * __amigaos4__, '\' on _WIN32 and as I'm developing this on Linux I
+	 * can't populate the list with drive specifiers etc., so possibly
+	 * you could have a virtual area above root that you fill yourself,
+	 * or you could populate the root list with "(c:)", "(d:)" etc. and
+	 * when the user selects one, you could change to that drive and set
+	 * dir equal to root. Other functions you should take a look at are
+	 * file_dialog_cd, the code within sdl_input.c:2555 that extracts the
+	 * directory from the list to change to and file_dialog_basename. And
+	 * DIR_DELIMITER_CHAR and strcatdelimiter are useful. That's it :) */
+
+	if ((dirstream = opendir(dir))) {
+
+		while ((direntry = readdir(dirstream))) {
+
+			/* Store the size of the list element once */
+			if (*dirlist_sizeof == 0)
+				*dirlist_sizeof = sizeof(direntry->d_name) + 2;
+
+			/* Get directory entry status information */
+			if (stat(direntry->d_name, &filestatus)) {
+				fprintf(stderr, "%s: Cannot stat %s\n", __func__, direntry->d_name);
+			} else {
+
+				found = FALSE;
+
+				if (strcmp(direntry->d_name, "..") == 0) {
+					found = TRUE;
+				} else if (strcmp(direntry->d_name, ".") == 0) {
+					/* Discard */
+				} else if (!(filetypes & DIRLIST_FILETYPE_HIDDEN) &&
+					direntry->d_name[0] == '.') {
+					/* Discard */
+				} else if (S_ISDIR(filestatus.st_mode)) {
+					found = TRUE;
+				} else if (filetypes & DIRLIST_FILETYPE_ZX80 &&
+					sdl_filetype_casecmp(direntry->d_name, ".o") == 0) {
+					found = TRUE;
+				} else if (filetypes & DIRLIST_FILETYPE_ZX80 &&
+					sdl_filetype_casecmp(direntry->d_name, ".80") == 0) {
+					found = TRUE;
+				} else if (filetypes & DIRLIST_FILETYPE_ZX81 &&
+					sdl_filetype_casecmp(direntry->d_name, ".p") == 0) {
+					found = TRUE;
+				} else if (filetypes & DIRLIST_FILETYPE_ZX81 &&
+					sdl_filetype_casecmp(direntry->d_name, ".81") == 0) {
+					found = TRUE;
+				} else if (filetypes & DIRLIST_FILETYPE_TXT &&
+					sdl_filetype_casecmp(direntry->d_name, ".txt") == 0) {
+					found = TRUE;
+				}
+
+				if (found) {
+
+					/* Record that the parent directory was found because it's
+					 * not always the case that it is (the Zaurus for example) */
 					if (strcmp(direntry->d_name, "..") == 0) parentfound = TRUE;
 
 					/* Expand the list by the necessary size (if the list
@@ -1183,83 +2601,6 @@ char *strzx80_to_ascii(int memaddr) {
 	return translated;
 }
 
-/***************************************************************************
- * File Write Unsigned Short Little Endian                                 *
- ***************************************************************************/
-
-void fwrite_unsigned_short_little_endian(unsigned short *source, FILE *fp) {
-	unsigned char byteval;
-
-	byteval = *source & 0xff;			fwrite(&byteval, 1, 1, fp);
-	byteval = (*source >> 8) & 0xff;	fwrite(&byteval, 1, 1, fp);
-}
-
-/***************************************************************************
- * File Write Int Little Endian                                            *
- ***************************************************************************/
-
-void fwrite_int_little_endian(int *source, FILE *fp) {
-	unsigned char byteval;
-
-	byteval = *source & 0xff;			fwrite(&byteval, 1, 1, fp);
-	byteval = (*source >> 8) & 0xff;	fwrite(&byteval, 1, 1, fp);
-	byteval = (*source >> 16) & 0xff;	fwrite(&byteval, 1, 1, fp);
-	byteval = (*source >> 24) & 0xff;	fwrite(&byteval, 1, 1, fp);
-}
-
-/***************************************************************************
- * File Write Unsigned Long Little Endian                                  *
- ***************************************************************************/
-
-void fwrite_unsigned_long_little_endian(unsigned long *source, FILE *fp) {
-	unsigned char byteval;
-
-	byteval = *source & 0xff;			fwrite(&byteval, 1, 1, fp);
-	byteval = (*source >> 8) & 0xff;	fwrite(&byteval, 1, 1, fp);
-	byteval = (*source >> 16) & 0xff;	fwrite(&byteval, 1, 1, fp);
-	byteval = (*source >> 24) & 0xff;	fwrite(&byteval, 1, 1, fp);
-}
-
-/***************************************************************************
- * File Read Unsigned Short Little Endian                                  *
- ***************************************************************************/
-
-void fread_unsigned_short_little_endian(unsigned short *target, FILE *fp) {
-	unsigned char byteval;
-
-	*target = 0;
-	fread(&byteval, 1, 1, fp); *target |= byteval;
-	fread(&byteval, 1, 1, fp); *target |= (byteval << 8);
-}
-
-/***************************************************************************
- * File Read Int Little Endian                                             *
- ***************************************************************************/
-
-void fread_int_little_endian(int *target, FILE *fp) {
-	unsigned char byteval;
-
-	*target = 0;
-	fread(&byteval, 1, 1, fp); *target |= byteval;
-	fread(&byteval, 1, 1, fp); *target |= (byteval << 8);
-	fread(&byteval, 1, 1, fp); *target |= (byteval << 16);
-	fread(&byteval, 1, 1, fp); *target |= (byteval << 24);
-}
-
-/***************************************************************************
- * File Read Unsigned Long Little Endian                                   *
- ***************************************************************************/
-
-void fread_unsigned_long_little_endian(unsigned long *target, FILE *fp) {
-	unsigned char byteval;
-
-	*target = 0;
-	fread(&byteval, 1, 1, fp); *target |= byteval;
-	fread(&byteval, 1, 1, fp); *target |= (byteval << 8);
-	fread(&byteval, 1, 1, fp); *target |= (byteval << 16);
-	fread(&byteval, 1, 1, fp); *target |= (byteval << 24);
-}
-
 /***************************************************************************
  * Get Filename Next Highest                                               *
  ***************************************************************************/
@@ -40,6 +40,68 @@
 #define SSTATE_MODE_SAVE 0
 #define SSTATE_MODE_LOAD 1
 
+/* Save state files: a magic number ("SZSS") and a version followed by
+ * chunks, each of which is an ID, a length and then that many bytes.
+ * Unknown chunks are skipped. The thumbnail is always the first chunk so
+ * that the save state dialog can read it cheaply */
+#define STATE_FILE_MAGIC 0x53535a53
+#define STATE_FILE_VERSION 1
+#define STATE_CHUNK_THUMBNAIL 0x424d4854	/* "THMB" */
+#define STATE_CHUNK_CONFIG 0x464e4f43		/* "CONF" */
+#define STATE_CHUNK_RAM 0x204d4152			/* "RAM " */
+#define STATE_CHUNK_MACHINE 0x4843414d		/* "MACH" */
+#define STATE_CHUNK_PROGRAM 0x474f5250		/* "PROG" */
+#define STATE_CHUNK_END 0x20444e45			/* "END " */
+#define STATE_FILE_SIZE (SNAPSHOT_SIZE + 1024)
+
+/* Save state thumbnails are 1bpp and each pixel summarises an 8x8 cell */
+#define SSTATE_THUMB_W 32
+#define SSTATE_THUMB_H 24
+#define SSTATE_THUMB_SIZE (SSTATE_THUMB_W * SSTATE_THUMB_H / 8)
+
+/* Rewind history defaults and limits (the memory is in KB) */
+#define REWIND_INTERVAL 5
+#define REWIND_INTERVAL_MIN 1
+#define REWIND_INTERVAL_MAX 50
+#define REWIND_MEMORY 4096
+#define REWIND_MEMORY_MIN 256
+#define REWIND_MEMORY_MAX 65536
+
+/* Run ahead limit in frames */
+#define RUNAHEAD_MAX 4
+
+/* Auto-warp budget in frames after a LOAD */
+#define AUTO_WARP_DEFAULT 1000
+#define AUTO_WARP_MAX 15000
+
+/* Input recordings: a header ("SZ8I"), a snapshot to start from and then
+ * each change to keyports[0] to [7] along with the frame it was made on */
+#define INPUT_LOG_MAGIC 0x49385a53
+#define INPUT_LOG_VERSION 1
+#define INPUT_LOG_HEADER_SIZE (7 * 4)
+#define INPUT_LOG_RECORD_SIZE (4 + 8)
+
+/* Input log modes */
+#define INPUT_LOG_NONE 0
+#define INPUT_LOG_RECORD 1
+#define INPUT_LOG_PLAY 2
+
+/* In-memory quick save slots */
+#define QUICK_SLOTS 4
+#define QUICK_SLOT_CAPTURE 1
+#define QUICK_SLOT_RESTORE 2
+
+/* Frames to let the ROM settle after its first keyboard scan */
+#define FAST_BOOT_SETTLE 10
+
+/* Background file writes */
+#define IO_JOBS_MAX 8
+#define IO_JOB_FREE 0
+#define IO_JOB_QUEUED 1
+#define IO_JOB_WRITING 2
+#define IO_JOB_DONE 3
+#define IO_JOB_FAILED 4
+
 /* Variables */
 struct {
 	int state;
@@ -61,6 +123,8 @@ struct {
 	int xoffset;
 	int yoffset;
 	int slots[9];		/* The slots currently saved to (existing state files) */
+	int thumbs[9];		/* The slots with a thumbnail */
+	unsigned char thumbnails[9][SSTATE_THUMB_SIZE];
 	int mode;			/* Are we loading or saving */
 } save_state_dialog;
 
@@ -73,6 +137,21 @@ void file_dialog_cd(char *dir, char *direntry);
 void dirlist_populate(char *dir, char **dirlist, int *dirlist_sizeof,
 	int *dirlist_count, int filetypes);
 int get_filename_next_highest(char *dir, char *format);
-
-
+int state_file_build(unsigned char *buf);
+int state_file_parse(unsigned char *buf, int len);
+void rewind_step(void);
+void rewind_end(void);
+int io_writer_submit(char *fullpath, unsigned char *data, int len,
+	SDL_Surface *surface, char *title);
+void io_writer_poll(void);
+void io_writer_flush(void);
+void io_writer_end(void);
+void quick_slot_request(int slot, int action);
+void quick_slot_flush(void);
+void quick_slot_end(void);
+void fast_boot_end(void);
+void auto_warp_start(void);
+void auto_resume_save(void);
+int input_log_begin(int mode, char *filename);
+void input_log_end(void);
 
@@ -48,6 +48,8 @@ void update_scrn(void) {
 	unsigned char *ptr, *optr, *cptr, d, dc;
 	int x, y, a, mask;
 
+	PROFILE_PUSH(PROFILE_DIFF);
+
 	for (y = 0; y < ZX_VID_VGA_HEIGHT; y++) {
 		ptr = scrnbmp + (y + ZX_VID_VGA_YOFS) * 
 			ZX_VID_FULLWIDTH / 8 + ZX_VID_VGA_XOFS / 8;
@@ -75,6 +77,8 @@ void update_scrn(void) {
 
 	refresh_screen = 0;
 
+	PROFILE_POP();
+
 	sdl_video_update();
 }
 
@@ -86,7 +90,11 @@ void update_scrn(void) {
 void check_events(void) {
 	int b, y;
 
-	keyboard_update();
+	PROFILE_FRAME();
+
+	PROFILE_PUSH(PROFILE_KEYBOARD);
+	keyboard_update(0);
+	PROFILE_POP();
 
 	/* ugly, but there's no pleasant way to do this */
 	if (sdl_emulator.state && !sdl_emulator.paused) {
@@ -234,6 +242,9 @@ int main(int argc, char *argv[]) {
 					/* Initialise the required ROM and RAM */
 					initmem();
 
+					/* The history belongs to the previous machine */
+					rewind_reset();
+
 					#ifdef OSS_SOUND_SUPPORT
 						/* z81 has a variable 'sound' that is set to true
 						 * if the user requests sound else false. At this
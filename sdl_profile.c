@@ -0,0 +1,152 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Includes */
+#include "sdl_engine.h"
+
+#ifdef SDL_PROFILE
+
+/* Defines */
+
+/* Variables */
+char *profile_names[PROFILE_STAGES] = {"cpu", "cpy", "dif", "scl", "ovl",
+	"flp", "snd", "kbd", "idl"};
+char *profile_columns[PROFILE_STAGES] = {"cpu", "copy", "diff", "scale",
+	"overlay", "flip", "sound", "keyboard", "idle"};
+
+/* Each frame in ns, and the sum of the last PROFILE_WINDOW of them */
+unsigned int profile_history[PROFILE_HISTORY][PROFILE_STAGES];
+long long profile_sums[PROFILE_STAGES];
+long profile_frames = 0;
+
+/* Function prototypes */
+
+
+/***************************************************************************
+ * Profile Frame                                                           *
+ ***************************************************************************/
+/* This is called at the start of every frame that input is read for */
+
+void profile_frame(void) {
+	unsigned int *this, *oldest;
+	int stage;
+
+	profile_charge();
+
+	this = profile_history[profile_frames % PROFILE_HISTORY];
+	oldest = profile_frames < PROFILE_WINDOW ? NULL :
+		profile_history[(profile_frames - PROFILE_WINDOW) % PROFILE_HISTORY];
+	for (stage = 0; stage < PROFILE_STAGES; stage++) {
+		if (profile.frame[stage] > 0xffffffffLL) profile.frame[stage] = 0xffffffffLL;
+		this[stage] = profile.frame[stage];
+		profile_sums[stage] += this[stage];
+		if (oldest) profile_sums[stage] -= oldest[stage];
+		profile.frame[stage] = 0;
+	}
+	profile_frames++;
+}
+
+/***************************************************************************
+ * Profile Render                                                          *
+ ***************************************************************************/
+/* Show the averages top-left as two lines of ms */
+
+void profile_render(void) {
+	int stage, frames, line;
+	Uint32 fg_colour, bg_colour;
+	SDL_Surface *renderedtext;
+	char text[2][64];
+	SDL_Rect dstrect;
+	long long total;
+
+	if (!profile_frames) return;
+	frames = profile_frames < PROFILE_WINDOW ? profile_frames : PROFILE_WINDOW;
+
+	for (stage = 0, total = 0; stage < PROFILE_STAGES; stage++)
+		total += profile_sums[stage];
+	text[0][0] = text[1][0] = 0;
+	for (stage = 0; stage < PROFILE_STAGES; stage++) {
+		line = stage < 5 ? 0 : 1;
+		sprintf(text[line] + strlen(text[line]), "%s%4.1f ", profile_names[stage],
+			profile_sums[stage] / 1e6 / frames);
+	}
+	sprintf(text[1] + strlen(text[1]), "all%4.1f", total / 1e6 / frames);
+
+	if (!sdl_emulator.invert) {
+		fg_colour = colours.emu_fg; bg_colour = colours.emu_bg;
+	} else {
+		fg_colour = colours.emu_bg; bg_colour = colours.emu_fg;
+	}
+
+	for (line = 0; line < 2; line++) {
+		renderedtext = BMF_RenderText(BMF_FONT_ZX82, text[line], fg_colour, bg_colour);
+		if (renderedtext == NULL) return;
+		dstrect.x = 0; dstrect.y = line * renderedtext->h;
+		dstrect.w = renderedtext->w; dstrect.h = renderedtext->h;
+		if (SDL_BlitSurface (renderedtext, NULL, video.screen, &dstrect) < 0) {
+			fprintf(stderr, "%s: BlitSurface error: %s\n", __func__, SDL_GetError ());
+			exit(1);
+		}
+		SDL_FreeSurface(renderedtext);
+	}
+}
+
+/***************************************************************************
+ * Profile End                                                             *
+ ***************************************************************************/
+/* Write the frames that are still within the history to profile.csv in
+ * microseconds, the oldest first */
+
+void profile_end(void) {
+	char fullpath[256];
+	long frame;
+	int stage;
+	FILE *fp;
+
+	if (!profile_frames) return;
+
+	#if defined(PLATFORM_GP2X) || defined(__amigaos4__) || defined(_WIN32) || defined(PLATFORM_DINGUX_A320)
+		strcpy(fullpath, LOCAL_DATA_DIR);
+	#else
+		strcpy(fullpath, getenv ("HOME"));
+		strcatdelimiter(fullpath);
+		strcat(fullpath, LOCAL_DATA_DIR);
+	#endif
+	strcatdelimiter(fullpath);
+	strcat(fullpath, "profile.csv");
+
+	if ((fp = fopen(fullpath, "w")) == NULL) {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__, fullpath);
+		return;
+	}
+	fprintf(fp, "frame");
+	for (stage = 0; stage < PROFILE_STAGES; stage++)
+		fprintf(fp, ",%s", profile_columns[stage]);
+	fprintf(fp, "\n");
+
+	frame = profile_frames > PROFILE_HISTORY ? profile_frames - PROFILE_HISTORY : 0;
+	for (; frame < profile_frames; frame++) {
+		fprintf(fp, "%li", frame);
+		for (stage = 0; stage < PROFILE_STAGES; stage++)
+			fprintf(fp, ",%.1f", profile_history[frame % PROFILE_HISTORY][stage] / 1e3);
+		fprintf(fp, "\n");
+	}
+	fclose(fp);
+	profile_frames = 0;
+}
+
+#endif
@@ -0,0 +1,121 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* The frame stage profiler.
+ *
+ * Build with -DSDL_PROFILE to have the time spent within each stage of
+ * a frame measured, shown top-left as the average over the last
+ * PROFILE_WINDOW frames in ms and written to LOCAL_DATA_DIR/profile.csv
+ * a frame per line on exit. Without it the PROFILE_* macros are nothing.
+ *
+ * The stages nest: PROFILE_PUSH starts one within whatever is running,
+ * PROFILE_SWITCH ends it and starts another and PROFILE_POP returns to
+ * what was running before. The time since the last of these is charged
+ * to the stage on top only and so a stage's time excludes those within
+ * it. Anything not within a stage is the Z80 and the ULA's emulation.
+ *
+ * The emulator core marks its stages too so this is included by sdl.h
+ * and mustn't need SDL itself. What's charged is kept here so that the
+ * core doesn't need anything else linked (see sdl.h about -fcommon) */
+
+#ifndef SDL_PROFILE_H
+#define SDL_PROFILE_H
+
+#ifdef SDL_PROFILE
+
+/* Includes */
+#include <time.h>
+
+/* Defines */
+/* Stages */
+#define PROFILE_CPU 0		/* The Z80 and the ULA */
+#define PROFILE_COPY 1		/* The vsync's copy of the new frame */
+#define PROFILE_DIFF 2		/* update_scrn's diff into the VGA memory */
+#define PROFILE_SCALE 3		/* sdl_video_update scaling it up */
+#define PROFILE_OVERLAY 4	/* Dialogs, vkeyb, hotspots and notifications */
+#define PROFILE_FLIP 5		/* SDL_Flip */
+#define PROFILE_SOUND 6		/* sound_frame */
+#define PROFILE_KEYBOARD 7	/* keyboard_update */
+#define PROFILE_IDLE 8		/* Waiting for the next frame */
+#define PROFILE_STAGES 9
+
+#define PROFILE_DEPTH 8		/* How deep the stages can nest */
+#define PROFILE_WINDOW 50	/* Frames that the HUD averages over */
+#define PROFILE_HISTORY (50 * 60 * 10)	/* Frames written to the CSV */
+
+#define PROFILE_PUSH(stage) profile_push(stage)
+#define PROFILE_SWITCH(stage) profile_switch(stage)
+#define PROFILE_POP() profile_pop()
+#define PROFILE_FRAME() profile_frame()
+#define PROFILE_RENDER() profile_render()
+#define PROFILE_END() profile_end()
+
+/* Variables */
+struct {
+	long long stamp;	/* When the stage on top was last charged in ns */
+	int stack[PROFILE_DEPTH];
+	int depth;			/* stack[depth] is on top */
+	long long frame[PROFILE_STAGES];	/* Charged so far this frame in ns */
+} profile;
+
+/* Function prototypes */
+void profile_frame(void);
+void profile_render(void);
+void profile_end(void);
+
+/***************************************************************************
+ * Charge                                                                  *
+ ***************************************************************************/
+/* Charge the time since the last stamp to the stage on top */
+
+static inline void profile_charge(void) {
+	struct timespec now;
+	long long ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (long long)now.tv_sec * 1000000000 + now.tv_nsec;
+	if (profile.stamp) profile.frame[profile.stack[profile.depth]] += ns - profile.stamp;
+	profile.stamp = ns;
+}
+
+static inline void profile_push(int stage) {
+	profile_charge();
+	if (profile.depth < PROFILE_DEPTH - 1) profile.stack[++profile.depth] = stage;
+}
+
+static inline void profile_switch(int stage) {
+	profile_charge();
+	profile.stack[profile.depth] = stage;
+}
+
+static inline void profile_pop(void) {
+	profile_charge();
+	if (profile.depth) profile.depth--;
+}
+
+#else
+
+#define PROFILE_PUSH(stage)
+#define PROFILE_SWITCH(stage)
+#define PROFILE_POP()
+#define PROFILE_FRAME()
+#define PROFILE_RENDER()
+#define PROFILE_END()
+
+#endif
+
+#endif
@@ -162,7 +162,10 @@ void sdl_rcfile_read(void) {
 	#endif
 	int read_vkeyb_alpha, read_vkeyb_autohide, read_vkeyb_toggle_shift;
 	int read_sound_volume, read_sound_device, read_sound_stereo;
-	int read_emulator_ramsize, read_emulator_invert;
+	int read_sound_ay_thread, read_sound_samples, read_sound_buffer_size;
+	int read_emulator_ramsize, read_emulator_invert, read_emulator_runahead;
+	int read_emulator_fastboot, read_emulator_autowarp, read_emulator_resume;
+	int read_rewind_enabled, read_rewind_interval, read_rewind_memory;
 	int count, index, line_count, found;
 	int read_joystick_dead_zone;
 	int read_show_input_id;
@@ -200,9 +203,19 @@ void sdl_rcfile_read(void) {
 	#endif
 	read_emulator_ramsize = UNDEFINED;
 	read_emulator_invert = UNDEFINED;
+	read_emulator_runahead = UNDEFINED;
+	read_emulator_fastboot = UNDEFINED;
+	read_emulator_autowarp = UNDEFINED;
+	read_emulator_resume = UNDEFINED;
 	read_sound_volume = UNDEFINED;
 	read_sound_device = UNDEFINED;
 	read_sound_stereo = UNDEFINED;
+	read_sound_ay_thread = UNDEFINED;
+	read_sound_samples = UNDEFINED;
+	read_sound_buffer_size = UNDEFINED;
+	read_rewind_enabled = UNDEFINED;
+	read_rewind_interval = UNDEFINED;
+	read_rewind_memory = UNDEFINED;
 	read_vkeyb_alpha = UNDEFINED;
 	read_vkeyb_autohide = UNDEFINED;
 	read_vkeyb_toggle_shift = UNDEFINED;
@@ -322,6 +335,32 @@ void sdl_rcfile_read(void) {
 					read_emulator_invert = FALSE;
 				}
 			}
+			strcpy(key, "emulator.runahead=");
+			if (!strncmp(line, key, strlen(key))) {
+				sscanf(&line[strlen(key)], "%i", &read_emulator_runahead);
+			}
+			strcpy(key, "emulator.fastboot=");
+			if (!strncmp(line, key, strlen(key))) {
+				strcpy(value, &line[strlen(key)]);
+				if (strcmp(value, "TRUE") == 0 || strcmp(value, "1") == 0) {
+					read_emulator_fastboot = TRUE;
+				} else if (strcmp(value, "FALSE") == 0 || strcmp(value, "0") == 0) {
+					read_emulator_fastboot = FALSE;
+				}
+			}
+			strcpy(key, "emulator.autowarp=");
+			if (!strncmp(line, key, strlen(key))) {
+				sscanf(&line[strlen(key)], "%i", &read_emulator_autowarp);
+			}
+			strcpy(key, "emulator.resume=");
+			if (!strncmp(line, key, strlen(key))) {
+				strcpy(value, &line[strlen(key)]);
+				if (strcmp(value, "TRUE") == 0 || strcmp(value, "1") == 0) {
+					read_emulator_resume = TRUE;
+				} else if (strcmp(value, "FALSE") == 0 || strcmp(value, "0") == 0) {
+					read_emulator_resume = FALSE;
+				}
+			}
 			#ifdef OSS_SOUND_SUPPORT
 				strcpy(key, "sound.volume=");
 				if (!strncmp(line, key, strlen(key))) {
@@ -349,7 +388,46 @@ void sdl_rcfile_read(void) {
 						read_sound_stereo = FALSE;
 					}
 				}
+				strcpy(key, "sound.ay_thread=");
+				if (!strncmp(line, key, strlen(key))) {
+					strcpy(value, &line[strlen(key)]);
+					if (strcmp(value, "TRUE") == 0 || strcmp(value, "1") == 0) {
+						read_sound_ay_thread = TRUE;
+					} else if (strcmp(value, "FALSE") == 0 || strcmp(value, "0") == 0) {
+						read_sound_ay_thread = FALSE;
+					}
+				}
+				strcpy(key, "sound.samples=");
+				if (!strncmp(line, key, strlen(key))) {
+					strcpy(value, &line[strlen(key)]);
+					if (strcmp(value, "auto") == 0) {
+						read_sound_samples = SOUND_SAMPLES_AUTO;
+					} else {
+						sscanf(value, "%i", &read_sound_samples);
+					}
+				}
+				strcpy(key, "sound.buffer_size=");
+				if (!strncmp(line, key, strlen(key))) {
+					sscanf(&line[strlen(key)], "%i", &read_sound_buffer_size);
+				}
 			#endif
+			strcpy(key, "rewind.enabled=");
+			if (!strncmp(line, key, strlen(key))) {
+				strcpy(value, &line[strlen(key)]);
+				if (strcmp(value, "TRUE") == 0 || strcmp(value, "1") == 0) {
+					read_rewind_enabled = TRUE;
+				} else if (strcmp(value, "FALSE") == 0 || strcmp(value, "0") == 0) {
+					read_rewind_enabled = FALSE;
+				}
+			}
+			strcpy(key, "rewind.interval=");
+			if (!strncmp(line, key, strlen(key))) {
+				sscanf(&line[strlen(key)], "%i", &read_rewind_interval);
+			}
+			strcpy(key, "rewind.memory=");
+			if (!strncmp(line, key, strlen(key))) {
+				sscanf(&line[strlen(key)], "%i", &read_rewind_memory);
+			}
 			strcpy(key, "vkeyb.alpha=");
 			if (!strncmp(line, key, strlen(key))) {
 				sscanf(&line[strlen(key)], "%i", &read_vkeyb_alpha);
@@ -529,9 +607,19 @@ void sdl_rcfile_read(void) {
 		#endif
 		printf("read_emulator_ramsize=%i\n", read_emulator_ramsize);
 		printf("read_emulator_invert=%i\n", read_emulator_invert);
+		printf("read_emulator_runahead=%i\n", read_emulator_runahead);
+		printf("read_emulator_fastboot=%i\n", read_emulator_fastboot);
+		printf("read_emulator_autowarp=%i\n", read_emulator_autowarp);
+		printf("read_emulator_resume=%i\n", read_emulator_resume);
 		printf("read_sound_volume=%i\n", read_sound_volume);
 		printf("read_sound_device=%i\n", read_sound_device);
 		printf("read_sound_stereo=%i\n", read_sound_stereo);
+		printf("read_sound_ay_thread=%i\n", read_sound_ay_thread);
+		printf("read_sound_samples=%i\n", read_sound_samples);
+		printf("read_sound_buffer_size=%i\n", read_sound_buffer_size);
+		printf("read_rewind_enabled=%i\n", read_rewind_enabled);
+		printf("read_rewind_interval=%i\n", read_rewind_interval);
+		printf("read_rewind_memory=%i\n", read_rewind_memory);
 		printf("read_vkeyb_alpha=%i\n", read_vkeyb_alpha);
 		printf("read_vkeyb_autohide=%i\n", read_vkeyb_autohide);
 		printf("read_vkeyb_toggle_shift=%i\n", read_vkeyb_toggle_shift);
@@ -641,6 +729,32 @@ void sdl_rcfile_read(void) {
 		/* Invert screen (it's vetted) */
 		if (read_emulator_invert != UNDEFINED) sdl_emulator.invert = read_emulator_invert;
 
+		/* Run ahead */
+		if (read_emulator_runahead != UNDEFINED) {
+			if (read_emulator_runahead >= 0 && read_emulator_runahead <= RUNAHEAD_MAX) {
+				sdl_emulator.runahead = read_emulator_runahead;
+			} else {
+				fprintf(stderr, "%s: emulator.runahead within rcfile is invalid: "
+					"try 0 to %i\n", __func__, RUNAHEAD_MAX);
+			}
+		}
+
+		/* Fast boot (it's vetted) */
+		if (read_emulator_fastboot != UNDEFINED) sdl_emulator.fastboot = read_emulator_fastboot;
+
+		/* Auto-warp */
+		if (read_emulator_autowarp != UNDEFINED) {
+			if (read_emulator_autowarp >= 0 && read_emulator_autowarp <= AUTO_WARP_MAX) {
+				sdl_emulator.autowarp = read_emulator_autowarp;
+			} else {
+				fprintf(stderr, "%s: emulator.autowarp within rcfile is invalid: "
+					"try 0 to %i\n", __func__, AUTO_WARP_MAX);
+			}
+		}
+
+		/* Auto-resume (it's vetted) */
+		if (read_emulator_resume != UNDEFINED) sdl_emulator.resume = read_emulator_resume;
+
 		#ifdef OSS_SOUND_SUPPORT
 			/* Sound volume */
 			if (read_sound_volume != UNDEFINED) {
@@ -657,8 +771,62 @@ void sdl_rcfile_read(void) {
 
 			/* Sound stereo (it's vetted) */
 			if (read_sound_stereo != UNDEFINED) sdl_sound.stereo = read_sound_stereo;
+
+			/* AY synthesis within the audio callback (it's vetted) */
+			if (read_sound_ay_thread != UNDEFINED) sdl_sound.ay_thread = read_sound_ay_thread;
+
+			/* Audio device buffer size */
+			if (read_sound_samples != UNDEFINED) {
+				if (read_sound_samples == SOUND_SAMPLES_AUTO ||
+					sdl_sound_samples_valid(read_sound_samples)) {
+					sdl_sound.samples = read_sound_samples;
+				} else {
+					fprintf(stderr, "%s: sound.samples within rcfile is invalid: "
+						"try auto or a power of 2 from %i to %i\n", __func__,
+						SOUND_SAMPLES_MIN, SOUND_SAMPLES_MAX);
+				}
+			}
+
+			/* Linear sound buffer size */
+			if (read_sound_buffer_size != UNDEFINED) {
+				if (read_sound_buffer_size >= SOUND_BUFFER_SIZE_MIN &&
+					read_sound_buffer_size <= SOUND_BUFFER_SIZE_MAX) {
+					sdl_sound.buffer_size = read_sound_buffer_size;
+				} else {
+					fprintf(stderr, "%s: sound.buffer_size within rcfile is invalid: "
+						"try %i to %i\n", __func__, SOUND_BUFFER_SIZE_MIN,
+						SOUND_BUFFER_SIZE_MAX);
+				}
+			}
 		#endif
 
+		/* Rewind enabled (it's vetted) */
+		if (read_rewind_enabled != UNDEFINED) sdl_rewind.state = read_rewind_enabled;
+
+		/* Rewind interval */
+		if (read_rewind_interval != UNDEFINED) {
+			if (read_rewind_interval >= REWIND_INTERVAL_MIN &&
+				read_rewind_interval <= REWIND_INTERVAL_MAX) {
+				sdl_rewind.interval = read_rewind_interval;
+			} else {
+				fprintf(stderr, "%s: rewind.interval within rcfile is invalid: "
+					"try %i to %i\n", __func__, REWIND_INTERVAL_MIN,
+					REWIND_INTERVAL_MAX);
+			}
+		}
+
+		/* Rewind memory */
+		if (read_rewind_memory != UNDEFINED) {
+			if (read_rewind_memory >= REWIND_MEMORY_MIN &&
+				read_rewind_memory <= REWIND_MEMORY_MAX) {
+				sdl_rewind.memory = read_rewind_memory;
+			} else {
+				fprintf(stderr, "%s: rewind.memory within rcfile is invalid: "
+					"try %i to %i\n", __func__, REWIND_MEMORY_MIN,
+					REWIND_MEMORY_MAX);
+			}
+		}
+
 		/* Vkeyb alpha */
 		if (read_vkeyb_alpha != UNDEFINED) {
 			if (read_vkeyb_alpha >= 0 && read_vkeyb_alpha <= SDL_ALPHA_OPAQUE) {
@@ -1089,6 +1257,28 @@ void rcfile_write(void) {
 	}
 	fprintf(fp, "%s=%s\n", key, value);
 
+	fprintf(fp, "emulator.runahead=%i\n", sdl_emulator.runahead);
+
+	/* sdl_emulator.fastboot */
+	strcpy(key, "emulator.fastboot"); strcpy(value, "");
+	if (sdl_emulator.fastboot) {
+		strcat(value, "TRUE");
+	} else {
+		strcat(value, "FALSE");
+	}
+	fprintf(fp, "%s=%s\n", key, value);
+
+	fprintf(fp, "emulator.autowarp=%i\n", sdl_emulator.autowarp);
+
+	/* sdl_emulator.resume */
+	strcpy(key, "emulator.resume"); strcpy(value, "");
+	if (sdl_emulator.resume) {
+		strcat(value, "TRUE");
+	} else {
+		strcat(value, "FALSE");
+	}
+	fprintf(fp, "%s=%s\n", key, value);
+
 	fprintf(fp, "sound.volume=%i\n", sdl_sound.volume);
 
 	/* sdl_sound.device */
@@ -1113,6 +1303,36 @@ void rcfile_write(void) {
 	}
 	fprintf(fp, "%s=%s\n", key, value);
 
+	/* sdl_sound.ay_thread */
+	strcpy(key, "sound.ay_thread"); strcpy(value, "");
+	if (sdl_sound.ay_thread) {
+		strcat(value, "TRUE");
+	} else {
+		strcat(value, "FALSE");
+	}
+	fprintf(fp, "%s=%s\n", key, value);
+
+	/* sdl_sound.samples */
+	if (sdl_sound.samples == SOUND_SAMPLES_AUTO) {
+		fprintf(fp, "sound.samples=auto\n");
+	} else {
+		fprintf(fp, "sound.samples=%i\n", sdl_sound.samples);
+	}
+
+	fprintf(fp, "sound.buffer_size=%i\n", sdl_sound.buffer_size);
+
+	/* sdl_rewind.state */
+	strcpy(key, "rewind.enabled"); strcpy(value, "");
+	if (sdl_rewind.state) {
+		strcat(value, "TRUE");
+	} else {
+		strcat(value, "FALSE");
+	}
+	fprintf(fp, "%s=%s\n", key, value);
+
+	fprintf(fp, "rewind.interval=%i\n", sdl_rewind.interval);
+	fprintf(fp, "rewind.memory=%i\n", sdl_rewind.memory);
+
 	fprintf(fp, "vkeyb.alpha=%i\n", vkeyb.alpha);
 
 	/* vkeyb.autohide */
@@ -1776,6 +1996,14 @@ void notification_show(int funcid, struct Notification *notification) {
 		/* Kill an existing notification */
 		the_nfn.timeout = 0;
 
+	} else if (funcid == NOTIFICATION_QUERY && notification != NULL) {
+
+		/* Return a copy of the existing notification with the time
+		 * remaining before it expires (<= 0 if there isn't one) */
+		*notification = the_nfn;
+		if (the_nfn.timeout > 0)
+			notification->timeout -= SDL_GetTicks() - last_time;
+
 	} else if (funcid == NOTIFICATION_SHOW && notification == NULL) {
 
 		/* Show an existing notification */
@@ -64,6 +64,7 @@
 /* Notification function IDs */
 #define NOTIFICATION_SHOW 1
 #define NOTIFICATION_KILL 2
+#define NOTIFICATION_QUERY 3
 
 /* Notification timeouts in ms */
 #define NOTIFICATION_TIMEOUT_1250 1250
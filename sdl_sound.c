@@ -21,10 +21,34 @@
 #include "sdl_engine.h"
 
 /* Defines */
+/* The ring that the capture is written through. Size must be a power of two */
+#define CAPTURE_RING_SIZE (1024 * 256)
+
+#ifdef __GNUC__
+	#define CAPTURE_BARRIER() __sync_synchronize()
+#else
+	#define CAPTURE_BARRIER()
+#endif
 
 /* Variables */
+SDL_AudioSpec sound_desired;
+int sound_samples_auto = 0;		/* Where auto sizing has got to */
+int sound_auto;					/* TRUE if auto sizing is in effect */
+Uint32 sound_underrun_time;
+
+FILE *capture_fp = NULL;
+unsigned char *capture_ring;
+volatile unsigned int capture_head, capture_tail;
+volatile int capture_quit;
+SDL_Thread *capture_thread;
+unsigned long capture_len;
+int capture_channels;
+int capture_freq;
 
 /* Function prototypes */
+int sdl_sound_open(void);
+void sdl_sound_capture_header(void);
+int sdl_sound_capture_writer(void *data);
 
 
 /***************************************************************************
@@ -35,36 +59,51 @@
 
 int sdl_sound_init(int freq, int *stereo, int *sixteenbit) {
 	SDL_AudioSpec desired, obtained;
+	int samples;
 	
 	sdl_sound.buffer_start = sdl_sound.buffer_end = 0;
+	sdl_sound.buffer_read = 0;
+	sdl_sound.underruns = 0;
+
+	/* The command line overrides the rcfile */
+	if (sdl_com_line.samples != UNDEFINED) {
+		samples = sdl_com_line.samples;
+	} else {
+		samples = sdl_sound.samples;
+	}
+	sound_auto = samples == SOUND_SAMPLES_AUTO;
+	if (sound_auto) {
+		/* Start small (or where we got to last time) and let
+		 * sdl_sound_frame grow it if it underruns */
+		if (!sound_samples_auto) sound_samples_auto = SOUND_SAMPLES_AUTO_START;
+		samples = sound_samples_auto;
+	}
 	
 	desired.freq = freq;
 	#if defined(PLATFORM_GP2X)
 		desired.format = AUDIO_U16;
-		#if defined(TOOLCHAIN_OPEN2X) || defined(TOOLCHAIN_OPENWIZ)
-			desired.samples = 256;
-		#else
-			desired.samples = 1024;	/* This might be better at 512 */
-		#endif
 	#else
 		desired.format = AUDIO_U8;	/* z81's default */
-		desired.samples = 1024;		/* This might be better at 512 */
 	#endif
+	desired.samples = samples;
 	desired.channels = *stereo + 1;
 	desired.callback = sdl_sound_callback;
 	desired.userdata = NULL;
+	sound_desired = desired;
 
 	/* Open the audio device */
-	if (SDL_OpenAudio(&desired, &obtained) < 0 ) {
-		fprintf(stderr, "%s: Couldn't open audio: %s\n", __func__, SDL_GetError());
-		return TRUE;
-	}
+	if (sdl_sound_open()) return TRUE;
+	obtained = sound_desired;
 
 	sdl_sound.state = TRUE;
 
 	*stereo = obtained.channels - 1;
 	*sixteenbit = (obtained.format & 0xff) / 16;
 
+	if (sound_auto) printf("%s: Audio buffer is %i samples (auto)\n",
+		__func__, obtained.samples);
+	sound_underrun_time = SDL_GetTicks();
+
 	/* Start playing */
 	SDL_PauseAudio(0);
 
@@ -95,14 +134,74 @@ int sdl_sound_init(int freq, int *stereo, int *sixteenbit) {
 	return FALSE;
 }
 
+/***************************************************************************
+ * Sound Open                                                              *
+ ***************************************************************************/
+/* Opens the audio device using sound_desired and then (re)allocates the
+ * linear sound buffer so that it's at least sdl_sound.buffer_size and can
+ * comfortably hold a few of the device's own buffers. sound_desired is
+ * updated with what was obtained.
+ * 
+ * On exit: returns FALSE on success else
+ *          returns TRUE on error */
+
+int sdl_sound_open(void) {
+	SDL_AudioSpec obtained;
+	int size;
+
+	if (SDL_OpenAudio(&sound_desired, &obtained) < 0 ) {
+		fprintf(stderr, "%s: Couldn't open audio: %s\n", __func__, SDL_GetError());
+		return TRUE;
+	}
+
+	size = sdl_sound.buffer_size;
+	if (size < obtained.size * 4) size = obtained.size * 4;
+	if (sdl_sound.buffer == NULL || size > sdl_sound.buffer_capacity) {
+		if (sdl_sound.buffer) free(sdl_sound.buffer);
+		if ((sdl_sound.buffer = malloc(size)) == NULL) {
+			fprintf(stderr, "%s: Cannot allocate memory for the sound buffer\n", __func__);
+			SDL_CloseAudio();
+			return TRUE;
+		}
+		/* Anything that was waiting to be played has gone */
+		if (sdl_sound.buffer_capacity)
+			sdl_sound.buffer_read += (sdl_sound.buffer_end - sdl_sound.buffer_start +
+				sdl_sound.buffer_capacity) % sdl_sound.buffer_capacity;
+		sdl_sound.buffer_start = sdl_sound.buffer_end = 0;
+		sdl_sound.buffer_capacity = size;
+	}
+
+	sound_desired = obtained;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Sound Samples Valid                                                     *
+ ***************************************************************************/
+/* On exit: returns TRUE if samples is a usable audio device buffer size
+ *          else FALSE */
+
+int sdl_sound_samples_valid(int samples) {
+	return samples >= SOUND_SAMPLES_MIN && samples <= SOUND_SAMPLES_MAX &&
+		(samples & (samples - 1)) == 0;
+}
+
 /***************************************************************************
  * Sound Callback                                                          *
  ***************************************************************************/
 /* When the audio device is ready for more data it calls this function which
  * could be running in another thread. The data will have been previously
- * stored in our linear sound buffer via the sound frame function below */
+ * stored in our linear sound buffer via the sound frame function below.
+ * 
+ * If sdl_sound.ay_thread is TRUE then the emulator only supplies the AY's
+ * register writes and the AY itself is synthesised here on top of what was
+ * taken from the buffer, which moves that work off the emulation thread */
 
 void sdl_sound_callback(void *userdata, Uint8 *stream, int len) {
+	unsigned long pos = sdl_sound.buffer_read;
+	Uint8 *start = stream;
+	int wanted = len;
 	#if defined(SDL_DEBUG_SOUND) || defined(SDL_DEBUG_TIMING)
 		static Uint32 lasttime = 0;
 		static int Hz = 0;
@@ -121,13 +220,25 @@ void sdl_sound_callback(void *userdata, Uint8 *stream, int len) {
 		*(stream++) = (rand() % 256) / 8;
 	} */
 
+	TRACE_THREAD("audio");
+	TRACE_BEGIN("callback", "sound");
+
 	/* Keep writing to the stream until it's full or our linear
 	 * buffer's end reaches its start i.e. no more sound data */
 	while (len--) {
 		if (sdl_sound.buffer_start == sdl_sound.buffer_end) break;
 		*(stream++) = sdl_sound.buffer[sdl_sound.buffer_start++];
-		if (sdl_sound.buffer_start >= SOUND_BUFFER_SIZE) sdl_sound.buffer_start = 0;
+		if (sdl_sound.buffer_start >= sdl_sound.buffer_capacity) sdl_sound.buffer_start = 0;
+		sdl_sound.buffer_read++;
 	}
+
+	/* Once sound is flowing, running out is an underrun */
+	if (stream - start < wanted && sdl_sound.buffer_read) sdl_sound.underruns++;
+
+	if (sdl_sound.ay_thread && stream > start)
+		sound_ay_callback(start, stream - start, pos);
+
+	TRACE_END("callback", "sound");
 }
 
 /***************************************************************************
@@ -141,14 +252,39 @@ void sdl_sound_callback(void *userdata, Uint8 *stream, int len) {
 
 void sdl_sound_frame(unsigned char *data, int len) {
 	static int ovfcnt = 0;
+
+	/* If auto sizing then grow the audio device's buffer if it keeps
+	 * underrunning. This is done here rather than in the callback since
+	 * the device has to be closed and reopened */
+	if (sound_auto) {
+		if (sdl_sound.underruns >= SOUND_UNDERRUN_LIMIT &&
+			sound_desired.samples < SOUND_SAMPLES_MAX) {
+			SDL_CloseAudio();
+			sound_desired.samples *= 2;
+			if (sdl_sound_open()) {
+				sdl_sound.state = FALSE;
+				return;
+			}
+			sound_samples_auto = sound_desired.samples;
+			printf("%s: Audio buffer is %i samples (auto)\n", __func__,
+				sound_desired.samples);
+			SDL_PauseAudio(0);
+			sdl_sound.underruns = 0;
+			sound_underrun_time = SDL_GetTicks();
+		} else if (SDL_GetTicks() - sound_underrun_time >= SOUND_UNDERRUN_PERIOD) {
+			sdl_sound.underruns = 0;
+			sound_underrun_time = SDL_GetTicks();
+		}
+	}
 	
 	SDL_LockAudio();
 	while (len--) {
 		sdl_sound.buffer[sdl_sound.buffer_end++] = *(data++);
-		if (sdl_sound.buffer_end >= SOUND_BUFFER_SIZE) sdl_sound.buffer_end = 0;
+		if (sdl_sound.buffer_end >= sdl_sound.buffer_capacity) sdl_sound.buffer_end = 0;
 		if (sdl_sound.buffer_end == sdl_sound.buffer_start) {
 			sdl_sound.buffer_start++;
-			if (sdl_sound.buffer_start >= SOUND_BUFFER_SIZE) sdl_sound.buffer_start = 0;
+			if (sdl_sound.buffer_start >= sdl_sound.buffer_capacity) sdl_sound.buffer_start = 0;
+			sdl_sound.buffer_read++;
 			if (ovfcnt++ < 10) fprintf(stderr, "%s: Sound buffer overflow\n", __func__);
 		}
 	}
@@ -164,8 +300,182 @@ void sdl_sound_end(void) {
 		sdl_sound.state = FALSE;
 		SDL_CloseAudio();
 	}
+	if (sdl_sound.buffer) {
+		free(sdl_sound.buffer);
+		sdl_sound.buffer = NULL;
+		sdl_sound.buffer_capacity = 0;
+	}
 }
 
-#endif	/* OSS_SOUND_SUPPORT */
+/***************************************************************************
+ * Sound Lock                                                              *
+ ***************************************************************************/
+/* The emulator calls these around anything it shares with the callback */
+
+void sdl_sound_lock(void) {
+	SDL_LockAudio();
+}
+
+void sdl_sound_unlock(void) {
+	SDL_UnlockAudio();
+}
+
+/***************************************************************************
+ * Sound Capture Start                                                     *
+ ***************************************************************************/
+/* Optional capture of everything that's played to a .wav file (sz81 -a).
+ * Each frame is copied into a preallocated ring and a background thread
+ * does the actual writing so that the emulator never waits on the disk.
+ * The header's lengths are patched when the capture ends. It doesn't need
+ * an audio device so it still works if one couldn't be opened.
+ * 
+ * The emulator calls this every time its sound is initialised but the
+ * capture only starts the first time, and then runs across resets */
+
+void sdl_sound_capture_start(int freq, int stereo) {
+	static int tried = FALSE;
+
+	if (!*sdl_com_line.wavfile || tried) return;
+	tried = TRUE;
+
+	if ((capture_fp = fopen(sdl_com_line.wavfile, "wb")) == NULL) {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__,
+			sdl_com_line.wavfile);
+		return;
+	}
+
+	if ((capture_ring = malloc(CAPTURE_RING_SIZE)) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		fclose(capture_fp);
+		capture_fp = NULL;
+		return;
+	}
+
+	capture_head = capture_tail = 0;
+	capture_quit = FALSE;
+	capture_len = 0;
+	capture_channels = stereo + 1;
+	capture_freq = freq;
+	sdl_sound_capture_header();
+
+	if ((capture_thread = SDL_CreateThread(sdl_sound_capture_writer, NULL)) == NULL) {
+		fprintf(stderr, "%s: Cannot create thread: %s\n", __func__,
+			SDL_GetError());
+		free(capture_ring);
+		fclose(capture_fp);
+		capture_fp = NULL;
+	}
+}
+
+/***************************************************************************
+ * Sound Capture Header                                                    *
+ ***************************************************************************/
+/* Writes the RIFF header for the 8-bit unsigned PCM captured so far */
+
+void sdl_sound_capture_header(void) {
+	unsigned char hdr[44];
+	unsigned long riff = capture_len + 36;
+	unsigned long rate = capture_freq;
+	unsigned long bytes = rate * capture_channels;
+
+	memcpy(hdr, "RIFF    WAVEfmt ", 16);
+	hdr[4] = riff; hdr[5] = riff >> 8; hdr[6] = riff >> 16; hdr[7] = riff >> 24;
+	hdr[16] = 16; hdr[17] = hdr[18] = hdr[19] = 0;	/* fmt chunk size */
+	hdr[20] = 1; hdr[21] = 0;						/* PCM */
+	hdr[22] = capture_channels; hdr[23] = 0;
+	hdr[24] = rate; hdr[25] = rate >> 8; hdr[26] = rate >> 16; hdr[27] = rate >> 24;
+	hdr[28] = bytes; hdr[29] = bytes >> 8; hdr[30] = bytes >> 16; hdr[31] = bytes >> 24;
+	hdr[32] = capture_channels; hdr[33] = 0;		/* Block align */
+	hdr[34] = 8; hdr[35] = 0;						/* Unsigned 8-bit */
+	memcpy(hdr + 36, "data", 4);
+	hdr[40] = capture_len; hdr[41] = capture_len >> 8;
+	hdr[42] = capture_len >> 16; hdr[43] = capture_len >> 24;
+
+	fseek(capture_fp, 0, SEEK_SET);
+	fwrite(hdr, 1, sizeof(hdr), capture_fp);
+	fseek(capture_fp, 0, SEEK_END);
+}
+
+/***************************************************************************
+ * Sound Capture Writer                                                    *
+ ***************************************************************************/
+/* This runs in its own thread, writing out whatever's in the ring */
+
+int sdl_sound_capture_writer(void *data) {
+	unsigned int head, count;
+
+	for (;;) {
+		head = capture_head;
+		if (head == capture_tail) {
+			if (capture_quit) break;
+			SDL_Delay(10);
+			continue;
+		}
+		CAPTURE_BARRIER();
+
+		/* Up to the tail or the end of the ring, whichever is first */
+		count = capture_tail - head;
+		if (count > CAPTURE_RING_SIZE - (head & (CAPTURE_RING_SIZE - 1)))
+			count = CAPTURE_RING_SIZE - (head & (CAPTURE_RING_SIZE - 1));
 
+		fwrite(capture_ring + (head & (CAPTURE_RING_SIZE - 1)), 1, count, capture_fp);
+		CAPTURE_BARRIER();
+		capture_head = head + count;
+	}
 
+	return 0;
+}
+
+/***************************************************************************
+ * Sound Capture Frame                                                     *
+ ***************************************************************************/
+/* This receives the emulator's 8-bit unsigned samples before they're sent
+ * to sdl_sound_frame. The capture stays with whatever channels it started
+ * with, converting if the emulator has since changed */
+
+void sdl_sound_capture_frame(unsigned char *data, int len, int stereo) {
+	unsigned int tail = capture_tail;
+	int count;
+
+	if (!capture_fp) return;
+
+	if (stereo + 1 != capture_channels)
+		len = (capture_channels == 2 ? len * 2 : len / 2);
+
+	/* The writer only falls behind if the disk can't keep up, and we'd
+	 * rather wait than leave holes in the capture */
+	while (CAPTURE_RING_SIZE - (tail - capture_head) < len) SDL_Delay(1);
+
+	for (count = 0; count < len; count++, tail++) {
+		if (stereo + 1 == capture_channels) {
+			capture_ring[tail & (CAPTURE_RING_SIZE - 1)] = data[count];
+		} else if (capture_channels == 2) {
+			capture_ring[tail & (CAPTURE_RING_SIZE - 1)] = data[count / 2];
+		} else {
+			capture_ring[tail & (CAPTURE_RING_SIZE - 1)] = data[count * 2];
+		}
+	}
+
+	CAPTURE_BARRIER();
+	capture_tail = tail;
+	capture_len += len;
+}
+
+/***************************************************************************
+ * Sound Capture End                                                       *
+ ***************************************************************************/
+/* This is called once on exit */
+
+void sdl_sound_capture_end(void) {
+	if (!capture_fp) return;
+
+	capture_quit = TRUE;
+	SDL_WaitThread(capture_thread, NULL);
+
+	sdl_sound_capture_header();
+	fclose(capture_fp);
+	capture_fp = NULL;
+	free(capture_ring);
+}
+
+#endif	/* OSS_SOUND_SUPPORT */
@@ -21,8 +21,29 @@
 #define DEVICE_ZONX 2
 #define DEVICE_VSYNC 3
 
+/* Audio device buffer sizes in samples. With SOUND_SAMPLES_AUTO the
+ * device is opened with SOUND_SAMPLES_AUTO_START and doubled whenever
+ * SOUND_UNDERRUN_LIMIT underruns occur within SOUND_UNDERRUN_PERIOD ms */
+#if defined(PLATFORM_GP2X) && (defined(TOOLCHAIN_OPEN2X) || defined(TOOLCHAIN_OPENWIZ))
+	#define SOUND_SAMPLES_DEFAULT 256
+#else
+	#define SOUND_SAMPLES_DEFAULT 1024	/* This might be better at 512 */
+#endif
+#define SOUND_SAMPLES_AUTO 0
+#define SOUND_SAMPLES_MIN 64
+#define SOUND_SAMPLES_MAX 8192
+#define SOUND_SAMPLES_AUTO_START 256
+#define SOUND_UNDERRUN_LIMIT 3
+#define SOUND_UNDERRUN_PERIOD 5000
+
+/* Linear sound buffer sizes in bytes */
+#define SOUND_BUFFER_SIZE_MIN (1024 * 4)
+#define SOUND_BUFFER_SIZE_MAX (1024 * 1024)
+
 /* Variables */
 
 /* Function prototypes */
+int sdl_sound_samples_valid(int samples);
+void sdl_sound_callback(void *userdata, Uint8 *stream, int len);
 
 
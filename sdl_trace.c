@@ -0,0 +1,243 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Includes */
+#include <sys/time.h>
+#include "sdl_engine.h"
+
+/* Defines */
+#ifdef __GNUC__
+	#define TRACE_BARRIER() __sync_synchronize()
+	#define TRACE_CLAIM(counter) __sync_fetch_and_add(counter, 1)
+#else
+	#define TRACE_BARRIER()
+	#define TRACE_CLAIM(counter) (*(counter))++
+#endif
+
+/* Variables */
+struct trace_record {
+	long long us;		/* Since trace_begin */
+	const char *name;
+	const char *cat;
+	int phase;			/* 'B'egin, 'E'nd or 'i'nstant */
+};
+
+struct trace_buffer {
+	const char *name;	/* The thread's */
+	volatile int count;	/* Records written, which is only ever raised */
+	int dropped;
+	struct trace_record *chunks[TRACE_CHUNKS];
+};
+
+struct trace_buffer *trace_buffers[TRACE_THREADS];
+int trace_threads = 0;	/* Slots of trace_buffers claimed */
+__thread struct trace_buffer *trace_mine = NULL;
+__thread int trace_unlisted = FALSE;	/* TRUE if there wasn't a slot */
+
+char trace_filename[256];
+struct timeval trace_start;
+int trace_batch = FALSE;	/* TRUE whilst within a batch of scanlines */
+int trace_framing = FALSE;	/* TRUE whilst within a frame */
+
+/* Function prototypes */
+struct trace_buffer *trace_buffer(void);
+
+
+/***************************************************************************
+ * Trace Begin                                                             *
+ ***************************************************************************/
+/* On entry: char *filename = the JSON to write on exit
+ *  On exit: returns TRUE on error
+ *           else FALSE */
+
+int trace_begin(char *filename) {
+	FILE *fp;
+
+	/* Find out now rather than on exit if it can't be written */
+	if ((fp = fopen(filename, "w")) == NULL) {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__, filename);
+		return TRUE;
+	}
+	fclose(fp);
+
+	strncpy(trace_filename, filename, 255);
+	trace_filename[255] = 0;
+	gettimeofday(&trace_start, NULL);
+	sdl_trace.state = TRUE;
+	trace_thread("main");
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Trace Buffer                                                            *
+ ***************************************************************************/
+/* This returns the calling thread's buffer, claiming a slot for it the
+ * first time through.
+ *
+ * On exit: returns a pointer to the buffer
+ *          else NULL if there wasn't a slot or the memory */
+
+struct trace_buffer *trace_buffer(void) {
+	int slot;
+
+	if (trace_mine || trace_unlisted) return trace_mine;
+
+	trace_unlisted = TRUE;
+	if ((slot = TRACE_CLAIM(&trace_threads)) >= TRACE_THREADS) {
+		fprintf(stderr, "%s: Too many threads to trace\n", __func__);
+		return NULL;
+	}
+	if ((trace_mine = calloc(1, sizeof(struct trace_buffer))) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		return NULL;
+	}
+	trace_unlisted = FALSE;
+	TRACE_BARRIER();
+	trace_buffers[slot] = trace_mine;
+
+	return trace_mine;
+}
+
+/***************************************************************************
+ * Trace Event                                                             *
+ ***************************************************************************/
+/* The record is complete before the count is raised past it so that what
+ * trace_end reads below the count is never half written.
+ *
+ * On entry: const char *name and *cat = the event and its category,
+ *           which must last until the end (string literals are fine)
+ *           int phase = 'B', 'E' or 'i' */
+
+void trace_event(const char *name, const char *cat, int phase) {
+	struct trace_buffer *buffer;
+	struct trace_record **chunk, *record;
+	struct timeval now;
+	int count;
+
+	if ((buffer = trace_buffer()) == NULL) return;
+
+	count = buffer->count;
+	if (count >= TRACE_CHUNK * TRACE_CHUNKS) {
+		buffer->dropped++;
+		return;
+	}
+	chunk = &buffer->chunks[count / TRACE_CHUNK];
+	if (*chunk == NULL &&
+		(*chunk = malloc(TRACE_CHUNK * sizeof(struct trace_record))) == NULL) {
+		buffer->dropped++;
+		return;
+	}
+
+	gettimeofday(&now, NULL);
+	record = *chunk + count % TRACE_CHUNK;
+	record->us = (long long)(now.tv_sec - trace_start.tv_sec) * 1000000 +
+		now.tv_usec - trace_start.tv_usec;
+	record->name = name;
+	record->cat = cat;
+	record->phase = phase;
+	TRACE_BARRIER();
+	buffer->count = count + 1;
+}
+
+/***************************************************************************
+ * Trace Thread                                                            *
+ ***************************************************************************/
+/* This names the calling thread's track, which is numbered otherwise */
+
+void trace_thread(const char *name) {
+	struct trace_buffer *buffer;
+
+	if ((buffer = trace_buffer()) && buffer->name == NULL) buffer->name = name;
+}
+
+/***************************************************************************
+ * Trace Frame                                                             *
+ ***************************************************************************/
+/* The emulator calls this at every vsync, which ends one frame and
+ * begins the next, and trace_scanline at the start of every scanline */
+
+void trace_frame(void) {
+	if (trace_batch) trace_event("scanlines", "ula", 'E');
+	trace_batch = FALSE;
+	if (trace_framing) trace_event("frame", "ula", 'E');
+	trace_event("frame", "ula", 'B');
+	trace_framing = TRUE;
+}
+
+void trace_scanline(int line) {
+	if (line % TRACE_SCANLINES) return;
+	if (trace_batch) trace_event("scanlines", "ula", 'E');
+	trace_event("scanlines", "ula", 'B');
+	trace_batch = TRUE;
+}
+
+/***************************************************************************
+ * Trace End                                                               *
+ ***************************************************************************/
+/* This stops tracing and writes everything recorded as Chrome trace JSON.
+ * A thread that's still running may add to its buffer whilst it's being
+ * read which is harmless, and so the buffers are left for the exit */
+
+void trace_end(void) {
+	struct trace_buffer *buffer;
+	struct trace_record *record;
+	int slot, threads, count, index, first = TRUE;
+	FILE *fp;
+
+	if (!sdl_trace.state) return;
+
+	if (trace_batch) trace_event("scanlines", "ula", 'E');
+	if (trace_framing) trace_event("frame", "ula", 'E');
+	trace_batch = trace_framing = FALSE;
+	sdl_trace.state = FALSE;
+	TRACE_BARRIER();
+
+	if ((fp = fopen(trace_filename, "w")) == NULL) {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__, trace_filename);
+		return;
+	}
+	threads = trace_threads < TRACE_THREADS ? trace_threads : TRACE_THREADS;
+
+	fprintf(fp, "{\"traceEvents\":[\n");
+	for (slot = 0; slot < threads; slot++) {
+		if ((buffer = trace_buffers[slot]) == NULL) continue;
+		count = buffer->count;
+		TRACE_BARRIER();
+
+		if (buffer->name) {
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+				"\"tid\":%i,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n",
+				slot + 1, buffer->name);
+			first = FALSE;
+		}
+		for (index = 0; index < count; index++) {
+			record = buffer->chunks[index / TRACE_CHUNK] + index % TRACE_CHUNK;
+			fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\","
+				"\"ts\":%lli,\"pid\":1,\"tid\":%i%s}", first ? "" : ",\n",
+				record->name, record->cat, record->phase, record->us, slot + 1,
+				record->phase == 'i' ? ",\"s\":\"t\"" : "");
+			first = FALSE;
+		}
+		if (buffer->dropped) {
+			fprintf(stderr, "%s: %s dropped %i events\n", __func__,
+				buffer->name ? buffer->name : "A thread", buffer->dropped);
+		}
+	}
+	fprintf(fp, "\n]}\n");
+	fclose(fp);
+}
@@ -0,0 +1,72 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* The event tracer.
+ *
+ * Run with -j file.json to have the frames, batches of TRACE_SCANLINES
+ * scanlines, the NMIs and INTs, the audio callback, SDL's event
+ * processing, the waits for the timer, file I/O and the W5100's socket
+ * operations recorded as they happen and written on exit as Chrome trace
+ * JSON that chrome://tracing and Perfetto will show. Each thread is a
+ * track of its own so the main loop, SDL's timer and audio threads, the
+ * IO writer and the W5100's receive threads can be seen side by side.
+ *
+ * Every thread records into a buffer of its own that nothing else writes
+ * to and so there aren't any locks. A buffer is made up of chunks of
+ * TRACE_CHUNK events that are allocated as it fills, up to TRACE_CHUNKS
+ * of them after which further events are dropped and counted.
+ *
+ * Whilst it isn't tracing each TRACE_* is the one test of sdl_trace.state.
+ * This is included by sdl.h for the emulator core and by w5100.c and
+ * so it mustn't need SDL itself */
+
+#ifndef SDL_TRACE_H
+#define SDL_TRACE_H
+
+/* Defines */
+#define TRACE_SCANLINES 32	/* Scanlines to a batch */
+#define TRACE_THREADS 16
+#define TRACE_CHUNK 4096
+#define TRACE_CHUNKS 256	/* TRACE_CHUNK * TRACE_CHUNKS events a thread */
+
+#define TRACE_BEGIN(name, cat) \
+	do { if (sdl_trace.state) trace_event(name, cat, 'B'); } while (0)
+#define TRACE_END(name, cat) \
+	do { if (sdl_trace.state) trace_event(name, cat, 'E'); } while (0)
+#define TRACE_INSTANT(name, cat) \
+	do { if (sdl_trace.state) trace_event(name, cat, 'i'); } while (0)
+#define TRACE_THREAD(name) \
+	do { if (sdl_trace.state) trace_thread(name); } while (0)
+#define TRACE_FRAME() \
+	do { if (sdl_trace.state) trace_frame(); } while (0)
+#define TRACE_SCANLINE(line) \
+	do { if (sdl_trace.state) trace_scanline(line); } while (0)
+
+/* Variables */
+struct {
+	int state;		/* TRUE whilst tracing */
+} sdl_trace;
+
+/* Function prototypes */
+int trace_begin(char *filename);
+void trace_event(const char *name, const char *cat, int phase);
+void trace_thread(const char *name);
+void trace_frame(void);
+void trace_scanline(int line);
+void trace_end(void);
+
+#endif
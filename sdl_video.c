@@ -415,6 +415,8 @@ void sdl_video_update(void) {
 		}
 	#endif
 
+	PROFILE_PUSH(PROFILE_SCALE);
+
 	/* Monitor and manage component states */
 	sdl_component_executive();
 
@@ -557,6 +559,8 @@ void sdl_video_update(void) {
 
 	}
 
+	PROFILE_SWITCH(PROFILE_OVERLAY);
+
 	/* Is the save state dialog being rendered? */
 	if (save_state_dialog.state) {
 		srcx = save_state_dialog.xoffset;
@@ -630,7 +634,8 @@ void sdl_video_update(void) {
 		for (ypos = 0; ypos < 3; ypos++) {
 			dstrect.x = srcx + 0.5 * 8 * video.scale;
 			for (xpos = 0; xpos < 3; xpos++) {
-				if (!save_state_dialog.slots[ypos * 3 + xpos]) {
+				if (!save_state_dialog.slots[ypos * 3 + xpos] ||
+					save_state_dialog.thumbs[ypos * 3 + xpos]) {
 					colourRGB = bg_colourRGB;
 				} else {
 					colourRGB = fg_colourRGB;
@@ -647,6 +652,29 @@ void sdl_video_update(void) {
 		/* Draw the slot text */
 		for (ypos = 0; ypos < 3; ypos++) {
 			for (xpos = 0; xpos < 3; xpos++) {
+				offset = ypos * 3 + xpos;
+				if (save_state_dialog.thumbs[offset]) {
+					/* A small slot number above the thumbnail */
+					dstrect.w = video.scale; dstrect.h = video.scale;
+					dstrect.y = srcy + 1 * 8 * video.scale + ypos * 4.5 * 8 * video.scale;
+					for (ybyte = 0; ybyte < 8 + SSTATE_THUMB_H; ybyte++) {
+						dstrect.x = srcx + 0.5 * 8 * video.scale + xpos * 4.5 * 8 * video.scale;
+						for (count = 0; count < SSTATE_THUMB_W; count++) {
+							if ((ybyte < 8 && count >= 12 && count < 20 &&
+								save_state_dialog_icons[offset * 8 + ybyte] & (0x80 >> (count - 12))) ||
+								(ybyte >= 8 && save_state_dialog.thumbnails[offset]
+								[(ybyte - 8) * SSTATE_THUMB_W / 8 + count / 8] & (0x80 >> (count % 8)))) {
+								if (SDL_FillRect(video.screen, &dstrect, fg_colourRGB) < 0) {
+									fprintf(stderr, "%s: FillRect error: %s\n", __func__, SDL_GetError ());
+									exit(1);
+								}
+							}
+							dstrect.x += video.scale;
+						}
+						dstrect.y += video.scale;
+					}
+					continue;
+				}
 				dstrect.y = srcy + 1 * 8 * video.scale + ypos * 4.5 * 8 * video.scale;
 				for (ybyte = 0; ybyte < 8; ybyte++) {
 					dstrect.x = srcx + 0.5 * 8 * video.scale + xpos * 4.5 * 8 * video.scale;
@@ -1303,6 +1331,7 @@ void sdl_video_update(void) {
 	#endif
 	
 	#if defined(PLATFORM_MIYOO)
+	PROFILE_SWITCH(PROFILE_SCALE);
 	if (sdl_emulator.fullscr == FULL_SCREEN_YES) //TODO change for 1 when finish option Full Screen in menu
 	{
 		offscreen = SDL_CreateRGBSurface(SDL_SWSURFACE, video.xres, video.yres, video.screen->format->BitsPerPixel,
@@ -1332,8 +1361,14 @@ void sdl_video_update(void) {
 		}
 	}
 	#endif
-	
+
+	/* The profiler's averages go over everything */
+	PROFILE_SWITCH(PROFILE_OVERLAY);
+	PROFILE_RENDER();
+
+	PROFILE_SWITCH(PROFILE_FLIP);
 	SDL_Flip(video.screen);
+	PROFILE_POP();
 }
 
 /***************************************************************************
@@ -1797,6 +1832,8 @@ void set_joy_cfg_text(int textid) {
 
 void save_screenshot(void) {
 	char fullpath[256], filename[256];
+	static int lastnum = 0;
+	SDL_Surface *copy;
 	int nextnum;
 
 	#if defined(PLATFORM_GP2X) || defined(__amigaos4__) || defined(_WIN32) || defined(PLATFORM_DINGUX_A320)
@@ -1814,12 +1851,19 @@ void save_screenshot(void) {
 	 * (it'll return 0 if the directory couldn't be opened or 1 as
 	 * the base number when no files exist that match the pattern) */
 	nextnum = get_filename_next_highest(fullpath, "scnsht%4d");
+	/* The previous screenshot mightn't have been written yet */
+	if (nextnum && nextnum <= lastnum) nextnum = lastnum + 1;
+	lastnum = nextnum;
 	sprintf(filename, "scnsht%04i.bmp", nextnum);
 	strcat(fullpath, filename);
 
-	if (SDL_SaveBMP(video.screen, fullpath) < 0) {
+	/* Copy the screen now and write the copy in the background */
+	if ((copy = SDL_ConvertSurface(video.screen, video.screen->format,
+		SDL_SWSURFACE)) == NULL) {
 		fprintf(stderr, "%s: Cannot save screenshot: %s\n", __func__,
 			SDL_GetError());
+		return;
 	}
+	io_writer_submit(fullpath, NULL, 0, copy, "Screenshot");
 }
 
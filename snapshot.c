@@ -0,0 +1,541 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Includes */
+#include <stdio.h>
+#include <string.h>
+#include "sdl.h"
+#include "common.h"
+#include "sound.h"
+#include "z80.h"
+#include "snapshot.h"
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+/* Emulator variables I require access to */
+/* Variables from the top of z80.c */
+extern MACHINE_LOCAL unsigned long frames;
+extern MACHINE_LOCAL int liney, lineyi;
+extern MACHINE_LOCAL int vsy;
+extern MACHINE_LOCAL unsigned long linestart;
+extern MACHINE_LOCAL int vsync_toggle, vsync_lasttoggle;
+extern MACHINE_LOCAL int linestate, linex, nrmvideo;
+
+/* Variables liberated from the top of mainloop */
+extern MACHINE_LOCAL unsigned char a, f, b, c, d, e, h, l;
+extern MACHINE_LOCAL unsigned char r, a1, f1, b1, c1, d1, e1, h1, l1, i, iff1, iff2, im;
+extern MACHINE_LOCAL unsigned short pc;
+extern MACHINE_LOCAL unsigned short ix, iy, sp;
+extern MACHINE_LOCAL unsigned char radjust;
+extern MACHINE_LOCAL unsigned long nextlinetime, linegap, lastvsyncpend;
+extern MACHINE_LOCAL unsigned char ixoriy, new_ixoriy;
+extern MACHINE_LOCAL unsigned char intsample;
+extern MACHINE_LOCAL unsigned short videodata;
+extern MACHINE_LOCAL unsigned char op;
+extern MACHINE_LOCAL int ulacharline;
+extern MACHINE_LOCAL int nmipend, intpend, vsyncpend, vsynclen;
+extern MACHINE_LOCAL int hsyncskip;
+extern MACHINE_LOCAL int framewait;
+
+/* Variables from the top of common.c */
+extern MACHINE_LOCAL int zxpframes, zxpcycles, zxpspeed, zxpnewspeed;
+extern MACHINE_LOCAL int zxppixel, zxpstylus;
+extern MACHINE_LOCAL unsigned char zxpline[];
+
+/***************************************************************************
+ * Snapshot Capture                                                        *
+ ***************************************************************************/
+/* This serialises the entire state of the machine into a contiguous buffer
+ * so that it can be stored, compared or restored later. It's cheap enough
+ * to be called every frame.
+ * 
+ * The layout begins with exactly what 2.1.7 wrote to its save state files
+ * so that those files are still loadable. It is then followed by a magic
+ * number and a version and anything added since. Everything is stored by
+ * the byte in little-endian format so the buffer is platform independent.
+ * These are the integer sizes on my development computer (GNU/Linux 32bit):
+ * 
+ * sizeof(long) = 4 bytes
+ * sizeof(int) = 4 bytes
+ * sizeof(short) = 2 bytes
+ * sizeof(char) = 1 byte
+ * 
+ * keyports and signal_int_flag aren't machine state and refresh_screen I'm
+ * forcing to 1 anyway.
+ * 
+ * On entry: unsigned char *buf points to at least SNAPSHOT_SIZE bytes
+ *  On exit: returns the number of bytes used */
+
+int snapshot_capture(unsigned char *buf) {
+
+	/* The entire contents of memory followed by everything else */
+	memcpy(buf, mem, 64 * 1024);
+
+	return 64 * 1024 + snapshot_capture_state(buf + 64 * 1024);
+}
+
+/***************************************************************************
+ * Snapshot Capture State                                                  *
+ ***************************************************************************/
+/* This is everything that snapshot_capture records after the contents of
+ * memory, for those that keep the memory by other means.
+ * 
+ * On entry: unsigned char *buf points to at least SNAPSHOT_STATE_SIZE bytes
+ *  On exit: returns the number of bytes used */
+
+int snapshot_capture_state(unsigned char *buf) {
+	unsigned char *ptr = buf;
+	unsigned long magic = SNAPSHOT_MAGIC;
+	int version = SNAPSHOT_VERSION;
+	#ifdef OSS_SOUND_SUPPORT
+		struct sound_ay_state ay_state;
+	#endif
+	int count;
+
+	/* Variables from the top of z80.c */
+	memwrite_unsigned_long_little_endian(&tstates, &ptr);
+	memwrite_unsigned_long_little_endian(&frames, &ptr);
+	memwrite_int_little_endian(&liney, &ptr);
+	memwrite_int_little_endian(&vsy, &ptr);
+	memwrite_unsigned_long_little_endian(&linestart, &ptr);
+	memwrite_int_little_endian(&vsync_toggle, &ptr);
+	memwrite_int_little_endian(&vsync_lasttoggle, &ptr);
+
+	/* Variables liberated from the top of mainloop */
+	*ptr++ = a; *ptr++ = f; *ptr++ = b; *ptr++ = c;
+	*ptr++ = d; *ptr++ = e; *ptr++ = h; *ptr++ = l;
+	*ptr++ = r;
+	*ptr++ = a1; *ptr++ = f1; *ptr++ = b1; *ptr++ = c1;
+	*ptr++ = d1; *ptr++ = e1; *ptr++ = h1; *ptr++ = l1;
+	*ptr++ = i; *ptr++ = iff1; *ptr++ = iff2; *ptr++ = im;
+	memwrite_unsigned_short_little_endian(&pc, &ptr);
+	memwrite_unsigned_short_little_endian(&ix, &ptr);
+	memwrite_unsigned_short_little_endian(&iy, &ptr);
+	memwrite_unsigned_short_little_endian(&sp, &ptr);
+	*ptr++ = radjust;
+	memwrite_unsigned_long_little_endian(&nextlinetime, &ptr);
+	memwrite_unsigned_long_little_endian(&linegap, &ptr);
+	memwrite_unsigned_long_little_endian(&lastvsyncpend, &ptr);
+	*ptr++ = ixoriy; *ptr++ = new_ixoriy;
+	*ptr++ = intsample; *ptr++ = op;
+	memwrite_int_little_endian(&ulacharline, &ptr);
+	memwrite_int_little_endian(&nmipend, &ptr);
+	memwrite_int_little_endian(&intpend, &ptr);
+	memwrite_int_little_endian(&vsyncpend, &ptr);
+	memwrite_int_little_endian(&vsynclen, &ptr);
+	memwrite_int_little_endian(&hsyncskip, &ptr);
+	memwrite_int_little_endian(&framewait, &ptr);
+
+	/* Variables from the top of common.c */
+	memwrite_int_little_endian(&interrupted, &ptr);
+	memwrite_int_little_endian(&nmigen, &ptr);
+	memwrite_int_little_endian(&hsyncgen, &ptr);
+	memwrite_int_little_endian(&vsync, &ptr);
+
+	/* 65654/0x10076 bytes to here with the memory for 2.1.7 (SNAPSHOT_SIZE_2_1_7) */
+
+	memwrite_unsigned_long_little_endian(&magic, &ptr);
+	memwrite_int_little_endian(&version, &ptr);
+
+	/* The rest of the ULA's state */
+	memwrite_int_little_endian(&lineyi, &ptr);
+	memwrite_int_little_endian(&linestate, &ptr);
+	memwrite_int_little_endian(&linex, &ptr);
+	memwrite_int_little_endian(&nrmvideo, &ptr);
+	memwrite_unsigned_short_little_endian(&videodata, &ptr);
+	memwrite_int_little_endian(&chromamode, &ptr);
+	*ptr++ = bordercolour;
+
+	/* The printer. zxpheight is left alone as it's the count of lines
+	 * already within the printer's output file */
+	memwrite_int_little_endian(&zxpframes, &ptr);
+	memwrite_int_little_endian(&zxpcycles, &ptr);
+	memwrite_int_little_endian(&zxpspeed, &ptr);
+	memwrite_int_little_endian(&zxpnewspeed, &ptr);
+	memwrite_int_little_endian(&zxppixel, &ptr);
+	memwrite_int_little_endian(&zxpstylus, &ptr);
+	memcpy(ptr, zxpline, 256); ptr += 256;
+
+	/* The AY (zeroed if there's no sound support) */
+	memwrite_int_little_endian(&ay_reg, &ptr);
+	#ifdef OSS_SOUND_SUPPORT
+		sound_ay_getstate(&ay_state);
+		memcpy(ptr, ay_state.registers, 16); ptr += 16;
+		for (count = 0; count < 3; count++)
+			memwrite_unsigned_int_little_endian(&ay_state.tone_tick[count], &ptr);
+		memwrite_unsigned_int_little_endian(&ay_state.noise_tick, &ptr);
+		memwrite_unsigned_int_little_endian(&ay_state.env_tick, &ptr);
+		memwrite_unsigned_int_little_endian(&ay_state.env_subcycles, &ptr);
+		memwrite_int_little_endian(&ay_state.env_held, &ptr);
+		memwrite_int_little_endian(&ay_state.env_alternating, &ptr);
+		memwrite_int_little_endian(&ay_state.env_level, &ptr);
+		memwrite_int_little_endian(&ay_state.rng, &ptr);
+		memwrite_int_little_endian(&ay_state.noise_toggle, &ptr);
+	#else
+		for (count = 0; count < 16 + 11 * 4; count++) *ptr++ = 0;
+	#endif
+
+	return ptr - buf;
+}
+
+/***************************************************************************
+ * Snapshot Restore                                                        *
+ ***************************************************************************/
+/* This restores the state of the machine from a buffer filled by
+ * snapshot_capture. A buffer containing a 2.1.7 save state should be zero
+ * padded to SNAPSHOT_SIZE and the things that 2.1.7 didn't record will be
+ * left as they are.
+ * 
+ * On entry: unsigned char *buf points to SNAPSHOT_SIZE bytes
+ *  On exit: returns TRUE on error (nothing will have been restored)
+ *           else FALSE */
+
+int snapshot_restore(unsigned char *buf) {
+
+	if (snapshot_restore_state(buf + 64 * 1024)) return TRUE;
+
+	/* The entire contents of memory */
+	memcpy(mem, buf, 64 * 1024);
+	memdirty = ~0ULL;
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Snapshot Restore State                                                  *
+ ***************************************************************************/
+/* This restores everything but the contents of memory from a buffer
+ * filled by snapshot_capture_state.
+ * 
+ * On entry: unsigned char *buf points to SNAPSHOT_STATE_SIZE bytes
+ *  On exit: returns TRUE on error (nothing will have been restored)
+ *           else FALSE */
+
+int snapshot_restore_state(unsigned char *buf) {
+	unsigned char *ptr = buf + SNAPSHOT_SIZE_2_1_7 - 64 * 1024;
+	unsigned long magic;
+	int version;
+	#ifdef OSS_SOUND_SUPPORT
+		struct sound_ay_state ay_state;
+		int count;
+	#endif
+
+	/* Check that we understand what follows the 2.1.7 part */
+	memread_unsigned_long_little_endian(&magic, &ptr);
+	memread_int_little_endian(&version, &ptr);
+	if (magic != SNAPSHOT_MAGIC) {
+		version = 0;
+	} else if (version > SNAPSHOT_VERSION) {
+		fprintf(stderr, "%s: Snapshot version %i is unsupported\n", __func__,
+			version);
+		return TRUE;
+	}
+	ptr = buf;
+
+	/* Variables from the top of z80.c */
+	memread_unsigned_long_little_endian(&tstates, &ptr);
+	memread_unsigned_long_little_endian(&frames, &ptr);
+	memread_int_little_endian(&liney, &ptr);
+	memread_int_little_endian(&vsy, &ptr);
+	memread_unsigned_long_little_endian(&linestart, &ptr);
+	memread_int_little_endian(&vsync_toggle, &ptr);
+	memread_int_little_endian(&vsync_lasttoggle, &ptr);
+
+	/* Variables liberated from the top of mainloop */
+	a = *ptr++; f = *ptr++; b = *ptr++; c = *ptr++;
+	d = *ptr++; e = *ptr++; h = *ptr++; l = *ptr++;
+	r = *ptr++;
+	a1 = *ptr++; f1 = *ptr++; b1 = *ptr++; c1 = *ptr++;
+	d1 = *ptr++; e1 = *ptr++; h1 = *ptr++; l1 = *ptr++;
+	i = *ptr++; iff1 = *ptr++; iff2 = *ptr++; im = *ptr++;
+	memread_unsigned_short_little_endian(&pc, &ptr);
+	memread_unsigned_short_little_endian(&ix, &ptr);
+	memread_unsigned_short_little_endian(&iy, &ptr);
+	memread_unsigned_short_little_endian(&sp, &ptr);
+	radjust = *ptr++;
+	memread_unsigned_long_little_endian(&nextlinetime, &ptr);
+	memread_unsigned_long_little_endian(&linegap, &ptr);
+	memread_unsigned_long_little_endian(&lastvsyncpend, &ptr);
+	ixoriy = *ptr++; new_ixoriy = *ptr++;
+	intsample = *ptr++; op = *ptr++;
+	memread_int_little_endian(&ulacharline, &ptr);
+	memread_int_little_endian(&nmipend, &ptr);
+	memread_int_little_endian(&intpend, &ptr);
+	memread_int_little_endian(&vsyncpend, &ptr);
+	memread_int_little_endian(&vsynclen, &ptr);
+	memread_int_little_endian(&hsyncskip, &ptr);
+	memread_int_little_endian(&framewait, &ptr);
+
+	/* Variables from the top of common.c */
+	memread_int_little_endian(&interrupted, &ptr);
+	memread_int_little_endian(&nmigen, &ptr);
+	memread_int_little_endian(&hsyncgen, &ptr);
+	memread_int_little_endian(&vsync, &ptr);
+
+	if (version == 0) return FALSE;
+	ptr += 4 + 4;	/* Magic and version */
+
+	/* The rest of the ULA's state */
+	memread_int_little_endian(&lineyi, &ptr);
+	memread_int_little_endian(&linestate, &ptr);
+	memread_int_little_endian(&linex, &ptr);
+	memread_int_little_endian(&nrmvideo, &ptr);
+	memread_unsigned_short_little_endian(&videodata, &ptr);
+	memread_int_little_endian(&chromamode, &ptr);
+	bordercolour = *ptr++;
+
+	/* The printer */
+	memread_int_little_endian(&zxpframes, &ptr);
+	memread_int_little_endian(&zxpcycles, &ptr);
+	memread_int_little_endian(&zxpspeed, &ptr);
+	memread_int_little_endian(&zxpnewspeed, &ptr);
+	memread_int_little_endian(&zxppixel, &ptr);
+	memread_int_little_endian(&zxpstylus, &ptr);
+	memcpy(zxpline, ptr, 256); ptr += 256;
+
+	/* The AY */
+	memread_int_little_endian(&ay_reg, &ptr);
+	#ifdef OSS_SOUND_SUPPORT
+		memcpy(ay_state.registers, ptr, 16); ptr += 16;
+		for (count = 0; count < 3; count++)
+			memread_unsigned_int_little_endian(&ay_state.tone_tick[count], &ptr);
+		memread_unsigned_int_little_endian(&ay_state.noise_tick, &ptr);
+		memread_unsigned_int_little_endian(&ay_state.env_tick, &ptr);
+		memread_unsigned_int_little_endian(&ay_state.env_subcycles, &ptr);
+		memread_int_little_endian(&ay_state.env_held, &ptr);
+		memread_int_little_endian(&ay_state.env_alternating, &ptr);
+		memread_int_little_endian(&ay_state.env_level, &ptr);
+		memread_int_little_endian(&ay_state.rng, &ptr);
+		memread_int_little_endian(&ay_state.noise_toggle, &ptr);
+		sound_ay_setstate(&ay_state);
+	#endif
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Program Load                                                            *
+ ***************************************************************************/
+/* This puts a program file's contents into memory. z81 said of its own
+ * autoload that "we load a snapshot, in effect", and when auto-loading or
+ * forced-loading that's what this does: the machine is first put into the
+ * state that the ROM's LOAD would have left it in.
+ * 
+ * On entry: unsigned char *data points to the contents of a .o or .p
+ *           int len is its size, of which at most the RAM is used
+ *           int autoload is TRUE to preset the machine as well */
+
+void program_load(unsigned char *data, int len, int autoload) {
+	int ramsize;
+
+	if (autoload) {
+		/* To duplicate these values: in mainloop in z80.c around
+		 * line 189, change #if 0 to #if 1 and recompile. Run
+		 * the emulator, load a suitably sized program by typing
+		 * LOAD or LOAD "something" and view the console output.
+		 * 
+		 * It's likely I've been a bit too thorough recording these
+		 * values because I know from looking at the ZX81 ROM that
+		 * DE points to the program name in memory which would get
+		 * overwritten on LOAD and make it redundant, and HL and A
+		 * are modified soon after anyway, but there's no harm done.
+		 * 
+		 * Note that the ZX81's RAMTOP won't be greater than 0x8000
+		 * unless POKEd by the user.
+		 */
+		if (*sdl_emulator.model == MODEL_ZX80) {
+			/* Registers (common values) */
+			a = 0x00; f = 0x44; b = 0x00; c = 0x00;
+			d = 0x07; e = 0xae; h = 0x40; l = 0x2a;
+			pc = 0x0283;
+			ix = 0x0000; iy = 0x4000; i = 0x0e; r = 0xdd;
+			a1 = 0x00; f1 = 0x00; b1 = 0x00; c1 = 0x21;
+			d1 = 0xd8; e1 = 0xf0; h1 = 0xd8; l1 = 0xf0;
+			iff1 = 0x00; iff2 = 0x00; im = 0x02;
+			radjust = 0x6a;
+			/* Machine Stack (common values) */
+			if (sdl_emulator.ramsize >= 16) {
+				sp = 0x8000 - 4;
+			} else {
+				sp = 0x4000 - 4 + sdl_emulator.ramsize * 1024;
+			}
+			mem[sp + 0] = 0x47;
+			mem[sp + 1] = 0x04;
+			mem[sp + 2] = 0xba;
+			mem[sp + 3] = 0x3f;
+			/* Now override if RAM configuration changes things
+			 * (there's a possibility these changes are unimportant) */
+			if (sdl_emulator.ramsize == 16) {
+				mem[sp + 2] = 0x22;
+			}
+		} else if (*sdl_emulator.model == MODEL_ZX81) {
+			/* Registers (common values) */
+			a = 0x0b; f = 0x00; b = 0x00; c = 0x02;
+			d = 0x40; e = 0x9b; h = 0x40; l = 0x99;
+			pc = 0x0207;
+			ix = 0x0281; iy = 0x4000; i = 0x1e; r = 0xdd;
+			a1 = 0xf8; f1 = 0xa9; b1 = 0x00; c1 = 0x00;
+			d1 = 0x00; e1 = 0x2b; h1 = 0x00; l1 = 0x00;
+			iff1 = 0; iff2 = 0; im = 2;
+			radjust = 0xa4;
+			/* GOSUB Stack (common values) */
+			if (sdl_emulator.ramsize >= 16) {
+				sp = 0x8000 - 4;
+			} else {
+				sp = 0x4000 - 4 + sdl_emulator.ramsize * 1024;
+			}
+			mem[sp + 0] = 0x76;
+			mem[sp + 1] = 0x06;
+			mem[sp + 2] = 0x00;
+			mem[sp + 3] = 0x3e;
+			/* Now override if RAM configuration changes things
+			 * (there's a possibility these changes are unimportant) */
+			if (sdl_emulator.ramsize >= 4) {
+				d = 0x43; h = 0x43;
+				a1 = 0xec; b1 = 0x81; c1 = 0x02;
+				radjust = 0xa9;
+			}
+			/* System variables */
+			mem[0x4000] = 0xff;				/* ERR_NR */
+			mem[0x4001] = 0x80;				/* FLAGS */
+			mem[0x4002] = sp & 0xff;		/* ERR_SP lo */
+			mem[0x4003] = sp >> 8;			/* ERR_SP hi */
+			mem[0x4004] = (sp + 4) & 0xff;	/* RAMTOP lo */
+			mem[0x4005] = (sp + 4) >> 8;	/* RAMTOP hi */
+			mem[0x4006] = 0x00;				/* MODE */
+			mem[0x4007] = 0xfe;				/* PPC lo */
+			mem[0x4008] = 0xff;				/* PPC hi */
+		}
+	}
+
+	/* Read in up to 48K of data */
+	if (sdl_emulator.ramsize > 48) {
+		ramsize = 48;
+	} else {
+		ramsize = sdl_emulator.ramsize;
+	}
+	if (*sdl_emulator.model == MODEL_ZX80) {
+		if (len > ramsize * 1024) len = ramsize * 1024;
+		memcpy(mem + 0x4000, data, len);
+	} else if (*sdl_emulator.model == MODEL_ZX81) {
+		if (len > ramsize * 1024 - 9) len = ramsize * 1024 - 9;
+		memcpy(mem + 0x4009, data, len);
+	}
+
+	/* This wasn't written to by store (see memattr_watch) */
+	memdirty = ~0ULL;
+}
+
+/***************************************************************************
+ * Memory Write Unsigned Short Little Endian                               *
+ ***************************************************************************/
+
+void memwrite_unsigned_short_little_endian(unsigned short *source, unsigned char **ptr) {
+
+	*(*ptr)++ = *source & 0xff;
+	*(*ptr)++ = (*source >> 8) & 0xff;
+}
+
+/***************************************************************************
+ * Memory Write Int Little Endian                                          *
+ ***************************************************************************/
+
+void memwrite_int_little_endian(int *source, unsigned char **ptr) {
+
+	*(*ptr)++ = *source & 0xff;
+	*(*ptr)++ = (*source >> 8) & 0xff;
+	*(*ptr)++ = (*source >> 16) & 0xff;
+	*(*ptr)++ = (*source >> 24) & 0xff;
+}
+
+/***************************************************************************
+ * Memory Write Unsigned Int Little Endian                                 *
+ ***************************************************************************/
+
+void memwrite_unsigned_int_little_endian(unsigned int *source, unsigned char **ptr) {
+
+	*(*ptr)++ = *source & 0xff;
+	*(*ptr)++ = (*source >> 8) & 0xff;
+	*(*ptr)++ = (*source >> 16) & 0xff;
+	*(*ptr)++ = (*source >> 24) & 0xff;
+}
+
+/***************************************************************************
+ * Memory Write Unsigned Long Little Endian                                *
+ ***************************************************************************/
+
+void memwrite_unsigned_long_little_endian(unsigned long *source, unsigned char **ptr) {
+
+	*(*ptr)++ = *source & 0xff;
+	*(*ptr)++ = (*source >> 8) & 0xff;
+	*(*ptr)++ = (*source >> 16) & 0xff;
+	*(*ptr)++ = (*source >> 24) & 0xff;
+}
+
+/***************************************************************************
+ * Memory Read Unsigned Short Little Endian                                *
+ ***************************************************************************/
+
+void memread_unsigned_short_little_endian(unsigned short *target, unsigned char **ptr) {
+
+	*target = 0;
+	*target |= *(*ptr)++;
+	*target |= (unsigned short)*(*ptr)++ << 8;
+}
+
+/***************************************************************************
+ * Memory Read Int Little Endian                                           *
+ ***************************************************************************/
+
+void memread_int_little_endian(int *target, unsigned char **ptr) {
+
+	*target = 0;
+	*target |= *(*ptr)++;
+	*target |= (int)*(*ptr)++ << 8;
+	*target |= (int)*(*ptr)++ << 16;
+	*target |= (int)*(*ptr)++ << 24;
+}
+
+/***************************************************************************
+ * Memory Read Unsigned Int Little Endian                                  *
+ ***************************************************************************/
+
+void memread_unsigned_int_little_endian(unsigned int *target, unsigned char **ptr) {
+
+	*target = 0;
+	*target |= *(*ptr)++;
+	*target |= (unsigned int)*(*ptr)++ << 8;
+	*target |= (unsigned int)*(*ptr)++ << 16;
+	*target |= (unsigned int)*(*ptr)++ << 24;
+}
+
+/***************************************************************************
+ * Memory Read Unsigned Long Little Endian                                 *
+ ***************************************************************************/
+
+/* Only 32 bits are stored, and the z80.c timings kept in unsigned longs
+ * can wrap below zero, so this sign extends to get back what was stored
+ * where a long is wider than that */
+
+void memread_unsigned_long_little_endian(unsigned long *target, unsigned char **ptr) {
+	unsigned int value;
+
+	memread_unsigned_int_little_endian(&value, ptr);
+	*target = (unsigned long)(long)(int)value;
+}
@@ -0,0 +1,51 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ * 
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* This is the emulator's own save/restore/load code. It's part of the
+ * core and so it doesn't use SDL, which lets the front end and libsz81
+ * share it */
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+/* Defines */
+/* Machine snapshots: the 2.1.7 save state followed by a magic number
+ * ("SZ81"), a version and whatever was added since */
+#define SNAPSHOT_MAGIC 0x31385a53
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_SIZE_2_1_7 65654
+#define SNAPSHOT_SIZE (SNAPSHOT_SIZE_2_1_7 + 8 + 23 + 280 + 64)
+
+/* What follows the contents of memory within a snapshot */
+#define SNAPSHOT_STATE_SIZE (SNAPSHOT_SIZE - 64 * 1024)
+
+/* Function prototypes */
+int snapshot_capture(unsigned char *buf);
+int snapshot_restore(unsigned char *buf);
+int snapshot_capture_state(unsigned char *buf);
+int snapshot_restore_state(unsigned char *buf);
+void program_load(unsigned char *data, int len, int autoload);
+void memwrite_unsigned_short_little_endian(unsigned short *source, unsigned char **ptr);
+void memwrite_int_little_endian(int *source, unsigned char **ptr);
+void memwrite_unsigned_int_little_endian(unsigned int *source, unsigned char **ptr);
+void memwrite_unsigned_long_little_endian(unsigned long *source, unsigned char **ptr);
+void memread_unsigned_short_little_endian(unsigned short *target, unsigned char **ptr);
+void memread_int_little_endian(int *target, unsigned char **ptr);
+void memread_unsigned_int_little_endian(unsigned int *target, unsigned char **ptr);
+void memread_unsigned_long_little_endian(unsigned long *target, unsigned char **ptr);
+
+#endif
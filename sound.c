@@ -68,7 +68,7 @@
 
 
 /* configuration */
-int sound_enabled=0;
+MACHINE_LOCAL int sound_enabled=0;
 int sound_freq=32000;
 int sound_stereo=0;
 int sound_stereo_acb=0;		/* 1 for ACB stereo, else 0 */
@@ -99,47 +99,102 @@ int sound_stereo_acb=0;		/* 1 for ACB stereo, else 0 */
 #define AMPL_AY_TONE		31	/* three of these */
 #endif
 
-/* full range of beeper volume */
-#ifdef SZ81	/* Added by Thunor */
-#define VOL_BEEPER (sdl_sound.volume / 2)
-#else
-#define VOL_BEEPER		(AMPL_BEEPER*2)
-#endif
-
 /* max. number of sub-frame AY port writes allowed;
  * given the number of port writes theoretically possible in a
  * 50th I think this should be plenty.
  */
 #define AY_CHANGE_MAX		8000
 
-static int sound_framesiz;
+static MACHINE_LOCAL int sound_framesiz;
 
-static unsigned char ay_tone_levels[16];
+static MACHINE_LOCAL unsigned char ay_tone_levels[16];
 
-static unsigned char *sound_buf;
-static unsigned char *sound_ptr;
-static int sound_oldpos,sound_fillpos,sound_oldval,sound_oldval_orig;
+static MACHINE_LOCAL unsigned char *sound_buf;
+static MACHINE_LOCAL unsigned char *sound_ptr;
 
-/* timer used for fadeout after beeper-toggle;
- * fixed-point with low 24 bits as fractional part.
+/* the beeper is synthesised with band-limited steps. Each edge adds
+ * a short windowed-sinc impulse (the derivative of a band-limited step)
+ * into blep_delta[], picked from blep_kernel[] by the edge's sub-sample
+ * phase, and sound_frame() integrates the lot once per frame. The
+ * result has (next to) nothing above Nyquist, so unlike edges placed at
+ * sample resolution it doesn't alias, and a low sound_freq still sounds
+ * clean.
+ *
+ * Kernel taps for each phase sum to exactly 1<<BLEP_SHIFT, and levels
+ * use the same fixed-point, so the integral always settles exactly.
  */
-static unsigned int beeper_tick,beeper_tick_incr;
+#define BLEP_PHASE_BITS		5
+#define BLEP_PHASES		(1<<BLEP_PHASE_BITS)
+#define BLEP_TAPS		16
+#define BLEP_SHIFT		12
+
+/* windowed sinc (Blackman, cutoff 0.45*sound_freq), one row per phase */
+static const short blep_kernel[BLEP_PHASES][BLEP_TAPS]=
+  {
+  {0,-3,4,11,-75,246,-671,2537,2535,-671,246,-75,11,4,-3,0},
+  {0,-2,2,17,-86,261,-680,2405,2660,-656,229,-63,5,7,-4,1},
+  {0,-2,0,22,-95,273,-683,2272,2781,-634,208,-50,-1,9,-5,1},
+  {0,-1,-3,27,-103,282,-681,2135,2897,-606,185,-36,-8,12,-5,1},
+  {0,-1,-4,31,-110,288,-673,1996,3007,-571,160,-21,-16,15,-6,1},
+  {0,0,-6,35,-116,292,-660,1856,3109,-529,131,-5,-23,18,-7,1},
+  {0,0,-8,38,-120,294,-643,1714,3206,-480,101,11,-31,21,-8,1},
+  {0,1,-9,41,-123,292,-621,1572,3293,-424,68,29,-39,24,-9,1},
+  {0,1,-10,43,-125,289,-596,1430,3374,-361,33,47,-47,26,-9,1},
+  {0,1,-11,45,-126,283,-566,1290,3445,-292,-4,65,-55,29,-10,2},
+  {0,2,-12,46,-126,276,-534,1150,3508,-215,-43,84,-63,32,-11,2},
+  {0,2,-13,47,-125,266,-499,1013,3563,-132,-83,103,-71,35,-12,2},
+  {0,2,-13,48,-123,254,-462,879,3607,-42,-125,122,-78,37,-12,2},
+  {0,2,-14,48,-120,242,-422,748,3642,54,-167,141,-86,39,-13,2},
+  {0,2,-14,47,-116,227,-381,620,3667,157,-210,160,-93,41,-13,2},
+  {0,2,-14,46,-111,212,-339,497,3681,265,-253,178,-99,43,-14,2},
+  {0,2,-14,45,-105,195,-296,378,3686,378,-296,195,-105,45,-14,2},
+  {0,2,-14,43,-99,178,-253,265,3681,497,-339,212,-111,46,-14,2},
+  {0,2,-13,41,-93,160,-210,157,3667,620,-381,227,-116,47,-14,2},
+  {0,2,-13,39,-86,141,-167,54,3642,748,-422,242,-120,48,-14,2},
+  {0,2,-12,37,-78,122,-125,-42,3607,879,-462,254,-123,48,-13,2},
+  {0,2,-12,35,-71,103,-83,-132,3563,1013,-499,266,-125,47,-13,2},
+  {0,2,-11,32,-63,84,-43,-215,3508,1150,-534,276,-126,46,-12,2},
+  {0,2,-10,29,-55,65,-4,-292,3445,1290,-566,283,-126,45,-11,1},
+  {0,1,-9,26,-47,47,33,-361,3374,1430,-596,289,-125,43,-10,1},
+  {0,1,-9,24,-39,29,68,-424,3293,1572,-621,292,-123,41,-9,1},
+  {0,1,-8,21,-31,11,101,-480,3206,1714,-643,294,-120,38,-8,0},
+  {0,1,-7,18,-23,-5,131,-529,3109,1856,-660,292,-116,35,-6,0},
+  {0,1,-6,15,-16,-21,160,-571,3007,1996,-673,288,-110,31,-4,-1},
+  {0,1,-5,12,-8,-36,185,-606,2897,2135,-681,282,-103,27,-3,-1},
+  {0,1,-5,9,-1,-50,208,-634,2781,2272,-683,273,-95,22,0,-2},
+  {0,1,-4,7,5,-63,229,-656,2659,2406,-680,261,-86,17,2,-2}
+  };
+
+static MACHINE_LOCAL int *blep_delta;		/* sound_framesiz+BLEP_TAPS entries */
+static MACHINE_LOCAL int blep_acc;		/* running integral of blep_delta[] */
+static MACHINE_LOCAL int beeper_level;	/* where the output is heading */
+
+/* max. number of beeper edges per frame, much as for the AY below */
+#define BEEPER_EDGE_MAX		8000
+
+struct beeper_edge_tag
+  {
+  int pos;		/* in 1/BLEP_PHASES samples from start of frame */
+  int on;
+  };
+
+static MACHINE_LOCAL struct beeper_edge_tag beeper_edge[BEEPER_EDGE_MAX];
+static MACHINE_LOCAL int beeper_edge_count;
+static MACHINE_LOCAL int beeper_on;
 
 /* tick/incr/periods are all fixed-point with low 16 bits as
  * fractional part, except ay_env_{tick,period} which count as the chip does.
  */
-static unsigned int ay_tone_tick[3],ay_noise_tick;
-static unsigned int ay_env_tick,ay_env_subcycles;
-static unsigned int ay_tick_incr;
-static unsigned int ay_tone_period[3],ay_noise_period,ay_env_period;
+static MACHINE_LOCAL unsigned int ay_tone_tick[3],ay_noise_tick;
+static MACHINE_LOCAL unsigned int ay_env_tick,ay_env_subcycles;
+static MACHINE_LOCAL unsigned int ay_tick_incr;
+static MACHINE_LOCAL unsigned int ay_tone_period[3],ay_noise_period,ay_env_period;
 
-static int env_held=0,env_alternating=0;
-
-static int beeper_last_subpos=0;
+static MACHINE_LOCAL int env_held=0,env_alternating=0;
 
 /* AY registers */
 /* we have 16 so we can fake an 8910 if needed */
-static unsigned char sound_ay_registers[16];
+static MACHINE_LOCAL unsigned char sound_ay_registers[16];
 
 struct ay_change_tag
   {
@@ -148,8 +203,47 @@ struct ay_change_tag
   unsigned char reg,val;
   };
 
-static struct ay_change_tag ay_change[AY_CHANGE_MAX];
-static int ay_change_count;
+static MACHINE_LOCAL struct ay_change_tag ay_change[AY_CHANGE_MAX];
+static MACHINE_LOCAL int ay_change_count;
+
+#ifdef SZ81	/* Added by Thunor */
+/* when sound_ay_threaded is set the AY writes skip ay_change[] and go
+ * into this queue instead, stamped with the byte position in the output
+ * stream where they take effect. The audio callback is the only reader
+ * (see sound_ay_callback()) and does all the AY synthesis itself, so the
+ * emulation thread doesn't have to. One writer and one reader, so no
+ * locking is needed - just a barrier either side of moving head/tail.
+ * Size must be a power of two.
+ */
+#define AY_QUEUE_SIZE		8192
+
+#ifdef __GNUC__
+#define AY_QUEUE_BARRIER()	__sync_synchronize()
+#else
+#define AY_QUEUE_BARRIER()
+#endif
+
+struct ay_queue_tag
+  {
+  unsigned long pos;
+  unsigned char reg,val;
+  };
+
+static struct ay_queue_tag ay_queue[AY_QUEUE_SIZE];
+static volatile unsigned int ay_queue_head,ay_queue_tail;
+static MACHINE_LOCAL unsigned long ay_stream_pos;
+static MACHINE_LOCAL int sound_ay_threaded=0;
+
+/* the registers as the emulated machine last wrote them. Both of the
+ * above delay the writes reaching sound_ay_registers[], so snapshots
+ * take the registers from here instead.
+ */
+static MACHINE_LOCAL unsigned char ay_written[16];
+
+/* the registers written during frames run flat out, which aren't heard
+ * and so reach the AY only via sound_skip_frame() */
+static MACHINE_LOCAL int ay_resync;
+#endif
 
 
 #ifndef SZ81	/* Added by Thunor */
@@ -244,6 +338,10 @@ static unsigned char buf16[8192];
 int ret=0,ofs=0;
 #endif
 
+#ifdef SZ81	/* Added by Thunor */
+sdl_sound_capture_frame(data,len,sound_stereo);
+#endif
+
 if(sixteenbit)
   {
   unsigned char *src,*dst;
@@ -261,7 +359,8 @@ if(sixteenbit)
   }
 
 #ifdef SZ81	/* Added by Thunor */
-sdl_sound_frame(data, len);
+if(sdl_sound.state)
+  sdl_sound_frame(data, len);
 #else
 while(len)
   {
@@ -345,6 +444,17 @@ if((sound_buf=malloc(sound_framesiz*(sound_stereo+1)))==NULL)
 
 sound_ptr=sound_buf;	/* sound_ptr isn't used anyway */
 
+/* any edges still spreading out are lost, so have the beeper
+ * continue from where it was heading rather than leave an offset.
+ */
+if(blep_delta)
+  free(blep_delta);
+
+if((blep_delta=calloc(sound_framesiz+BLEP_TAPS,sizeof(int)))==NULL)
+  return 1;
+
+blep_acc=beeper_level;
+
 return 0;
 }
 #endif
@@ -353,7 +463,23 @@ return 0;
 void sound_init(void)
 {
 #ifdef SZ81	/* Added by Thunor */
-if (sdl_sound_init(sound_freq, &sound_stereo, &sixteenbit)) return;
+#ifdef MACHINE_THREADS
+/* the callback's thread has no machine of its own (see machine.h) */
+sound_ay_threaded=0;
+#else
+/* the capture is taken from sound_frame(), which only has the AY in it
+ * when it isn't left to the callback */
+sound_ay_threaded=(sound_ay && sdl_sound.ay_thread && !*sdl_com_line.wavfile);
+#endif
+ay_queue_head=ay_queue_tail=0;
+ay_stream_pos=0;
+if (sdl_sound_init(sound_freq, &sound_stereo, &sixteenbit))
+  {
+  /* with no audio device we can still capture, just not play */
+  if(!*sdl_com_line.wavfile) return;
+  sound_ay_threaded=0;
+  sixteenbit=0;
+  }
 #else
 if(!osssound_init(&sound_freq,&sound_stereo))
   {
@@ -379,23 +505,27 @@ if(sound_framesiz_init())
 #else
 sound_framesiz=sound_freq/50;
 
-if((sound_buf=malloc(sound_framesiz*(sound_stereo+1)))==NULL)
+if((sound_buf=malloc(sound_framesiz*(sound_stereo+1)))==NULL ||
+   (blep_delta=calloc(sound_framesiz+BLEP_TAPS,sizeof(int)))==NULL)
   {
   sound_end();
   return;
   }
 #endif
 
-sound_oldval=sound_oldval_orig=128;
-sound_oldpos=-1;
-sound_fillpos=0;
 sound_ptr=sound_buf;
 
-beeper_tick=0;
-beeper_tick_incr=(1<<24)/sound_freq;
+blep_acc=beeper_level=0;
+beeper_edge_count=0;
+beeper_on=-1;
 
 if(sound_ay)
   sound_ay_init();
+
+#ifdef SZ81	/* Added by Thunor */
+/* the capture runs from here until we exit, across resets */
+sdl_sound_capture_start(sound_freq,sound_stereo);
+#endif
 }
 
 
@@ -405,6 +535,9 @@ if(sound_enabled)
   {
   if(sound_buf)
     free(sound_buf);
+  if(blep_delta)
+    free(blep_delta);
+  blep_delta=NULL;
 #ifdef SZ81	/* Added by Thunor */
   sdl_sound_end();
 #else
@@ -446,20 +579,152 @@ if(sound_enabled)
     }
 
 
-static void sound_ay_overlay(void)
+static MACHINE_LOCAL int rng=1;
+static MACHINE_LOCAL int noise_toggle=1;
+static MACHINE_LOCAL int env_level=0;
+
+
+/* write an AY register and fix things as needed for the change */
+static void sound_ay_setreg(int reg,int val)
+{
+int r;
+
+sound_ay_registers[reg]=val;
+
+switch(reg)
+  {
+  case 0: case 1: case 2: case 3: case 4: case 5:
+    r=reg>>1;
+    ay_tone_period[r]=(8*(sound_ay_registers[reg&~1]|
+                          (sound_ay_registers[reg|1]&15)<<8))<<16;
+
+    /* important to get this right, otherwise e.g. Ghouls 'n' Ghosts
+     * has really scratchy, horrible-sounding vibrato.
+     */
+    if(ay_tone_period[r] && ay_tone_tick[r]>=ay_tone_period[r]*2)
+      ay_tone_tick[r]%=ay_tone_period[r]*2;
+    break;
+  case 6:
+    ay_noise_tick=0;
+    ay_noise_period=(16*(sound_ay_registers[reg]&31))<<16;
+    break;
+  case 11: case 12:
+    /* this one *isn't* fixed-point */
+    ay_env_period=sound_ay_registers[11]|(sound_ay_registers[12]<<8);
+    break;
+  case 13:
+    ay_env_tick=ay_env_subcycles=0;
+    env_held=env_alternating=0;
+    env_level=0;
+    break;
+  }
+}
+
+
+/* overlay one sample's worth of AY output at ptr (and ptr[1] if stereo) */
+static void sound_ay_sample(unsigned char *ptr)
 {
-static int rng=1;
-static int noise_toggle=1;
-static int env_level=0;
 int tone_level[3];
 int mixer,envshape;
-int f,g,level;
+int g,level;
 int v=0;
+int was_high;
+
+/* the tone level if no enveloping is being used */
+for(g=0;g<3;g++)
+  tone_level[g]=ay_tone_levels[sound_ay_registers[8+g]&15];
+
+/* envelope */
+envshape=sound_ay_registers[13];
+if(ay_env_period)
+  {
+  if(!env_held)
+    {
+    v=((int)ay_env_tick*15)/ay_env_period;
+    if(v<0) v=0;
+    if(v>15) v=15;
+    if((envshape&4)==0) v=15-v;
+    if(env_alternating) v=15-v;
+    env_level=ay_tone_levels[v];
+    }
+  }
+
+for(g=0;g<3;g++)
+  if(sound_ay_registers[8+g]&16)
+    tone_level[g]=env_level;
+
+if(ay_env_period)
+  {
+  /* envelope gets incr'd every 256 AY cycles */
+  ay_env_subcycles+=ay_tick_incr;
+  if(ay_env_subcycles>=(256<<16))
+    {
+    ay_env_subcycles-=(256<<16);
+    
+    ay_env_tick++;
+    if(ay_env_tick>=ay_env_period)
+      {
+      ay_env_tick-=ay_env_period;
+      if(!env_held && ((envshape&1) || (envshape&8)==0))
+        {
+        env_held=1;
+        if((envshape&2) || (envshape&0xc)==4)
+          env_level=ay_tone_levels[15-v];
+        }
+      if(!env_held && (envshape&2))
+        env_alternating=!env_alternating;
+      }
+    }
+  }
+
+/* generate tone+noise */
+/* channel C first to make ACB easier */
+mixer=sound_ay_registers[7];
+if((mixer&4)==0 || (mixer&0x20)==0)
+  {
+  level=(noise_toggle || (mixer&0x20))?tone_level[2]:0;
+  AY_OVERLAY_TONE(ptr,2,level);
+  if(sound_stereo && sound_stereo_acb)
+    ptr[1]=*ptr;
+  }
+if((mixer&1)==0 || (mixer&0x08)==0)
+  {
+  level=(noise_toggle || (mixer&0x08))?tone_level[0]:0;
+  AY_OVERLAY_TONE(ptr,0,level);
+  }
+if((mixer&2)==0 || (mixer&0x10)==0)
+  {
+  level=(noise_toggle || (mixer&0x10))?tone_level[1]:0;
+  AY_OVERLAY_TONE(ptr+sound_stereo_acb,1,level);
+  }
+
+if(sound_stereo && !sound_stereo_acb)
+  ptr[1]=*ptr;
+
+/* update noise RNG/filter */
+ay_noise_tick+=ay_tick_incr;
+if(ay_noise_tick>=ay_noise_period)
+  {
+  if((rng&1)^((rng&2)?1:0))
+    noise_toggle=!noise_toggle;
+  
+  /* rng is 17-bit shift reg, bit 0 is output.
+   * input is bit 0 xor bit 2.
+   */
+  rng|=((rng&1)^((rng&4)?1:0))?0x20000:0;
+  rng>>=1;
+  
+  ay_noise_tick-=ay_noise_period;
+  }
+}
+
+
+static void sound_ay_overlay(void)
+{
+int f;
 unsigned char *ptr;
 struct ay_change_tag *change_ptr=ay_change;
 int changes_left=ay_change_count;
-int reg,r;
-int was_high;
 int channels=(sound_stereo?2:1);
 
 /* If no AY chip, don't produce any AY sound (!) */
@@ -483,127 +748,55 @@ for(f=0,ptr=sound_buf;f<sound_framesiz;f++,ptr+=channels)
    */
   while(changes_left && (f>=change_ptr->ofs || f==sound_framesiz-1))
     {
-    sound_ay_registers[reg=change_ptr->reg]=change_ptr->val;
+    sound_ay_setreg(change_ptr->reg,change_ptr->val);
     change_ptr++; changes_left--;
-
-    /* fix things as needed for some register changes */
-    switch(reg)
-      {
-      case 0: case 1: case 2: case 3: case 4: case 5:
-        r=reg>>1;
-        ay_tone_period[r]=(8*(sound_ay_registers[reg&~1]|
-                              (sound_ay_registers[reg|1]&15)<<8))<<16;
-
-        /* important to get this right, otherwise e.g. Ghouls 'n' Ghosts
-         * has really scratchy, horrible-sounding vibrato.
-         */
-        if(ay_tone_period[r] && ay_tone_tick[r]>=ay_tone_period[r]*2)
-          ay_tone_tick[r]%=ay_tone_period[r]*2;
-        break;
-      case 6:
-        ay_noise_tick=0;
-        ay_noise_period=(16*(sound_ay_registers[reg]&31))<<16;
-        break;
-      case 11: case 12:
-        /* this one *isn't* fixed-point */
-        ay_env_period=sound_ay_registers[11]|(sound_ay_registers[12]<<8);
-        break;
-      case 13:
-        ay_env_tick=ay_env_subcycles=0;
-        env_held=env_alternating=0;
-        env_level=0;
-        break;
-      }
     }
-  
-  /* the tone level if no enveloping is being used */
-  for(g=0;g<3;g++)
-    tone_level[g]=ay_tone_levels[sound_ay_registers[8+g]&15];
 
-  /* envelope */
-  envshape=sound_ay_registers[13];
-  if(ay_env_period)
-    {
-    if(!env_held)
-      {
-      v=((int)ay_env_tick*15)/ay_env_period;
-      if(v<0) v=0;
-      if(v>15) v=15;
-      if((envshape&4)==0) v=15-v;
-      if(env_alternating) v=15-v;
-      env_level=ay_tone_levels[v];
-      }
-    }
-  
-  for(g=0;g<3;g++)
-    if(sound_ay_registers[8+g]&16)
-      tone_level[g]=env_level;
+  sound_ay_sample(ptr);
+  }
+}
 
-  if(ay_env_period)
-    {
-    /* envelope gets incr'd every 256 AY cycles */
-    ay_env_subcycles+=ay_tick_incr;
-    if(ay_env_subcycles>=(256<<16))
-      {
-      ay_env_subcycles-=(256<<16);
-      
-      ay_env_tick++;
-      if(ay_env_tick>=ay_env_period)
-        {
-        ay_env_tick-=ay_env_period;
-        if(!env_held && ((envshape&1) || (envshape&8)==0))
-          {
-          env_held=1;
-          if((envshape&2) || (envshape&0xc)==4)
-            env_level=ay_tone_levels[15-v];
-          }
-        if(!env_held && (envshape&2))
-          env_alternating=!env_alternating;
-        }
-      }
-    }
 
-  /* generate tone+noise */
-  /* channel C first to make ACB easier */
-  mixer=sound_ay_registers[7];
-  if((mixer&4)==0 || (mixer&0x20)==0)
-    {
-    level=(noise_toggle || (mixer&0x20))?tone_level[2]:0;
-    AY_OVERLAY_TONE(ptr,2,level);
-    if(sound_stereo && sound_stereo_acb)
-      ptr[1]=*ptr;
-    }
-  if((mixer&1)==0 || (mixer&0x08)==0)
-    {
-    level=(noise_toggle || (mixer&0x08))?tone_level[0]:0;
-    AY_OVERLAY_TONE(ptr,0,level);
-    }
-  if((mixer&2)==0 || (mixer&0x10)==0)
-    {
-    level=(noise_toggle || (mixer&0x10))?tone_level[1]:0;
-    AY_OVERLAY_TONE(ptr+sound_stereo_acb,1,level);
-    }
-  
-  if(sound_stereo && !sound_stereo_acb)
-    ptr[1]=*ptr;
+#ifdef SZ81	/* Added by Thunor */
+/* called from the audio callback with len bytes of stream just taken
+ * from the sound buffer, the first of them being at stream byte position
+ * pos. Queued register writes are applied as their positions are reached
+ * and the AY output is mixed in on top of what's already there.
+ */
+void sound_ay_callback(unsigned char *stream,int len,unsigned long pos)
+{
+struct ay_queue_tag *q;
+unsigned char buf[2];
+int channels=(sound_stereo?2:1);
+int bps=channels*(sixteenbit?2:1);
+int g;
 
-  /* update noise RNG/filter */
-  ay_noise_tick+=ay_tick_incr;
-  if(ay_noise_tick>=ay_noise_period)
+if(!sound_ay_threaded) return;
+
+for(;len>=bps;len-=bps,pos+=bps,stream+=bps)
+  {
+  while(ay_queue_head!=ay_queue_tail)
     {
-    if((rng&1)^((rng&2)?1:0))
-      noise_toggle=!noise_toggle;
-    
-    /* rng is 17-bit shift reg, bit 0 is output.
-     * input is bit 0 xor bit 2.
-     */
-    rng|=((rng&1)^((rng&4)?1:0))?0x20000:0;
-    rng>>=1;
-    
-    ay_noise_tick-=ay_noise_period;
+    AY_QUEUE_BARRIER();
+    q=&ay_queue[ay_queue_head&(AY_QUEUE_SIZE-1)];
+    if((long)(q->pos-pos)>0) break;
+    sound_ay_setreg(q->reg,q->val);
+    AY_QUEUE_BARRIER();
+    ay_queue_head++;
     }
+
+  buf[0]=buf[1]=128;
+  sound_ay_sample(buf);
+
+  /* 16-bit data has the 8-bit sample in its high byte */
+  for(g=0;g<channels;g++)
+    if(sixteenbit)
+      stream[g*2+1]+=buf[g]-128;
+    else
+      stream[g]+=buf[g]-128;
   }
 }
+#endif
 
 
 /* don't make the change immediately; record it for later,
@@ -616,6 +809,40 @@ if(!sound_enabled || !sound_ay) return;
 /* accept r15, in case of the two-I/O-port 8910 */
 if(reg>=16) return;
 
+#ifdef SZ81	/* Added by Thunor */
+/* frames being run ahead are never heard */
+if(sdl_emulator.speculating) return;
+
+ay_written[reg]=val;
+
+/* nor are frames run flat out, but what they write is kept */
+if(sdl_emulator.turbo || sdl_emulator.warping)
+  {
+  ay_resync|=1<<reg;
+  return;
+  }
+
+if(sound_ay_threaded)
+  {
+  struct ay_queue_tag *q;
+  int ofs;
+
+  ofs=(tstates*sound_freq)/3250000;
+  if(ofs>=sound_framesiz) ofs=sound_framesiz-1;
+
+  /* if the audio thread has fallen this far behind, drop it */
+  if(ay_queue_tail-ay_queue_head>=AY_QUEUE_SIZE) return;
+
+  q=&ay_queue[ay_queue_tail&(AY_QUEUE_SIZE-1)];
+  q->pos=ay_stream_pos+ofs*(sound_stereo+1)*(sixteenbit+1);
+  q->reg=reg;
+  q->val=val;
+  AY_QUEUE_BARRIER();
+  ay_queue_tail++;
+  return;
+  }
+#endif
+
 if(tstates>=0 && ay_change_count<AY_CHANGE_MAX)
   {
   ay_change[ay_change_count].tstates=tstates;
@@ -626,6 +853,74 @@ if(tstates>=0 && ay_change_count<AY_CHANGE_MAX)
 }
 
 
+#ifdef SZ81	/* Added by Thunor */
+/* copy the AY's state out for a snapshot. When the audio callback is
+ * doing the synthesis it owns the generator state, so stop it briefly.
+ */
+void sound_ay_getstate(struct sound_ay_state *state)
+{
+int f;
+
+if(sound_ay_threaded) sdl_sound_lock();
+
+for(f=0;f<16;f++)
+  state->registers[f]=ay_written[f];
+for(f=0;f<3;f++)
+  state->tone_tick[f]=ay_tone_tick[f];
+state->noise_tick=ay_noise_tick;
+state->env_tick=ay_env_tick;
+state->env_subcycles=ay_env_subcycles;
+state->env_held=env_held;
+state->env_alternating=env_alternating;
+state->env_level=env_level;
+state->rng=rng;
+state->noise_toggle=noise_toggle;
+
+if(sound_ay_threaded) sdl_sound_unlock();
+}
+
+
+/* put back the AY's state from a snapshot. Writes still waiting to be
+ * heard belong to the timeline being abandoned so they're dropped.
+ * Running ahead never touches the AY, so there's nothing to put back
+ * when returning from that.
+ */
+void sound_ay_setstate(struct sound_ay_state *state)
+{
+int f;
+
+if(sdl_emulator.speculating) return;
+
+if(sound_ay_threaded) sdl_sound_lock();
+
+ay_change_count=0;
+ay_queue_head=ay_queue_tail;
+
+for(f=0;f<16;f++)
+  {
+  ay_written[f]=state->registers[f];
+  /* r13 restarts the envelope, which is restored below anyway */
+  if(f==13)
+    sound_ay_registers[f]=state->registers[f];
+  else
+    sound_ay_setreg(f,state->registers[f]);
+  }
+for(f=0;f<3;f++)
+  ay_tone_tick[f]=state->tone_tick[f];
+ay_noise_tick=state->noise_tick;
+ay_env_tick=state->env_tick;
+ay_env_subcycles=state->env_subcycles;
+env_held=state->env_held;
+env_alternating=state->env_alternating;
+env_level=state->env_level;
+rng=state->rng;
+noise_toggle=state->noise_toggle;
+
+if(sound_ay_threaded) sdl_sound_unlock();
+}
+#endif
+
+
 /* no need to call this initially, but should be called
  * on reset otherwise.
  */
@@ -638,8 +933,8 @@ for(f=0;f<16;f++)
 }
 
 
-/* XXX currently using speccy beeper code verbatim for VSYNC.
- * Not sure how plausible this is, but for now it'll do.
+/* XXX the VSYNC beeper started out as the speccy beeper code from
+ * Fuse. Not sure how plausible this is, but for now it'll do.
  * It does *sound* pretty plausible.
  */
 
@@ -655,127 +950,169 @@ for(f=0;f<16;f++)
  * well and IMHO sounds a little more like a real speccy than most
  * emulations. It also has the considerable advantage of having a zero
  * rest position, which I'm a lot happier with. :-)
+ *
+ * The fade is slow enough not to need band-limiting, so it's applied
+ * straight to the integral rather than going through blep_delta[].
  */
 
-#define BEEPER_FADEOUT	(((1<<24)/150)/AMPL_BEEPER)
-
-#define BEEPER_OLDVAL_ADJUST \
-  beeper_tick+=beeper_tick_incr;	\
-  if(beeper_tick>=BEEPER_FADEOUT)	\
-    {					\
-    beeper_tick-=BEEPER_FADEOUT;	\
-    if(sound_oldval>128)		\
-      sound_oldval--;			\
-    else				\
-      if(sound_oldval<128)		\
-        sound_oldval++;			\
+static void sound_beeper_overlay(void)
+{
+struct beeper_edge_tag *edge_ptr=beeper_edge;
+int edges_left=beeper_edge_count;
+int ampl=AMPL_BEEPER<<BLEP_SHIFT;
+int fade=((AMPL_BEEPER*150)<<BLEP_SHIFT)/sound_freq;
+const short *kernel;
+unsigned char *ptr;
+int f,k,step,sum,d,val;
+
+for(f=0,ptr=sound_buf;f<sound_framesiz;f++)
+  {
+  /* start off any edges in this sample */
+  while(edges_left && (edge_ptr->pos>>BLEP_PHASE_BITS)<=f)
+    {
+    step=(edge_ptr->on?ampl:-ampl)-beeper_level;
+    beeper_level+=step;
+
+    kernel=blep_kernel[edge_ptr->pos&(BLEP_PHASES-1)];
+    for(k=0,sum=0;k<BLEP_TAPS;k++)
+      {
+      d=(step*kernel[k])>>BLEP_SHIFT;
+      blep_delta[f+k]+=d;
+      sum+=d;
+      }
+    /* make sure it adds up to the full step */
+    blep_delta[f+BLEP_TAPS/2]+=step-sum;
+
+    edge_ptr++; edges_left--;
+    }
+
+  /* fade towards the rest position */
+  if(beeper_level>0)
+    {
+    d=(beeper_level<fade?beeper_level:fade);
+    beeper_level-=d; blep_acc-=d;
     }
+  else if(beeper_level<0)
+    {
+    d=(-beeper_level<fade?-beeper_level:fade);
+    beeper_level+=d; blep_acc+=d;
+    }
+
+  blep_acc+=blep_delta[f];
+  val=128+((blep_acc+(1<<(BLEP_SHIFT-1)))>>BLEP_SHIFT);
+  if(val<0) val=0;
+  if(val>255) val=255;
+
+  *ptr++=val;
+  if(sound_stereo)
+    *ptr++=val;
+  }
+
+/* carry the tails of late edges over to the next frame */
+memmove(blep_delta,blep_delta+sound_framesiz,BLEP_TAPS*sizeof(int));
+memset(blep_delta+BLEP_TAPS,0,sound_framesiz*sizeof(int));
+
+beeper_edge_count=0;
+}
 
 
 void sound_frame(void)
 {
-unsigned char *ptr;
-int f;
-
 if(!sound_enabled) return;
 
 if(sound_vsync)
-  {
-  ptr=sound_buf+(sound_stereo?sound_fillpos*2:sound_fillpos);
-  for(f=sound_fillpos;f<sound_framesiz;f++)
-    {
-    BEEPER_OLDVAL_ADJUST;
-    *ptr++=sound_oldval;
-    if(sound_stereo)
-      *ptr++=sound_oldval;
-    }
-  }
+  sound_beeper_overlay();
 else
   /* must be AY then, so `zero' buffer ready for it */
   memset(sound_buf,128,sound_framesiz*(sound_stereo+1));
 
+#ifdef SZ81	/* Added by Thunor */
+/* if threaded, the audio callback does the AY instead */
+if(sound_ay && !sound_ay_threaded)
+#else
 if(sound_ay)
+#endif
   sound_ay_overlay();
 
 osssound_frame(sound_buf,sound_framesiz*(sound_stereo+1));
 
-sound_oldpos=-1;
-sound_fillpos=0;
+#ifdef SZ81	/* Added by Thunor */
+ay_stream_pos+=sound_framesiz*(sound_stereo+1)*(sixteenbit+1);
+#endif
+
 sound_ptr=sound_buf;
 
 ay_change_count=0;
 }
 
 
-void sound_beeper(int on)
+#ifdef SZ81	/* Added by Thunor */
+/* this is called instead of sound_frame() for frames run flat out. What
+ * was left over from before they started is dropped and the AY is
+ * brought up to date with what they've written, so that the first frame
+ * heard afterwards carries on from where they left off.
+ */
+void sound_skip_frame(void)
 {
-unsigned char *ptr;
-int newpos,subpos;
-int val,subval;
 int f;
 
-if(!sound_enabled || !sound_vsync) return;
-
-val=(on?128+AMPL_BEEPER:128-AMPL_BEEPER);
+if(!sound_enabled) return;
 
-if(val==sound_oldval_orig) return;
+beeper_edge_count=0;
+ay_change_count=0;
 
-/* XXX a lookup table might help here... */
-newpos=(tstates*sound_framesiz)/tsmax;
-subpos=(tstates*sound_framesiz*VOL_BEEPER)/tsmax-VOL_BEEPER*newpos;
+if(!sound_ay) return;
 
-/* if we already wrote here, adjust the level.
- */
-if(newpos==sound_oldpos)
+/* when threaded the audio callback owns the AY, and writes still queued
+ * from before are dropped as they're in ay_written[] too */
+if(sound_ay_threaded)
   {
-  /* adjust it as if the rest of the sample period were all in
-   * the new state. (Often it will be, but if not, we'll fix
-   * it later by doing this again.)
-   */
-  if(on)
-    beeper_last_subpos+=VOL_BEEPER-subpos;
-  else
-    beeper_last_subpos-=VOL_BEEPER-subpos;
+  if(!ay_resync && ay_queue_head==ay_queue_tail) return;
+  sdl_sound_lock();
+  ay_queue_head=ay_queue_tail;
   }
-else
-  beeper_last_subpos=(on?VOL_BEEPER-subpos:subpos);
 
-subval=128-AMPL_BEEPER+beeper_last_subpos;
+for(f=0;f<16;f++)
+  if((ay_resync>>f&1) || sound_ay_registers[f]!=ay_written[f])
+    sound_ay_setreg(f,ay_written[f]);
+ay_resync=0;
 
-if(newpos>=0)
-  {
-  /* fill gap from previous position */
-  ptr=sound_buf+(sound_stereo?sound_fillpos*2:sound_fillpos);
-  for(f=sound_fillpos;f<newpos && f<sound_framesiz;f++)
-    {
-    BEEPER_OLDVAL_ADJUST;
-    *ptr++=sound_oldval;
-    if(sound_stereo)
-      *ptr++=sound_oldval;
-    }
+if(sound_ay_threaded) sdl_sound_unlock();
+}
+#endif
 
-  if(newpos<sound_framesiz)
-    {
-    /* newpos may be less than sound_fillpos, so... */
-    ptr=sound_buf+(sound_stereo?newpos*2:newpos);
-    
-    /* limit subval in case of faded beeper level,
-     * to avoid slight spikes on ordinary tones.
-     */
-    if((sound_oldval<128 && subval<sound_oldval) ||
-       (sound_oldval>=128 && subval>sound_oldval))
-      subval=sound_oldval;
-
-    /* write subsample value */
-    *ptr=subval;
-    if(sound_stereo)
-      *++ptr=subval;
-    }
+
+/* don't make the change immediately; record it for later,
+ * to be made by sound_frame() (via sound_beeper_overlay()).
+ */
+void sound_beeper(int on)
+{
+int pos;
+
+if(!sound_enabled || !sound_vsync) return;
+
+#ifdef SZ81	/* Added by Thunor */
+/* frames being run ahead are never heard */
+if(sdl_emulator.speculating) return;
+
+/* nor are frames run flat out, but the level they leave is kept */
+if(sdl_emulator.turbo || sdl_emulator.warping)
+  {
+  beeper_on=on;
+  return;
   }
+#endif
+
+if(on==beeper_on || beeper_edge_count>=BEEPER_EDGE_MAX) return;
 
-sound_oldpos=newpos;
-sound_fillpos=newpos+1;
-sound_oldval=sound_oldval_orig=val;
+pos=(tstates*sound_framesiz*BLEP_PHASES)/tsmax;
+if(pos>=sound_framesiz*BLEP_PHASES)
+  pos=sound_framesiz*BLEP_PHASES-1;
+
+beeper_edge[beeper_edge_count].pos=pos;
+beeper_edge[beeper_edge_count].on=on;
+beeper_edge_count++;
+beeper_on=on;
 }
 
 
@@ -792,12 +1129,11 @@ for(count=0;count<16;count++)
   ay_tone_levels[count]=0;
 sound_buf=NULL;
 sound_ptr=NULL;
-sound_oldpos=0;
-sound_fillpos=0;
-sound_oldval=0;
-sound_oldval_orig=0;
-beeper_tick=0;
-beeper_tick_incr=0;
+blep_delta=NULL;
+blep_acc=0;
+beeper_level=0;
+beeper_edge_count=0;
+beeper_on=-1;
 for(count=0;count<3;count++)
   ay_tone_tick[count]=0;
 ay_noise_tick=0;
@@ -810,7 +1146,6 @@ ay_noise_period=0;
 ay_env_period=0;
 env_held=0;
 env_alternating=0;
-beeper_last_subpos=0;
 for(count=0;count<16;count++)
   sound_ay_registers[count]=0;
 for(count=0;count<AY_CHANGE_MAX;count++)
@@ -821,6 +1156,12 @@ for(count=0;count<AY_CHANGE_MAX;count++)
   ay_change[count].val=0;
   }
 ay_change_count=0;
+ay_queue_head=ay_queue_tail=0;
+ay_stream_pos=0;
+for(count=0;count<16;count++)
+  ay_written[count]=0;
+ay_resync=0;
+sound_ay_threaded=0;
 sixteenbit=0;
 }
 #endif
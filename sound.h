@@ -21,15 +21,29 @@
 
 #ifdef OSS_SOUND_SUPPORT
 
-extern int sound_enabled;
+extern MACHINE_LOCAL int sound_enabled;
 extern int sound_freq;
 extern int sound_stereo;
 extern int sound_stereo_acb;
 
 #ifdef SZ81	/* Added by Thunor */
+/* what's needed to carry on generating the AY's output from where it
+ * left off (the periods are worked out again from the registers) */
+struct sound_ay_state
+  {
+  unsigned char registers[16];
+  unsigned int tone_tick[3],noise_tick;
+  unsigned int env_tick,env_subcycles;
+  int env_held,env_alternating,env_level;
+  int rng,noise_toggle;
+  };
+
 extern void sound_ay_setvol(void);
 extern int sound_framesiz_init(void);
 extern void sound_reset(void);
+extern void sound_ay_getstate(struct sound_ay_state *state);
+extern void sound_ay_setstate(struct sound_ay_state *state);
+extern void sound_skip_frame(void);
 #endif
 extern void sound_init(void);
 extern void sound_end(void);
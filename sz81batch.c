@@ -0,0 +1,448 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* sz81batch: runs every program within a directory through libsz81.
+ *
+ * The directory is searched recursively for .p and .81 (ZX81) and .o and
+ * .80 (ZX80) programs which are then shared out between a pool of worker
+ * threads, each running one machine at a time. Each program is auto-loaded
+ * and run for a number of frames, optionally typing on the keyboard as an
+ * input script says, and one line of CSV is written per program with a
+ * hash of the final framebuffer, the frames per second achieved and what
+ * became of the program.
+ *
+ * The machines are independent and there's nothing shared but the ROM
+ * images and so the throughput scales with the number of cores. This
+ * requires libsz81 built with -DMACHINE_THREADS (see machine.h) which the
+ * Makefile does for this.
+ *
+ * An input script is a text file of lines each with a frame number and
+ * the keys that are held down from that frame onwards, or none to release
+ * them all. A key is a character on the ZX81's keyboard or SHIFT, NEWLINE
+ * or SPACE, and # begins a comment, for example:
+ *
+ * # Press NEWLINE to start and then hold 5 (left) for a second
+ * 100 NEWLINE
+ * 105
+ * 200 5
+ * 250
+ *
+ * A program's status is one of these:
+ * ok      it ran
+ * lockup  it hasn't drawn anything or read the keyboard for the last
+ *         lockup frames (see sz81_get_idle_frames)
+ * crash   it has disappeared from memory, which is what the machine
+ *         resetting itself looks like
+ * error   it couldn't be read or there's no ROM for its model
+ *
+ * Usage: sz81batch [options] directory
+ * -j jobs     worker threads (default: the number of cores)
+ * -f frames   frames to run each program for (default 500)
+ * -s script   an input script
+ * -d dir      where zx80.rom and zx81.rom are (default data)
+ * -m ramsize  RAM in K (default 16)
+ * -l frames   idle frames that are a lockup (default 250)
+ * -o file     where to write the CSV (default stdout) */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "libsz81.h"
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+#define STATUS_OK 0
+#define STATUS_LOCKUP 1
+#define STATUS_CRASH 2
+#define STATUS_ERROR 3
+
+#define SCRIPT_EVENTS_MAX 4096
+#define PROGRAM_SIZE_MAX (48 * 1024)
+
+/* Variables */
+struct job {
+	char *filename;
+	int model;				/* SZ81_MODEL_* */
+	unsigned long long hash;
+	double fps;
+	int status;				/* STATUS_* */
+};
+
+/* These are static as libsz81 exports the emulator's own globals */
+static struct {
+	int frame;
+	unsigned long long keys;
+} script[SCRIPT_EVENTS_MAX];
+static int script_count = 0;
+
+static struct job *jobs = NULL;
+static int job_count = 0;
+static int job_capacity = 0;
+static int job_next = 0;			/* The next job to be claimed by a worker */
+static pthread_mutex_t job_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned char zx80rom[4 * 1024], zx81rom[8 * 1024];
+static int zx80rom_ok = FALSE, zx81rom_ok = FALSE;
+
+static int frames = 500;
+static int ramsize = 16;
+static int lockup = 250;
+
+static char *status_names[] = {"ok", "lockup", "crash", "error"};
+
+/* Function prototypes */
+int read_file(char *filename, unsigned char *buf, int size);
+int script_load(char *filename);
+int dir_scan(char *dirname);
+int job_compare(const void *a, const void *b);
+void *worker(void *arg);
+void job_run(struct job *job, unsigned char *program);
+double seconds_now(void);
+
+
+/***************************************************************************
+ * Main                                                                    *
+ ***************************************************************************/
+
+int main(int argc, char *argv[]) {
+	char *romdir = "data", *scriptfile = NULL, *outfile = NULL;
+	char filename[256];
+	pthread_t *threads;
+	int threads_count, count, opt, totals[4] = {0, 0, 0, 0};
+	double start, elapsed;
+	FILE *fp = stdout;
+
+	threads_count = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "j:f:s:d:m:l:o:")) != -1) {
+		switch (opt) {
+			case 'j': threads_count = atoi(optarg); break;
+			case 'f': frames = atoi(optarg); break;
+			case 's': scriptfile = optarg; break;
+			case 'd': romdir = optarg; break;
+			case 'm': ramsize = atoi(optarg); break;
+			case 'l': lockup = atoi(optarg); break;
+			case 'o': outfile = optarg; break;
+			default: optind = argc + 1; break;
+		}
+	}
+	if (optind != argc - 1 || frames <= 0 || lockup <= 0) {
+		fprintf(stderr, "Usage: %s [-j jobs] [-f frames] [-s script] [-d romdir] "
+			"[-m ramsize] [-l lockup frames] [-o out.csv] directory\n", argv[0]);
+		return 1;
+	}
+	if (threads_count < 1) threads_count = 1;
+
+	snprintf(filename, sizeof(filename), "%s/zx80.rom", romdir);
+	zx80rom_ok = read_file(filename, zx80rom, sizeof(zx80rom)) == sizeof(zx80rom);
+	snprintf(filename, sizeof(filename), "%s/zx81.rom", romdir);
+	zx81rom_ok = read_file(filename, zx81rom, sizeof(zx81rom)) == sizeof(zx81rom);
+	if (!zx80rom_ok && !zx81rom_ok) return 1;
+
+	if (scriptfile && script_load(scriptfile)) return 1;
+	if (dir_scan(argv[optind])) return 1;
+	qsort(jobs, job_count, sizeof(struct job), job_compare);
+	if (threads_count > job_count) threads_count = job_count > 0 ? job_count : 1;
+
+	if (outfile && (fp = fopen(outfile, "w")) == NULL) {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__, outfile);
+		return 1;
+	}
+
+	/* Every worker claims the next job until there are none left */
+	if ((threads = malloc(threads_count * sizeof(pthread_t))) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		return 1;
+	}
+	start = seconds_now();
+	for (count = 0; count < threads_count; count++) {
+		if (pthread_create(&threads[count], NULL, worker, NULL)) {
+			fprintf(stderr, "%s: Cannot create a thread\n", __func__);
+			return 1;
+		}
+	}
+	for (count = 0; count < threads_count; count++)
+		pthread_join(threads[count], NULL);
+	elapsed = seconds_now() - start;
+
+	fprintf(fp, "file,model,frames,hash,fps,status\n");
+	for (count = 0; count < job_count; count++) {
+		fprintf(fp, "%s,%s,%i,%016llx,%.1f,%s\n", jobs[count].filename,
+			jobs[count].model == SZ81_MODEL_ZX80 ? "zx80" : "zx81", frames,
+			jobs[count].hash, jobs[count].fps, status_names[jobs[count].status]);
+		totals[jobs[count].status]++;
+	}
+	if (fp != stdout) fclose(fp);
+
+	fprintf(stderr, "%i programs (%i ok, %i lockup, %i crash, %i error) on %i "
+		"threads in %.2fs, %.0f frames/s\n", job_count, totals[STATUS_OK],
+		totals[STATUS_LOCKUP], totals[STATUS_CRASH], totals[STATUS_ERROR],
+		threads_count, elapsed, elapsed > 0 ? job_count * frames / elapsed : 0);
+
+	return totals[STATUS_ERROR] != 0;
+}
+
+/***************************************************************************
+ * Worker                                                                  *
+ ***************************************************************************/
+/* Each worker thread has a machine context of its own and so can run
+ * one machine at a time alongside the others */
+
+void *worker(void *arg) {
+	unsigned char *program;
+	struct job *job;
+
+	if ((program = malloc(PROGRAM_SIZE_MAX)) == NULL) {
+		fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+		return NULL;
+	}
+
+	for (;;) {
+		pthread_mutex_lock(&job_mutex);
+		job = job_next < job_count ? &jobs[job_next++] : NULL;
+		pthread_mutex_unlock(&job_mutex);
+		if (!job) break;
+		job_run(job, program);
+	}
+
+	free(program);
+
+	return NULL;
+}
+
+/***************************************************************************
+ * Job Run                                                                 *
+ ***************************************************************************/
+/* This runs one program, stopping at each of the input script's frames
+ * to change the keys held down.
+ *
+ * The program disappearing is detected using the system variable that
+ * follows it in memory: VARS on the ZX80 and D_FILE on the ZX81, which
+ * point to where the program begins (0x4028 and 0x407d) if it's empty.
+ *
+ * On entry: unsigned char *program is a buffer of PROGRAM_SIZE_MAX */
+
+void job_run(struct job *job, unsigned char *program) {
+	int len, frame = 0, event = 0, next, addr, empty;
+	double start;
+	sz81 *machine;
+
+	job->status = STATUS_ERROR;
+	if ((job->model == SZ81_MODEL_ZX80 && !zx80rom_ok) ||
+		(job->model == SZ81_MODEL_ZX81 && !zx81rom_ok)) return;
+	if ((len = read_file(job->filename, program, PROGRAM_SIZE_MAX)) <= 0) return;
+
+	if (job->model == SZ81_MODEL_ZX80) {
+		machine = sz81_create(job->model, ramsize, zx80rom, sizeof(zx80rom));
+		addr = 0x4008;
+		empty = 0x4028;
+	} else {
+		machine = sz81_create(job->model, ramsize, zx81rom, sizeof(zx81rom));
+		addr = 0x400c;
+		empty = 0x407d;
+	}
+	if (!machine) return;
+	if (sz81_load_program(machine, program, len)) {
+		sz81_destroy(machine);
+		return;
+	}
+
+	start = seconds_now();
+	while (frame < frames) {
+		while (event < script_count && script[event].frame <= frame)
+			sz81_set_keys(machine, script[event++].keys);
+		next = event < script_count && script[event].frame < frames ?
+			script[event].frame : frames;
+		if (sz81_run_frames(machine, next - frame)) break;
+		frame = next;
+	}
+	job->fps = frame / (seconds_now() - start);
+	job->hash = sz81_hash(sz81_get_framebuffer(machine), SZ81_SCREEN_SIZE);
+
+	if (frame < frames) {
+		job->status = STATUS_ERROR;
+	} else if (sz81_peek(machine, addr) + (sz81_peek(machine, addr + 1) << 8) ==
+		empty) {
+		job->status = STATUS_CRASH;
+	} else if (sz81_get_idle_frames(machine) >= lockup) {
+		job->status = STATUS_LOCKUP;
+	} else {
+		job->status = STATUS_OK;
+	}
+
+	sz81_destroy(machine);
+}
+
+/***************************************************************************
+ * Directory Scan                                                          *
+ ***************************************************************************/
+/* This adds a job for every program within a directory and recursively
+ * within its subdirectories.
+ *
+ * On exit: returns TRUE on error
+ *          else FALSE */
+
+int dir_scan(char *dirname) {
+	char fullpath[1024], *ext;
+	struct dirent *entry;
+	struct job *grown;
+	struct stat buf;
+	int model;
+	DIR *dir;
+
+	if ((dir = opendir(dirname)) == NULL) {
+		fprintf(stderr, "%s: Cannot read from %s\n", __func__, dirname);
+		return TRUE;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		if (entry->d_name[0] == '.') continue;
+		snprintf(fullpath, sizeof(fullpath), "%s/%s", dirname, entry->d_name);
+		if (stat(fullpath, &buf) != 0) continue;
+		if (S_ISDIR(buf.st_mode)) {
+			if (dir_scan(fullpath)) {
+				closedir(dir);
+				return TRUE;
+			}
+			continue;
+		}
+
+		if ((ext = strrchr(entry->d_name, '.')) == NULL) continue;
+		if (strcasecmp(ext, ".p") == 0 || strcasecmp(ext, ".81") == 0) {
+			model = SZ81_MODEL_ZX81;
+		} else if (strcasecmp(ext, ".o") == 0 || strcasecmp(ext, ".80") == 0) {
+			model = SZ81_MODEL_ZX80;
+		} else {
+			continue;
+		}
+
+		if (job_count == job_capacity) {
+			job_capacity = job_capacity ? job_capacity * 2 : 256;
+			if ((grown = realloc(jobs, job_capacity * sizeof(struct job))) == NULL) {
+				fprintf(stderr, "%s: Cannot allocate memory\n", __func__);
+				closedir(dir);
+				return TRUE;
+			}
+			jobs = grown;
+		}
+		memset(&jobs[job_count], 0, sizeof(struct job));
+		jobs[job_count].filename = strdup(fullpath);
+		jobs[job_count].model = model;
+		job_count++;
+	}
+
+	closedir(dir);
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Job Compare                                                             *
+ ***************************************************************************/
+/* The CSV is in filename order whatever order the jobs finish in */
+
+int job_compare(const void *a, const void *b) {
+	return strcmp(((struct job *)a)->filename, ((struct job *)b)->filename);
+}
+
+/***************************************************************************
+ * Script Load                                                             *
+ ***************************************************************************/
+/* On exit: returns TRUE on error
+ *          else FALSE */
+
+int script_load(char *filename) {
+	char line[256], *token;
+	unsigned long long key;
+	int lineno = 0;
+	FILE *fp;
+
+	if ((fp = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "%s: Cannot read from %s\n", __func__, filename);
+		return TRUE;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		lineno++;
+		if ((token = strchr(line, '#')) != NULL) *token = 0;
+		if ((token = strtok(line, " \t\r\n")) == NULL) continue;
+
+		if (script_count == SCRIPT_EVENTS_MAX || !isdigit(*token) ||
+			(script_count > 0 && atoi(token) < script[script_count - 1].frame)) {
+			fprintf(stderr, "%s: %s line %i is invalid\n", __func__, filename,
+				lineno);
+			fclose(fp);
+			return TRUE;
+		}
+		script[script_count].frame = atoi(token);
+		script[script_count].keys = 0;
+		while ((token = strtok(NULL, " \t\r\n")) != NULL) {
+			if (sz81_key_lookup(token, &key)) {
+				fprintf(stderr, "%s: %s line %i has an unknown key %s\n",
+					__func__, filename, lineno, token);
+				fclose(fp);
+				return TRUE;
+			}
+			script[script_count].keys |= key;
+		}
+		script_count++;
+	}
+
+	fclose(fp);
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Read File                                                               *
+ ***************************************************************************/
+/* On exit: returns the number of bytes read or -1 on error */
+
+int read_file(char *filename, unsigned char *buf, int size) {
+	FILE *fp;
+	int len;
+
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		fprintf(stderr, "%s: Cannot read from %s\n", __func__, filename);
+		return -1;
+	}
+	len = fread(buf, 1, size, fp);
+	fclose(fp);
+
+	return len;
+}
+
+/***************************************************************************
+ * Seconds Now                                                             *
+ ***************************************************************************/
+
+double seconds_now(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
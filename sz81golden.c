@@ -0,0 +1,565 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* sz81golden: checks what the emulator draws against golden images.
+ *
+ * Each golden file describes a deterministic headless replay through
+ * libsz81: a program to auto-load (or none, to just boot the machine),
+ * the keys to press and when, and the hashes (see sz81_hash) of the
+ * framebuffer and of the chroma colours at the frames that are to be
+ * checked. Any change to the CPU, the ULA or the display code that makes
+ * a difference to what's drawn shows up as a mismatch, and so these are
+ * what to run after optimising any of them. Only the hashes are kept and
+ * so the golden files are small enough to keep within the tree.
+ *
+ * On a mismatch the frame is written to the dump directory as a PBM
+ * named after the golden file and the frame, and the chroma colours too
+ * as a PPM if the program is using them, to be compared by eye with the
+ * same from a build that's known to be good.
+ *
+ * A golden file is text with one item to a line and # beginning a
+ * comment. Relative paths are from the current directory, for example:
+ *
+ * # TetrisHR's title and then the game started with NEWLINE
+ * program games-etc/tetrishr.p
+ * model zx81
+ * ramsize 16
+ * hash 300 d57f3b6da831a1b8 -
+ * keys 300 NEWLINE
+ * keys 305
+ * hash 400 ef8432813e3283de -
+ *
+ * model and ramsize are optional (the model is otherwise that of the
+ * program's extension, and 16K). keys are held down from that frame
+ * onwards, as within sz81batch's input scripts. A hash is of the machine
+ * after that many frames, which is before the keys for the same frame,
+ * and is the framebuffer's followed by the chroma colours' or - if they
+ * aren't in use. A hash of just - is one yet to be filled in by -u, and
+ * the frames must be in order.
+ *
+ * Usage: sz81golden [options] file|directory...
+ * -u          rewrite the golden files' hashes with what's drawn now
+ * -d dir      where zx80.rom and zx81.rom are (default data)
+ * -o dir      where to dump mismatched frames (default .) */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "libsz81.h"
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+#define EVENT_KEYS 0
+#define EVENT_HASH 1
+
+#define GOLDEN_LINES_MAX 1024
+#define GOLDEN_LINE_SIZE 256
+#define PROGRAM_SIZE_MAX (48 * 1024)
+
+/* Variables */
+struct event {
+	int type;				/* EVENT_* */
+	int frame;
+	int line;				/* Where it came from within the golden file */
+	unsigned long long keys;
+	int known;				/* FALSE if the hashes are yet to be filled in */
+	unsigned long long hash;
+	int chroma;				/* TRUE if there are chroma colours */
+	unsigned long long chroma_hash;
+};
+
+/* These are static as libsz81 exports the emulator's own globals */
+static char lines[GOLDEN_LINES_MAX][GOLDEN_LINE_SIZE];
+static int line_count;
+static struct event events[GOLDEN_LINES_MAX];
+static int event_count;
+
+static unsigned char zx80rom[4 * 1024], zx81rom[8 * 1024];
+static int zx80rom_ok = FALSE, zx81rom_ok = FALSE;
+static unsigned char program[PROGRAM_SIZE_MAX];
+
+static int update = FALSE;
+static char *dumpdir = ".";
+static int golden_count = 0, hash_count = 0, mismatches = 0, errors = 0;
+static long long frames_run = 0;
+
+/* The Chroma 81's colours as sdl_video.c's cvtChroma has them */
+static unsigned char palette[16][3] = {
+	{0x00, 0x00, 0x00}, {0x00, 0x00, 0x7f}, {0x7f, 0x00, 0x00}, {0x7f, 0x00, 0x7f},
+	{0x00, 0x7f, 0x00}, {0x00, 0x7f, 0x7f}, {0x7f, 0x7f, 0x00}, {0x7f, 0x7f, 0x7f},
+	{0x00, 0x00, 0x00}, {0x00, 0x00, 0xff}, {0xff, 0x00, 0x00}, {0xff, 0x00, 0xff},
+	{0x00, 0xff, 0x00}, {0x00, 0xff, 0xff}, {0xff, 0xff, 0x00}, {0xff, 0xff, 0xff}};
+
+static char programfile[GOLDEN_LINE_SIZE];
+static int model, ramsize;
+
+/* Function prototypes */
+int golden_path(char *path);
+int golden_load(char *filename);
+int golden_run(char *filename);
+int golden_write(char *filename);
+int event_check(char *filename, struct event *event, sz81 *machine);
+int dump_frame(char *filename, int frame, unsigned char *screen,
+	unsigned char *chroma);
+int hash_parse(char *token, unsigned long long *hash, int *known);
+int read_file(char *filename, unsigned char *buf, int size);
+double seconds_now(void);
+
+
+/***************************************************************************
+ * Main                                                                    *
+ ***************************************************************************/
+
+int main(int argc, char *argv[]) {
+	char *romdir = "data";
+	char filename[256];
+	double start, elapsed;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "ud:o:")) != -1) {
+		switch (opt) {
+			case 'u': update = TRUE; break;
+			case 'd': romdir = optarg; break;
+			case 'o': dumpdir = optarg; break;
+			default: optind = argc + 1; break;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "Usage: %s [-u] [-d romdir] [-o dumpdir] "
+			"file|directory...\n", argv[0]);
+		return 1;
+	}
+
+	snprintf(filename, sizeof(filename), "%s/zx80.rom", romdir);
+	zx80rom_ok = read_file(filename, zx80rom, sizeof(zx80rom)) == sizeof(zx80rom);
+	snprintf(filename, sizeof(filename), "%s/zx81.rom", romdir);
+	zx81rom_ok = read_file(filename, zx81rom, sizeof(zx81rom)) == sizeof(zx81rom);
+
+	start = seconds_now();
+	for (; optind < argc; optind++) golden_path(argv[optind]);
+	elapsed = seconds_now() - start;
+
+	fprintf(stderr, "%i golden files, %i hashes, %i %s, %i errors in %.2fs, "
+		"%.0f frames/s\n", golden_count, hash_count, mismatches,
+		update ? "updated" : "mismatched", errors, elapsed,
+		elapsed > 0 ? frames_run / elapsed : 0);
+
+	return (mismatches && !update) || errors;
+}
+
+/***************************************************************************
+ * Golden Path                                                             *
+ ***************************************************************************/
+/* A directory's .txt files are run in name order so that the output is
+ * always the same */
+
+int golden_path(char *path) {
+	struct dirent **entries;
+	char fullpath[1024], *ext;
+	struct stat buf;
+	int count, index;
+
+	if (stat(path, &buf) != 0 ||
+		(S_ISDIR(buf.st_mode) &&
+		(count = scandir(path, &entries, NULL, alphasort)) < 0)) {
+		fprintf(stderr, "%s: Cannot read from %s\n", __func__, path);
+		errors++;
+		return TRUE;
+	}
+	if (!S_ISDIR(buf.st_mode)) return golden_run(path);
+
+	for (index = 0; index < count; index++) {
+		ext = strrchr(entries[index]->d_name, '.');
+		if (entries[index]->d_name[0] != '.' && ext && strcasecmp(ext, ".txt") == 0) {
+			snprintf(fullpath, sizeof(fullpath), "%s/%s", path,
+				entries[index]->d_name);
+			golden_run(fullpath);
+		}
+		free(entries[index]);
+	}
+	free(entries);
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Golden Load                                                             *
+ ***************************************************************************/
+/* This reads a golden file into lines[] and events[], keeping the lines
+ * so that the file can be written back with new hashes.
+ *
+ * On exit: returns TRUE on error
+ *          else FALSE */
+
+int golden_load(char *filename) {
+	char line[GOLDEN_LINE_SIZE], *token, *ext;
+	unsigned long long key;
+	struct event *event;
+	int valid;
+	FILE *fp;
+
+	if ((fp = fopen(filename, "r")) == NULL) {
+		fprintf(stderr, "%s: Cannot read from %s\n", __func__, filename);
+		return TRUE;
+	}
+
+	*programfile = 0;
+	model = -1;
+	ramsize = 16;
+	line_count = event_count = 0;
+	while (line_count < GOLDEN_LINES_MAX &&
+		fgets(lines[line_count], GOLDEN_LINE_SIZE, fp)) {
+		strcpy(line, lines[line_count++]);
+		if ((token = strchr(line, '#')) != NULL) *token = 0;
+		if ((token = strtok(line, " \t\r\n")) == NULL) continue;
+
+		valid = FALSE;
+		if (strcmp(token, "program") == 0) {
+			if ((token = strtok(NULL, " \t\r\n")) != NULL) {
+				strcpy(programfile, token);
+				valid = TRUE;
+			}
+		} else if (strcmp(token, "model") == 0) {
+			if ((token = strtok(NULL, " \t\r\n")) != NULL) {
+				if (strcmp(token, "zx81") == 0) {
+					model = SZ81_MODEL_ZX81;
+					valid = TRUE;
+				} else if (strcmp(token, "zx80") == 0) {
+					model = SZ81_MODEL_ZX80;
+					valid = TRUE;
+				}
+			}
+		} else if (strcmp(token, "ramsize") == 0) {
+			if ((token = strtok(NULL, " \t\r\n")) != NULL) {
+				ramsize = atoi(token);
+				valid = TRUE;
+			}
+		} else if (strcmp(token, "keys") == 0 || strcmp(token, "hash") == 0) {
+			event = &events[event_count];
+			memset(event, 0, sizeof(struct event));
+			event->type = strcmp(token, "keys") == 0 ? EVENT_KEYS : EVENT_HASH;
+			event->line = line_count - 1;
+			if ((token = strtok(NULL, " \t\r\n")) != NULL && isdigit(*token) &&
+				(event_count == 0 || atoi(token) >= events[event_count - 1].frame)) {
+				event->frame = atoi(token);
+				valid = TRUE;
+			}
+			if (valid && event->type == EVENT_KEYS) {
+				while (valid && (token = strtok(NULL, " \t\r\n")) != NULL) {
+					valid = !sz81_key_lookup(token, &key);
+					event->keys |= key;
+				}
+			} else if (valid) {
+				/* Either - alone or both hashes */
+				token = strtok(NULL, " \t\r\n");
+				ext = strtok(NULL, " \t\r\n");
+				valid = !hash_parse(token, &event->hash, &event->known) &&
+					(event->known ? ext != NULL &&
+					!hash_parse(ext, &event->chroma_hash, &event->chroma) :
+					ext == NULL);
+			}
+			if (valid) event_count++;
+		}
+		if (!valid) {
+			fprintf(stderr, "%s: %s line %i is invalid\n", __func__, filename,
+				line_count);
+			fclose(fp);
+			return TRUE;
+		}
+	}
+	if (!feof(fp)) {
+		fprintf(stderr, "%s: %s is too long\n", __func__, filename);
+		fclose(fp);
+		return TRUE;
+	}
+	fclose(fp);
+
+	if (model < 0) {
+		ext = strrchr(programfile, '.');
+		model = ext && (strcasecmp(ext, ".o") == 0 || strcasecmp(ext, ".80") == 0) ?
+			SZ81_MODEL_ZX80 : SZ81_MODEL_ZX81;
+	}
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Golden Run                                                              *
+ ***************************************************************************/
+/* This replays a golden file and checks every hash, or fills them in.
+ *
+ * On exit: returns TRUE on error
+ *          else FALSE */
+
+int golden_run(char *filename) {
+	int len = 0, frame = 0, event;
+	sz81 *machine;
+
+	golden_count++;
+	if (golden_load(filename)) {
+		errors++;
+		return TRUE;
+	}
+	if ((model == SZ81_MODEL_ZX80 && !zx80rom_ok) ||
+		(model == SZ81_MODEL_ZX81 && !zx81rom_ok)) {
+		fprintf(stderr, "%s: %s has no ROM for its model\n", __func__, filename);
+		errors++;
+		return TRUE;
+	}
+	if (*programfile &&
+		(len = read_file(programfile, program, PROGRAM_SIZE_MAX)) <= 0) {
+		errors++;
+		return TRUE;
+	}
+
+	if (model == SZ81_MODEL_ZX80) {
+		machine = sz81_create(model, ramsize, zx80rom, sizeof(zx80rom));
+	} else {
+		machine = sz81_create(model, ramsize, zx81rom, sizeof(zx81rom));
+	}
+	if (!machine || (len && sz81_load_program(machine, program, len))) {
+		sz81_destroy(machine);
+		errors++;
+		return TRUE;
+	}
+
+	/* The events are in frame order and so the machine is run from one
+	 * to the next */
+	for (event = 0; event < event_count; event++) {
+		if (events[event].frame > frame) {
+			if (sz81_run_frames(machine, events[event].frame - frame)) {
+				fprintf(stderr, "%s: %s failed to run\n", __func__, filename);
+				sz81_destroy(machine);
+				errors++;
+				return TRUE;
+			}
+			frames_run += events[event].frame - frame;
+			frame = events[event].frame;
+		}
+		if (events[event].type == EVENT_KEYS) {
+			sz81_set_keys(machine, events[event].keys);
+		} else {
+			event_check(filename, &events[event], machine);
+		}
+	}
+
+	sz81_destroy(machine);
+
+	if (update && golden_write(filename)) {
+		errors++;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Event Check                                                             *
+ ***************************************************************************/
+/* This compares the machine with a hash event, dumping the frame if it
+ * doesn't match or updating the event with it if updating.
+ *
+ * On exit: returns TRUE if it doesn't match
+ *          else FALSE */
+
+int event_check(char *filename, struct event *event, sz81 *machine) {
+	unsigned char *screen, *chroma;
+	unsigned long long hash, chroma_hash = 0;
+
+	hash_count++;
+	screen = sz81_get_framebuffer(machine);
+	chroma = sz81_get_chroma(machine);
+	hash = sz81_hash(screen, SZ81_SCREEN_SIZE);
+	if (chroma) chroma_hash = sz81_hash(chroma, SZ81_SCREEN_SIZE);
+
+	if (event->known && hash == event->hash && (chroma != NULL) == event->chroma &&
+		chroma_hash == event->chroma_hash) return FALSE;
+
+	mismatches++;
+	if (update) {
+		event->known = TRUE;
+		event->hash = hash;
+		event->chroma = chroma != NULL;
+		event->chroma_hash = chroma_hash;
+	} else {
+		fprintf(stderr, "%s frame %i: hash %016llx ", filename, event->frame, hash);
+		if (chroma) {
+			fprintf(stderr, "%016llx", chroma_hash);
+		} else {
+			fprintf(stderr, "-");
+		}
+		if (!event->known) {
+			fprintf(stderr, " is yet to be filled in (-u)\n");
+		} else if (event->chroma) {
+			fprintf(stderr, " was %016llx %016llx\n", event->hash, event->chroma_hash);
+		} else {
+			fprintf(stderr, " was %016llx -\n", event->hash);
+		}
+		dump_frame(filename, event->frame, screen, chroma);
+	}
+
+	return TRUE;
+}
+
+/***************************************************************************
+ * Golden Write                                                            *
+ ***************************************************************************/
+/* This writes the golden file back as it was read but for the hashes.
+ *
+ * On exit: returns TRUE on error
+ *          else FALSE */
+
+int golden_write(char *filename) {
+	int line, event;
+	FILE *fp;
+
+	for (event = 0; event < event_count; event++) {
+		if (events[event].type != EVENT_HASH) continue;
+		line = events[event].line;
+		if (events[event].chroma) {
+			snprintf(lines[line], GOLDEN_LINE_SIZE, "hash %i %016llx %016llx\n",
+				events[event].frame, events[event].hash, events[event].chroma_hash);
+		} else {
+			snprintf(lines[line], GOLDEN_LINE_SIZE, "hash %i %016llx -\n",
+				events[event].frame, events[event].hash);
+		}
+	}
+
+	if ((fp = fopen(filename, "w")) == NULL) {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__, filename);
+		return TRUE;
+	}
+	for (line = 0; line < line_count; line++) fputs(lines[line], fp);
+	fclose(fp);
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Dump Frame                                                              *
+ ***************************************************************************/
+/* The framebuffer is already a binary PBM's raster as a set bit is ink,
+ * which is black. The chroma colours are expanded to an RGB PPM using
+ * the framebuffer to choose between the ink and the paper.
+ *
+ * On entry: unsigned char *chroma is NULL if there are none
+ *  On exit: returns TRUE on error
+ *           else FALSE */
+
+int dump_frame(char *filename, int frame, unsigned char *screen,
+	unsigned char *chroma) {
+	char name[256], dumpfile[1024], *ext;
+	unsigned char colour;
+	int count, bit;
+	FILE *fp;
+
+	/* The golden file's name less the path and the extension */
+	strncpy(name, (ext = strrchr(filename, '/')) ? ext + 1 : filename,
+		sizeof(name) - 1);
+	name[sizeof(name) - 1] = 0;
+	if ((ext = strrchr(name, '.')) != NULL) *ext = 0;
+
+	snprintf(dumpfile, sizeof(dumpfile), "%s/%s-%i.pbm", dumpdir, name, frame);
+	if ((fp = fopen(dumpfile, "wb")) == NULL) {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__, dumpfile);
+		return TRUE;
+	}
+	fprintf(fp, "P4\n%i %i\n", SZ81_SCREEN_WIDTH, SZ81_SCREEN_HEIGHT);
+	fwrite(screen, 1, SZ81_SCREEN_SIZE, fp);
+	fclose(fp);
+	fprintf(stderr, "  wrote %s\n", dumpfile);
+
+	if (!chroma) return FALSE;
+
+	snprintf(dumpfile, sizeof(dumpfile), "%s/%s-%i.ppm", dumpdir, name, frame);
+	if ((fp = fopen(dumpfile, "wb")) == NULL) {
+		fprintf(stderr, "%s: Cannot write to %s\n", __func__, dumpfile);
+		return TRUE;
+	}
+	fprintf(fp, "P6\n%i %i\n255\n", SZ81_SCREEN_WIDTH, SZ81_SCREEN_HEIGHT);
+	for (count = 0; count < SZ81_SCREEN_SIZE; count++) {
+		for (bit = 128; bit; bit >>= 1) {
+			colour = screen[count] & bit ? chroma[count] & 0x0f : chroma[count] >> 4;
+			fwrite(palette[colour], 1, 3, fp);
+		}
+	}
+	fclose(fp);
+	fprintf(stderr, "  wrote %s\n", dumpfile);
+
+	return FALSE;
+}
+
+/***************************************************************************
+ * Hash Parse                                                              *
+ ***************************************************************************/
+/* On entry: char *token is 16 hex digits or - or NULL
+ *  On exit: *known is FALSE if it's -
+ *           returns TRUE on error
+ *           else FALSE */
+
+int hash_parse(char *token, unsigned long long *hash, int *known) {
+	char *end;
+
+	if (!token) return TRUE;
+	*hash = 0;
+	*known = strcmp(token, "-") != 0;
+	if (!*known) return FALSE;
+	if (strlen(token) != 16) return TRUE;
+	*hash = strtoull(token, &end, 16);
+
+	return *end != 0;
+}
+
+/***************************************************************************
+ * Read File                                                               *
+ ***************************************************************************/
+/* On exit: returns the number of bytes read or -1 on error */
+
+int read_file(char *filename, unsigned char *buf, int size) {
+	FILE *fp;
+	int len;
+
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		fprintf(stderr, "%s: Cannot read from %s\n", __func__, filename);
+		return -1;
+	}
+	len = fread(buf, 1, size, fp);
+	fclose(fp);
+
+	return len;
+}
+
+/***************************************************************************
+ * Seconds Now                                                             *
+ ***************************************************************************/
+
+double seconds_now(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
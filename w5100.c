@@ -18,6 +18,8 @@
 #include <SDL/SDL.h>
 #include <SDL/SDL_thread.h>
 #include "w5100.h"
+#include "machine.h"
+#include "sdl_trace.h"
 
 // #define W_DEBUG
 
@@ -36,7 +38,7 @@ static int w_sockfd[4];
 static SDL_Thread* w_thread[4];
 static struct threadData w_threadData[4];
 
-extern unsigned char mem[];
+extern MACHINE_LOCAL unsigned char mem[];
 
 
 uint16_t w_rn2(int addr)
@@ -234,7 +236,9 @@ void w_sendto(int so, int sn)
 
    printf("- Exchanging via UDP  : %s", inet_ntoa(server.sin_addr));
 
+   TRACE_BEGIN("sendto","w5100");
    n = sendto(w_sockfd[sn],buf,lbuf,0,(const struct sockaddr *)&server,length);
+   TRACE_END("sendto","w5100");
    if (n < 0) {
      perror("w_sendto");
      return;
@@ -258,6 +262,8 @@ int w_recvfrom(void *data)
 
    length = sizeof(struct sockaddr_in);
 
+   TRACE_THREAD("w5100 recv");
+
    for (;;) {
 
    n = recvfrom(w_sockfd[sn],buf,W_BUFSIZ,0,(struct sockaddr *)&from, &length);
@@ -272,6 +278,8 @@ int w_recvfrom(void *data)
      return 0;
    }
 
+   TRACE_BEGIN("recvfrom","w5100");
+
    printf(" *\n");
 
    i1 = 0;
@@ -296,6 +304,8 @@ int w_recvfrom(void *data)
    w_wn2(so+Sn_RX_RSR0, n);
    w_mem[so+Sn_IR] |= S_IR_RECV;
 
+   TRACE_END("recvfrom","w5100");
+
    }
 
    return 0;
@@ -320,7 +330,9 @@ void w_send(int so, int sn)
 #endif
      i1++;
    }
+   TRACE_BEGIN("send","w5100");
    n = send(w_sockfd[sn],buf,lbuf,0);
+   TRACE_END("send","w5100");
    if (n < 0) {
      perror("w_send");
      return;
@@ -340,6 +352,8 @@ int w_recv(void *data)
    so = ((struct threadData *)data)->so;
    sn = ((struct threadData *)data)->sn;
 
+   TRACE_THREAD("w5100 recv");
+
    for (;;) {
 
    n = recv(w_sockfd[sn],buf,W_BUFSIZ,0);
@@ -354,6 +368,8 @@ int w_recv(void *data)
      return 0;
    }
 
+   TRACE_BEGIN("recv","w5100");
+
    while (w_mem[so+Sn_IR] & S_IR_RECV) {
      SDL_Delay(10);
 #ifdef W_DEBUG
@@ -376,6 +392,8 @@ int w_recv(void *data)
    w_wn2(so+Sn_RX_RSR0, n);
    w_mem[so+Sn_IR] |= S_IR_RECV;
 
+   TRACE_END("recv","w5100");
+
    }
 
    return 0;
@@ -394,11 +412,14 @@ void w_connect(int so, int sn)
 
    printf("- Connecting to       : %s\n", inet_ntoa(server.sin_addr));
 
+   TRACE_BEGIN("connect","w5100");
    if (connect(w_sockfd[sn],(struct sockaddr *) &server,length) < 0) {
+     TRACE_END("connect","w5100");
      perror("w_connect");
      w_mem[so+Sn_IR] |= S_IR_TIMEOUT;
      return;
    }
+   TRACE_END("connect","w5100");
 
    w_mem[so+Sn_IR] |= S_IR_CON;
    w_mem[so+Sn_SR] = S_SR_SOCK_ESTABLISHED;
@@ -446,12 +467,14 @@ void w_socket(int addr, int val)
 					       w_thread[sn] = NULL;
 					     }
 					     break;
-		         case S_CR_CLOSE   : if (w_thread[sn]) {
+		         case S_CR_CLOSE   : TRACE_BEGIN("close","w5100");
+					     if (w_thread[sn]) {
 			      		       shutdown(w_sockfd[sn], SHUT_RDWR);
 					       SDL_WaitThread(w_thread[sn],&retval);
 					       w_thread[sn] = NULL;
 					     }
 			      		     close(w_sockfd[sn]);
+					     TRACE_END("close","w5100");
 			      		     w_sockfd[sn] = -1;
 			      		     w_mem[so+Sn_SR] = S_SR_SOCK_CLOSED;
 			      		     w_mem[so+Sn_IR] &= ~S_IR_CON;
@@ -48,34 +48,38 @@ unsigned char partable[256]={
    };
 
 
-unsigned long tstates=0,tsmax=65000,frames=0;
+MACHINE_LOCAL unsigned long tstates=0,tsmax=65000,frames=0;
 
 /* odd place to have this, but the display does work in an odd way :-) */
-unsigned char scrnbmp_new[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8]; /* written */
-unsigned char scrnbmp[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8];	/* displayed */
-unsigned char scrnbmp_old[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8];
+MACHINE_LOCAL unsigned char scrnbmp_new[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8]; /* written */
+MACHINE_LOCAL unsigned char scrnbmp[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8];	/* displayed */
+MACHINE_LOCAL unsigned char scrnbmp_old[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8];
 						/* checked against for diffs */
 
 /* chroma */
-unsigned char scrnbmpc_new[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8]; /* written */
-unsigned char scrnbmpc[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8]; /* displayed */
+MACHINE_LOCAL unsigned char scrnbmpc_new[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8]; /* written */
+MACHINE_LOCAL unsigned char scrnbmpc[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8]; /* displayed */
             /* checked against for diffs */
 
 #ifdef SZ81	/* Added by Thunor. I need these to be visible to sdl_loadsave.c */
-int liney=0, lineyi=0;
-int vsy=0;
-unsigned long linestart=0;
-int vsync_toggle=0,vsync_lasttoggle=0;
+MACHINE_LOCAL int liney=0, lineyi=0;
+MACHINE_LOCAL int vsy=0;
+MACHINE_LOCAL unsigned long linestart=0;
+MACHINE_LOCAL int vsync_toggle=0,vsync_lasttoggle=0;
 #else
-static int liney=0, lineyi=0;
-static int vsy=0;
-static unsigned long linestart=0;
-static int vsync_toggle=0,vsync_lasttoggle=0;
+static MACHINE_LOCAL int liney=0, lineyi=0;
+static MACHINE_LOCAL int vsy=0;
+static MACHINE_LOCAL unsigned long linestart=0;
+static MACHINE_LOCAL int vsync_toggle=0,vsync_lasttoggle=0;
 #endif
 
-int ay_reg=0;
+MACHINE_LOCAL int ay_reg=0;
 
-static int linestate=0, linex=0, nrmvideo=1;
+#ifdef SZ81	/* Added by Thunor. These are needed by snapshot_capture too */
+MACHINE_LOCAL int linestate=0, linex=0, nrmvideo=1;
+#else
+static MACHINE_LOCAL int linestate=0, linex=0, nrmvideo=1;
+#endif
 
 #define LINEX 	((tstates-linestart)>>2)
 
@@ -128,20 +132,20 @@ for(y=vsy;y<ny;y++)
 void mainloop()
 {
 #endif
-unsigned char a, f, b, c, d, e, h, l;
-unsigned char r, a1, f1, b1, c1, d1, e1, h1, l1, i, iff1, iff2, im;
-unsigned short pc;
-unsigned short ix, iy, sp;
-unsigned char radjust;
-unsigned long nextlinetime=0,linegap=208,lastvsyncpend=0;
-unsigned char ixoriy, new_ixoriy;
-unsigned char intsample=0;
-unsigned short videodata=0;
-unsigned char op;
-int ulacharline=0;
-int nmipend=0,intpend=0,vsyncpend=0,vsynclen=0;
-int hsyncskip=0;
-int framewait=0;
+MACHINE_LOCAL unsigned char a, f, b, c, d, e, h, l;
+MACHINE_LOCAL unsigned char r, a1, f1, b1, c1, d1, e1, h1, l1, i, iff1, iff2, im;
+MACHINE_LOCAL unsigned short pc;
+MACHINE_LOCAL unsigned short ix, iy, sp;
+MACHINE_LOCAL unsigned char radjust;
+MACHINE_LOCAL unsigned long nextlinetime=0,linegap=208,lastvsyncpend=0;
+MACHINE_LOCAL unsigned char ixoriy, new_ixoriy;
+MACHINE_LOCAL unsigned char intsample=0;
+MACHINE_LOCAL unsigned short videodata=0;
+MACHINE_LOCAL unsigned char op;
+MACHINE_LOCAL int ulacharline=0;
+MACHINE_LOCAL int nmipend=0,intpend=0,vsyncpend=0,vsynclen=0;
+MACHINE_LOCAL int hsyncskip=0;
+MACHINE_LOCAL int framewait=0;
 
 #ifdef SZ81	/* Added by Thunor */
 void mainloop()
@@ -163,13 +167,20 @@ nextlinetime=linegap;
 int ilinex;
 
 #ifdef SZ81	/* Added by Thunor */
-if(sdl_emulator.autoload)
+/* carry on from where the last session left off if possible */
+if(auto_resume_start())
   {
-  sdl_emulator.autoload=0;
-  /* This could be an initial autoload or a later forcedload */
-  if(!sdl_load_file(0,LOAD_FILE_METHOD_DETECT))
-    /* wait for a real frame, to avoid an annoying frame `jump'. */
-    framewait=1;
+  if(sdl_emulator.autoload)
+    {
+    sdl_emulator.autoload=0;
+    /* This could be an initial autoload or a later forcedload */
+    if(!sdl_load_file(0,LOAD_FILE_METHOD_DETECT))
+      /* wait for a real frame, to avoid an annoying frame `jump'. */
+      framewait=1;
+    }
+  else
+    /* skip the ROM's RAM test if we've seen this machine boot before */
+    fast_boot_start();
   }
 #else
 if(autoload)
@@ -326,6 +337,9 @@ executed by the Z80.
         v=mem[(i<<8)|(r&0x80)|(radjust&0x7f)];
       if(taguladisp) v^=128;
       scrnbmp_new[y*(ZX_VID_FULLWIDTH/8)+x] = ((op&128)?~v:v);
+#ifdef SZ81	/* Added by Thunor */
+      sdl_emulator.ulachars++;
+#endif
 
       if (chromamode) {
         op2 = ((op&0x80)>>1) | (op&0x3f);
@@ -426,6 +440,7 @@ executed by the Z80.
       vsyncpend=1;
       vsynclen=1;
       
+      PROFILE_PUSH(PROFILE_COPY);
       memset(scrnbmp,0xff,sizeof(scrnbmp));	/* blank the screen */
       goto postcopy;				/* skip the usual copying */
       }
@@ -433,6 +448,7 @@ executed by the Z80.
     if(!vsyncpend)
       {
       if (!lineyi) liney++;
+      TRACE_SCANLINE(liney);
       
       if(hsyncgen && !hsyncskip)
         {
@@ -443,12 +459,15 @@ executed by the Z80.
       }
     else
       {
+      PROFILE_PUSH(PROFILE_COPY);
       memcpy(scrnbmp,scrnbmp_new,sizeof(scrnbmp));
       if (chromamode) memcpy(scrnbmpc,scrnbmpc_new,sizeof(scrnbmpc)); /* chroma */
       
       postcopy:
       memset(scrnbmp_new,0,sizeof(scrnbmp_new));
       if (chromamode) memset(scrnbmpc_new,bordercolour<<4,sizeof(scrnbmpc_new));
+      PROFILE_POP();
+      TRACE_FRAME();
       
       lastvsyncpend=tstates;
       vsyncpend=0;
@@ -473,6 +492,7 @@ executed by the Z80.
     if(nmigen)
       {
 /*      printf("NMI line %d tst %d\n",liney,tstates);*/
+      TRACE_INSTANT("NMI","z80");
       iff2=iff1;
       iff1=0;
       /* hardware syncs tstates to falling of NMI pulse (?),
@@ -503,6 +523,7 @@ executed by the Z80.
     if(iff1)
       {
 /*      printf("int line %d tst %d\n",liney,tstates);*/
+      TRACE_INSTANT("INT","z80");
       //if(fetch(pc&0x7fff)==0x76)pc++;
       if (fetchm(pc)==0x76) pc++;
       iff1=iff2=0;
@@ -537,6 +558,15 @@ executed by the Z80.
     if(interrupted==1)
       {
       do_interrupt();	/* also zeroes it */
+#ifdef SZ81	/* Added by Thunor */
+      /* between instructions, so it's safe to take or restore snapshots */
+      rewind_frame();
+      input_log_frame();
+      quick_slot_frame();
+      fast_boot_frame();
+      auto_warp_frame();
+      runahead_frame();
+#endif
       }
 #ifdef SZ81	/* Added by Thunor */
     /* I've added these new interrupt types to support a thorough
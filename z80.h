@@ -24,10 +24,10 @@
 #define Z80_log   6
 
 extern int hsize,vsize;
-extern int interrupted;
-extern unsigned char scrnbmp_new[],scrnbmp[],scrnbmp_old[],scrnbmpc_new[],scrnbmpc[];
-extern unsigned long tstates,tsmax,frames;
-extern int ay_reg;
+extern MACHINE_LOCAL int interrupted;
+extern MACHINE_LOCAL unsigned char scrnbmp_new[],scrnbmp[],scrnbmp_old[],scrnbmpc_new[],scrnbmpc[];
+extern MACHINE_LOCAL unsigned long tstates,tsmax,frames;
+extern MACHINE_LOCAL int ay_reg;
 
 extern void vsync_raise(void);
 extern void vsync_lower(void);
@@ -63,12 +63,23 @@ extern void z80_reset(void);
 #define AY_STORE_CHECK(x,y)  /* nothing */
 #endif
 
+/* a memattr of 2 is writable but the first store is noted (see
+ * memattr_watch in common.c)
+ */
+#ifdef SZ81	/* Added by Thunor */
+#define MEMATTR_STORE_CHECK(attr,page,off) \
+          if((attr)>1) memattr_first_store(page,off);
+#else
+#define MEMATTR_STORE_CHECK(attr,page,off)  /* nothing */
+#endif
+
 #define store(x,y) do {\
           unsigned short off=(x)&1023;\
           unsigned char page=(unsigned short)(x)>>10;\
           int attr=memattr[page];\
           AY_STORE_CHECK(x,y) \
           if(attr){\
+             MEMATTR_STORE_CHECK(attr,page,off) \
              memptr[page][off]=(y);\
              }\
            } while(0)
@@ -78,6 +89,7 @@ extern void z80_reset(void);
           unsigned char page=(unsigned short)(x)>>10;\
           int attr=memattr[page];\
           if(attr) { \
+             MEMATTR_STORE_CHECK(attr,page,off) \
              memptr[page][off]=(lo);\
              memptr[page][off+1]=(hi);\
              }\
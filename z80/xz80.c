@@ -0,0 +1,200 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* Includes */
+#include <string.h>
+#include "../common.h"
+#include "../z80.h"
+#include "../sdl.h"
+#include "xz80.h"
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+#define parity(a) (partable[a])
+
+/* Variables */
+/* What ../z80ops.c works on, as ../z80.c and ../common.c define it */
+unsigned char a, f, b, c, d, e, h, l;
+unsigned char r, a1, f1, b1, c1, d1, e1, h1, l1, i, iff1, iff2, im;
+unsigned short pc;
+unsigned short ix, iy, sp;
+unsigned char radjust;
+unsigned char ixoriy, new_ixoriy;
+unsigned char intsample;
+unsigned char op;
+int framewait;
+unsigned long tstates;
+unsigned char partable[256];
+unsigned char *memptr[64];
+int memattr[64];
+int zx80;
+struct sdl_emulator sdl_emulator;
+
+unsigned char (*xz80_readport)(int port);
+void (*xz80_writeport)(int port, int data);
+unsigned long long xz80_written;
+
+static int physical[64];	/* The page of the test's memory that each maps to */
+static int ula = FALSE;
+static int halted = FALSE;
+
+
+/***************************************************************************
+ * Init                                                                    *
+ ***************************************************************************/
+
+void xz80_init(void) {
+	int count, bit;
+
+	for (count = 0; count < 256; count++) {
+		for (bit = 0, partable[count] = 4; bit < 8; bit++)
+			partable[count] ^= (count >> bit & 1) << 2;
+	}
+	sdl_emulator.ramsize = 16;
+}
+
+/***************************************************************************
+ * Map                                                                     *
+ ***************************************************************************/
+/* On entry: int page is the 1K page of the address space
+ *           unsigned char *ptr is the memory it maps to
+ *           int writable is TRUE for RAM and FALSE for ROM
+ *           int physical is the page of the test's memory that ptr is,
+ *           which is what xz80_written has set when it's stored to */
+
+void xz80_map(int page, unsigned char *ptr, int writable, int phys) {
+	memptr[page] = ptr;
+	/* A memattr of 2 has every store come through memattr_first_store */
+	memattr[page] = writable ? 2 : 0;
+	physical[page] = phys;
+}
+
+/***************************************************************************
+ * Set ULA                                                                 *
+ ***************************************************************************/
+/* On entry: int state is TRUE to have instructions fetched above 32K
+ *           with bit 6 clear seen as a NOP, as the ZX80 and ZX81's ULA
+ *           has it when it's executing the display file */
+
+void xz80_set_ula(int state) {
+	ula = state;
+}
+
+/***************************************************************************
+ * Step                                                                    *
+ ***************************************************************************/
+/* This is the top of mainloop less the ULA. A DD or FD prefix is an
+ * instruction of its own to xz80 and so it carries on through them.
+ *
+ * On exit: returns the T-states taken */
+
+int xz80_step(void) {
+	unsigned long start = tstates;
+
+	xz80_written = 0;
+	do {
+		ixoriy = new_ixoriy;
+		new_ixoriy = 0;
+		op = fetchm(pc);
+		if (ula && (pc & 0x8000) && !(op & 64)) op = 0;
+		pc++;
+		radjust++;
+		switch (op) {
+#include "../z80ops.c"
+		}
+	} while (new_ixoriy);
+	halted = op == 0x76;
+
+	return tstates - start;
+}
+
+/***************************************************************************
+ * Get                                                                     *
+ ***************************************************************************/
+/* xz80's im 1 is the undocumented IM 0/1 which behaves as IM 0 */
+
+void xz80_get(struct z80_state *state) {
+	static unsigned char ims[] = {0, 0, 1, 2};
+
+	state->a = a; state->f = f; state->b = b; state->c = c;
+	state->d = d; state->e = e; state->h = h; state->l = l;
+	state->a_ = a1; state->f_ = f1; state->b_ = b1; state->c_ = c1;
+	state->d_ = d1; state->e_ = e1; state->h_ = h1; state->l_ = l1;
+	state->ix = ix; state->iy = iy; state->sp = sp; state->pc = pc;
+	state->i = i;
+	state->r = (r & 0x80) | (radjust & 0x7f);
+	state->iff1 = iff1; state->iff2 = iff2;
+	state->im = ims[im & 3];
+	state->halted = halted;
+}
+
+/***************************************************************************
+ * Set                                                                     *
+ ***************************************************************************/
+
+void xz80_set(struct z80_state *state) {
+	static unsigned char ims[] = {0, 2, 3};
+
+	a = state->a; f = state->f; b = state->b; c = state->c;
+	d = state->d; e = state->e; h = state->h; l = state->l;
+	a1 = state->a_; f1 = state->f_; b1 = state->b_; c1 = state->c_;
+	d1 = state->d_; e1 = state->e_; h1 = state->h_; l1 = state->l_;
+	ix = state->ix; iy = state->iy; sp = state->sp; pc = state->pc;
+	i = state->i;
+	r = radjust = state->r;
+	iff1 = state->iff1; iff2 = state->iff2;
+	im = ims[state->im % 3];
+	halted = state->halted;
+	ixoriy = new_ixoriy = 0;
+	intsample = 1;
+}
+
+/***************************************************************************
+ * What z80ops.c Calls                                                     *
+ ***************************************************************************/
+/* The ports are the test's. OUT takes no more than the Z80 says it does
+ * here (sz81's out adds the ULA's extra T-state) */
+
+unsigned int in(int h, int l) {
+	return xz80_readport((h << 8) | l);
+}
+
+unsigned int out(int h, int l, int a) {
+	xz80_writeport((h << 8) | l, a);
+
+	return 0;
+}
+
+/* A store to memory that's mapped as writable */
+
+void memattr_first_store(int page, int off) {
+	xz80_written |= 1ULL << physical[page];
+	if (off == 1023) xz80_written |= 1ULL << physical[(page + 1) & 63];
+}
+
+/* ED FC and ED FD are sz81's LOAD and SAVE traps and don't do anything
+ * here, as the EightyOne/FUSE core's don't */
+
+int sdl_load_file(int parameter, int method) {
+	return TRUE;
+}
+
+int sdl_save_file(int parameter, int method) {
+	return TRUE;
+}
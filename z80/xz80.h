@@ -0,0 +1,56 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* The xz80 core that sz81 runs (../z80ops.c, ../cbops.c and ../edops.c)
+ * wrapped so that it can be stepped an instruction at a time alongside
+ * the EightyOne/FUSE core here, for the tests that compare the two.
+ *
+ * Within sz81 the instructions are a switch within mainloop, which also
+ * emulates the ULA between them. Here the same switch is compiled into
+ * xz80_step on its own, and everything else that it needs of a machine
+ * is supplied by the test: the memory as 1K pages and the ports */
+
+#ifndef XZ80_H
+#define XZ80_H
+
+/* Variables */
+/* The state of either core. im is 0, 1 or 2 as the Z80 has it and r is
+ * the whole of R */
+struct z80_state {
+	unsigned char a, f, b, c, d, e, h, l;
+	unsigned char a_, f_, b_, c_, d_, e_, h_, l_;
+	unsigned short ix, iy, sp, pc;
+	unsigned char i, r, iff1, iff2, im;
+	int halted;
+};
+
+/* The test's ports */
+extern unsigned char (*xz80_readport)(int port);
+extern void (*xz80_writeport)(int port, int data);
+
+/* The physical pages (see xz80_map) stored to by the last xz80_step */
+extern unsigned long long xz80_written;
+
+/* Function prototypes */
+void xz80_init(void);
+void xz80_map(int page, unsigned char *ptr, int writable, int physical);
+void xz80_set_ula(int state);
+int xz80_step(void);
+void xz80_get(struct z80_state *state);
+void xz80_set(struct z80_state *state);
+
+#endif
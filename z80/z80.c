@@ -50,7 +50,7 @@ BYTE parity_table[0x100]; /* The parity of the lookup value */
 BYTE sz53p_table[0x100]; /* OR the above two tables together */
 
 /* This is what everything acts on! */
-processor z80;
+MACHINE_LOCAL processor z80;
 
 static void z80_init_tables(void);
 
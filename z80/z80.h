@@ -32,6 +32,7 @@ extern "C" {
 #endif
 
 #include "config.h"
+#include "../machine.h"
 
 #ifndef FUSE_TYPES_H
 //#include <types.h>
@@ -78,7 +79,7 @@ extern int z80_do_opcode(void);
 
 extern void debug(int data);
 
-extern processor z80;
+extern MACHINE_LOCAL processor z80;
 extern BYTE halfcarry_add_table[];
 extern BYTE halfcarry_sub_table[];
 extern BYTE overflow_add_table[];
@@ -0,0 +1,855 @@
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+/* z80diff: runs the xz80 core that sz81 uses (see xz80.h) and the
+ * EightyOne/FUSE core here in lockstep and reports the first instruction
+ * that they disagree on. After every instruction the registers, the
+ * flags, HALT, the T-states taken and every 1K page of memory that
+ * either core has stored to are compared.
+ *
+ * The instructions come from these streams in turn:
+ * fuzz    single random instructions of every family (main, CB, ED,
+ *         DD/FD and DDCB/FDCB) with random registers and memory
+ * rom     the ZX81 and ZX80 ROMs booting from reset
+ * program each .p program given, loaded as z81 used to auto-load them,
+ *         with keys pressed now and then
+ *
+ * The ROMs and the programs run within a rough machine of the test's
+ * own, the same for both cores: the memory is mapped as sz81 maps 16K,
+ * the ULA's NOPs are fetched from the display file above 32K, the NMI
+ * generator interrupts every 207 T-states whilst on and INT is taken
+ * when bit 6 of R is clear. It isn't accurate, which doesn't matter as
+ * both cores see the same machine, but it's enough to take the ROMs
+ * through their display and keyboard routines. ED FB to ED FD are traps
+ * within both emulators and aren't fuzzed.
+ *
+ * Finally each core runs the ROM and program streams alone and its
+ * throughput is given.
+ *
+ * Usage: z80diff [options] [program.p...]
+ * -n count    fuzzed instructions (default 1000000)
+ * -i count    instructions to run of the ROMs and each program
+ *             (default 2000000)
+ * -s seed     the fuzzer's seed (default 1)
+ * -d dir      where zx80.rom and zx81.rom are (default ../data)
+ * -f mask     the flags of F and F' to compare (default ff)
+ * -t          don't compare the T-states
+ * -a          report every instruction that differs (once each) rather
+ *             than stopping at the first */
+
+/* Includes */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "config.h"
+#include "zx81config.h"
+#include "z80.h"
+#include "xz80.h"
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+#define CORE_XZ80 0
+#define CORE_FUSE 1
+
+#define MODEL_NONE -1	/* Fuzzing: all RAM and no machine */
+#define MODEL_ZX81 0
+#define MODEL_ZX80 1
+
+#define NMI_PERIOD 207
+#define FRAME_TSTATES 65000
+#define KEY_FRAMES 25	/* How long keys are held and then released */
+
+/* Variables */
+struct core {
+	char *name;
+	int (*step)(void);
+	void (*get)(struct z80_state *state);
+	void (*set)(struct z80_state *state);
+	unsigned long long *written;
+	unsigned char mem[64 * 1024];
+	unsigned char *ptr[64];		/* The memory map */
+	int writable[64];
+	int physical[64];
+};
+
+static unsigned long long fuse_written;
+static void fuse_init(void);
+static int fuse_step(void);
+static void fuse_get(struct z80_state *state);
+static void fuse_set(struct z80_state *state);
+
+static struct core cores[2] = {
+	{"xz80", xz80_step, xz80_get, xz80_set, &xz80_written},
+	{"fuse", fuse_step, fuse_get, fuse_set, &fuse_written}};
+
+static unsigned char zx80rom[4 * 1024], zx81rom[8 * 1024];
+static unsigned char program[16 * 1024];
+static int model = MODEL_NONE;
+static unsigned long long clock_tstates;	/* The machine around the cores */
+static unsigned long long nmi_next;
+static int nmigen;
+static int flagmask = 0xff;
+static int notstates = FALSE;
+static int all = FALSE;
+static int divergences = 0;
+static unsigned long long rng = 1;
+static unsigned char seen[0x500];		/* Instructions reported by -a */
+static unsigned char visited[64 * 1024 / 8];	/* Addresses executed */
+
+static char *families[] = {"main", "CB", "ED", "DD/FD", "DDCB/FDCB"};
+
+/* Function prototypes */
+static int fuzz_run(long count);
+static int stream_run(char *name, int streammodel, unsigned char *prog, int len,
+	long count);
+static double stream_time(struct core *core, int streammodel,
+	unsigned char *prog, int len, long count);
+static void machine_setup(int streammodel, unsigned char *prog, int len);
+static void core_map(struct core *core, int page, int phys, int writable);
+static void machine_step(struct core **list, int count, int *ts);
+static void core_interrupt(struct core *core, int vector, int nmi);
+static int compare(char *stream, long count, struct z80_state *before,
+	unsigned char *bytes, int ts0, int ts1);
+static int family(unsigned char *bytes);
+static unsigned char port_in(int port);
+static unsigned char xz80_port_in(int port);
+static void xz80_port_out(int port, int data);
+static void port_out(int port, int data);
+static unsigned char fetch_opcode(struct core *core, int addr);
+static unsigned long long random64(void);
+static int read_file(char *filename, unsigned char *buf, int size);
+static double seconds_now(void);
+
+
+/***************************************************************************
+ * Main                                                                    *
+ ***************************************************************************/
+
+int main(int argc, char *argv[]) {
+	char *romdir = "../data";
+	char filename[256];
+	long fuzzcount = 1000000, count = 2000000;
+	double elapsed[2] = {0, 0};
+	long long instructions = 0;
+	int opt, index, len, zx80ok, zx81ok, core;
+
+	while ((opt = getopt(argc, argv, "n:i:s:d:f:ta")) != -1) {
+		switch (opt) {
+			case 'n': fuzzcount = atol(optarg); break;
+			case 'i': count = atol(optarg); break;
+			case 's': rng = strtoull(optarg, NULL, 0) | 1; break;
+			case 'd': romdir = optarg; break;
+			case 'f': flagmask = strtol(optarg, NULL, 16); break;
+			case 't': notstates = TRUE; break;
+			case 'a': all = TRUE; break;
+			default: optind = argc + 1; break;
+		}
+	}
+	if (optind > argc) {
+		fprintf(stderr, "Usage: %s [-n fuzz count] [-i count] [-s seed] "
+			"[-d romdir] [-f flag mask] [-t] [-a] [program.p...]\n", argv[0]);
+		return 1;
+	}
+
+	z80_init();
+	fuse_init();
+	xz80_init();
+	xz80_readport = xz80_port_in;
+	xz80_writeport = xz80_port_out;
+
+	snprintf(filename, sizeof(filename), "%s/zx81.rom", romdir);
+	zx81ok = read_file(filename, zx81rom, sizeof(zx81rom)) == sizeof(zx81rom);
+	snprintf(filename, sizeof(filename), "%s/zx80.rom", romdir);
+	zx80ok = read_file(filename, zx80rom, sizeof(zx80rom)) == sizeof(zx80rom);
+
+	/* Lockstep */
+	if (fuzz_run(fuzzcount) && !all) return 1;
+	if (zx81ok && stream_run("rom zx81", MODEL_ZX81, NULL, 0, count) && !all)
+		return 1;
+	if (zx80ok && stream_run("rom zx80", MODEL_ZX80, NULL, 0, count) && !all)
+		return 1;
+	for (index = optind; index < argc && zx81ok; index++) {
+		if ((len = read_file(argv[index], program, sizeof(program))) <= 0) return 1;
+		if (stream_run(argv[index], MODEL_ZX81, program, len, count) && !all)
+			return 1;
+	}
+
+	/* Throughput */
+	for (core = 0; core < 2; core++) {
+		if (zx81ok) {
+			elapsed[core] += stream_time(&cores[core], MODEL_ZX81, NULL, 0, count);
+			instructions += core == 0 ? count : 0;
+		}
+		if (zx80ok) {
+			elapsed[core] += stream_time(&cores[core], MODEL_ZX80, NULL, 0, count);
+			instructions += core == 0 ? count : 0;
+		}
+		for (index = optind; index < argc && zx81ok; index++) {
+			len = read_file(argv[index], program, sizeof(program));
+			elapsed[core] += stream_time(&cores[core], MODEL_ZX81, program, len,
+				count);
+			instructions += core == 0 ? count : 0;
+		}
+	}
+	for (core = 0; core < 2 && instructions; core++) {
+		printf("%s: %lld instructions in %.2fs, %.1f million/s\n",
+			cores[core].name, instructions, elapsed[core],
+			instructions / elapsed[core] / 1e6);
+	}
+
+	if (divergences) printf("%i instructions differ\n", divergences);
+
+	return divergences != 0;
+}
+
+/***************************************************************************
+ * Fuzz Run                                                                *
+ ***************************************************************************/
+/* Each instruction is a random one of a random family written at a
+ * random address in memory that's random too, and it's run from random
+ * registers.
+ *
+ * On exit: returns TRUE if the cores differ
+ *          else FALSE */
+
+static int fuzz_run(long count) {
+	struct z80_state state;
+	unsigned char bytes[4];
+	long instruction;
+	int page, index, addr, ts0, ts1, differ = FALSE;
+
+	/* xz80 fetches opcodes above 48K from 32K below as the ZX81 mirrors
+	 * its RAM there, and so it's mirrored here too */
+	model = MODEL_NONE;
+	xz80_set_ula(FALSE);
+	for (page = 0; page < 64; page++) {
+		core_map(&cores[CORE_XZ80], page, page < 48 ? page : page - 32, TRUE);
+		core_map(&cores[CORE_FUSE], page, page < 48 ? page : page - 32, TRUE);
+	}
+	for (index = 0; index < 64 * 1024; index += 8)
+		*(unsigned long long *)(cores[CORE_XZ80].mem + index) = random64();
+	memcpy(cores[CORE_FUSE].mem, cores[CORE_XZ80].mem, 64 * 1024);
+
+	for (instruction = 0; instruction < count; instruction++) {
+		for (index = 0; index < 4; index++) bytes[index] = random64();
+		switch (random64() % 5) {
+			case 0:		/* main */
+				while (bytes[0] == 0xcb || bytes[0] == 0xdd || bytes[0] == 0xed ||
+					bytes[0] == 0xfd) bytes[0] = random64();
+				break;
+			case 1:		/* CB */
+				bytes[0] = 0xcb;
+				break;
+			case 2:		/* ED */
+				bytes[0] = 0xed;
+				while (bytes[1] >= 0xfb && bytes[1] <= 0xfd) bytes[1] = random64();
+				break;
+			case 3:		/* DD/FD */
+				bytes[0] = bytes[0] & 0x20 ? 0xfd : 0xdd;
+				while (bytes[1] == 0xcb || bytes[1] == 0xed) bytes[1] = random64();
+				break;
+			case 4:		/* DDCB/FDCB */
+				bytes[0] = bytes[0] & 0x20 ? 0xfd : 0xdd;
+				bytes[1] = 0xcb;
+				break;
+		}
+
+		state.a = random64(); state.f = random64(); state.b = random64();
+		state.c = random64(); state.d = random64(); state.e = random64();
+		state.h = random64(); state.l = random64();
+		state.a_ = random64(); state.f_ = random64(); state.b_ = random64();
+		state.c_ = random64(); state.d_ = random64(); state.e_ = random64();
+		state.h_ = random64(); state.l_ = random64();
+		state.ix = random64(); state.iy = random64(); state.sp = random64();
+		state.pc = random64();
+		state.i = random64(); state.r = random64();
+		state.iff1 = random64() & 1; state.iff2 = random64() & 1;
+		state.im = random64() % 3;
+		state.halted = FALSE;
+		for (index = 0; index < 4; index++) {
+			addr = (state.pc + index) & 0xffff;
+			cores[CORE_XZ80].ptr[addr >> 10][addr & 1023] = bytes[index];
+			cores[CORE_FUSE].ptr[addr >> 10][addr & 1023] = bytes[index];
+		}
+
+		cores[CORE_XZ80].set(&state);
+		cores[CORE_FUSE].set(&state);
+		ts0 = cores[CORE_XZ80].step();
+		ts1 = cores[CORE_FUSE].step();
+		if (compare("fuzz", instruction, &state, bytes, ts0, ts1)) {
+			differ = TRUE;
+			if (!all) return TRUE;
+			memcpy(cores[CORE_XZ80].mem, cores[CORE_FUSE].mem, 64 * 1024);
+		}
+	}
+	printf("fuzz: %li instructions %s\n", count, differ ? "differ" : "ok");
+
+	return differ;
+}
+
+/***************************************************************************
+ * Stream Run                                                              *
+ ***************************************************************************/
+/* On entry: unsigned char *prog is a .p program or NULL to boot the ROM
+ *  On exit: returns TRUE if the cores differ
+ *           else FALSE */
+
+static int stream_run(char *name, int streammodel, unsigned char *prog, int len,
+	long count) {
+	struct core *both[2] = {&cores[CORE_XZ80], &cores[CORE_FUSE]};
+	struct z80_state state;
+	unsigned char bytes[4];
+	long instruction;
+	int index, ts[2], addresses = 0, differ = FALSE;
+
+	machine_setup(streammodel, prog, len);
+	memset(visited, 0, sizeof(visited));
+
+	for (instruction = 0; instruction < count; instruction++) {
+		cores[CORE_FUSE].get(&state);
+		for (index = 0; index < 4; index++)
+			bytes[index] = fetch_opcode(&cores[CORE_FUSE], state.pc + index);
+		visited[state.pc >> 3] |= 1 << (state.pc & 7);
+
+		machine_step(both, 2, ts);
+		if (compare(name, instruction, &state, bytes, ts[0], ts[1])) {
+			differ = TRUE;
+			if (!all) return TRUE;
+			/* Carry on from where the EightyOne/FUSE core is */
+			cores[CORE_FUSE].get(&state);
+			cores[CORE_XZ80].set(&state);
+			memcpy(cores[CORE_XZ80].mem, cores[CORE_FUSE].mem, 64 * 1024);
+		}
+	}
+
+	for (index = 0; index < sizeof(visited); index++)
+		addresses += __builtin_popcount(visited[index]);
+	printf("%s: %li instructions at %i addresses %s\n", name, count, addresses,
+		differ ? "differ" : "ok");
+
+	return differ;
+}
+
+/***************************************************************************
+ * Stream Time                                                             *
+ ***************************************************************************/
+/* On exit: returns the seconds that one core took to run a stream */
+
+static double stream_time(struct core *core, int streammodel,
+	unsigned char *prog, int len, long count) {
+	double start;
+	long instruction;
+	int ts;
+
+	machine_setup(streammodel, prog, len);
+	start = seconds_now();
+	for (instruction = 0; instruction < count; instruction++)
+		machine_step(&core, 1, &ts);
+
+	return seconds_now() - start;
+}
+
+/***************************************************************************
+ * Machine Setup                                                           *
+ ***************************************************************************/
+/* This maps both cores' memory as sz81's initmem does for 16K and resets
+ * them, or loads a program as z81 did: the registers and the system
+ * variables are as the ROM has them just after a LOAD and the program
+ * follows at 0x4009 */
+
+static void machine_setup(int streammodel, unsigned char *prog, int len) {
+	static unsigned char bit1[9] = {0xff, 0x80, 0xfc, 0x7f, 0x00, 0x80, 0x00,
+		0xfe, 0xff};
+	static unsigned char bit2[4] = {0x76, 0x06, 0x00, 0x3e};
+	struct z80_state state;
+	int core, page;
+
+	model = streammodel;
+	memset(&state, 0, sizeof(state));
+	if (prog) {
+		state.a = 0x0b; state.f = 0x85; state.b = 0x00; state.c = 0xff;
+		state.d = 0x43; state.e = 0x99; state.h = 0xc3; state.l = 0x99;
+		state.a_ = 0xe2; state.f_ = 0xa1; state.b_ = 0x81; state.c_ = 0x02;
+		state.d_ = 0x00; state.e_ = 0x2b; state.h_ = 0x00; state.l_ = 0x00;
+		state.i = 0x1e; state.im = 1;
+		state.r = 0xca;
+		state.ix = 0x281; state.iy = 0x4000;
+		state.sp = 0x7ffc;
+		state.pc = 0x207;
+	}
+
+	for (core = 0; core < 2; core++) {
+		memset(cores[core].mem, 0, 64 * 1024);
+		if (model == MODEL_ZX80) {
+			memcpy(cores[core].mem, zx80rom, sizeof(zx80rom));
+		} else {
+			memcpy(cores[core].mem, zx81rom, sizeof(zx81rom));
+		}
+		for (page = 0; page < 16; page++) {
+			core_map(&cores[core], page, page % (model == MODEL_ZX80 ? 4 : 8),
+				FALSE);
+			core_map(&cores[core], page + 32, page % (model == MODEL_ZX80 ? 4 : 8),
+				FALSE);
+			core_map(&cores[core], page + 16, page + 16, TRUE);
+			core_map(&cores[core], page + 48, page + 16, TRUE);
+		}
+		if (prog) {
+			memcpy(cores[core].mem + 0x4000, bit1, sizeof(bit1));
+			memcpy(cores[core].mem + 0x7ffc, bit2, sizeof(bit2));
+			memcpy(cores[core].mem + 0x4009, prog, len > 0x3ff7 - 0x4 ?
+				0x3ff7 - 0x4 : len);
+		}
+		cores[core].set(&state);
+	}
+	clock_tstates = 0;
+	nmi_next = NMI_PERIOD;
+	nmigen = FALSE;
+	xz80_set_ula(TRUE);
+}
+
+/***************************************************************************
+ * Core Map                                                                *
+ ***************************************************************************/
+
+static void core_map(struct core *core, int page, int phys, int writable) {
+	core->ptr[page] = core->mem + phys * 1024;
+	core->writable[page] = writable;
+	core->physical[page] = phys;
+	if (core == &cores[CORE_XZ80])
+		xz80_map(page, core->ptr[page], writable, phys);
+}
+
+/***************************************************************************
+ * Machine Step                                                            *
+ ***************************************************************************/
+/* This runs an instruction on one core or on both in lockstep and then
+ * has them take any interrupt that's due. The machine's clock is kept by
+ * the last core of the list, which is the EightyOne/FUSE core when they
+ * run in lockstep, so that both are interrupted at the same instruction
+ * even if their T-states differ.
+ *
+ * On exit: ts has the T-states of each core's instruction alone */
+
+static void machine_step(struct core **list, int count, int *ts) {
+	struct z80_state state;
+	int index, intpend, opcode;
+
+	/* INT is sampled before R is incremented */
+	list[count - 1]->get(&state);
+	intpend = !(state.r & 0x40);
+	opcode = fetch_opcode(list[count - 1], state.pc);
+
+	for (index = 0; index < count; index++) ts[index] = list[index]->step();
+	clock_tstates += ts[count - 1];
+
+	if (nmigen && clock_tstates >= nmi_next) {
+		while (nmi_next <= clock_tstates) nmi_next += NMI_PERIOD;
+		for (index = 0; index < count; index++)
+			core_interrupt(list[index], 0x66, TRUE);
+		clock_tstates += 11;
+	} else if (intpend && opcode != 0xfb && opcode != 0xdd && opcode != 0xfd &&
+		state.iff1) {
+		for (index = 0; index < count; index++)
+			core_interrupt(list[index], 0x38, FALSE);
+		clock_tstates += 13;
+	}
+}
+
+/***************************************************************************
+ * Core Interrupt                                                          *
+ ***************************************************************************/
+/* The return address is pushed through the memory map as the core would.
+ * An INT is only taken if it's enabled, which state.iff1 above was from
+ * before the instruction, and so it's checked again here */
+
+static void core_interrupt(struct core *core, int vector, int nmi) {
+	struct z80_state state;
+	int count, addr;
+
+	core->get(&state);
+	if (!nmi && !state.iff1) return;
+	if (state.halted) {
+		state.pc++;
+		state.halted = FALSE;
+	}
+	for (count = 0; count < 2; count++) {
+		addr = --state.sp;
+		if (core->writable[addr >> 10]) {
+			core->ptr[addr >> 10][addr & 1023] = count ? state.pc : state.pc >> 8;
+			*core->written |= 1ULL << core->physical[addr >> 10];
+		}
+	}
+	state.iff1 = 0;
+	if (!nmi) state.iff2 = 0;
+	state.pc = vector;
+	state.r = (state.r & 0x80) | ((state.r + 1) & 0x7f);
+	core->set(&state);
+}
+
+/***************************************************************************
+ * Compare                                                                 *
+ ***************************************************************************/
+/* On entry: struct z80_state *before is what both began the instruction
+ *           with and bytes are the instruction's first 4
+ *  On exit: returns TRUE if the cores differ
+ *           else FALSE */
+
+static int compare(char *stream, long count, struct z80_state *before,
+	unsigned char *bytes, int ts0, int ts1) {
+	struct z80_state state[2];
+	unsigned long long written;
+	int page, addr = -1, key, index;
+	static struct {
+		char *name;
+		int offset;
+		int size;
+	} fields[] = {
+		{"A", offsetof(struct z80_state, a), 1},
+		{"F", offsetof(struct z80_state, f), 1},
+		{"B", offsetof(struct z80_state, b), 1},
+		{"C", offsetof(struct z80_state, c), 1},
+		{"D", offsetof(struct z80_state, d), 1},
+		{"E", offsetof(struct z80_state, e), 1},
+		{"H", offsetof(struct z80_state, h), 1},
+		{"L", offsetof(struct z80_state, l), 1},
+		{"A'", offsetof(struct z80_state, a_), 1},
+		{"F'", offsetof(struct z80_state, f_), 1},
+		{"B'", offsetof(struct z80_state, b_), 1},
+		{"C'", offsetof(struct z80_state, c_), 1},
+		{"D'", offsetof(struct z80_state, d_), 1},
+		{"E'", offsetof(struct z80_state, e_), 1},
+		{"H'", offsetof(struct z80_state, h_), 1},
+		{"L'", offsetof(struct z80_state, l_), 1},
+		{"IX", offsetof(struct z80_state, ix), 2},
+		{"IY", offsetof(struct z80_state, iy), 2},
+		{"SP", offsetof(struct z80_state, sp), 2},
+		{"PC", offsetof(struct z80_state, pc), 2},
+		{"I", offsetof(struct z80_state, i), 1},
+		{"R", offsetof(struct z80_state, r), 1},
+		{"IFF1", offsetof(struct z80_state, iff1), 1},
+		{"IFF2", offsetof(struct z80_state, iff2), 1},
+		{"IM", offsetof(struct z80_state, im), 1},
+		{"HALT", offsetof(struct z80_state, halted), 4}};
+	int differ[sizeof(fields) / sizeof(fields[0])], any = FALSE;
+	int value[2];
+
+	cores[CORE_XZ80].get(&state[0]);
+	cores[CORE_FUSE].get(&state[1]);
+	state[0].f &= flagmask;
+	state[1].f &= flagmask;
+	state[0].f_ &= flagmask;
+	state[1].f_ &= flagmask;
+
+	for (index = 0; index < sizeof(fields) / sizeof(fields[0]); index++) {
+		differ[index] = memcmp((char *)&state[0] + fields[index].offset,
+			(char *)&state[1] + fields[index].offset, fields[index].size) != 0;
+		any |= differ[index];
+	}
+
+	written = *cores[CORE_XZ80].written | *cores[CORE_FUSE].written;
+	for (page = 0; page < 64 && addr < 0; page++) {
+		if (!(written & (1ULL << page)) ||
+			!memcmp(cores[CORE_XZ80].mem + page * 1024,
+			cores[CORE_FUSE].mem + page * 1024, 1024)) continue;
+		for (addr = page * 1024; cores[CORE_XZ80].mem[addr] ==
+			cores[CORE_FUSE].mem[addr]; addr++);
+	}
+
+	if (notstates) ts0 = ts1;
+	if (!any && addr < 0 && ts0 == ts1) return FALSE;
+
+	/* -a reports an instruction once, for the first way that it differs */
+	if (all) {
+		if (bytes[0] == 0xcb) {
+			key = 0x100 | bytes[1];
+		} else if (bytes[0] == 0xed) {
+			key = 0x200 | bytes[1];
+		} else if ((bytes[0] == 0xdd || bytes[0] == 0xfd) && bytes[1] == 0xcb) {
+			key = 0x400 | bytes[3];
+		} else if (bytes[0] == 0xdd || bytes[0] == 0xfd) {
+			key = 0x300 | bytes[1];
+		} else {
+			key = bytes[0];
+		}
+		if (seen[key]) return TRUE;
+		seen[key] = TRUE;
+	}
+	divergences++;
+
+	printf("%s: instruction %li differs: %02x %02x %02x %02x (%s) at %04x\n",
+		stream, count, bytes[0], bytes[1], bytes[2], bytes[3],
+		families[family(bytes)], before->pc);
+	printf("  %-6s %8s %8s %8s\n", "", "before", cores[0].name, cores[1].name);
+	for (index = 0; index < sizeof(fields) / sizeof(fields[0]); index++) {
+		if (all && !differ[index]) continue;
+		value[0] = value[1] = 0;
+		memcpy(&value[0], (char *)&state[0] + fields[index].offset,
+			fields[index].size);
+		memcpy(&value[1], (char *)&state[1] + fields[index].offset,
+			fields[index].size);
+		key = 0;
+		memcpy(&key, (char *)before + fields[index].offset, fields[index].size);
+		printf("%c %-6s %8x %8x %8x\n", differ[index] ? '*' : ' ',
+			fields[index].name, key, value[0], value[1]);
+	}
+	if (ts0 != ts1 || !all)
+		printf("%c %-6s %8s %8i %8i\n", ts0 != ts1 ? '*' : ' ', "T", "", ts0, ts1);
+	for (page = 0; page < 64; page++) {
+		if (!(written & (1ULL << page))) continue;
+		for (addr = page * 1024; addr < page * 1024 + 1024; addr++) {
+			if (cores[CORE_XZ80].mem[addr] != cores[CORE_FUSE].mem[addr])
+				printf("* (%04x) %8s %8x %8x\n", addr, "",
+					cores[CORE_XZ80].mem[addr], cores[CORE_FUSE].mem[addr]);
+		}
+	}
+
+	return TRUE;
+}
+
+/***************************************************************************
+ * Family                                                                  *
+ ***************************************************************************/
+/* On exit: returns the index of the instruction's family within families */
+
+static int family(unsigned char *bytes) {
+	if (bytes[0] == 0xcb) return 1;
+	if (bytes[0] == 0xed) return 2;
+	if (bytes[0] == 0xdd || bytes[0] == 0xfd) return bytes[1] == 0xcb ? 4 : 3;
+
+	return 0;
+}
+
+/***************************************************************************
+ * Port In                                                                 *
+ ***************************************************************************/
+/* Fuzzing a port reads as a hash of its address. Otherwise the ZX80 and
+ * ZX81 read the keyboard from any even port, the half-rows selected by
+ * clearing bits of the top byte, and a key is held down for KEY_FRAMES
+ * out of every other KEY_FRAMES */
+
+static unsigned char port_in(int port) {
+	unsigned long long held;
+	int row, key, data = 0xff;
+
+	if (model == MODEL_NONE) return (port * 2654435761U) >> 24;
+
+	if (!(port & 1)) {
+		held = clock_tstates / FRAME_TSTATES / KEY_FRAMES;
+		if (held & 1) {
+			key = (held * 2654435761U >> 16) % 40;
+			row = key / 5;
+			if (!(port & (0x100 << row))) data &= ~(1 << (key % 5));
+		}
+	}
+
+	return data;
+}
+
+/***************************************************************************
+ * Port Out                                                                *
+ ***************************************************************************/
+/* The ZX81's NMI generator is turned on by port fe and off by port fd */
+
+static void port_out(int port, int data) {
+	if (model != MODEL_ZX81) return;
+
+	if ((port & 0xff) == 0xfe) {
+		if (!nmigen) nmi_next = clock_tstates + NMI_PERIOD;
+		nmigen = TRUE;
+	} else if ((port & 0xff) == 0xfd) {
+		nmigen = FALSE;
+	}
+}
+
+/***************************************************************************
+ * Fetch Opcode                                                            *
+ ***************************************************************************/
+/* An M1 cycle above 32K fetches from below 48K, as sz81's fetchm does,
+ * and the ULA takes it as display and has the CPU see a NOP if bit 6 is
+ * clear */
+
+static unsigned char fetch_opcode(struct core *core, int addr) {
+	unsigned char data;
+
+	addr &= 0xffff;
+	if (model == MODEL_NONE) return core->ptr[addr >> 10][addr & 1023];
+	data = core->ptr[(addr >= 0xc000 ? addr & 0x7fff : addr) >> 10][addr & 1023];
+
+	return (addr & 0x8000) && !(data & 64) ? 0 : data;
+}
+
+/***************************************************************************
+ * The EightyOne/FUSE Core                                                 *
+ ***************************************************************************/
+/* The machine's callbacks (see zx81config.h) */
+
+static BYTE fuse_readbyte(int addr) {
+	addr &= 0xffff;
+
+	return cores[CORE_FUSE].ptr[addr >> 10][addr & 1023];
+}
+
+static void fuse_writebyte(int addr, int data) {
+	addr &= 0xffff;
+	if (!cores[CORE_FUSE].writable[addr >> 10]) return;
+	cores[CORE_FUSE].ptr[addr >> 10][addr & 1023] = data;
+	fuse_written |= 1ULL << cores[CORE_FUSE].physical[addr >> 10];
+}
+
+static BYTE fuse_opcode_fetch(int addr) {
+	return fetch_opcode(&cores[CORE_FUSE], addr);
+}
+
+static BYTE fuse_readport(int port, int *tstates) {
+	return port_in(port & 0xffff);
+}
+
+static void fuse_writeport(int port, int data, int *tstates) {
+	port_out(port & 0xffff, data);
+}
+
+static int fuse_contend(int addr, int states, int time) {
+	return time;
+}
+
+static void fuse_init(void) {
+	machine.readbyte = fuse_readbyte;
+	machine.writebyte = fuse_writebyte;
+	machine.opcode_fetch = fuse_opcode_fetch;
+	machine.readport = fuse_readport;
+	machine.writeport = fuse_writeport;
+	machine.contendmem = fuse_contend;
+	machine.contendio = fuse_contend;
+}
+
+/* EightyOne backs out of a DD or FD prefix that isn't followed by an
+ * instruction using HL and then runs what follows separately, which is
+ * carried on with here as xz80_step does. The instruction's fetch is
+ * counted twice when it does (see the FIXME within z80_ddfd.c) */
+
+static int fuse_step(void) {
+	unsigned short pc;
+	unsigned char opcode;
+	int ts = 0, backtracked = FALSE;
+
+	fuse_written = 0;
+	do {
+		if (backtracked) ts -= 4;
+		pc = z80.pc.w;
+		opcode = fuse_opcode_fetch(pc);
+		ts += z80_do_opcode();
+	} while ((backtracked = (opcode == 0xdd || opcode == 0xfd) &&
+		z80.pc.w == (WORD)(pc + 1)));
+
+	return ts;
+}
+
+static void fuse_get(struct z80_state *state) {
+	state->a = z80.af.b.h; state->f = z80.af.b.l;
+	state->b = z80.bc.b.h; state->c = z80.bc.b.l;
+	state->d = z80.de.b.h; state->e = z80.de.b.l;
+	state->h = z80.hl.b.h; state->l = z80.hl.b.l;
+	state->a_ = z80.af_.b.h; state->f_ = z80.af_.b.l;
+	state->b_ = z80.bc_.b.h; state->c_ = z80.bc_.b.l;
+	state->d_ = z80.de_.b.h; state->e_ = z80.de_.b.l;
+	state->h_ = z80.hl_.b.h; state->l_ = z80.hl_.b.l;
+	state->ix = z80.ix.w; state->iy = z80.iy.w;
+	state->sp = z80.sp.w; state->pc = z80.pc.w;
+	state->i = z80.i;
+	state->r = (z80.r7 & 0x80) | (z80.r & 0x7f);
+	state->iff1 = z80.iff1; state->iff2 = z80.iff2;
+	state->im = z80.im;
+	state->halted = z80.halted;
+}
+
+static void fuse_set(struct z80_state *state) {
+	z80.af.b.h = state->a; z80.af.b.l = state->f;
+	z80.bc.b.h = state->b; z80.bc.b.l = state->c;
+	z80.de.b.h = state->d; z80.de.b.l = state->e;
+	z80.hl.b.h = state->h; z80.hl.b.l = state->l;
+	z80.af_.b.h = state->a_; z80.af_.b.l = state->f_;
+	z80.bc_.b.h = state->b_; z80.bc_.b.l = state->c_;
+	z80.de_.b.h = state->d_; z80.de_.b.l = state->e_;
+	z80.hl_.b.h = state->h_; z80.hl_.b.l = state->l_;
+	z80.ix.w = state->ix; z80.iy.w = state->iy;
+	z80.sp.w = state->sp; z80.pc.w = state->pc;
+	z80.i = state->i;
+	z80.r = state->r; z80.r7 = state->r;
+	z80.iff1 = state->iff1; z80.iff2 = state->iff2;
+	z80.im = state->im;
+	z80.halted = state->halted;
+}
+
+/* And xz80's */
+
+static unsigned char xz80_port_in(int port) {
+	return port_in(port & 0xffff);
+}
+
+static void xz80_port_out(int port, int data) {
+	port_out(port & 0xffff, data);
+}
+
+
+/***************************************************************************
+ * Random64                                                                *
+ ***************************************************************************/
+/* xorshift64* */
+
+static unsigned long long random64(void) {
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+
+	return rng * 2685821657736338717ULL;
+}
+
+/***************************************************************************
+ * Read File                                                               *
+ ***************************************************************************/
+/* On exit: returns the number of bytes read or -1 on error */
+
+static int read_file(char *filename, unsigned char *buf, int size) {
+	FILE *fp;
+	int len;
+
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		fprintf(stderr, "%s: Cannot read from %s\n", __func__, filename);
+		return -1;
+	}
+	len = fread(buf, 1, size, fp);
+	fclose(fp);
+
+	return len;
+}
+
+/***************************************************************************
+ * Seconds Now                                                             *
+ ***************************************************************************/
+
+static double seconds_now(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
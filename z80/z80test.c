@@ -1,68 +1,1295 @@
-#include <stdio.h>
+/* sz81 Copyright (C) 2007-2011 Thunor <thunorsif@hotmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
 
-#include "z80.h"
-#include "z80_macros.h"
+/* z80test: an instruction exerciser and benchmark of a Z80 core.
+ *
+ * It's built for either core: make z80test for the EightyOne/FUSE core
+ * here and make z80test-xz80 for the xz80 core that sz81 runs (see
+ * xz80.h). Both run the same tests so that a change to either core's
+ * dispatch or flags can be measured a family of instructions at a time.
+ *
+ * The checks run instructions one at a time from known registers and
+ * compare what they did with what the Z80 does, as worked out here from
+ * first principles. The flags are checked in full, the undocumented
+ * bits 3 and 5 too, wherever they're known (they're only left out for
+ * BIT n,(HL) which takes them from the internal MEMPTR register). The
+ * ALU, INC/DEC, the rotates and shifts and the CB instructions are
+ * checked for every operand, and the rest for a sample of them. The
+ * T-states of every instruction are checked against Zilog's, taking the
+ * shortest path of the conditional and repeating instructions.
+ *
+ * ED FB to ED FD are left out as sz81 uses them to trap LOAD and SAVE.
+ *
+ * The benchmarks time a tight loop of each kind of instruction and give
+ * the nanoseconds that the core takes over each one.
+ *
+ * Usage: z80test [options]
+ * -c        only run the checks
+ * -b        only run the benchmarks
+ * -n count  instructions to run for each benchmark (default 20000000)
+ * -v        print every failure rather than the first few of each family
+ *
+ * Exits with 1 if any check failed */
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include "xz80.h"
+#ifndef XZ80
+#include "config.h"
 #include "zx81config.h"
+#include "z80.h"
+#endif
+
+/* Defines */
+#define TRUE 1
+#define FALSE 0
+
+#define FLAG_C 0x01
+#define FLAG_N 0x02
+#define FLAG_P 0x04
+#define FLAG_V FLAG_P
+#define FLAG_X 0x08
+#define FLAG_H 0x10
+#define FLAG_Y 0x20
+#define FLAG_Z 0x40
+#define FLAG_S 0x80
+#define FLAG_XY (FLAG_X | FLAG_Y)
+
+#define FAMILY_MAIN 0
+#define FAMILY_CB 1
+#define FAMILY_ED 2
+#define FAMILY_DDFD 3
+#define FAMILY_DDCB 4
+#define FAMILY_COUNT 5
+
+#define CODE 0x1000		/* Where the instructions are run from */
+#define DATA 0x6000		/* What (HL) and (IX+d) point around */
+#define STACK 0xa000
+
+#define FAILURES_SHOWN 10
+
+/* Variables */
+struct family {
+	char *name;
+	long checks;
+	long failures;
+};
+
+static struct family families[FAMILY_COUNT] = {
+	{"main"}, {"CB"}, {"ED"}, {"DD/FD"}, {"DDCB/FDCB"}};
+
+struct bench {
+	char *name;
+	unsigned char code[64];
+	int len;
+};
+
+/* Each is repeated to fill a block ending with a JP back to its start.
+ * The registers are set up by bench_run so that what's addressed is
+ * well away from the code */
+static struct bench benches[] = {
+	{"main: 8-bit ALU", {0x80, 0x89, 0x92, 0x9b, 0xa4, 0xad, 0xb7, 0xb8,
+		0x3c, 0x15, 0xc6, 0x11, 0xee, 0x5a}, 14},
+	{"main: 16-bit arithmetic", {0x09, 0x13, 0x0b, 0x19, 0x23, 0x2b, 0x39,
+		0x03}, 8},
+	{"main: loads and (HL)", {0x78, 0x41, 0x7e, 0x77, 0x86, 0x3e, 0x55,
+		0x34, 0x35}, 9},
+	{"CB: rotates and bits", {0xcb, 0x00, 0xcb, 0x39, 0xcb, 0x5a, 0xcb, 0xcb,
+		0xcb, 0xbc, 0xcb, 0x16, 0xcb, 0x46}, 14},
+	{"ED: 16-bit arithmetic", {0xed, 0x5a, 0xed, 0x42, 0xed, 0x44, 0xed, 0x6f},
+		8},
+	{"ED: block copy and search", {0x21, 0x00, 0x60, 0x11, 0x00, 0x70, 0x01,
+		0x00, 0x01, 0xed, 0xb0, 0x21, 0x00, 0x60, 0x01, 0x00, 0x01, 0xed, 0xb1},
+		19},
+	{"DD/FD: indexed", {0xdd, 0x7e, 0x01, 0xfd, 0x86, 0x02, 0xdd, 0x34, 0x03,
+		0xfd, 0x77, 0x04, 0xdd, 0x84, 0xfd, 0x2c}, 16},
+	{"DDCB/FDCB: indexed bits", {0xdd, 0xcb, 0x05, 0x5e, 0xfd, 0xcb, 0xfe,
+		0xce, 0xdd, 0xcb, 0x00, 0xb6, 0xdd, 0xcb, 0x01, 0x06}, 16}};
+
+/* The T-states of the main instructions, with conditions not met */
+static unsigned char main_tstates[256] = {
+	 4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4,
+	 8, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,
+	 7, 10, 16,  6,  4,  4,  7,  4,  7, 11, 16,  6,  4,  4,  7,  4,
+	 7, 10, 13,  6, 11, 11, 10,  4,  7, 11, 13,  6,  4,  4,  7,  4,
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+	 7,  7,  7,  7,  7,  7,  4,  7,  4,  4,  4,  4,  4,  4,  7,  4,
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+	 4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+	 5, 10, 10, 10, 10, 11,  7, 11,  5, 10, 10,  0, 10, 17,  7, 11,
+	 5, 10, 10, 11, 10, 11,  7, 11,  5,  4, 10, 11, 10,  0,  7, 11,
+	 5, 10, 10, 19, 10, 11,  7, 11,  5,  4, 10,  4, 10,  0,  7, 11,
+	 5, 10, 10,  4, 10, 11,  7, 11,  5,  6, 10,  4, 10,  0,  7, 11};
+
+/* And ED's from 40 to bf, the rest being NOPs of 8 */
+static unsigned char ed_tstates[128] = {
+	12, 12, 15, 20,  8, 14,  8,  9, 12, 12, 15, 20,  8, 14,  8,  9,
+	12, 12, 15, 20,  8, 14,  8,  9, 12, 12, 15, 20,  8, 14,  8,  9,
+	12, 12, 15, 20,  8, 14,  8, 18, 12, 12, 15, 20,  8, 14,  8, 18,
+	12, 12, 15, 20,  8, 14,  8,  8, 12, 12, 15, 20,  8, 14,  8,  8,
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,
+	 8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,  8,
+	16, 16, 16, 16,  8,  8,  8,  8, 16, 16, 16, 16,  8,  8,  8,  8,
+	16, 16, 16, 16,  8,  8,  8,  8, 16, 16, 16, 16,  8,  8,  8,  8};
+
+static unsigned char mem[64 * 1024];
+static int port_data = 0xff;	/* What IN reads */
+static int verbose = FALSE;
+static unsigned long long rng = 1;
+
+/* Function prototypes */
+static void check_main(void);
+static void check_cb(void);
+static void check_ed(void);
+static void check_ddfd(void);
+static void check_ddcb(void);
+static void check_tstates(int family, unsigned char *code, int len,
+	struct z80_state *state, int expected);
+static void check(int family, int ok, unsigned char *code, int len,
+	char *fmt, ...);
+static int run(struct z80_state *state, unsigned char *code, int len);
+static void random_state(struct z80_state *state);
+static unsigned char *reg(struct z80_state *state, int index);
+static int alu(int op, int a, int v, int f, int *flags);
+static int shift(int op, int v, int f, int *flags);
+static int bit(int n, int v, int f, int xy);
+static int szxy(int v);
+static int parity(int v);
+static int taken(int op, int f);
+static void bench_run(struct bench *bench, long count);
+static unsigned long long random64(void);
+static double seconds_now(void);
+static void core_init(void);
+static int core_step(void);
+static void core_get(struct z80_state *state);
+static void core_set(struct z80_state *state);
+
+
+/***************************************************************************
+ * Main                                                                    *
+ ***************************************************************************/
+
+int main(int argc, char *argv[]) {
+	long count = 20000000, failures = 0;
+	int opt, checks = TRUE, benchmarks = TRUE, index;
+
+	while ((opt = getopt(argc, argv, "cbn:v")) != -1) {
+		switch (opt) {
+			case 'c': benchmarks = FALSE; break;
+			case 'b': checks = FALSE; break;
+			case 'n': count = atol(optarg); break;
+			case 'v': verbose = TRUE; break;
+			default: optind = argc + 1; break;
+		}
+	}
+	if (optind != argc) {
+		fprintf(stderr, "Usage: %s [-c] [-b] [-n count] [-v]\n", argv[0]);
+		return 1;
+	}
+
+	core_init();
+
+	if (checks) {
+		check_main();
+		check_cb();
+		check_ed();
+		check_ddfd();
+		check_ddcb();
+		for (index = 0; index < FAMILY_COUNT; index++) {
+			printf("%-10s %9li checks, %li failed\n", families[index].name,
+				families[index].checks, families[index].failures);
+			failures += families[index].failures;
+		}
+	}
+
+	if (benchmarks) {
+		for (index = 0; index < sizeof(benches) / sizeof(benches[0]); index++)
+			bench_run(&benches[index], count);
+	}
+
+	return failures != 0;
+}
+
+/***************************************************************************
+ * Check Main                                                              *
+ ***************************************************************************/
+
+static void check_main(void) {
+	static unsigned char alu_imm[] = {0xc6, 0xce, 0xd6, 0xde, 0xe6, 0xee, 0xf6,
+		0xfe};
+	struct z80_state state, before;
+	unsigned char code[4];
+	int op, a, v, f, carry, res, flags, expected, diff, count;
+
+	/* ALU A,B and A,n for every A, operand and carry */
+	for (op = 0; op < 8; op++) {
+		for (a = 0; a < 256; a++) {
+			for (v = 0; v < 256; v++) {
+				for (carry = 0; carry < 2; carry++) {
+					random_state(&before);
+					before.a = a; before.b = v;
+					before.f = (before.f & ~FLAG_C) | carry;
+					res = alu(op, a, v, before.f, &flags);
+
+					code[0] = 0x80 | op << 3;
+					state = before;
+					run(&state, code, 1);
+					check(FAMILY_MAIN, state.a == res && state.f == flags, code, 1,
+						"A=%02x B=%02x F=%02x: A=%02x F=%02x, expected A=%02x F=%02x",
+						a, v, before.f, state.a, state.f, res, flags);
+
+					code[0] = alu_imm[op]; code[1] = v;
+					state = before;
+					run(&state, code, 2);
+					check(FAMILY_MAIN, state.a == res && state.f == flags, code, 2,
+						"A=%02x F=%02x: A=%02x F=%02x, expected A=%02x F=%02x",
+						a, before.f, state.a, state.f, res, flags);
+				}
+			}
+		}
+	}
+
+	/* ALU A,(HL) for a sample */
+	for (count = 0; count < 65536; count++) {
+		random_state(&before);
+		op = random64() & 7;
+		before.h = DATA >> 8; before.l = random64();
+		v = mem[DATA | before.l] = random64();
+		res = alu(op, before.a, v, before.f, &flags);
+		code[0] = 0x86 | op << 3;
+		state = before;
+		run(&state, code, 1);
+		check(FAMILY_MAIN, state.a == res && state.f == flags, code, 1,
+			"A=%02x (HL)=%02x F=%02x: A=%02x F=%02x, expected A=%02x F=%02x",
+			before.a, v, before.f, state.a, state.f, res, flags);
+	}
+
+	/* INC r and DEC r (C here) for every value */
+	for (v = 0; v < 256; v++) {
+		for (f = 0; f < 256; f += 0xff) {
+			random_state(&before);
+			before.c = v; before.f = f;
+
+			code[0] = 0x0c;
+			state = before;
+			run(&state, code, 1);
+			res = (v + 1) & 0xff;
+			flags = (f & FLAG_C) | szxy(res) | ((v & 0xf) == 0xf ? FLAG_H : 0) |
+				(v == 0x7f ? FLAG_V : 0);
+			check(FAMILY_MAIN, state.c == res && state.f == flags, code, 1,
+				"C=%02x F=%02x: C=%02x F=%02x, expected C=%02x F=%02x",
+				v, f, state.c, state.f, res, flags);
+
+			code[0] = 0x0d;
+			state = before;
+			run(&state, code, 1);
+			res = (v - 1) & 0xff;
+			flags = (f & FLAG_C) | FLAG_N | szxy(res) |
+				((v & 0xf) == 0 ? FLAG_H : 0) | (v == 0x80 ? FLAG_V : 0);
+			check(FAMILY_MAIN, state.c == res && state.f == flags, code, 1,
+				"C=%02x F=%02x: C=%02x F=%02x, expected C=%02x F=%02x",
+				v, f, state.c, state.f, res, flags);
+		}
+	}
+
+	/* RLCA, RRCA, RLA, RRA, DAA, CPL, SCF and CCF for every A and the
+	 * flags that matter to them */
+	for (a = 0; a < 256; a++) {
+		for (f = 0; f < 256; f++) {
+			if (f & ~(FLAG_N | FLAG_H | FLAG_C) && f != 0xff) continue;
+			random_state(&before);
+			before.a = a; before.f = f;
+			for (op = 0; op < 8; op++) {
+				code[0] = 0x07 | op << 3;
+				switch (op) {
+					case 0:
+						res = (a << 1 | a >> 7) & 0xff;
+						flags = (f & (FLAG_S | FLAG_Z | FLAG_P)) | (res & FLAG_XY) | a >> 7;
+						break;
+					case 1:
+						res = (a >> 1 | a << 7) & 0xff;
+						flags = (f & (FLAG_S | FLAG_Z | FLAG_P)) | (res & FLAG_XY) | (a & 1);
+						break;
+					case 2:
+						res = (a << 1 | (f & FLAG_C)) & 0xff;
+						flags = (f & (FLAG_S | FLAG_Z | FLAG_P)) | (res & FLAG_XY) | a >> 7;
+						break;
+					case 3:
+						res = (a >> 1 | (f & FLAG_C) << 7) & 0xff;
+						flags = (f & (FLAG_S | FLAG_Z | FLAG_P)) | (res & FLAG_XY) | (a & 1);
+						break;
+					case 4:
+						diff = 0;
+						carry = f & FLAG_C;
+						if (f & FLAG_H || (a & 0xf) > 9) diff = 6;
+						if (carry || a > 0x99) {
+							diff |= 0x60;
+							carry = FLAG_C;
+						}
+						res = (f & FLAG_N ? a - diff : a + diff) & 0xff;
+						if (f & FLAG_N) {
+							expected = f & FLAG_H && (a & 0xf) < 6 ? FLAG_H : 0;
+						} else {
+							expected = (a & 0xf) > 9 ? FLAG_H : 0;
+						}
+						flags = szxy(res) | parity(res) | expected | (f & FLAG_N) | carry;
+						break;
+					case 5:
+						res = ~a & 0xff;
+						flags = (f & (FLAG_S | FLAG_Z | FLAG_P | FLAG_C)) | FLAG_H |
+							FLAG_N | (res & FLAG_XY);
+						break;
+					case 6:
+						res = a;
+						flags = (f & (FLAG_S | FLAG_Z | FLAG_P)) | (a & FLAG_XY) | FLAG_C;
+						break;
+					default:
+						res = a;
+						flags = (f & (FLAG_S | FLAG_Z | FLAG_P)) | (a & FLAG_XY) |
+							(f & FLAG_C ? FLAG_H : FLAG_C);
+						break;
+				}
+				state = before;
+				run(&state, code, 1);
+				/* SCF and CCF take bits 3 and 5 from A, or from A and F
+				 * when the last instruction didn't change F, which either
+				 * core can't know of here */
+				if (op >= 6 && state.f == (flags | (f & FLAG_XY))) state.f = flags;
+				check(FAMILY_MAIN, state.a == res && state.f == flags, code, 1,
+					"A=%02x F=%02x: A=%02x F=%02x, expected A=%02x F=%02x",
+					a, f, state.a, state.f, res, flags);
+			}
+		}
+	}
+
+	/* ADD HL,BC for a sample */
+	for (count = 0; count < 65536; count++) {
+		random_state(&before);
+		a = before.h << 8 | before.l;
+		v = before.b << 8 | before.c;
+		res = a + v;
+		flags = (before.f & (FLAG_S | FLAG_Z | FLAG_P)) | (res >> 8 & FLAG_XY) |
+			((a ^ v ^ res) >> 8 & FLAG_H) | (res > 0xffff ? FLAG_C : 0);
+		code[0] = 0x09;
+		state = before;
+		run(&state, code, 1);
+		check(FAMILY_MAIN, (state.h << 8 | state.l) == (res & 0xffff) &&
+			state.f == flags, code, 1,
+			"HL=%04x BC=%04x F=%02x: HL=%04x F=%02x, expected HL=%04x F=%02x",
+			a, v, before.f, state.h << 8 | state.l, state.f, res & 0xffff, flags);
+	}
 
-BYTE memory[1024 * 1024];
+	/* T-states of everything */
+	for (op = 0; op < 256; op++) {
+		if (op == 0xcb || op == 0xdd || op == 0xed || op == 0xfd) continue;
+		for (f = 0; f < 256; f += 0xff) {
+			random_state(&state);
+			state.f = f;
+			state.b = 1;
+			code[0] = op; code[1] = code[2] = code[3] = 0;
+			check_tstates(FAMILY_MAIN, code, 3, &state, main_tstates[op] +
+				(taken(op, f) ? (op & 0xc7) == 0xc4 ? 7 : (op & 0xc7) == 0xc0 ?
+				6 : (op & 0xc7) == 0xc2 ? 0 : 5 : 0));
+		}
+	}
+}
+
+/***************************************************************************
+ * Check CB                                                                *
+ ***************************************************************************/
+
+static void check_cb(void) {
+	struct z80_state state, before;
+	unsigned char code[4];
+	int op, index, v, carry, res, flags;
+
+	for (op = 0; op < 256; op++) {
+		index = op & 7;
+		for (v = 0; v < 256; v++) {
+			for (carry = 0; carry < 2; carry++) {
+				random_state(&before);
+				before.f = (before.f & ~FLAG_C) | carry;
+				before.h = DATA >> 8;
+				*reg(&before, index) = v;
+				state = before;
+				code[0] = 0xcb; code[1] = op;
+				run(&state, code, 2);
+
+				if (op < 0x40) {
+					res = shift(op >> 3, v, before.f, &flags);
+				} else if (op < 0x80) {
+					res = v;
+					flags = bit(op >> 3 & 7, v, before.f, v);
+					/* BIT n,(HL) takes bits 3 and 5 from MEMPTR */
+					if (index == 6) state.f = (state.f & ~FLAG_XY) | (flags & FLAG_XY);
+				} else if (op < 0xc0) {
+					res = v & ~(1 << (op >> 3 & 7));
+					flags = before.f;
+				} else {
+					res = v | 1 << (op >> 3 & 7);
+					flags = before.f;
+				}
+				check(FAMILY_CB, *reg(&state, index) == res && state.f == flags,
+					code, 2, "v=%02x F=%02x: v=%02x F=%02x, expected v=%02x F=%02x",
+					v, before.f, *reg(&state, index), state.f, res, flags);
+			}
+		}
 
-int zx81_contend(int Address, int states, int time)
-{
-        return(time);
+		random_state(&state);
+		state.h = DATA >> 8;
+		check_tstates(FAMILY_CB, code, 2, &state, index != 6 ? 8 :
+			(op & 0xc0) == 0x40 ? 12 : 15);
+	}
 }
 
-BYTE zx81_readbyte(int Address)
-{
-        BYTE data;
-	data = memory[Address];
-	return data;
+/***************************************************************************
+ * Check ED                                                                *
+ ***************************************************************************/
+
+static void check_ed(void) {
+	static unsigned char ims[8] = {0, 0, 1, 2, 0, 0, 1, 2};
+	struct z80_state state, before;
+	unsigned char code[4];
+	int op, a, v, hl, bc, res, flags, n, addr, count, expected;
+
+	code[0] = 0xed;
+
+	/* NEG and its mirrors for every A */
+	for (op = 0x44; op < 0x80; op += 8) {
+		for (a = 0; a < 256; a++) {
+			random_state(&before);
+			before.a = a;
+			res = alu(2, 0, a, before.f, &flags);
+			code[1] = op;
+			state = before;
+			run(&state, code, 2);
+			check(FAMILY_ED, state.a == res && state.f == flags, code, 2,
+				"A=%02x: A=%02x F=%02x, expected A=%02x F=%02x",
+				a, state.a, state.f, res, flags);
+		}
+	}
+
+	/* ADC HL,BC and SBC HL,BC for a sample */
+	for (count = 0; count < 65536; count++) {
+		random_state(&before);
+		hl = before.h << 8 | before.l;
+		bc = before.b << 8 | before.c;
+		if (count & 1) {
+			code[1] = 0x4a;
+			res = hl + bc + (before.f & FLAG_C);
+			flags = ((hl ^ res) & (bc ^ res) & 0x8000 ? FLAG_V : 0) |
+				(res > 0xffff ? FLAG_C : 0);
+		} else {
+			code[1] = 0x42;
+			res = hl - bc - (before.f & FLAG_C);
+			flags = ((hl ^ bc) & (hl ^ res) & 0x8000 ? FLAG_V : 0) | FLAG_N |
+				(res < 0 ? FLAG_C : 0);
+		}
+		flags |= (res >> 8 & (FLAG_S | FLAG_XY)) | (res & 0xffff ? 0 : FLAG_Z) |
+			((hl ^ bc ^ res) >> 8 & FLAG_H);
+		state = before;
+		run(&state, code, 2);
+		check(FAMILY_ED, (state.h << 8 | state.l) == (res & 0xffff) &&
+			state.f == flags, code, 2,
+			"HL=%04x BC=%04x F=%02x: HL=%04x F=%02x, expected HL=%04x F=%02x",
+			hl, bc, before.f, state.h << 8 | state.l, state.f, res & 0xffff, flags);
+	}
+
+	/* LD A,I and LD A,R copy IFF2 to P/V */
+	for (count = 0; count < 1024; count++) {
+		random_state(&before);
+		code[1] = count & 1 ? 0x5f : 0x57;
+		res = count & 1 ? (before.r & 0x80) | ((before.r + 2) & 0x7f) : before.i;
+		flags = (before.f & FLAG_C) | szxy(res) | (before.iff2 ? FLAG_P : 0);
+		state = before;
+		run(&state, code, 2);
+		check(FAMILY_ED, state.a == res && state.f == flags, code, 2,
+			"I=%02x R=%02x IFF2=%i F=%02x: A=%02x F=%02x, expected A=%02x F=%02x",
+			before.i, before.r, before.iff2, before.f, state.a, state.f, res, flags);
+	}
+
+	/* RRD and RLD for every A and (HL) */
+	for (a = 0; a < 256; a++) {
+		for (v = 0; v < 256; v++) {
+			for (op = 0x67; op < 0x70; op += 8) {
+				random_state(&before);
+				before.a = a;
+				before.h = DATA >> 8;
+				mem[DATA | before.l] = v;
+				if (op == 0x67) {
+					res = (a & 0xf0) | (v & 0xf);
+					n = (a << 4 | v >> 4) & 0xff;
+				} else {
+					res = (a & 0xf0) | v >> 4;
+					n = (v << 4 | (a & 0xf)) & 0xff;
+				}
+				flags = (before.f & FLAG_C) | szxy(res) | parity(res);
+				code[1] = op;
+				state = before;
+				run(&state, code, 2);
+				check(FAMILY_ED, state.a == res && mem[DATA | before.l] == n &&
+					state.f == flags, code, 2,
+					"A=%02x (HL)=%02x: A=%02x (HL)=%02x F=%02x, "
+					"expected A=%02x (HL)=%02x F=%02x", a, v, state.a,
+					mem[DATA | before.l], state.f, res, n, flags);
+			}
+		}
+	}
+
+	/* LDI, LDD, CPI and CPD for a sample, including BC reaching 0 */
+	for (count = 0; count < 65536; count++) {
+		random_state(&before);
+		before.h = DATA >> 8;
+		before.d = (DATA >> 8) + 0x10;
+		if (count & 2) before.b = 0, before.c = 1;
+		hl = before.h << 8 | before.l;
+		bc = ((before.b << 8 | before.c) - 1) & 0xffff;
+		v = mem[hl] = random64();
+		code[1] = 0xa0 | (count & 1) << 3 | (count & 4) >> 2;
+		state = before;
+		run(&state, code, 2);
+		addr = count & 1 ? hl - 1 : hl + 1;
+		if (code[1] & 1) {
+			res = before.a - v;
+			expected = (before.a ^ v ^ res) & FLAG_H;
+			n = res - (expected ? 1 : 0);
+			flags = (before.f & FLAG_C) | FLAG_N | (szxy(res) & (FLAG_S | FLAG_Z)) |
+				expected | (bc ? FLAG_P : 0) | (n & FLAG_X) | (n & 2 ? FLAG_Y : 0);
+			check(FAMILY_ED, (state.h << 8 | state.l) == addr &&
+				(state.b << 8 | state.c) == bc && state.f == flags, code, 2,
+				"A=%02x (HL)=%02x BC=%04x F=%02x: F=%02x, expected F=%02x",
+				before.a, v, bc + 1, before.f, state.f, flags);
+		} else {
+			n = before.a + v;
+			flags = (before.f & (FLAG_S | FLAG_Z | FLAG_C)) | (bc ? FLAG_P : 0) |
+				(n & FLAG_X) | (n & 2 ? FLAG_Y : 0);
+			res = before.d << 8 | before.e;
+			check(FAMILY_ED, (state.h << 8 | state.l) == addr &&
+				(state.d << 8 | state.e) == (count & 1 ? res - 1 : res + 1) &&
+				(state.b << 8 | state.c) == bc && mem[res] == v &&
+				state.f == flags, code, 2,
+				"A=%02x (HL)=%02x BC=%04x F=%02x: F=%02x, expected F=%02x",
+				before.a, v, bc + 1, before.f, state.f, flags);
+		}
+	}
+
+	/* INI, IND, OUTI and OUTD for a sample */
+	for (count = 0; count < 65536; count++) {
+		random_state(&before);
+		before.h = DATA >> 8;
+		hl = before.h << 8 | before.l;
+		code[1] = 0xa2 | (count & 1) << 3 | (count & 2) >> 1;
+		if (code[1] & 1) {
+			v = mem[hl] = random64();
+			hl = count & 1 ? hl - 1 : hl + 1;
+			n = v + (hl & 0xff);
+		} else {
+			v = port_data = random64() & 0xff;
+			n = v + ((count & 1 ? before.c - 1 : before.c + 1) & 0xff);
+			hl = count & 1 ? hl - 1 : hl + 1;
+		}
+		res = (before.b - 1) & 0xff;
+		flags = szxy(res) | (v & 0x80 ? FLAG_N : 0) |
+			(n > 0xff ? FLAG_H | FLAG_C : 0) | parity((n & 7) ^ res);
+		state = before;
+		run(&state, code, 2);
+		check(FAMILY_ED, (state.h << 8 | state.l) == hl && state.b == res &&
+			(code[1] & 1 || mem[before.h << 8 | before.l] == v) &&
+			state.f == flags, code, 2,
+			"B=%02x C=%02x L=%02x v=%02x: B=%02x F=%02x, expected B=%02x F=%02x",
+			before.b, before.c, before.l, v, state.b, state.f, res, flags);
+	}
+
+	/* IN r,(C) for a sample, with IN F,(C) setting only the flags */
+	for (count = 0; count < 8192; count++) {
+		random_state(&before);
+		op = 0x40 | (count & 7) << 3;
+		v = port_data = random64() & 0xff;
+		flags = (before.f & FLAG_C) | szxy(v) | parity(v);
+		code[1] = op;
+		state = before;
+		run(&state, code, 2);
+		check(FAMILY_ED, (op == 0x70 || *reg(&state, op >> 3 & 7) == v) &&
+			state.f == flags, code, 2,
+			"in %02x F=%02x: F=%02x, expected F=%02x",
+			v, before.f, state.f, flags);
+	}
+	port_data = 0xff;
+
+	/* RETN, RETI and their mirrors all copy IFF2 to IFF1 */
+	for (op = 0x45; op < 0x80; op += 8) {
+		for (count = 0; count < 4; count++) {
+			random_state(&before);
+			before.iff1 = count & 1; before.iff2 = count >> 1;
+			before.sp = STACK;
+			mem[STACK] = 0x34; mem[STACK + 1] = 0x12;
+			code[1] = op;
+			state = before;
+			run(&state, code, 2);
+			check(FAMILY_ED, state.pc == 0x1234 && state.sp == STACK + 2 &&
+				state.iff1 == before.iff2 && state.iff2 == before.iff2, code, 2,
+				"IFF1=%i IFF2=%i: PC=%04x IFF1=%i IFF2=%i, expected PC=1234 "
+				"IFF1=%i IFF2=%i", before.iff1, before.iff2, state.pc, state.iff1,
+				state.iff2, before.iff2, before.iff2);
+		}
+	}
+
+	/* IM and its mirrors */
+	for (op = 0x46; op < 0x80; op += 8) {
+		random_state(&state);
+		code[1] = op;
+		run(&state, code, 2);
+		check(FAMILY_ED, state.im == ims[op >> 3 & 7], code, 2,
+			"IM=%i, expected IM=%i", state.im, ims[op >> 3 & 7]);
+	}
+
+	/* T-states of everything, the repeating ones once only */
+	for (op = 0; op < 256; op++) {
+		if (op >= 0xfb && op <= 0xfd) continue;
+		random_state(&state);
+		state.h = DATA >> 8;
+		state.d = (DATA >> 8) + 0x10;
+		state.sp = STACK;
+		if ((op & 0xf2) == 0xb2) {
+			state.b = 1;
+		} else if ((op & 0xf2) == 0xb0) {
+			state.b = 0; state.c = 1;
+		}
+		code[1] = op; code[2] = code[3] = 0;
+		check_tstates(FAMILY_ED, code, 4, &state,
+			op >= 0x40 && op < 0xc0 ? ed_tstates[op - 0x40] : 8);
+	}
 }
 
-void zx81_writebyte(int Address, int Data)
-{
+/***************************************************************************
+ * Check DD/FD                                                             *
+ ***************************************************************************/
+/* The DD and FD instructions are the HL ones with IX and IY for HL, IXH
+ * and IXL for H and L (undocumented) and (IX+d) for (HL) */
+
+static void check_ddfd(void) {
+	static int indices[6] = {2, 3, 4, 5, 6, 7};	/* D, E, IXH, IXL, (IX+d), A */
+	struct z80_state state, before;
+	unsigned char code[4];
+	unsigned short *xy;
+	int prefix, op, index, v, res, flags, addr, count, len, extra;
+
+	for (prefix = 0xdd; prefix <= 0xfd; prefix += 0x20) {
+		code[0] = prefix;
+
+		/* ALU A,IXH, A,IXL and A,(IX+d) and others without IX for a sample */
+		for (count = 0; count < 65536; count++) {
+			random_state(&before);
+			xy = prefix == 0xdd ? &before.ix : &before.iy;
+			op = random64() & 7;
+			index = indices[count % 6];
+			code[1] = 0x80 | op << 3 | index;
+			code[2] = random64();
+			len = 2;
+			*xy = (*xy & 0xff) | DATA;
+			if (index == 6) {
+				addr = (*xy + (signed char)code[2]) & 0xffff;
+				v = mem[addr] = random64();
+				len = 3;
+			} else if (index == 4) {
+				v = *xy >> 8;
+			} else if (index == 5) {
+				v = *xy & 0xff;
+			} else {
+				v = *reg(&before, index);
+			}
+			res = alu(op, before.a, v, before.f, &flags);
+			state = before;
+			run(&state, code, len);
+			check(FAMILY_DDFD, state.a == res && state.f == flags, code, len,
+				"A=%02x v=%02x F=%02x: A=%02x F=%02x, expected A=%02x F=%02x",
+				before.a, v, before.f, state.a, state.f, res, flags);
+		}
+
+		/* INC and DEC of IXH, IXL and (IX+d) for every value */
+		for (v = 0; v < 256; v++) {
+			for (op = 0x24; op <= 0x35; op++) {
+				if ((op & 6) != 4) continue;
+				random_state(&before);
+				xy = prefix == 0xdd ? &before.ix : &before.iy;
+				*xy = (*xy & 0xff) | DATA;
+				code[1] = op; code[2] = random64();
+				addr = (*xy + (signed char)code[2]) & 0xffff;
+				len = 2;
+				if (op >= 0x34) {
+					mem[addr] = v;
+					len = 3;
+				} else if (op & 8) {
+					*xy = (*xy & 0xff00) | v;
+				} else {
+					*xy = (*xy & 0xff) | v << 8;
+				}
+				if (op & 1) {
+					res = (v - 1) & 0xff;
+					flags = (before.f & FLAG_C) | FLAG_N | szxy(res) |
+						((v & 0xf) == 0 ? FLAG_H : 0) | (v == 0x80 ? FLAG_V : 0);
+				} else {
+					res = (v + 1) & 0xff;
+					flags = (before.f & FLAG_C) | szxy(res) |
+						((v & 0xf) == 0xf ? FLAG_H : 0) | (v == 0x7f ? FLAG_V : 0);
+				}
+				state = before;
+				run(&state, code, len);
+				xy = prefix == 0xdd ? &state.ix : &state.iy;
+				check(FAMILY_DDFD, (op >= 0x34 ? mem[addr] : op & 8 ? *xy & 0xff :
+					*xy >> 8) == res && state.f == flags, code, len,
+					"v=%02x F=%02x: v=%02x F=%02x, expected v=%02x F=%02x",
+					v, before.f, op >= 0x34 ? mem[addr] : op & 8 ? *xy & 0xff :
+					*xy >> 8, state.f, res, flags);
+			}
+		}
+
+		/* ADD IX,BC for a sample */
+		for (count = 0; count < 65536; count++) {
+			random_state(&before);
+			xy = prefix == 0xdd ? &before.ix : &before.iy;
+			addr = *xy;
+			v = before.b << 8 | before.c;
+			res = addr + v;
+			flags = (before.f & (FLAG_S | FLAG_Z | FLAG_P)) | (res >> 8 & FLAG_XY) |
+				((addr ^ v ^ res) >> 8 & FLAG_H) | (res > 0xffff ? FLAG_C : 0);
+			code[1] = 0x09;
+			state = before;
+			run(&state, code, 2);
+			xy = prefix == 0xdd ? &state.ix : &state.iy;
+			check(FAMILY_DDFD, *xy == (res & 0xffff) && state.f == flags, code, 2,
+				"IX=%04x BC=%04x F=%02x: IX=%04x F=%02x, expected IX=%04x F=%02x",
+				addr, v, before.f, *xy, state.f, res & 0xffff, flags);
+		}
+
+		/* T-states of everything. The prefix takes 4 and (HL) becoming
+		 * (IX+d) takes 8 more, but for LD (IX+d),n's 5 */
+		for (op = 0; op < 256; op++) {
+			if (op == 0xcb || op == 0xdd || op == 0xed || op == 0xfd) continue;
+			random_state(&state);
+			state.b = 1;
+			state.f = 0;
+			code[1] = op; code[2] = code[3] = 0;
+			extra = 4;
+			if (op == 0x36) {
+				extra += 5;
+			} else if (op == 0x34 || op == 0x35 || ((op & 0xc0) == 0x40 &&
+				((op & 7) == 6 || (op & 0xf8) == 0x70) && op != 0x76) ||
+				(op & 0xc7) == 0x86) {
+				extra += 8;
+			}
+			check_tstates(FAMILY_DDFD, code, 4, &state, main_tstates[op] + extra +
+				(taken(op, 0) ? (op & 0xc7) == 0xc4 ? 7 : (op & 0xc7) == 0xc0 ?
+				6 : (op & 0xc7) == 0xc2 ? 0 : 5 : 0));
+		}
+	}
 }
 
-BYTE zx81_opcode_fetch(int Address)
-{
-        BYTE data;
-	data = zx81_readbyte(Address);
-	return data;
+/***************************************************************************
+ * Check DDCB/FDCB                                                         *
+ ***************************************************************************/
+/* These all work on (IX+d) and the undocumented ones whose last three
+ * bits aren't 6 copy the result to a register too, but for BIT. BIT
+ * takes bits 3 and 5 from the high byte of IX+d */
+
+static void check_ddcb(void) {
+	struct z80_state state, before;
+	unsigned char code[4];
+	unsigned short *xy;
+	int prefix, op, index, v, carry, res, flags, addr, copied;
+
+	for (prefix = 0xdd; prefix <= 0xfd; prefix += 0x20) {
+		code[0] = prefix; code[1] = 0xcb;
+		for (op = 0; op < 256; op++) {
+			index = op & 7;
+			for (v = 0; v < 256; v++) {
+				for (carry = 0; carry < 2; carry++) {
+					random_state(&before);
+					before.f = (before.f & ~FLAG_C) | carry;
+					xy = prefix == 0xdd ? &before.ix : &before.iy;
+					*xy = (*xy & 0xff) | DATA;
+					code[2] = random64(); code[3] = op;
+					addr = (*xy + (signed char)code[2]) & 0xffff;
+					mem[addr] = v;
+
+					if (op < 0x40) {
+						res = shift(op >> 3, v, before.f, &flags);
+					} else if (op < 0x80) {
+						res = v;
+						flags = bit(op >> 3 & 7, v, before.f, addr >> 8);
+					} else if (op < 0xc0) {
+						res = v & ~(1 << (op >> 3 & 7));
+						flags = before.f;
+					} else {
+						res = v | 1 << (op >> 3 & 7);
+						flags = before.f;
+					}
+					state = before;
+					run(&state, code, 4);
+					copied = index == 6 || (op & 0xc0) == 0x40 ||
+						*reg(&state, index) == res;
+					if (index != 6 && (op & 0xc0) == 0x40)
+						copied = *reg(&state, index) == *reg(&before, index);
+					check(FAMILY_DDCB, mem[addr] == res && copied && state.f == flags,
+						code, 4, "(IX+d)=%02x F=%02x: (IX+d)=%02x r=%02x F=%02x, "
+						"expected (IX+d)=%02x F=%02x", v, before.f, mem[addr],
+						*reg(&state, index), state.f, res, flags);
+				}
+			}
+
+			random_state(&state);
+			check_tstates(FAMILY_DDCB, code, 4, &state,
+				(op & 0xc0) == 0x40 ? 20 : 23);
+		}
+	}
 }
 
-BYTE zx81_readport(int Address, int *tstates)
-{
-	return 0xff;
+/***************************************************************************
+ * Check T-states                                                          *
+ ***************************************************************************/
+
+static void check_tstates(int family, unsigned char *code, int len,
+	struct z80_state *state, int expected) {
+	int ts;
+
+	state->sp = STACK;
+	ts = run(state, code, len);
+	check(family, ts == expected, code, len, "%i T-states, expected %i",
+		ts, expected);
 }
 
-void zx81_writeport(int Address, int Data, int *tstates)
-{
+/***************************************************************************
+ * Check                                                                   *
+ ***************************************************************************/
+/* On entry: int ok is FALSE if the check failed, in which case fmt and
+ *           what follows describe how */
+
+static void check(int family, int ok, unsigned char *code, int len,
+	char *fmt, ...) {
+	va_list args;
+	int index;
+
+	families[family].checks++;
+	if (ok) return;
+
+	if (families[family].failures++ < FAILURES_SHOWN || verbose) {
+		for (index = 0; index < 4; index++) {
+			if (index < len) {
+				printf("%02x ", code[index]);
+			} else {
+				printf("   ");
+			}
+		}
+		va_start(args, fmt);
+		vprintf(fmt, args);
+		va_end(args);
+		printf("\n");
+	}
 }
 
-int main()
-{
+/***************************************************************************
+ * Run                                                                     *
+ ***************************************************************************/
+/* This runs the instruction in code from state, which it's left with.
+ *
+ * On exit: returns the T-states taken */
+
+static int run(struct z80_state *state, unsigned char *code, int len) {
 	int ts;
 
-//        machine.initialise = zx81_initialise;
-//        machine.do_scanline = zx81_do_scanline;
-        machine.writebyte = zx81_writebyte;
-        machine.readbyte = zx81_readbyte;
-        machine.opcode_fetch = zx81_opcode_fetch;
-        machine.readport = zx81_readport;
-        machine.writeport = zx81_writeport;
-        machine.contendmem = zx81_contend;
-        machine.contendio = zx81_contend;
-        machine.reset = NULL;
-        machine.nmi = NULL;
-        machine.exit = NULL;
+	memcpy(mem + CODE, code, len);
+	state->pc = CODE;
+	core_set(state);
+	ts = core_step();
+	core_get(state);
+
+	return ts;
+}
+
+/***************************************************************************
+ * Random State                                                            *
+ ***************************************************************************/
+/* The registers are random and those that address memory do so away from
+ * the code (and the stack) */
+
+static void random_state(struct z80_state *state) {
+	state->a = random64(); state->f = random64();
+	state->b = random64(); state->c = random64();
+	state->d = random64(); state->e = random64();
+	state->h = random64(); state->l = random64();
+	state->a_ = random64(); state->f_ = random64();
+	state->b_ = random64(); state->c_ = random64();
+	state->d_ = random64(); state->e_ = random64();
+	state->h_ = random64(); state->l_ = random64();
+	state->ix = random64(); state->iy = random64();
+	state->sp = STACK;
+	state->i = random64(); state->r = random64();
+	state->iff1 = random64() & 1; state->iff2 = random64() & 1;
+	state->im = 1;
+	state->halted = FALSE;
+	if ((state->b & 0xf0) == CODE >> 8) state->b ^= 0x80;
+	if ((state->d & 0xf0) == CODE >> 8) state->d ^= 0x80;
+	if ((state->h & 0xf0) == CODE >> 8) state->h ^= 0x80;
+}
+
+/***************************************************************************
+ * Reg                                                                     *
+ ***************************************************************************/
+/* On exit: returns where a register is in the order that the
+ *          instructions have them: B, C, D, E, H, L, (HL) and A */
+
+static unsigned char *reg(struct z80_state *state, int index) {
+	switch (index) {
+		case 0: return &state->b;
+		case 1: return &state->c;
+		case 2: return &state->d;
+		case 3: return &state->e;
+		case 4: return &state->h;
+		case 5: return &state->l;
+		case 6: return &mem[state->h << 8 | state->l];
+		default: return &state->a;
+	}
+}
+
+/***************************************************************************
+ * ALU                                                                     *
+ ***************************************************************************/
+/* On entry: int op is ADD, ADC, SUB, SBC, AND, XOR, OR or CP as 0 to 7
+ *  On exit: returns A and flags has F */
+
+static int alu(int op, int a, int v, int f, int *flags) {
+	int res, carry = op == 1 || op == 3 ? f & FLAG_C : 0;
+
+	switch (op) {
+		case 0:
+		case 1:
+			res = a + v + carry;
+			*flags = szxy(res) | ((a ^ v ^ res) & FLAG_H) |
+				((a ^ res) & (v ^ res) & 0x80 ? FLAG_V : 0) |
+				(res > 0xff ? FLAG_C : 0);
+			break;
+		case 2:
+		case 3:
+		case 7:
+			res = a - v - carry;
+			*flags = szxy(res) | ((a ^ v ^ res) & FLAG_H) |
+				((a ^ v) & (a ^ res) & 0x80 ? FLAG_V : 0) | FLAG_N |
+				(res < 0 ? FLAG_C : 0);
+			/* CP takes bits 3 and 5 from the operand */
+			if (op == 7) {
+				*flags = (*flags & ~FLAG_XY) | (v & FLAG_XY);
+				res = a;
+			}
+			break;
+		case 4:
+			res = a & v;
+			*flags = szxy(res) | FLAG_H | parity(res);
+			break;
+		case 5:
+			res = a ^ v;
+			*flags = szxy(res) | parity(res);
+			break;
+		default:
+			res = a | v;
+			*flags = szxy(res) | parity(res);
+			break;
+	}
+
+	return res & 0xff;
+}
+
+/***************************************************************************
+ * Shift                                                                   *
+ ***************************************************************************/
+/* On entry: int op is RLC, RRC, RL, RR, SLA, SRA, SLL or SRL as 0 to 7
+ *  On exit: returns the result and flags has F */
+
+static int shift(int op, int v, int f, int *flags) {
+	int res, carry;
+
+	switch (op) {
+		case 0: carry = v >> 7; res = v << 1 | carry; break;
+		case 1: carry = v & 1; res = v >> 1 | carry << 7; break;
+		case 2: carry = v >> 7; res = v << 1 | (f & FLAG_C); break;
+		case 3: carry = v & 1; res = v >> 1 | (f & FLAG_C) << 7; break;
+		case 4: carry = v >> 7; res = v << 1; break;
+		case 5: carry = v & 1; res = v >> 1 | (v & 0x80); break;
+		case 6: carry = v >> 7; res = v << 1 | 1; break;
+		default: carry = v & 1; res = v >> 1; break;
+	}
+	res &= 0xff;
+	*flags = szxy(res) | parity(res) | carry;
+
+	return res;
+}
+
+/***************************************************************************
+ * Bit                                                                     *
+ ***************************************************************************/
+/* On entry: int xy is where bits 3 and 5 are taken from
+ *  On exit: returns F after BIT n */
+
+static int bit(int n, int v, int f, int xy) {
+	return (f & FLAG_C) | FLAG_H | (xy & FLAG_XY) | (v & 1 << n ?
+		(n == 7 ? FLAG_S : 0) : FLAG_Z | FLAG_P);
+}
+
+/***************************************************************************
+ * SZXY                                                                    *
+ ***************************************************************************/
+/* On exit: returns S, Z, and bits 3 and 5 for an 8-bit result */
+
+static int szxy(int v) {
+	v &= 0xff;
+
+	return (v & (FLAG_S | FLAG_XY)) | (v ? 0 : FLAG_Z);
+}
+
+/***************************************************************************
+ * Parity                                                                  *
+ ***************************************************************************/
+/* On exit: returns FLAG_P if v has an even number of bits set */
+
+static int parity(int v) {
+	v &= 0xff;
+	v ^= v >> 4;
+	v ^= v >> 2;
+	v ^= v >> 1;
+
+	return v & 1 ? 0 : FLAG_P;
+}
+
+/***************************************************************************
+ * Taken                                                                   *
+ ***************************************************************************/
+/* On exit: returns TRUE if op is a conditional JR, DJNZ, JP, CALL or RET
+ *          whose condition is met by f (and B being 1 for DJNZ) */
+
+static int taken(int op, int f) {
+	static int masks[4] = {FLAG_Z, FLAG_C, FLAG_P, FLAG_S};
+	int cond;
+
+	if (op == 0x10) return FALSE;
+	if (op == 0x20 || op == 0x28 || op == 0x30 || op == 0x38) {
+		cond = op >> 3 & 3;
+	} else if ((op & 0xc7) == 0xc0 || (op & 0xc7) == 0xc2 ||
+		(op & 0xc7) == 0xc4) {
+		cond = op >> 3 & 7;
+	} else {
+		return FALSE;
+	}
+
+	return !(f & masks[cond >> 1]) == !(cond & 1);
+}
+
+/***************************************************************************
+ * Bench Run                                                               *
+ ***************************************************************************/
+/* The block of instructions repeated is about 256 bytes long */
+
+static void bench_run(struct bench *bench, long count) {
+	struct z80_state state;
+	unsigned long long tstates = 0;
+	double start, elapsed;
+	long instruction;
+	int addr;
+
+	for (addr = CODE; addr + bench->len < CODE + 256; addr += bench->len)
+		memcpy(mem + addr, bench->code, bench->len);
+	mem[addr] = 0xc3; mem[addr + 1] = CODE & 0xff; mem[addr + 2] = CODE >> 8;
+
+	random_state(&state);
+	state.pc = CODE;
+	state.b = state.c = state.d = state.e = 0;
+	state.h = DATA >> 8; state.l = 0;
+	state.ix = DATA + 0x80; state.iy = DATA + 0x180;
+	state.sp = STACK;
+	state.a = 0xff;
+	memset(mem + DATA, 0, 0x2000);
+	core_set(&state);
+
+	start = seconds_now();
+	for (instruction = 0; instruction < count; instruction++)
+		tstates += core_step();
+	elapsed = seconds_now() - start;
+
+	printf("%-26s %6.2f ns/instruction (%.1f T-states each)\n", bench->name,
+		elapsed * 1e9 / count, (double)tstates / count);
+}
+
+/***************************************************************************
+ * Random64                                                                *
+ ***************************************************************************/
+/* xorshift64* */
 
+static unsigned long long random64(void) {
+	rng ^= rng >> 12;
+	rng ^= rng << 25;
+	rng ^= rng >> 27;
+
+	return rng * 2685821657736338717ULL;
+}
+
+/***************************************************************************
+ * Seconds Now                                                             *
+ ***************************************************************************/
+
+static double seconds_now(void) {
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+#ifdef XZ80
+/***************************************************************************
+ * The xz80 Core                                                           *
+ ***************************************************************************/
+
+static unsigned char xz80_port_in(int port) {
+	return port_data;
+}
+
+static void xz80_port_out(int port, int data) {
+}
+
+static void core_init(void) {
+	int page;
+
+	xz80_init();
+	for (page = 0; page < 64; page++)
+		xz80_map(page, mem + page * 1024, TRUE, page);
+	xz80_set_ula(FALSE);
+	xz80_readport = xz80_port_in;
+	xz80_writeport = xz80_port_out;
+}
+
+static int core_step(void) {
+	return xz80_step();
+}
+
+static void core_get(struct z80_state *state) {
+	xz80_get(state);
+}
+
+static void core_set(struct z80_state *state) {
+	xz80_set(state);
+}
+
+#else
+/***************************************************************************
+ * The EightyOne/FUSE Core                                                 *
+ ***************************************************************************/
+
+static BYTE fuse_readbyte(int addr) {
+	return mem[addr & 0xffff];
+}
+
+static void fuse_writebyte(int addr, int data) {
+	mem[addr & 0xffff] = data;
+}
+
+static BYTE fuse_readport(int port, int *tstates) {
+	return port_data;
+}
+
+static void fuse_writeport(int port, int data, int *tstates) {
+}
+
+static int fuse_contend(int addr, int states, int time) {
+	return time;
+}
+
+static void core_init(void) {
+	machine.readbyte = fuse_readbyte;
+	machine.writebyte = fuse_writebyte;
+	machine.opcode_fetch = fuse_readbyte;
+	machine.readport = fuse_readport;
+	machine.writeport = fuse_writeport;
+	machine.contendmem = fuse_contend;
+	machine.contendio = fuse_contend;
 	z80_init();
 	z80_reset();
+}
 
-	printf("PC: %d", PC);
+/* EightyOne backs out of a DD or FD prefix that isn't followed by an
+ * instruction using HL and then runs what follows separately, which is
+ * carried on with here. The instruction's fetch is counted twice when it
+ * does (see the FIXME within z80_ddfd.c) */
 
-	ts = z80_do_opcode();
+static int core_step(void) {
+	unsigned short pc;
+	unsigned char opcode;
+	int ts = 0, backtracked = FALSE;
 
-	printf(" TS: %d\n",ts);
+	do {
+		if (backtracked) ts -= 4;
+		pc = z80.pc.w;
+		opcode = mem[pc];
+		ts += z80_do_opcode();
+	} while ((backtracked = (opcode == 0xdd || opcode == 0xfd) &&
+		z80.pc.w == (WORD)(pc + 1)));
+
+	return ts;
+}
+
+static void core_get(struct z80_state *state) {
+	state->a = z80.af.b.h; state->f = z80.af.b.l;
+	state->b = z80.bc.b.h; state->c = z80.bc.b.l;
+	state->d = z80.de.b.h; state->e = z80.de.b.l;
+	state->h = z80.hl.b.h; state->l = z80.hl.b.l;
+	state->a_ = z80.af_.b.h; state->f_ = z80.af_.b.l;
+	state->b_ = z80.bc_.b.h; state->c_ = z80.bc_.b.l;
+	state->d_ = z80.de_.b.h; state->e_ = z80.de_.b.l;
+	state->h_ = z80.hl_.b.h; state->l_ = z80.hl_.b.l;
+	state->ix = z80.ix.w; state->iy = z80.iy.w;
+	state->sp = z80.sp.w; state->pc = z80.pc.w;
+	state->i = z80.i;
+	state->r = (z80.r7 & 0x80) | (z80.r & 0x7f);
+	state->iff1 = z80.iff1; state->iff2 = z80.iff2;
+	state->im = z80.im;
+	state->halted = z80.halted;
+}
 
-	return 0;
+static void core_set(struct z80_state *state) {
+	z80.af.b.h = state->a; z80.af.b.l = state->f;
+	z80.bc.b.h = state->b; z80.bc.b.l = state->c;
+	z80.de.b.h = state->d; z80.de.b.l = state->e;
+	z80.hl.b.h = state->h; z80.hl.b.l = state->l;
+	z80.af_.b.h = state->a_; z80.af_.b.l = state->f_;
+	z80.bc_.b.h = state->b_; z80.bc_.b.l = state->c_;
+	z80.de_.b.h = state->d_; z80.de_.b.l = state->e_;
+	z80.hl_.b.h = state->h_; z80.hl_.b.l = state->l_;
+	z80.ix.w = state->ix; z80.iy.w = state->iy;
+	z80.sp.w = state->sp; z80.pc.w = state->pc;
+	z80.i = state->i;
+	z80.r = state->r; z80.r7 = state->r;
+	z80.iff1 = state->iff1; z80.iff2 = state->iff2;
+	z80.im = state->im;
+	z80.halted = state->halted;
 }
+#endif
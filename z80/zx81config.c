@@ -1,4 +1,4 @@
 #include "config.h"
 #include "zx81config.h"
 
-MACHINE machine;
+MACHINE_LOCAL MACHINE machine;
@@ -1,6 +1,8 @@
 #ifndef _ZX81CONFIG_H_
 #define _ZX81CONFIG_H_
 
+#include "../machine.h"
+
 typedef struct
 {
         int sync_len, sync_valid;
@@ -32,7 +34,7 @@ typedef struct
 
 } MACHINE;
 
-extern MACHINE machine;
+extern MACHINE_LOCAL MACHINE machine;
 
 #define readbyte(Addr) (machine.readbyte(Addr))
 #define writebyte(Addr,Data) (machine.writebyte(Addr,Data))
@@ -6,28 +6,28 @@
 #include "zx81.h"
 
 /* odd place to have this, but the display does work in an odd way :-) */
-unsigned char scrnbmp[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8];    /* displayed */
-unsigned char scrnbmp_old[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8];
+MACHINE_LOCAL unsigned char scrnbmp[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8];    /* displayed */
+MACHINE_LOCAL unsigned char scrnbmp_old[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT/8];
                                                 /* checked against for diffs */
 
 /* chroma */
-unsigned char scrnbmpc[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT];   /* displayed */
+MACHINE_LOCAL unsigned char scrnbmpc[ZX_VID_FULLWIDTH*ZX_VID_FULLHEIGHT];   /* displayed */
 
 /* Minimized (so no longer really Accurate...)
   from the libretro adaptation of the EightyOne source */
 
-extern ZX81 zx81;
-extern BYTE scanline[];
-extern long noise;
-extern int scanline_len;
-extern int sync_len;
-extern int sync_valid;
-int RasterX = 0;
-int RasterY;
-int TVH;
-int TVP;
-static int ScanLen;
-static int dest;
+extern MACHINE_LOCAL ZX81 zx81;
+extern MACHINE_LOCAL BYTE scanline[];
+extern MACHINE_LOCAL long noise;
+extern MACHINE_LOCAL int scanline_len;
+extern MACHINE_LOCAL int sync_len;
+extern MACHINE_LOCAL int sync_valid;
+MACHINE_LOCAL int RasterX = 0;
+MACHINE_LOCAL int RasterY;
+MACHINE_LOCAL int TVH;
+MACHINE_LOCAL int TVP;
+static MACHINE_LOCAL int ScanLen;
+static MACHINE_LOCAL int dest;
 
 #define HTOL 400
 #define VTOLMIN 260
@@ -88,7 +88,9 @@ void AccurateInit()
   dest = 0;
 
   RasterX = 0;
-  RasterY = myrandom( 256 );
+  /* this was myrandom( 256 ), but a fixed start keeps every run of the
+   * same input the same, as recordings (sdl_loadsave.c) rely on */
+  RasterY = 0;
 
   ScanLen = 2 + machine.tperscanline * 2;
 
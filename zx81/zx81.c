@@ -18,37 +18,37 @@
 #define LASTINSTOUTFD 3
 #define LASTINSTOUTFF 4
 
-ZX81 zx81;
-BYTE *memory;
-int int_pending=0;
-long noise;
-int border, ink, paper;
-int pink, ppaper;
-int SelectAYReg;
-BYTE font[512];
-BYTE memhrg[1024];
-int borrow=0;
-
-unsigned long tstates=0;
-unsigned long tsmax=0;
-unsigned long frames=0;
+MACHINE_LOCAL ZX81 zx81;
+MACHINE_LOCAL BYTE *memory;
+MACHINE_LOCAL int int_pending=0;
+MACHINE_LOCAL long noise;
+MACHINE_LOCAL int border, ink, paper;
+MACHINE_LOCAL int pink, ppaper;
+MACHINE_LOCAL int SelectAYReg;
+MACHINE_LOCAL BYTE font[512];
+MACHINE_LOCAL BYTE memhrg[1024];
+MACHINE_LOCAL int borrow=0;
+
+MACHINE_LOCAL unsigned long tstates=0;
+MACHINE_LOCAL unsigned long tsmax=0;
+MACHINE_LOCAL unsigned long frames=0;
 
 /* I/O port 1 allows reading of the zx81 structure */
-int configbyte=0;
-
-int NMI_generator=0;
-int HSYNC_generator=0;
-int sync_len, sync_valid;
-int setborder=0;
-int LastInstruction;
-int MemotechMode=0;
-int HWidthCounter=0;
-int shift_register=0, shift_reg_inv, shift_store=0;
-int rowcounter=0;
-int zx81_stop=0;
-int hsync_counter=0;
-BYTE scanline[800*50];
-int scanline_len=0;
+MACHINE_LOCAL int configbyte=0;
+
+MACHINE_LOCAL int NMI_generator=0;
+MACHINE_LOCAL int HSYNC_generator=0;
+MACHINE_LOCAL int sync_len, sync_valid;
+MACHINE_LOCAL int setborder=0;
+MACHINE_LOCAL int LastInstruction;
+MACHINE_LOCAL int MemotechMode=0;
+MACHINE_LOCAL int HWidthCounter=0;
+MACHINE_LOCAL int shift_register=0, shift_reg_inv, shift_store=0;
+MACHINE_LOCAL int rowcounter=0;
+MACHINE_LOCAL int zx81_stop=0;
+MACHINE_LOCAL int hsync_counter=0;
+MACHINE_LOCAL BYTE scanline[800*50];
+MACHINE_LOCAL int scanline_len=0;
 
 /* in accdraw.c */
 int myrandom( int x );
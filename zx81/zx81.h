@@ -1,8 +1,10 @@
 #ifndef _ZX81_H_
 #define _ZX81_H_
 
-extern unsigned char scrnbmp[],scrnbmp_old[],scrnbmpc[];
-extern unsigned long frames;
+#include "../machine.h"
+
+extern MACHINE_LOCAL unsigned char scrnbmp[],scrnbmp_old[],scrnbmpc[];
+extern MACHINE_LOCAL unsigned long frames;
 
 #define CFGBYTE char
 